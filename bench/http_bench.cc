@@ -0,0 +1,187 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <EventLoopThread.h>
+#include <HttpServer.h>
+#include <HttpRouter.h>
+#include <Logger.h>
+
+/**
+ * HttpServer吞吐压测
+ * 进程内启动一个HttpServer 每个请求返回固定的小响应; 客户端线程用阻塞socket在keep-alive连接上发GET
+ * 先逐个请求 请求-响应 往返(depth=1) 再一次发出depth个请求(pipelining)后读回全部响应
+ * 两者对比就是pipelining省下的往返和系统调用
+ * 服务器通过StaticHttpRouter分发 最后一轮请求带{id:int}参数的路径 和/hello对比就是参数匹配的开销
+ *
+ * 用法: ./http_bench [clients=8] [seconds=5] [depth=16] [serverThreads=2]
+ */
+
+static const uint16_t kPort = 19300;
+static const char kBody[] = "hello, world\n";
+
+// 所有路由都返回同样的响应 客户端按固定长度读
+static void hello(const HttpRequest &, HttpResponse *resp, const RouteParams &)
+{
+    resp->setContentType("text/plain");
+    resp->setBody(kBody);
+}
+
+constexpr HttpRoute kRoutes[] = {
+    {HttpRequest::kGet, "/hello", hello},
+    {HttpRequest::kGet, "/users/{id:int}", hello},
+    {HttpRequest::kGet, "/users/{id:int}/posts/{post}", hello},
+    {HttpRequest::kGet, "/static/{path*}", hello},
+    {HttpRequest::kPost, "/users", hello},
+};
+using Router = StaticHttpRouter<kRoutes>;
+
+static int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    return fd;
+}
+
+static bool writeAll(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::write(fd, data, len);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::read(fd, data, len);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 响应是固定的 用HttpResponse算出它的长度 客户端按长度读
+static size_t responseBytes()
+{
+    HttpResponse resp;
+    resp.reset(false);
+    resp.setContentType("text/plain");
+    resp.setBody(kBody);
+    Buffer buf;
+    resp.appendToBuffer(&buf);
+    return buf.readableBytes();
+}
+
+struct Result
+{
+    double seconds;
+    uint64_t requests;
+};
+
+static Result runClients(int clients, int seconds, int depth, const char *path)
+{
+    std::atomic<uint64_t> requests(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    const size_t respBytes = responseBytes();
+
+    std::string batch;
+    for (int i = 0; i < depth; ++i)
+    {
+        batch += std::string("GET ") + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nUser-Agent: http_bench\r\nAccept: */*\r\n\r\n";
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < clients; ++i)
+    {
+        threads.emplace_back([&]() {
+            int fd = connectTo(kPort);
+            if (fd < 0)
+            {
+                fprintf(stderr, "connect failed\n");
+                return;
+            }
+            std::string in(respBytes * depth, '\0');
+            uint64_t local = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                if (!writeAll(fd, batch.data(), batch.size()) || !readAll(fd, &in[0], in.size()))
+                    break;
+                local += depth;
+            }
+            requests += local;
+            ::close(fd);
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return {elapsed, requests.load()};
+}
+
+static void report(const char *name, const Result &r)
+{
+    printf("%-10s requests: %10lu  %10.0f req/s\n", name, r.requests, r.requests / r.seconds);
+}
+
+int main(int argc, char *argv[])
+{
+    int clients = argc > 1 ? atoi(argv[1]) : 8;
+    int seconds = argc > 2 ? atoi(argv[2]) : 5;
+    int depth = argc > 3 ? atoi(argv[3]) : 16;
+    int serverThreads = argc > 4 ? atoi(argv[4]) : 2;
+
+    Logger::setLogLevel(Logger::ERROR);
+
+    // 服务器运行在独立的loop线程上 对象在进程退出时随进程回收
+    EventLoopThread *serverThread = new EventLoopThread(EventLoopThread::ThreadInitCallback(), "http");
+    EventLoop *serverLoop = serverThread->startLoop();
+    HttpServer *server = new HttpServer(serverLoop, InetAddress(kPort), "HttpBench");
+    server->setHttpCallback(Router::handle);
+    server->setThreadNum(serverThreads);
+    server->start();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    printf("clients=%d seconds=%d depth=%d serverThreads=%d\n", clients, seconds, depth, serverThreads);
+    report("keepalive", runClients(clients, seconds, 1, "/hello"));
+    report("pipelined", runClients(clients, seconds, depth, "/hello"));
+    report("routed", runClients(clients, seconds, depth, "/users/42"));
+
+    fflush(stdout);
+    ::_exit(0);
+}
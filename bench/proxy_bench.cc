@@ -0,0 +1,194 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <EventLoopThread.h>
+#include <ProxyServer.h>
+#include <TcpServerT.h>
+#include <Logger.h>
+
+/**
+ * 反向代理吞吐压测
+ * 进程内启动若干个echo后端和一个ProxyServer 客户端线程用阻塞socket做 请求-回显 往返
+ * 先直连后端测一遍作为基线 再经过代理测一遍 两者对比就是代理这一跳的开销
+ *
+ * 用法: ./proxy_bench [clients=8] [seconds=5] [msgBytes=16384] [proxyThreads=2] [backends=2]
+ */
+
+static const uint16_t kBackendBasePort = 19100;
+static const uint16_t kProxyPort = 19000;
+
+Task echoSession(TcpConnectionPtr conn)
+{
+    while (conn->connected())
+    {
+        Buffer *buf = co_await conn->read();
+        if (buf->readableBytes() > 0)
+        {
+            conn->send(buf);
+        }
+    }
+}
+
+// echo后端用编译期绑定的TcpServerT 连接建立时直接调用onConnection
+struct EchoHandler
+{
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        conn->setTcpNoDelay(true);
+        echoSession(conn);
+    }
+};
+
+static int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    return fd;
+}
+
+static bool writeAll(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::write(fd, data, len);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::read(fd, data, len);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+struct Result
+{
+    double seconds;
+    uint64_t roundTrips;
+    uint64_t bytes;
+};
+
+// 每个客户端线程循环: 写msgBytes 读回msgBytes
+static Result runClients(const std::vector<uint16_t> &ports, int clients, int seconds, size_t msgBytes)
+{
+    std::atomic<uint64_t> roundTrips(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < clients; ++i)
+    {
+        uint16_t port = ports[i % ports.size()];
+        threads.emplace_back([&, port]() {
+            int fd = connectTo(port);
+            if (fd < 0)
+            {
+                fprintf(stderr, "connect %u failed\n", port);
+                return;
+            }
+            std::string out(msgBytes, 'x');
+            std::string in(msgBytes, '\0');
+            uint64_t local = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                if (!writeAll(fd, out.data(), out.size()) || !readAll(fd, &in[0], in.size()))
+                    break;
+                ++local;
+            }
+            roundTrips += local;
+            ::close(fd);
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t n = roundTrips.load();
+    return {elapsed, n, n * msgBytes * 2};
+}
+
+static void report(const char *name, const Result &r)
+{
+    printf("%-8s round trips: %10lu  %10.0f rt/s  %10.2f MB/s\n",
+           name, r.roundTrips, r.roundTrips / r.seconds, r.bytes / r.seconds / 1024 / 1024);
+}
+
+int main(int argc, char *argv[])
+{
+    int clients = argc > 1 ? atoi(argv[1]) : 8;
+    int seconds = argc > 2 ? atoi(argv[2]) : 5;
+    size_t msgBytes = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 16384;
+    int proxyThreads = argc > 4 ? atoi(argv[4]) : 2;
+    int numBackends = argc > 5 ? atoi(argv[5]) : 2;
+
+    Logger::setLogLevel(Logger::ERROR);
+
+    // 后端和代理各自运行在独立的loop线程上 对象在进程退出时随进程回收
+    EventLoopThread *backendThread = new EventLoopThread(EventLoopThread::ThreadInitCallback(), "backend");
+    EventLoop *backendLoop = backendThread->startLoop();
+    std::vector<InetAddress> backendAddrs;
+    std::vector<uint16_t> backendPorts;
+    for (int i = 0; i < numBackends; ++i)
+    {
+        uint16_t port = static_cast<uint16_t>(kBackendBasePort + i);
+        auto *server = new TcpServerT<EchoHandler>(backendLoop, InetAddress(port), "EchoBackend" + std::to_string(i));
+        server->setThreadNum(1);
+        server->start();
+        backendAddrs.emplace_back(port);
+        backendPorts.push_back(port);
+    }
+
+    EventLoopThread *proxyThread = new EventLoopThread(EventLoopThread::ThreadInitCallback(), "proxy");
+    EventLoop *proxyLoop = proxyThread->startLoop();
+    ProxyServer *proxy = new ProxyServer(proxyLoop, InetAddress(kProxyPort), "Proxy",
+                                         LoadBalancer::kLeastConn, backendAddrs);
+    proxy->setThreadNum(proxyThreads);
+    proxy->start();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    printf("clients=%d seconds=%d msgBytes=%zu proxyThreads=%d backends=%d\n",
+           clients, seconds, msgBytes, proxyThreads, numBackends);
+    report("direct", runClients(backendPorts, clients, seconds, msgBytes));
+    report("proxy", runClients({kProxyPort}, clients, seconds, msgBytes));
+
+    fflush(stdout);
+    ::_exit(0);
+}
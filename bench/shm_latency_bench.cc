@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <ShmConnection.h>
+#include <TcpServer.h>
+#include <TcpClient.h>
+#include <Logger.h>
+
+/**
+ * 同机两个进程之间的往返时延: 共享内存环 vs 回环TCP
+ * fork出的子进程同时提供shm和TCP两个echo 父进程依次做 请求-回显 往返并统计每次往返的时延分布
+ * busyPoll>0 时两端读协程挂起前先自旋 对应对延迟极敏感、愿意用一个核换时延的场景
+ * 自旋要求两端各自独占一个核 只有一个CPU时自旋只会抢走对端的时间片 时延反而变差
+ *
+ * 用法: ./shm_latency_bench [roundTrips=100000] [msgBytes=64] [busyPoll=0]
+ */
+
+static const uint16_t kTcpPort = 19200;
+
+static int g_roundTrips = 100000;
+static size_t g_msgBytes = 64;
+static int g_busyPoll = 0;
+
+// ================= 子进程: echo =================
+
+Task shmEcho(ShmConnectionPtr conn, EventLoop *loop)
+{
+    while (true)
+    {
+        Buffer *buf = co_await conn->read();
+        if (buf->readableBytes() == 0)
+        {
+            break; // 父进程测完后关闭
+        }
+        conn->send(buf);
+    }
+    loop->quit();
+}
+
+Task tcpEcho(TcpConnectionPtr conn)
+{
+    while (conn->connected())
+    {
+        Buffer *buf = co_await conn->read();
+        if (buf->readableBytes() > 0)
+        {
+            conn->send(buf);
+        }
+    }
+}
+
+static void runChild(ShmConnection::Descriptor desc)
+{
+    EventLoop loop;
+    auto shm = std::make_shared<ShmConnection>(&loop, desc, 1, "shm-echo");
+    ShmConnection::closeDescriptor(&desc);
+    shm->setBusyPoll(g_busyPoll);
+
+    TcpServer server(&loop, InetAddress(kTcpPort), "tcp-echo");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            tcpEcho(conn);
+        }
+    });
+    server.start();
+
+    shmEcho(shm, &loop);
+    loop.loop();
+}
+
+// ================= 父进程: 测量 =================
+
+static void report(const char *name, std::vector<double> &samples)
+{
+    if (samples.empty())
+    {
+        printf("%-6s no samples\n", name);
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double s : samples)
+    {
+        sum += s;
+    }
+    auto pct = [&](double p) { return samples[static_cast<size_t>(p * (samples.size() - 1))]; };
+    printf("%-6s avg %8.2f us  p50 %8.2f us  p99 %8.2f us  p99.9 %8.2f us\n",
+           name, sum / samples.size(), pct(0.50), pct(0.99), pct(0.999));
+}
+
+Task measure(EventLoop *loop, ShmConnectionPtr shm, TcpClient *client)
+{
+    std::string msg(g_msgBytes, 'x');
+    std::vector<double> shmSamples;
+    std::vector<double> tcpSamples;
+    shmSamples.reserve(g_roundTrips);
+    tcpSamples.reserve(g_roundTrips);
+
+    for (int i = 0; i < g_roundTrips; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        shm->send(msg);
+        Buffer *buf = shm->inputBuffer();
+        while (buf->readableBytes() < g_msgBytes)
+        {
+            buf = co_await shm->read();
+            if (!shm->connected())
+            {
+                break;
+            }
+        }
+        buf->retrieve(g_msgBytes);
+        shmSamples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    TcpConnectionPtr conn = co_await client->connect(3.0);
+    if (conn)
+    {
+        conn->setTcpNoDelay(true);
+        for (int i = 0; i < g_roundTrips && conn->connected(); ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            conn->send(msg);
+            std::string echo = co_await conn->readExactly(g_msgBytes);
+            if (echo.size() != g_msgBytes)
+            {
+                break;
+            }
+            tcpSamples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+        conn->shutdown();
+    }
+    else
+    {
+        fprintf(stderr, "connect to tcp echo failed\n");
+    }
+
+    printf("roundTrips=%d msgBytes=%zu busyPoll=%d\n", g_roundTrips, g_msgBytes, g_busyPoll);
+    report("shm", shmSamples);
+    report("tcp", tcpSamples);
+    fflush(stdout);
+
+    shm->shutdown();
+    loop->quit();
+}
+
+int main(int argc, char *argv[])
+{
+    g_roundTrips = argc > 1 ? atoi(argv[1]) : 100000;
+    g_msgBytes = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 64;
+    g_busyPoll = argc > 3 ? atoi(argv[3]) : 0;
+
+    Logger::setLogLevel(Logger::ERROR);
+
+    ShmConnection::Descriptor desc;
+    if (!ShmConnection::createDescriptor(ShmConnection::kDefaultCapacity, &desc))
+    {
+        return 1;
+    }
+
+    pid_t pid = ::fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0)
+    {
+        runChild(desc);
+        ::_exit(0);
+    }
+
+    {
+        EventLoop loop;
+        auto shm = std::make_shared<ShmConnection>(&loop, desc, 0, "shm-client");
+        ShmConnection::closeDescriptor(&desc);
+        shm->setBusyPoll(g_busyPoll);
+        TcpClient client(&loop, InetAddress(kTcpPort, "127.0.0.1"), "tcp-client");
+
+        // shm测完之后才连TCP 子进程的TcpServer此时早已开始监听
+        loop.runInLoop([&]() { measure(&loop, shm, &client); });
+        loop.loop();
+    }
+
+    ::waitpid(pid, nullptr, 0);
+    return 0;
+}
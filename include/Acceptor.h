@@ -2,6 +2,8 @@
 
 #include <functional>
 #include <coroutine>
+#include <errno.h>
+#include <sys/types.h>
 
 #include "noncopyable.h"
 #include "Socket.h"
@@ -25,6 +27,11 @@ public:
     // 监听本地端口
     void listen();
 
+    // 暂停/恢复接收新连接 暂停期间挂起在accept()上的协程保持挂起 新连接留在内核的全连接队列里
+    void pauseAccepting();
+    void resumeAccepting();
+    bool paused() const { return paused_; }
+
     // ================= 协程接口 =================
 
     // 定义 accept 返回的结果
@@ -49,7 +56,10 @@ public:
         {
             // 将协程句柄注册给 Channel
             acceptor_->acceptChannel_->setReadCoroutine(h);
-            acceptor_->acceptChannel_->enableReading();
+            if (!acceptor_->paused_)
+            {
+                acceptor_->acceptChannel_->enableReading();
+            }
         }
 
         AcceptResult await_resume()
@@ -62,10 +72,12 @@ public:
             {
                 return {connfd, peerAddr, 0};
             }
-            else
+            int err = errno;
+            if (err == EMFILE || err == ENFILE)
             {
-                return {-1, peerAddr, errno};
+                acceptor_->dropPendingConnection();
             }
+            return {-1, peerAddr, err};
         }
     };
 
@@ -74,10 +86,17 @@ public:
 
 private:
     // void handleRead();//处理新用户的连接事件
+    // fd耗尽时用预留的idleFd_接收并立即关闭一个连接 否则LT模式下listenfd会一直可读
+    void dropPendingConnection();
 
     EventLoop *loop_; // Acceptor用的就是用户定义的那个baseLoop 也称作mainLoop
     Socket acceptSocket_;//专门用于接收新连接的socket
     Channel *acceptChannel_;// 专门用于监听新连接的channel
+    const InetAddress listenAddr_;// 监听地址 Unix域socket析构时需要删除socket文件
     // NewConnectionCallback NewConnectionCallback_;//新连接的回调函数
     bool listenning_;//是否在监听
+    bool paused_;    //是否暂停接收新连接
+    int idleFd_;     // 预留的fd 进程fd耗尽时关闭它腾出一个位置
+    dev_t socketDev_; // 本Acceptor bind时创建的Unix域socket文件 析构时只删除它
+    ino_t socketIno_; // 0表示没有创建socket文件
 };
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+class EventLoop;
+
+/**
+ * 广播/发布订阅: 一条消息只序列化一次 按引用分发给所有订阅者
+ *
+ * publish 把消息包装成不可变的 SharedMessage(shared_ptr<const string>)，
+ * 每个EventLoop只投递一次(一次queueInLoop)，在loop线程里遍历该loop上的订阅者，
+ * 用 TcpConnection::sendShared 把同一块内存挂到各个连接的发送队列上，不再逐个连接拷贝
+ *
+ * 慢订阅者(发送队列超过 maxQueuedBytes)的处理策略:
+ *   kDropNewest   丢弃这条新消息 适合可以容忍丢失的推送
+ *   kDropOldest   丢弃队列里最旧的、还没开始发送的消息 再放入新消息 适合只关心最新状态的SSE
+ *   kDisconnect   断开该订阅者
+ *   kBackpressure 不丢消息 继续排队; 计入 congestedSubscribers() 由发布方据此限速
+ *
+ * 所有接口线程安全 订阅者连接关闭后自动移除(TcpConnection::addCloseObserver)
+ * 订阅者跟着连接迁移换组; 某个loop上没有订阅者之后它的组被删除 有组期间retain该loop 线程池缩容时不会被回收
+ * 分发任务引用Broadcaster本身 它的生命周期要覆盖订阅者所在的loop(通常和TcpServer放在一起)
+ * 用法(SSE):
+ *   Broadcaster ticker("ticker");
+ *   ticker.subscribe(conn, Broadcaster::kDropOldest, 256 * 1024);
+ *   ticker.publish("data: " + json + "\n\n");
+ **/
+class Broadcaster : noncopyable
+{
+public:
+    enum OverflowPolicy
+    {
+        kDropNewest,
+        kDropOldest,
+        kDisconnect,
+        kBackpressure,
+    };
+
+    static const size_t kDefaultMaxQueuedBytes = 1024 * 1024;
+
+    explicit Broadcaster(const std::string &name);
+    ~Broadcaster();
+
+    static SharedMessage makeMessage(std::string data)
+    {
+        return std::make_shared<const std::string>(std::move(data));
+    }
+
+    void subscribe(const TcpConnectionPtr &conn,
+                   OverflowPolicy policy = kDropNewest,
+                   size_t maxQueuedBytes = kDefaultMaxQueuedBytes);
+    void unsubscribe(const TcpConnectionPtr &conn);
+
+    void publish(const SharedMessage &msg);
+    void publish(std::string data) { publish(makeMessage(std::move(data))); }
+
+    const std::string &name() const { return name_; }
+    size_t numSubscribers() const { return numSubscribers_.load(std::memory_order_relaxed); }
+    uint64_t droppedMessages() const { return dropped_.load(std::memory_order_relaxed); }
+    uint64_t disconnectedSubscribers() const { return disconnected_.load(std::memory_order_relaxed); }
+    // 最近一次分发时发送队列超限的kBackpressure订阅者个数
+    size_t congestedSubscribers() const;
+
+private:
+    struct Subscriber
+    {
+        std::weak_ptr<TcpConnection> conn;
+        TcpConnection *key; // 只用于unsubscribe时比较
+        OverflowPolicy policy;
+        size_t maxQueuedBytes;
+        bool congested;
+    };
+
+    // 某个loop上的订阅者 subscribers只在该loop线程中访问
+    struct LoopGroup
+    {
+        EventLoop *loop;
+        std::vector<Subscriber> subscribers;
+        std::atomic<size_t> congested{0};
+        size_t members = 0; // members_中记在本组的订阅者数 归零时删除该组 mutex_保护
+    };
+    using LoopGroupPtr = std::shared_ptr<LoopGroup>;
+
+    // 以下 *Locked 函数要求持有mutex_
+    // 向组所在loop投递的回调都在mutex_内用queueInLoop发出: 同一个组上的增删按加锁顺序执行，
+    // 投递时组还在 loop一定还没被回收(排队中的回调也会阻止loop退出)
+    LoopGroupPtr groupForLocked(EventLoop *loop);
+    void leaveLocked(const LoopGroupPtr &group);
+    void forgetLocked(TcpConnection *key, const LoopGroupPtr &group);
+
+    void addInLoop(const LoopGroupPtr &group, Subscriber sub);
+    void removeInLoop(const LoopGroupPtr &group, TcpConnection *key);
+    void dispatchInLoop(const LoopGroupPtr &group, const SharedMessage &msg);
+    // 返回false表示该订阅者需要从组里移除
+    bool deliver(LoopGroup &group, Subscriber &sub, const TcpConnectionPtr &conn, const SharedMessage &msg);
+
+    const std::string name_;
+    mutable std::mutex mutex_;
+    std::unordered_map<EventLoop *, LoopGroupPtr> groups_;        // mutex_保护的只是这两张表 组内的订阅者由各自的loop维护
+    std::unordered_map<TcpConnection *, LoopGroupPtr> members_;   // 订阅者当前记在哪个组 迁移后的连接靠它找到
+    std::shared_ptr<int> alive_; // 连接的关闭观察者持有它的weak_ptr Broadcaster先销毁时观察者什么也不做
+    std::atomic<size_t> numSubscribers_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> disconnected_;
+};
@@ -2,26 +2,49 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <stddef.h>
 
-// 网络库底层的缓冲区类型定义
+/**
+ * 网络库底层的缓冲区类型定义
+ *
+ * 默认使用 vector 作为底层存储，空间不足时 makeSpace 会搬移未读数据或者扩容
+ * enableMirroredRing 之后切换为环形缓冲区: 同一个memfd被连续映射两次
+ * | ring_ [0, cap) | ring_ + cap [cap, 2cap) |  两段虚拟地址对应同一块物理内存
+ * 可读区和可写区即使跨越环尾也总是一段连续的地址，peek/append/readFd 的用法不变，
+ * 读写过程中不再需要搬移数据，只有数据量超过容量时才会扩容
+ **/
 class Buffer
 {
 public:
     static const size_t kCheapPrepend = 8;//初始预留的prependabel空间大小
     static const size_t kInitialSize = 1024;
+    static const size_t kDefaultRingSize = 256 * 1024;
 
     explicit Buffer(size_t initalSize = kInitialSize)
         : buffer_(kCheapPrepend + initalSize)
         , readerIndex_(kCheapPrepend)
         , writerIndex_(kCheapPrepend)
+        , ring_(nullptr)
+        , ringCapacity_(0)
     {
     }
+    ~Buffer();
+
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    // 切换为双映射环形缓冲区 容量向上取整到页大小 已有的可读数据会保留
+    // memfd_create/mmap 失败时返回false 继续使用vector存储
+    bool enableMirroredRing(size_t capacity = kDefaultRingSize);
+    bool mirrored() const { return ring_ != nullptr; }
 
     size_t readableBytes() const { return writerIndex_ - readerIndex_; }
-    size_t writableBytes() const { return buffer_.size() - writerIndex_; }
+    size_t writableBytes() const { return mirrored() ? ringCapacity_ - readableBytes() : buffer_.size() - writerIndex_; }
     size_t prependableBytes() const { return readerIndex_; }
+    // 实际占用的内存 用于缓冲区内存预算
+    size_t capacity() const { return mirrored() ? ringCapacity_ : buffer_.capacity(); }
 
     // 返回缓冲区中可读数据的起始地址
     const char *peek() const { return begin() + readerIndex_; }
@@ -30,6 +53,12 @@ public:
         if (len < readableBytes())
         {
             readerIndex_ += len; // 说明应用只读取了可读缓冲区数据的一部分，就是len长度 还剩下readerIndex+=len到writerIndex_的数据未读
+            if (mirrored() && readerIndex_ >= ringCapacity_)
+            {
+                // 读位置越过了第一段映射 两个下标同时回绕 数据本身不动
+                readerIndex_ -= ringCapacity_;
+                writerIndex_ -= ringCapacity_;
+            }
         }
         else // len == readableBytes()
         {
@@ -38,8 +67,8 @@ public:
     }
     void retrieveAll()
     {
-        readerIndex_ = kCheapPrepend;
-        writerIndex_ = kCheapPrepend;
+        readerIndex_ = mirrored() ? 0 : kCheapPrepend;
+        writerIndex_ = readerIndex_;
     }
 
     // 把onMessage函数上报的Buffer数据 转成string类型的数据返回
@@ -51,6 +80,30 @@ public:
         return result;
     }
 
+    /**
+     * 在可读区上原地查找 不拷贝数据 找不到返回nullptr
+     * start 必须位于 [peek(), beginWrite()] 之间 用于增量解析时跳过已经扫描过的部分
+     * CRLF/双CRLF/字节集合走SSE2/AVX2内核 进程内按CPU支持情况选定一次(见 scanIsa()) 单字节查找用memchr
+     **/
+    const char *findCRLF() const { return scanCRLF(peek(), beginWrite()); }
+    const char *findCRLF(const char *start) const { return scanCRLF(start, beginWrite()); }
+    const char *findByte(char c) const { return scanByte(peek(), beginWrite(), c); }
+    const char *findByte(const char *start, char c) const { return scanByte(start, beginWrite(), c); }
+    // 第一个属于set中任意字节的位置 例如 findAnyOf("\r\n")
+    const char *findAnyOf(std::string_view set) const { return scanAnyOf(peek(), beginWrite(), set); }
+    const char *findAnyOf(const char *start, std::string_view set) const { return scanAnyOf(start, beginWrite(), set); }
+    // "\r\n\r\n" 的起始位置 HTTP头部的结尾
+    const char *findDoubleCRLF() const { return scanDoubleCRLF(peek(), beginWrite()); }
+    const char *findDoubleCRLF(const char *start) const { return scanDoubleCRLF(start, beginWrite()); }
+
+    // 作用于任意内存区间[begin, end)的扫描内核 解析器在已经切好的行/头部上也可以直接使用
+    static const char *scanCRLF(const char *begin, const char *end);
+    static const char *scanByte(const char *begin, const char *end, char c);
+    static const char *scanAnyOf(const char *begin, const char *end, std::string_view set);
+    static const char *scanDoubleCRLF(const char *begin, const char *end);
+    // 当前使用的内核: "avx2" / "sse2" / "scalar"
+    static const char *scanIsa();
+
     // buffer_.size - writerIndex_
     void ensureWritableBytes(size_t len)
     {
@@ -69,6 +122,22 @@ public:
     }
     char *beginWrite() { return begin() + writerIndex_; }
     const char *beginWrite() const { return begin() + writerIndex_; }
+    // 数据已经直接写到beginWrite()处(例如SSL_read) 移动写指针
+    void hasWritten(size_t len) { writerIndex_ += len; }
+
+    // 释放多余的容量 只保留可读数据和reserve字节的可写空间 环形模式下不处理
+    void shrink(size_t reserve)
+    {
+        if (mirrored())
+        {
+            return;
+        }
+        std::vector<char> buf(kCheapPrepend + readableBytes() + reserve);
+        std::copy(peek(), peek() + readableBytes(), buf.begin() + kCheapPrepend);
+        writerIndex_ = kCheapPrepend + readableBytes();
+        readerIndex_ = kCheapPrepend;
+        buffer_.swap(buf);
+    }
 
     // 从fd上读取数据
     ssize_t readFd(int fd, int *saveErrno);
@@ -77,11 +146,19 @@ public:
 
 private:
     // vector底层数组首元素的地址 也就是数组的起始地址
-    char *begin() { return &*buffer_.begin(); }
-    const char *begin() const { return &*buffer_.begin(); }
+    char *begin() { return mirrored() ? ring_ : &*buffer_.begin(); }
+    const char *begin() const { return mirrored() ? ring_ : &*buffer_.begin(); }
+
+    // 环形模式下容量不足 换一块更大的双映射区域
+    void growRing(size_t len);
 
     void makeSpace(size_t len)
     {
+        if (mirrored())
+        {
+            growRing(len);
+            return;
+        }
         /**
          * | kCheapPrepend |xxx| reader | writer |                     // xxx标示reader中已读的部分
          * | kCheapPrepend | reader ｜          len          |
@@ -106,4 +183,8 @@ private:
     std::vector<char> buffer_;
     size_t readerIndex_;
     size_t writerIndex_;
+
+    // 环形模式: 下标满足 0 <= readerIndex_ < ringCapacity_, writerIndex_ <= readerIndex_ + ringCapacity_
+    char *ring_;
+    size_t ringCapacity_;
 };
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "noncopyable.h"
+
+class EventLoop;
+
+/**
+ * 连接缓冲区的内存预算(进程级)
+ *
+ * 每个TcpConnection把输入/输出Buffer实际占用的容量记到这里，同时记到所属EventLoop上(EventLoop::bufferBytes)
+ * 设置了上限(setLimit)并且总量超过上限时:
+ *   - TcpServer拒绝新连接(accept之后直接关闭)
+ *   - 占用超过平均值的连接暂停读 不再把客户端的数据搬进用户态 总量回落到 limit*resumeRatio 以下后恢复
+ *   - 输入/输出缓冲区为空的连接把缓冲区缩回初始大小
+ * 上限为0(默认)时只做统计
+ *
+ * 所有接口线程安全 统计值是近似的: 各个loop并发更新 只保证最终一致
+ **/
+class BufferBudget : noncopyable
+{
+public:
+    static BufferBudget &global();
+
+    void setLimit(size_t bytes) { limit_.store(bytes, std::memory_order_relaxed); }
+    size_t limit() const { return limit_.load(std::memory_order_relaxed); }
+    // 超限后总量低于 limit*ratio 时恢复读 默认0.8 留出余量避免在上限附近反复暂停/恢复
+    void setResumeRatio(double ratio) { resumeRatio_.store(ratio, std::memory_order_relaxed); }
+
+    size_t used() const;
+    size_t connections() const { return connections_.load(std::memory_order_relaxed); }
+    size_t pausedConnections() const { return paused_.load(std::memory_order_relaxed); }
+
+    bool exceeded() const;
+    bool belowResumeMark() const;
+    // 连接当前占用connBytes 总量超限时它是否属于需要暂停读的"大户"
+    bool shouldPause(size_t connBytes) const;
+
+    // TcpConnection调用: 记账 同时更新loop上的统计
+    void charge(EventLoop *loop, int64_t delta);
+    void connectionAttached() { connections_.fetch_add(1, std::memory_order_relaxed); }
+    void connectionDetached() { connections_.fetch_sub(1, std::memory_order_relaxed); }
+    void pausedChanged(int delta) { paused_.fetch_add(delta, std::memory_order_relaxed); }
+
+private:
+    BufferBudget();
+
+    std::atomic<size_t> limit_;
+    std::atomic<double> resumeRatio_;
+    std::atomic<int64_t> used_;
+    std::atomic<size_t> connections_;
+    std::atomic<int64_t> paused_;
+};
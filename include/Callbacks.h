@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include <functional>
 
 class Buffer;
@@ -11,6 +12,10 @@ using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr &)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
+class EventLoop;
+using MigrateCallback = std::function<void(const TcpConnectionPtr &, EventLoop *from, EventLoop *to)>;
+// 广播时多个连接共享的一条不可变消息
+using SharedMessage = std::shared_ptr<const std::string>;
 using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
 
 using MessageCallback = std::function<void(const TcpConnectionPtr &,
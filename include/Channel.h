@@ -1,7 +1,5 @@
 #pragma once
 
-#include <functional>
-#include <memory>
 #include <coroutine> // [新增]
 
 #include "noncopyable.h"
@@ -9,38 +7,53 @@
 
 class EventLoop;
 
+/**
+ * Channel上事件的分发目标 由拥有该Channel的对象(TcpConnection/Acceptor/TimerQueue...)实现
+ * 一个Channel只保存一个handler指针 取代了原来每个事件一个std::function的做法
+ * 每个fd只需要一个虚表指针 不再有四个function对象和它们在堆上的捕获
+ *
+ * 生命周期: handler必须活到它所在的handleEvent调用返回 Channel不持有handler的引用
+ * 回调里可能导致handler被释放时(比如恢复的协程结束后栈帧连同handler一起析构)，
+ * 要先setHandler(nullptr)摘掉handler或者把Channel一起析构 handleEvent看到后不再分发剩下的事件
+ **/
+class ChannelHandler
+{
+public:
+    virtual ~ChannelHandler() = default;
+
+    virtual void onReadable(Timestamp /*receiveTime*/) {}
+    virtual void onWritable() {}
+    // 对端挂断(EPOLLHUP且没有可读数据)
+    virtual void onHangup() {}
+    virtual void onError() {}
+};
+
 /**
  * 理清楚 EventLoop、Channel、Poller之间的关系  Reactor模型上对应多路事件分发器
  * Channel理解为通道 封装了sockfd和其感兴趣的event 如EPOLLIN、EPOLLOUT事件 还绑定了poller返回的具体事件
+ *
+ * 读事件优先唤醒挂起在该fd上的协程(readCoroutine_) 没有协程等待时才交给handler
+ * Channel不再通过tie持有owner的weak_ptr: owner必须保证在Channel从Poller中remove之前一直存活
+ * (TcpConnection在connectEstablished和connectDestroyed之间持有自身的引用)，事件分发路径上没有原子引用计数操作
+ * 代替tie的是handleEvent里每个分支之后的检查: Channel被析构或者handler被摘掉后不再分发剩下的事件
  **/
 class Channel : noncopyable
 {
 public:
-    using EventCallback = std::function<void()>; // muduo仍使用typedef
-    using ReadEventCallback = std::function<void(Timestamp)>;
-
     Channel(EventLoop *loop, int fd);
     ~Channel();
 
     // fd得到Poller通知以后 处理事件 handleEvent在EventLoop::loop()中调用
     void handleEvent(Timestamp receiveTime);
 
-    // 设置回调函数对象
-    void setReadCallback(ReadEventCallback cb) { readCallback_ = std::move(cb); }
-    void setWriteCallback(EventCallback cb) { writeCallback_ = std::move(cb); }
-    void setCloseCallback(EventCallback cb) { closeCallback_ = std::move(cb); }
-    void setErrorCallback(EventCallback cb) { errorCallback_ = std::move(cb); }
+    // 设置事件分发目标 handler的生命周期由调用方保证 传nullptr表示摘掉 正在进行的handleEvent随即停止分发
+    void setHandler(ChannelHandler *handler) { handler_ = handler; }
 
     // [新增] 协程设置接口
-    // 直接接管 Read 事件，优先级高于 ReadCallback
+    // 直接接管 Read 事件，优先级高于 handler
     void setReadCoroutine(std::coroutine_handle<> h) { readCoroutine_ = h; }
     void clearReadCoroutine() { readCoroutine_ = nullptr; }
-
-    void setReadResumeCallback(std::function<void()> cb) { readResumeCallback_ = std::move(cb); }
-    void clearReadResumeCallback() { readResumeCallback_ = nullptr; }
-
-    // 防止当channel被手动remove掉 channel还在执行回调操作
-    void tie(const std::shared_ptr<void> &);
+    std::coroutine_handle<> readCoroutine() const { return readCoroutine_; }
 
     int fd() const { return fd_; }
     int events() const { return events_; }
@@ -61,35 +74,30 @@ public:
     int index() { return index_; }
     void set_index(int idx) { index_ = idx; }
 
+    // 注册已有的事件集合 用于连接迁移后在新loop上恢复关注的事件
+    void enableEvents(int events) { events_ |= events; update(); }
+
     // one loop per thread
     EventLoop *ownerLoop() { return loop_; }
+    // 连接迁移: 必须先在原loop中remove() 之后的update会注册到新loop的Poller
+    void moveToLoop(EventLoop *loop) { loop_ = loop; }
     void remove();
 private:
 
     void update();
-    void handleEventWithGuard(Timestamp receiveTime);
+    void handleEventWithGuard(Timestamp receiveTime, const bool &alive);
 
     static const int kNoneEvent;
     static const int kReadEvent;
     static const int kWriteEvent;
 
-    EventLoop *loop_; // 事件循环
+    EventLoop *loop_;                        // 事件循环
+    ChannelHandler *handler_;                // 事件分发目标
+    std::coroutine_handle<> readCoroutine_;  // 挂起在读事件上的协程
     const int fd_;    // fd，Poller监听的对象
     int events_;      // 注册fd感兴趣的事件
     int revents_;     // Poller返回的具体发生的事件
     int index_;
     bool logHup_;
-
-    std::weak_ptr<void> tie_;
-    bool tied_;
-
-    // 因为channel通道里可获知fd最终发生的具体的事件events，所以它负责调用具体事件的回调操作
-    ReadEventCallback readCallback_;
-    EventCallback writeCallback_;
-    EventCallback closeCallback_;
-    EventCallback errorCallback_;
-
-    // [新增] 协程句柄
-    std::coroutine_handle<> readCoroutine_ = nullptr;
-    std::function<void()> readResumeCallback_;
-};
\ No newline at end of file
+    bool *alive_; // handleEvent期间指向它栈上的标志 Channel在分发中途析构时置为false
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <coroutine>
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+#include "Channel.h"
+
+class EventLoop;
+
+/**
+ * Connector 负责主动发起非阻塞 connect，与 Acceptor 对称
+ * Acceptor => 被动接收连接 拿到connfd   Connector => 主动发起连接 拿到sockfd
+ *
+ * 用法: auto [sockfd, err] = co_await connector.connect(3.0);
+ * connect 期间 Connector 对象必须存活(通常放在协程栈帧里)
+ **/
+class Connector : noncopyable, private ChannelHandler
+{
+public:
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    const InetAddress &serverAddress() const { return serverAddr_; }
+
+    // ================= 协程接口 =================
+
+    struct ConnectResult
+    {
+        int sockfd; // 连接成功时为已连接的非阻塞fd 失败时为-1
+        int err;    // 0 表示成功
+    };
+
+    struct ConnectAwaiter
+    {
+        Connector *connector_;
+        double timeoutSecs_;
+
+        ConnectAwaiter(Connector *connector, double timeoutSecs)
+            : connector_(connector), timeoutSecs_(timeoutSecs) {}
+
+        // 发起 connect，立即成功或立即失败时不需要挂起
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> h);
+        ConnectResult await_resume();
+    };
+
+    // timeoutSecs <= 0 表示不设置超时，由内核的SYN重传决定失败时间
+    ConnectAwaiter connect(double timeoutSecs = 0.0) { return ConnectAwaiter(this, timeoutSecs); }
+
+private:
+    // connect完成(成功或失败)时sockfd可写 失败时同时报告EPOLLERR
+    void onWritable() override { handleWrite(); }
+    void onError() override { handleWrite(); }
+    void handleWrite(); // sockfd可写 说明connect有结果了(成功或失败)
+    void handleTimeout();
+    void finish(int err);
+    void resetChannel();
+
+    EventLoop *loop_;
+    const InetAddress serverAddr_;
+    int sockfd_;
+    int err_;
+    std::unique_ptr<Channel> channel_;
+    std::coroutine_handle<> coroutine_ = nullptr;
+    TimerId timerId_;
+    bool timerArmed_;
+};
@@ -21,6 +21,89 @@ struct Task
     };
 };
 
+/**
+ * 可以被 co_await 的协程，用于调用方需要等它结束的场景(例如 HttpServer 的异步处理函数)
+ * 与 Task 的区别: 创建后不立即执行，第一次 co_await 或 start() 时才开始；结束时恢复等待它的协程
+ * 协程内未捕获的异常保存下来，在 co_await 处重新抛出
+ * 用法:
+ *   AsyncTask handle(HttpRequest &req, HttpResponse &resp) { co_await ...; co_return; }
+ *   co_await handle(req, resp);
+ **/
+class AsyncTask
+{
+public:
+    struct promise_type
+    {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+
+        AsyncTask get_return_object() { return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        // 结束时直接切换到等待者(对称转移) 没有等待者说明是在start()里同步跑完的
+        struct FinalAwaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+            {
+                auto c = h.promise().continuation;
+                return c ? c : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    AsyncTask(AsyncTask &&other) noexcept : handle_(other.handle_), started_(other.started_) { other.handle_ = nullptr; }
+    AsyncTask(const AsyncTask &) = delete;
+    AsyncTask &operator=(const AsyncTask &) = delete;
+    ~AsyncTask()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    // 先跑到第一个挂起点 调用方可以据此判断是否同步完成(done()) 再决定要不要 co_await
+    void start()
+    {
+        if (handle_ && !started_)
+        {
+            started_ = true;
+            handle_.resume();
+        }
+    }
+    bool done() const { return !handle_ || handle_.done(); }
+
+    bool await_ready() const { return done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h)
+    {
+        handle_.promise().continuation = h;
+        if (!started_)
+        {
+            started_ = true;
+            return handle_;
+        }
+        return std::noop_coroutine(); // 已经start过 正挂起在别处 结束时会恢复h
+    }
+    void await_resume()
+    {
+        if (handle_ && handle_.promise().exception)
+        {
+            std::rethrow_exception(handle_.promise().exception);
+        }
+    }
+
+private:
+    explicit AsyncTask(std::coroutine_handle<promise_type> h) : handle_(h) {}
+
+    std::coroutine_handle<promise_type> handle_;
+    bool started_ = false;
+};
+
 // === 基于 EventLoop/TimerQueue 的协程友好定时工具 ===
 
 class SleepAwaiter
@@ -38,10 +121,16 @@ public:
     void await_suspend(std::coroutine_handle<> h)
     {
         // 使用弱引用防止连接/协程已经结束时继续 resume
+        // 定时器属于当前loop 睡眠期间连接标记为busy 不会被迁移走
         std::weak_ptr<TcpConnection> weakConn = conn_;
+        if (conn_)
+        {
+            conn_->beginBusy();
+        }
         loop_->runAfter(seconds_, [h, weakConn]() mutable {
             if (auto conn = weakConn.lock())
             {
+                conn->endBusy();
                 if (!conn->connected())
                 {
                     return;
@@ -12,12 +12,12 @@
 #include "CurrentThread.h"
 #include "TimerQueue.h"
 #include "TimerId.h"
+#include "Channel.h"
 
-class Channel;
 class Poller;
 
 // 事件循环类 主要包含了两个大模块 Channel Poller(epoll的抽象)
-class EventLoop : noncopyable
+class EventLoop : noncopyable, private ChannelHandler
 {
 public:
     using Functor = std::function<void()>;
@@ -36,6 +36,9 @@ public:
     void runInLoop(Functor cb);
     // 把上层注册的回调函数cb放入队列中 唤醒loop所在的线程执行cb
     void queueInLoop(Functor cb);
+    // 在本轮事件循环的末尾(事件分发和pendingFunctors之后)执行cb 只能在loop线程调用
+    // 用于把同一轮里产生的多次小写操作合并成一次系统调用
+    void queueAfterDispatch(Functor cb);
 
     // 通过eventfd唤醒loop所在的线程
     void wakeup();
@@ -45,6 +48,26 @@ public:
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
 
+    // 该loop上所有连接的输入/输出缓冲区占用的字节数 见 BufferBudget
+    int64_t bufferBytes() const { return bufferBytes_.load(std::memory_order_relaxed); }
+    void addBufferBytes(int64_t delta) { bufferBytes_.fetch_add(delta, std::memory_order_relaxed); }
+
+    // 当前线程所属的EventLoop 非loop线程返回nullptr
+    static EventLoop *currentLoop();
+
+    /**
+     * 在loop之外保存了这个EventLoop*、之后还会向它投递回调的对象(WorkerPool任务、Broadcaster分组等)
+     * 持有期间retain 不再投递时release; 线程池缩容时有持有者的loop不会退出 见 EventLoopThreadPool::resize
+     * 线程安全
+     **/
+    void retain() { users_.fetch_add(1, std::memory_order_relaxed); }
+    void release() { users_.fetch_sub(1, std::memory_order_release); }
+    /**
+     * loop可以安全退出: 没有持有者、没有排队的回调、没有定时器、除了自己的wakeup/timerfd之外没有注册的channel
+     * 只能在loop线程调用
+     **/
+    bool idle();
+
     // 判断EventLoop对象是否在自己的线程里
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); } // threadId_为EventLoop创建时的线程id CurrentThread::tid()为当前线程id
 
@@ -129,8 +152,10 @@ public:
     // }
 
 private:
+    void onReadable(Timestamp) override { handleRead(); }
     void handleRead();        // 给eventfd返回的文件描述符wakeupFd_绑定的事件回调 当wakeup()时 即有事件发生时 调用handleRead()读wakeupFd_的8字节 同时唤醒阻塞的epoll_wait
     void doPendingFunctors(); // 执行上层回调
+    void doAfterDispatchFunctors(); // 执行本轮末尾的flush回调
 
     using ChannelList = std::vector<Channel *>;
 
@@ -151,4 +176,10 @@ private:
     std::atomic_bool callingPendingFunctors_; // 标识当前loop是否有需要执行的回调操作
     std::vector<Functor> pendingFunctors_;    // 存储loop需要执行的所有回调操作
     std::mutex mutex_;                        // 互斥锁 用来保护上面vector容器的线程安全操作
+
+    bool callingAfterDispatchFunctors_;         // 只在loop线程访问 不需要原子变量
+
+    std::atomic<int64_t> bufferBytes_;
+    std::atomic<int> users_; // retain/release 的计数
+    std::vector<Functor> afterDispatchFunctors_; // 只在loop线程访问 不需要加锁
 };
\ No newline at end of file
@@ -20,6 +20,11 @@ public:
     ~EventLoopThread();
 
     EventLoop *startLoop();
+    // 让loop执行完已经排队的回调后退出 并等待线程结束
+    void stop();
+    // 等loop上的连接、定时器、排队的回调和持有者都没有了再退出(见 EventLoop::idle) 并等待线程结束
+    // 可能等很久 不要在别的loop线程里调用
+    void stopWhenIdle();
 
 private:
     void threadFunc();
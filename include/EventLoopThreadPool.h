@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <unordered_map>
 
 #include "noncopyable.h"
 class EventLoop;
@@ -21,6 +22,20 @@ public:
 
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
+    /**
+     * 运行期间调整subloop的个数 必须在baseLoop线程调用
+     * 增加: 新loop立即参与轮询分配新连接
+     * 减少: 末尾的loop退出轮询(retiring) 不再分配新连接 上面最后一个连接关闭后
+     *       在后台线程里等这个loop空闲(没有定时器、排队的回调和retain的持有者 见 EventLoop::idle)再退出 不阻塞baseLoop
+     **/
+    void resize(int numThreads);
+    int numThreads() const { return static_cast<int>(loops_.size()); }
+    size_t numRetiring() const { return retiring_.size(); }
+
+    // 上层在某个loop上建立/销毁连接时通知线程池 用于判断retiring的loop何时可以退出(baseLoop线程调用)
+    void connectionAttached(EventLoop *loop);
+    void connectionDetached(EventLoop *loop);
+
 // 如果工作在多线程中，baseLoop_(mainLoop)会默认以轮询的方式分配Channel给subLoop
     EventLoop *getNextLoop();
 
@@ -37,4 +52,12 @@ private:
     int next_; // 新连接到来，所选择EventLoop的索引
     std::vector<std::unique_ptr<EventLoopThread>> threads_;//IO线程的列表
     std::vector<EventLoop *> loops_;//线程池中EventLoop的列表，指向的是EVentLoopThread线程函数创建的EventLoop对象。
+
+    void startThread(int index);
+    void retireIfIdle(EventLoop *loop);
+
+    ThreadInitCallback initCallback_; // resize时新线程同样需要执行
+    int nextThreadId_;                // 线程名编号 缩容后再扩容不会重名
+    std::unordered_map<EventLoop *, size_t> connections_; // 每个loop上的连接数
+    std::vector<std::pair<EventLoop *, std::unique_ptr<EventLoopThread>>> retiring_; // 等待连接全部关闭的loop
 };
\ No newline at end of file
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#include "noncopyable.h"
+#include "Channel.h"
+#include "Callbacks.h"
+
+class EventLoop;
+
+namespace KamaCache
+{
+template <typename Key, typename Value>
+class KLfuCache;
+}
+
+/**
+ * 打开文件缓存: 路径 => 已经打开的fd + stat结果 + 由stat算好的ETag/Last-Modified
+ * 命中时一次请求不再有open/fstat/close系统调用 "文件不存在"(ENOENT)也会缓存 探测.gz这类可选文件不产生系统调用
+ *
+ * 失效: 每个缓存文件所在的目录加一个inotify监视 目录下文件被创建、修改、改属性、删除、改名(原子替换)时
+ * 在loop线程里收到事件 把对应路径移出缓存 事件是异步的 修改后到失效之间有一个事件投递的窗口
+ * 每个目录有一个代数 收到该目录的事件时加一; open在打开之前记下代数 放进缓存时代数变了就不放，
+ * 避免"打开旧文件 -> 事件处理完 -> 旧文件放进缓存"留下永远不失效的缓存项
+ * inotify不可用时(达到系统上限等)退化为不缓存 每次都open/fstat
+ *
+ * 小文件的内容: content() 把不超过maxMemoryFileSize的文件读进内存 放在LFU缓存里(热点文件留下)
+ * 内容记录了读取时的inode/大小/修改时间 和当前stat不一致时重新读 不需要额外的失效通知
+ *
+ * 缓存项用shared_ptr交出去 失效只是从表里移除 正在sendFile的连接持有引用 fd在最后一个引用释放时关闭
+ * open/content任意线程调用 FileCache在loop线程析构
+ **/
+class FileCache : private ChannelHandler, noncopyable
+{
+public:
+    struct File : noncopyable
+    {
+        int fd = -1;
+        struct stat st;
+        std::string etag;         // "inode-size-mtime" 文件变了它就变
+        std::string lastModified; // HTTP日期格式的修改时间
+
+        ~File();
+        size_t size() const { return static_cast<size_t>(st.st_size); }
+    };
+    using FilePtr = std::shared_ptr<const File>;
+
+    static const size_t kDefaultMaxFiles = 4096;
+    static const int kDefaultMaxMemoryFiles = 512;
+    static const size_t kDefaultMaxMemoryFileSize = 64 * 1024;
+
+    // loop: 处理inotify事件的loop
+    explicit FileCache(EventLoop *loop,
+                       size_t maxFiles = kDefaultMaxFiles,
+                       int maxMemoryFiles = kDefaultMaxMemoryFiles,
+                       size_t maxMemoryFileSize = kDefaultMaxMemoryFileSize);
+    ~FileCache();
+
+    // 打开普通文件 失败返回nullptr并保留errno(不存在为ENOENT 目录为EISDIR 其他非普通文件为EACCES)
+    FilePtr open(const std::string &path);
+    // 小文件的完整内容 文件超过maxMemoryFileSize或读取失败返回nullptr
+    SharedMessage content(const std::string &path, const FilePtr &file);
+
+    size_t maxMemoryFileSize() const { return maxMemoryFileSize_; }
+    bool watching() const { return inotifyFd_ >= 0; }
+    size_t cachedFiles() const;
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+    uint64_t invalidations() const { return invalidations_.load(std::memory_order_relaxed); }
+
+    // 按RFC 7231格式化/解析HTTP日期 例如 "Sun, 06 Nov 1994 08:49:37 GMT" 解析失败返回-1
+    static std::string formatHttpDate(time_t t);
+    static time_t parseHttpDate(std::string_view s);
+
+private:
+    struct Content
+    {
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+        SharedMessage data;
+    };
+    using ContentPtr = std::shared_ptr<const Content>;
+
+    void onReadable(Timestamp) override { handleRead(); }
+    void handleRead();
+    // 给path所在的目录加监视 已经在监视时inotify返回同一个wd 成功时通过generation返回目录当前的代数
+    bool watchDirectory(const std::string &path, uint64_t *generation);
+    // 放进缓存 file为nullptr表示文件不存在 目录的代数已经不是generation时放弃(打开期间文件可能变了)
+    void remember(const std::string &path, const FilePtr &file, uint64_t generation);
+    uint64_t generationLocked(const std::string &dir) const;
+    // 把目录dir下的所有缓存项移出 目录本身被删除/移走时用(加锁后调用)
+    void removeDirectoryLocked(const std::string &dir);
+
+    EventLoop *loop_;
+    const int inotifyFd_;
+    Channel inotifyChannel_;
+    const size_t maxFiles_;
+    const size_t maxMemoryFileSize_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, FilePtr> files_;
+    std::unordered_map<int, std::string> watches_; // wd => 目录
+    std::unordered_map<std::string, uint64_t> generations_; // 目录 => 收到过的事件批数 监视被移除后也保留
+    uint64_t overflows_ = 0; // 事件队列溢出的次数 溢出时所有目录的代数都算变了
+
+    std::unique_ptr<KamaCache::KLfuCache<std::string, ContentPtr>> contents_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> invalidations_;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <unordered_map>
+
+#include "noncopyable.h"
+
+/**
+ * HPACK(RFC 7541) HTTP/2的头部压缩
+ *
+ * 索引空间: 1~61是静态表 62开始是动态表(最新加入的编号最小)
+ * 动态表按 名字长度 + 值长度 + 32 计大小 超过上限时从最旧的一端淘汰
+ * 每个HTTP/2连接每个方向各有一张动态表: HpackDecoder解码对端发来的头部块 HpackEncoder编码我们发出的
+ * 两张表的状态必须和对端保持一致 头部块即使因为别的原因被拒绝也要完整解码
+ **/
+class HpackTable
+{
+public:
+    static constexpr size_t kStaticEntries = 61;
+    static constexpr size_t kEntryOverhead = 32;
+
+    explicit HpackTable(size_t maxSize) : size_(0), maxSize_(maxSize), inserted_(0) {}
+
+    // index从1开始 覆盖静态表和动态表 越界返回false
+    bool get(size_t index, std::string_view *name, std::string_view *value) const;
+    void add(std::string_view name, std::string_view value);
+    void setMaxSize(size_t maxSize);
+
+    size_t size() const { return size_; }
+    size_t maxSize() const { return maxSize_; }
+    size_t dynamicCount() const { return entries_.size(); }
+    // 已经加入过的条目总数 编码器用它把"第几次加入"换算成当前的索引
+    uint64_t inserted() const { return inserted_; }
+
+    static std::string_view staticName(size_t index);
+    static std::string_view staticValue(size_t index);
+
+private:
+    struct Entry
+    {
+        std::string name;
+        std::string value;
+        uint64_t seq; // 第几个加入的
+    };
+    void evictTo(size_t maxSize);
+
+    std::deque<Entry> entries_; // 头部最新
+    size_t size_;
+    size_t maxSize_;
+    uint64_t inserted_;
+
+    friend class HpackEncoder;
+};
+
+class HpackDecoder : noncopyable
+{
+public:
+    using FieldCallback = std::function<void(std::string_view name, std::string_view value)>;
+
+    static constexpr size_t kDefaultTableSize = 4096;
+
+    // maxTableSize 是我们在SETTINGS_HEADER_TABLE_SIZE里通告的上限 对端的表大小更新不能超过它
+    explicit HpackDecoder(size_t maxTableSize = kDefaultTableSize);
+
+    // 解码一个完整的头部块(HEADERS + CONTINUATION拼好之后) 每个字段调用一次cb
+    // 传给cb的name/value只在这次回调期间有效 编码错误(COMPRESSION_ERROR)返回false
+    bool decode(const char *data, size_t len, const FieldCallback &cb);
+
+    const HpackTable &table() const { return table_; }
+
+private:
+    HpackTable table_;
+    const size_t settingsMaxSize_;
+    std::string nameBuf_;  // Huffman解码的结果 容量复用
+    std::string valueBuf_;
+};
+
+class HpackEncoder : noncopyable
+{
+public:
+    explicit HpackEncoder(size_t maxTableSize = HpackDecoder::kDefaultTableSize);
+
+    // 对端的SETTINGS_HEADER_TABLE_SIZE 下一个头部块开头会带上动态表大小更新
+    void setMaxTableSize(size_t peerMaxSize);
+
+    // 每个头部块开始时调用一次
+    void beginBlock(std::string *out);
+    // name必须是小写(HTTP/2要求)
+    void encode(std::string_view name, std::string_view value, std::string *out);
+
+    const HpackTable &table() const { return table_; }
+
+    // ===== 基本编码 也用于测试和调试 =====
+
+    // prefixBits位前缀的整数 first是首字节里前缀以外的标志位
+    static void encodeInteger(uint64_t value, int prefixBits, uint8_t first, std::string *out);
+    static bool decodeInteger(const uint8_t **p, const uint8_t *end, int prefixBits, uint64_t *value);
+    // 长度更短时用Huffman编码
+    static void encodeString(std::string_view s, std::string *out);
+    static size_t huffmanLength(std::string_view s);
+    static void huffmanEncode(std::string_view s, std::string *out);
+    // 失败(非法填充、出现EOS)返回false 结果追加到out
+    static bool huffmanDecode(const uint8_t *data, size_t len, std::string *out);
+
+private:
+    // 查找完整匹配或者名字匹配 返回索引 没有时返回0
+    size_t find(std::string_view name, std::string_view value, bool *exact) const;
+    void addEntry(std::string_view name, std::string_view value);
+
+    HpackTable table_;
+    size_t preferredMaxSize_;  // 我们自己愿意使用的上限
+    size_t pendingSizeUpdate_; // 需要在下一个头部块开头通知的新大小 SIZE_MAX表示没有
+    mutable std::string key_;  // 查找动态表用的 "name\0value" 容量复用
+    std::unordered_map<std::string, uint64_t> dynamicIndex_; // "name\0value" => 加入序号
+    std::unordered_map<std::string, uint64_t> dynamicNames_; // name => 最近一次加入序号
+};
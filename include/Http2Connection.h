@@ -0,0 +1,255 @@
+#pragma once
+
+#include <stdint.h>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Buffer.h"
+#include "CoroutineSupport.h"
+#include "Hpack.h"
+#include "HttpParser.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+class HttpServer;
+
+/**
+ * 一个HTTP/2连接(RFC 9113) 由HttpServer在连接以前言开头时创建(h2c prior knowledge 不支持Upgrade和ALPN)
+ *
+ * 三种协程:
+ *   读协程(run)   按帧处理输入缓冲区 控制帧(SETTINGS/PING/WINDOW_UPDATE/RST_STREAM)的回应直接写出
+ *   流协程        每个请求收齐(END_STREAM)后启动一个 调用HttpServer的处理函数 各个流互不等待
+ *   写协程        唯一的响应写出路径: 流协程完成时唤醒它 同一轮唤醒里所有就绪流的HEADERS/DATA
+ *                 编码进同一个缓冲区一次发出 DATA在各个流之间轮转(每轮每个流一帧) 避免大响应饿死小响应
+ * 流量控制: 发送方向按连接窗口和流窗口切分DATA 窗口用完的流等WINDOW_UPDATE
+ *   接收方向: 同步处理函数的请求体完整缓存(上限maxBodySize) 收到DATA就归还窗口;
+ *   协程处理函数收到HEADERS就启动 请求体边收边读(HttpRequest::readBody) 流窗口在处理函数读走数据之后才归还，
+ *   所以每个流最多缓存kStreamWindow字节 处理函数不读时对端停下来等 这就是上传的背压;
+ *   处理函数返回后剩下的请求体读掉丢弃(响应已经发完时用RST_STREAM(NO_ERROR)让对端停止上传)
+ *   连接级窗口收到DATA就归还(开到kConnectionWindow) 一个不读请求体的流不会卡住其他流
+ * 响应体: body/共享消息体拷贝进DATA帧 文件消息体用pread读进DATA帧(DATA需要帧头 不能sendfile)
+ * 流的状态只在所属loop线程访问 不需要加锁 流协程没有结束之前流对象不会释放(即使已经被RST_STREAM)
+ **/
+class Http2Connection : noncopyable
+{
+public:
+    enum PrefaceMatch
+    {
+        kPrefaceMismatch,
+        kPrefacePartial, // 收到的数据是前言的前缀 还不能确定
+        kPrefaceMatched
+    };
+
+    enum ErrorCode
+    {
+        kNoError = 0x0,
+        kProtocolError = 0x1,
+        kInternalError = 0x2,
+        kFlowControlError = 0x3,
+        kSettingsTimeout = 0x4,
+        kStreamClosed = 0x5,
+        kFrameSizeError = 0x6,
+        kRefusedStream = 0x7,
+        kCancel = 0x8,
+        kCompressionError = 0x9,
+        kEnhanceYourCalm = 0xb
+    };
+
+    static constexpr size_t kPrefaceLength = 24;
+    static constexpr size_t kFrameHeaderLength = 9;
+    static constexpr uint32_t kMaxConcurrentStreams = 100;
+    static constexpr uint32_t kDefaultWindow = 65535;         // 协议规定的初始窗口
+    static constexpr uint32_t kStreamWindow = 1024 * 1024;    // 我们通告的每个流的接收窗口
+    static constexpr uint32_t kConnectionWindow = 16 * 1024 * 1024;
+    static constexpr uint32_t kMaxFrameSize = 16384;          // 我们接收的最大帧 使用协议默认值
+    static constexpr size_t kMaxSendFrameSize = 64 * 1024;    // 对端允许更大时 我们发出的DATA帧最多这么大
+    static constexpr size_t kMaxHeaderBlock = 256 * 1024;     // HEADERS+CONTINUATION拼起来的上限
+    static constexpr size_t kHighWaterMark = 256 * 1024;      // 发送队列超过它时写协程等待排空 读协程暂停处理新帧
+    static constexpr uint32_t kMaxControlFrames = 1000;       // 每秒最多处理的PING/SETTINGS/PRIORITY/RST_STREAM 超过时GOAWAY(ENHANCE_YOUR_CALM)
+
+    static PrefaceMatch matchPreface(const Buffer *in);
+
+    Http2Connection(HttpServer *server, const TcpConnectionPtr &conn);
+    ~Http2Connection();
+
+    // 读协程 连接结束(对端关闭、GOAWAY、连接错误、空闲超时)并且所有流协程结束后返回
+    AsyncTask run();
+
+private:
+    enum FrameType
+    {
+        kData = 0x0,
+        kHeaders = 0x1,
+        kPriority = 0x2,
+        kRstStream = 0x3,
+        kSettings = 0x4,
+        kPushPromise = 0x5,
+        kPing = 0x6,
+        kGoAway = 0x7,
+        kWindowUpdate = 0x8,
+        kContinuation = 0x9
+    };
+    enum FrameFlag
+    {
+        kFlagEndStream = 0x1,
+        kFlagAck = 0x1,
+        kFlagEndHeaders = 0x4,
+        kFlagPadded = 0x8,
+        kFlagPriority = 0x20
+    };
+
+    struct Stream
+    {
+        Stream(uint32_t streamId, int64_t initialWindow);
+
+        uint32_t id;
+        HttpRequest req;
+        HttpResponse resp;
+        std::optional<AsyncTask> task; // 流协程 没有启动时是空的
+        bool started;      // 请求已经交给流协程
+        bool remoteClosed; // 收到了END_STREAM
+        bool headersSent;
+        bool localClosed;  // 发出了END_STREAM
+        bool reset;        // 任意一方发出了RST_STREAM 不再收发
+        int errorStatus;   // 不调用处理函数 直接回这个状态码(413/431/501)
+        bool streaming;    // 请求体边收边读(协程处理函数) 流协程在HEADERS之后就启动
+        bool discardBody;  // 处理函数已经返回 之后的DATA丢弃
+        uint64_t bodyReceived; // 收到的请求体字节数(不含填充) 用来核对content-length
+        int64_t windowCredit;  // 已经消费还没有用WINDOW_UPDATE归还的字节数
+        int64_t sendWindow;
+        int64_t recvWindow;
+        size_t bodyOffset; // 已经发出的响应体字节数
+        size_t bodyLength;
+        bool headOnly;
+    };
+    using StreamPtr = std::unique_ptr<Stream>;
+
+    // 写协程挂起在这里 流协程完成、窗口变大时唤醒
+    struct WakeAwaiter
+    {
+        Http2Connection *conn_;
+
+        bool await_ready() const { return conn_->writeRequested_; }
+        void await_suspend(std::coroutine_handle<> h) { conn_->writerHandle_ = h; }
+        void await_resume() { conn_->writeRequested_ = false; }
+    };
+    // 发送队列超过高水位时读协程暂停(对端只发PING/SETTINGS不读回应时回应不会无限堆积) 写协程排空后唤醒
+    struct OutputAwaiter
+    {
+        Http2Connection *conn_;
+
+        bool await_ready() const
+        {
+            return !conn_->conn_->connected() || conn_->conn_->pendingOutputBytes() < kHighWaterMark;
+        }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            conn_->readerHandle_ = h;
+            conn_->wakeWriter();
+        }
+        void await_resume() {}
+    };
+    // run() 结束前等待所有流协程结束
+    struct StreamsAwaiter
+    {
+        Http2Connection *conn_;
+
+        bool await_ready() const { return conn_->running_ == 0; }
+        void await_suspend(std::coroutine_handle<> h) { conn_->streamsHandle_ = h; }
+        void await_resume() {}
+    };
+
+    // 输入缓冲区里是否有一个完整的帧(或者一个已经可以判定过长的帧头)
+    static bool frameReady(Buffer *in);
+    // 处理缓冲区里所有完整的帧 发生连接错误时返回false
+    bool processFrames(Buffer *in);
+    bool handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const char *payload, size_t len);
+    bool handleData(uint8_t flags, uint32_t streamId, const char *payload, size_t len);
+    bool handleHeaders(uint8_t flags, uint32_t streamId, const char *payload, size_t len);
+    bool handleContinuation(uint8_t flags, uint32_t streamId, const char *payload, size_t len);
+    bool handleSettings(uint8_t flags, uint32_t streamId, const char *payload, size_t len);
+    bool handleWindowUpdate(uint32_t streamId, const char *payload, size_t len);
+    bool handleRstStream(uint32_t streamId, const char *payload, size_t len);
+    // 头部块收齐了 新建流或者处理trailer
+    bool finishHeaders(uint32_t streamId, uint8_t flags);
+    void endRemote(Stream *stream);
+    // 流式请求体: 处理函数读走了n字节 攒够一定量后归还流窗口
+    void creditWindow(Stream *stream, size_t n);
+    // 唤醒等待请求体的处理函数
+    void wakeBody(Stream *stream);
+    // 流被重置或者连接结束: 读请求体的处理函数得到错误
+    void failBody(Stream *stream);
+    // 处理函数返回后 缓存的和之后到达的请求体都丢弃
+    void discardBody(Stream *stream);
+    void startStream(Stream *stream);
+    AsyncTask runStream(Stream *stream);
+
+    // 写协程
+    AsyncTask writeLoop();
+    // 编码就绪流的帧 发送队列超过高水位时提前返回true
+    bool writeStreams();
+    void writeHeaders(Stream *stream);
+    // 写出一个DATA帧 受窗口限制写不出时返回false
+    bool writeData(Stream *stream);
+    // 流协程已经结束并且两个方向都关闭的流 释放
+    void reapStreams();
+
+    void appendFrameHeader(size_t len, uint8_t type, uint8_t flags, uint32_t streamId);
+    void sendSettings();
+    void sendWindowUpdate(uint32_t streamId, uint32_t increment);
+    // 流错误: 发RST_STREAM 流的状态随之关闭
+    void resetStream(uint32_t streamId, ErrorCode code);
+    // 控制帧计数 当前窗口内超过kMaxControlFrames时返回false
+    bool countControlFrame(uint8_t type);
+    // 连接错误: 发GOAWAY 之后不再处理任何帧
+    bool connectionError(ErrorCode code, const char *what);
+    void goAway(ErrorCode code);
+    void flush();
+    void wakeWriter();
+
+    HttpServer *server_;
+    TcpConnectionPtr conn_;
+    HttpParser parser_;
+    HpackDecoder decoder_;
+    HpackEncoder encoder_;
+    Buffer output_; // 待发出的帧 控制帧和响应共用
+
+    std::unordered_map<uint32_t, StreamPtr> streams_;
+    std::deque<uint32_t> sendQueue_; // 响应就绪还没发完的流 按就绪顺序轮转
+    uint32_t lastStreamId_;          // 对端开启过的最大流ID
+    size_t running_;                 // 还没结束的流协程
+
+    // 对端的设置
+    int64_t peerInitialWindow_;
+    size_t peerMaxFrameSize_;
+    int64_t connSendWindow_;
+    int64_t connRecvWindow_;
+
+    // 正在接收的头部块(HEADERS之后跟着CONTINUATION)
+    std::string headerBlock_;
+    uint32_t continuationStream_; // 0表示没有
+    uint8_t headerFlags_;
+
+    bool settingsReceived_;
+    bool peerGoAway_;
+    bool goAwaySent_;
+    bool failed_;   // 发生了连接错误
+    bool stopping_; // 读协程已经结束 写协程做完最后一轮后退出
+
+    bool writeRequested_;
+    bool wakeScheduled_;
+    std::coroutine_handle<> writerHandle_;
+    std::coroutine_handle<> streamsHandle_;
+    std::coroutine_handle<> readerHandle_; // 因发送队列过高暂停的读协程
+
+    int64_t controlWindowStart_; // 当前计数窗口的开始时间(微秒)
+    uint32_t controlFrames_;
+    std::string headerOut_; // 编码响应头部块 容量复用
+    std::string scratch_;   // 编码头部时小写化字段名
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "CoroutineSupport.h"
+
+class HttpRequest;
+class HttpResponse;
+class WorkerPool;
+
+/**
+ * HTTP响应压缩(zlib gzip/deflate) 配合HttpServer::setCompressor使用
+ *
+ * 只压缩内存中的响应体(setBody/setSharedBody): 状态200、没有Content-Encoding、Content-Type是文本类、
+ * 长度在[minLength, maxLength]之间; 文件消息体(setFileBody)不在这里压缩 静态文件用预压缩的.gz(见StaticFileHandler)
+ *
+ * 压缩结果放进按字节计容量的LRU缓存 键是 "内容标识 + 编码":
+ *   响应带ETag时用 Host + 完整的请求目标(含查询串) + ETag(静态文件的ETag由inode/大小/修改时间构成 不需要再读内容)
+ *   否则用响应体的SHA-256 内容相同的动态响应只压缩一次; 大的响应体在WorkerPool里算摘要 不占用loop线程
+ * 压不小的内容也记一个空标记 下次直接原样发送
+ * 未命中时压缩交给WorkerPool 会话协程挂起 loop继续服务其他连接; 没有WorkerPool时在loop线程里压缩
+ *
+ * 压缩后的响应带 Content-Encoding 和 Vary: Accept-Encoding 强ETag改成弱ETag(W/) 和nginx一致:
+ * 压缩后字节不同 强ETag不能复用; If-None-Match按弱比较 条件请求仍然能命中
+ * 所有接口线程安全 多个loop共享一个HttpCompressor
+ **/
+class HttpCompressor : noncopyable
+{
+public:
+    enum Encoding
+    {
+        kIdentity,
+        kGzip,
+        kDeflate
+    };
+
+    static const size_t kDefaultCacheBytes = 64 * 1024 * 1024;
+    static const size_t kDefaultMinLength = 256;
+    static const size_t kDefaultMaxLength = 4 * 1024 * 1024;
+
+    explicit HttpCompressor(WorkerPool *pool, size_t cacheBytes = kDefaultCacheBytes);
+
+    // zlib压缩级别 1~9
+    void setLevel(int level) { level_ = level; }
+    void setLengthLimits(size_t minLength, size_t maxLength)
+    {
+        minLength_ = minLength;
+        maxLength_ = maxLength;
+    }
+
+    // 便宜的检查 在loop线程里决定要不要走compress
+    bool shouldCompress(const HttpRequest &req, const HttpResponse &resp) const;
+    // 协商编码并替换响应体 只在缓存未命中时挂起
+    AsyncTask compress(const HttpRequest &req, HttpResponse &resp);
+
+    // 按Accept-Encoding选择编码(q值大的优先 相同时gzip优先) 都不接受时返回kIdentity
+    static Encoding negotiate(std::string_view acceptEncoding);
+    // Accept-Encoding是否接受enc(q=0表示拒绝 "*"匹配没有列出的编码)
+    static bool accepts(std::string_view acceptEncoding, Encoding enc);
+    static bool compressible(std::string_view contentType);
+    static const char *encodingName(Encoding enc);
+    // 一次性压缩 失败返回空
+    static std::string compressData(std::string_view data, Encoding enc, int level);
+
+    size_t cachedBytes() const;
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    struct CacheEntry
+    {
+        std::string key;
+        SharedMessage data; // 空串表示压不小
+    };
+    using EntryList = std::list<CacheEntry>;
+
+    bool lookup(const std::string &key, SharedMessage *data);
+    void insert(const std::string &key, const SharedMessage &data);
+
+    WorkerPool *pool_;
+    int level_;
+    size_t minLength_;
+    size_t maxLength_;
+
+    mutable std::mutex mutex_;
+    EntryList lru_; // 头部最近使用
+    std::unordered_map<std::string, EntryList::iterator> index_;
+    size_t cacheBytes_;
+    const size_t cacheCapacity_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+};
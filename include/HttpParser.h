@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+class Buffer;
+class HttpRequest;
+
+/**
+ * 增量式HTTP/1.x请求头解析器
+ *
+ * 每次有新数据到达就调用parse 已经扫描过的字节不会重复扫描; 找到头部结束的空行后一次性解析请求行和头部字段，
+ * 结果以偏移的形式写进HttpRequest 解析过程不分配内存 也不从Buffer中移走数据(请求头留给HttpRequest引用)
+ * 一个请求结束后调用reset 解析器可以在同一个连接上反复使用
+ *
+ * HTTP/2的请求没有请求行 由HPACK解码出的字段逐个交给addHttp2Field 字段拷贝进请求自己的存储，
+ * 伪头部(:method :scheme :path :authority)填进请求行对应的位置 :authority没有对应的host头部时补一个host
+ **/
+class HttpParser : noncopyable
+{
+public:
+    enum Result
+    {
+        kIncomplete,
+        kComplete,
+        kError
+    };
+
+    static const size_t kMaxHeaderBytes = 64 * 1024; // 请求行+头部的上限 超过返回431
+
+    HttpParser() { reset(); }
+
+    Result parse(Buffer *buf, HttpRequest *req);
+    void reset()
+    {
+        scanned_ = 0;
+        errorStatus_ = 0;
+    }
+    // kError时应该回给客户端的状态码 400/431/501/505
+    int errorStatus() const { return errorStatus_; }
+
+    // ================= HTTP/2 =================
+
+    // 开始一个新请求 conn必须在请求的整个生命期内有效
+    void beginHttp2(HttpRequest *req, const TcpConnectionPtr *conn);
+    // 返回false表示请求不合法: errorStatus()非0时应该回这个状态码(431/501) 为0时是畸形请求(RFC 9113 8.1.1 按流错误处理)
+    // 出错后剩下的字段不必再传进来 但头部块仍然要解码完(HPACK状态)
+    bool addHttp2Field(std::string_view name, std::string_view value, HttpRequest *req);
+    // 所有字段都已经传入 检查必需的伪头部 拆分path和query
+    bool endHttp2Fields(HttpRequest *req);
+
+private:
+    bool parseHead(const char *begin, size_t len, HttpRequest *req);
+    bool parseRequestLine(const char *begin, const char *end, HttpRequest *req);
+    bool parseHeader(const char *begin, const char *lineBegin, const char *lineEnd, HttpRequest *req);
+    bool fail(int status)
+    {
+        errorStatus_ = status;
+        return false;
+    }
+
+    size_t scanned_; // 已经确认不含头部结束标记的字节数
+    int errorStatus_;
+
+    // HTTP/2
+    bool regularSeen_;        // 出现过普通字段 之后不能再有伪头部
+    unsigned pseudoSeen_;     // 出现过的伪头部
+    std::string cookies_;     // 拆开发送的cookie字段 最后用"; "拼成一个(RFC 9113 8.2.3)
+    size_t authority_;        // :authority在headStorage_里的位置
+    size_t authorityLen_;
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "TcpConnection.h"
+
+class Buffer;
+class HttpParser;
+class Http2Connection;
+
+/**
+ * 一个HTTP请求 HTTP/1.x由HttpParser在连接的输入缓冲区上解析得到
+ *
+ * 不拷贝: 请求行和头部字段都记录为相对请求头起点的偏移 取值时返回指向输入缓冲区的string_view，
+ * 请求处理完之前请求头一直留在输入缓冲区里 缓冲区扩容搬移也不影响(偏移不变)
+ * 开始流式读取请求体时 请求头被复制到请求自己的存储里(每个连接复用同一个HttpRequest 容量不会反复分配)
+ *
+ * 请求体:
+ *   - HttpServer::setHttpCallback 的同步处理函数: 调用前已经完整读入 body() 直接可用
+ *   - HttpServer::setHandler 的协程处理函数: 按块流式读取 不会把整个请求体放进内存
+ *       while (true) { std::string_view chunk = co_await req.readBody(); if (chunk.empty()) break; ... }
+ *     chunk在下一次readBody之前有效 结束或出错时返回空 用bodyError()区分
+ * HTTP/2: 头部由HPACK解码后存放在请求自己的存储里
+ *   - 同步处理函数: 请求体在调用之前已经完整收齐(上限maxBodySize) body() 直接可用
+ *   - 协程处理函数: 收到HEADERS就调用 readBody() 返回到目前为止收到的DATA 没有时挂起等待，
+ *     流量控制窗口在处理函数读走数据之后才归还 对端最多领先一个窗口(Http2Connection::kStreamWindow)
+ *     处理函数读得慢 客户端就发得慢 每个上传占用的内存有上限
+ * 所有接口在连接所属loop线程使用
+ **/
+class HttpRequest : noncopyable
+{
+public:
+    enum Method
+    {
+        kInvalid,
+        kGet,
+        kPost,
+        kHead,
+        kPut,
+        kDelete,
+        kOptions,
+        kPatch,
+        kConnect,
+        kTrace
+    };
+    enum Version
+    {
+        kUnknown,
+        kHttp10,
+        kHttp11,
+        kHttp20
+    };
+
+    static const size_t kMaxHeaders = 64;
+
+    HttpRequest();
+
+    Method method() const { return method_; }
+    Version version() const { return version_; }
+    std::string_view methodString() const { return view(methodSpan_); }
+    // 请求目标的原始形式 path不含查询串 query不含'?'
+    std::string_view target() const { return view(targetSpan_); }
+    std::string_view path() const { return view(pathSpan_); }
+    std::string_view query() const { return view(querySpan_); }
+
+    // 按名字查找头部(不区分大小写) 没有时返回空
+    std::string_view header(std::string_view name) const;
+    bool hasHeader(std::string_view name) const;
+    size_t headerCount() const { return headerCount_; }
+    std::string_view headerName(size_t i) const { return view(headers_[i].name); }
+    std::string_view headerValue(size_t i) const { return view(headers_[i].value); }
+
+    bool keepAlive() const { return keepAlive_; }
+    bool chunked() const { return chunked_; }
+    // 没有Content-Length时为-1
+    int64_t contentLength() const { return contentLength_; }
+    bool expectContinue() const { return expectContinue_; }
+    bool hasBody() const { return chunked_ || contentLength_ > 0 || memoryStream_ || (memoryBody_ && !bodyStorage_.empty()); }
+
+    // 完整读入的请求体(同步处理函数)
+    std::string_view body() const;
+    bool bodyError() const { return bodyState_ == kBodyError; }
+    bool bodyComplete() const { return bodyState_ == kBodyDone; }
+
+    // HTTP/2的请求不直接关联连接(帧由Http2Connection收发) 此时connection()不可用
+    bool hasConnection() const { return conn_ != nullptr; }
+    const TcpConnectionPtr &connection() const { return *conn_; }
+
+    // 流式读取请求体的下一块
+    struct BodyAwaiter
+    {
+        HttpRequest *req_;
+        TcpConnection::ReadUntilAwaiter read_;
+
+        explicit BodyAwaiter(HttpRequest *req);
+
+        // HTTP/2的请求体由Http2Connection放进内存 不能碰连接的输入缓冲区(那里是其他流的帧)
+        bool await_ready() { return req_->memoryBody_ ? req_->memoryBodyReady() : read_.await_ready(); }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            if (req_->memoryBody_)
+            {
+                req_->bodyWaiter_ = h; // Http2Connection只在memoryBodyReady()时唤醒
+            }
+            else
+            {
+                read_.await_suspend(h);
+            }
+        }
+        std::string_view await_resume();
+    };
+    BodyAwaiter readBody() { return BodyAwaiter(this); }
+
+private:
+    friend class HttpParser;
+    friend class HttpServer;
+    friend class Http2Connection;
+
+    struct Span
+    {
+        uint32_t offset = 0;
+        uint32_t len = 0;
+    };
+    struct Header
+    {
+        Span name;
+        Span value;
+    };
+    enum BodyState
+    {
+        kBodyNone,      // 还没开始读请求体
+        kBodyStreaming, // 正在流式读取
+        kBodyBuffered,  // 同步处理函数: 请求体完整地放在输入缓冲区/bodyStorage_中
+        kBodyDone,
+        kBodyError
+    };
+    enum ChunkState
+    {
+        kChunkSize,
+        kChunkData,
+        kChunkDataEnd,
+        kChunkTrailer
+    };
+    enum PollResult
+    {
+        kPollChunk,
+        kPollEnd,
+        kPollNeedMore,
+        kPollError
+    };
+
+    const char *base() const { return detached_ ? headStorage_.data() : input_->peek(); }
+    std::string_view view(Span s) const { return std::string_view(base() + s.offset, s.len); }
+
+    // HttpServer调用: 新请求开始前复位 绑定到连接
+    void reset(const TcpConnectionPtr *conn);
+    // 请求处理结束 把请求头和已经读过的请求体从输入缓冲区移走
+    void finish();
+    // 转入流式读取: 请求头复制到headStorage_ 从输入缓冲区移走 之后输入缓冲区的开头就是请求体
+    void beginBodyStream();
+    // 从输入缓冲区取出下一块请求体 结果放在lastChunk_
+    PollResult pollBody(Buffer *in);
+    // HTTP/2: 有数据可读、已经结束或者出错
+    bool memoryBodyReady() const
+    {
+        return !memoryStream_ || bodyState_ != kBodyStreaming || !bodyStorage_.empty() || bodyEnded_;
+    }
+
+    const TcpConnectionPtr *conn_;
+    Buffer *input_;
+    bool detached_;
+    bool memoryBody_; // HTTP/2: 请求头在headStorage_ 请求体在bodyStorage_ 都不在输入缓冲区
+    bool memoryStream_; // HTTP/2协程处理函数: 请求体边收边读 Http2Connection把DATA追加进bodyStorage_
+    std::string headStorage_;
+    size_t headBytes_; // 请求头(含结尾空行)的字节数
+
+    Method method_;
+    Version version_;
+    Span methodSpan_;
+    Span targetSpan_;
+    Span pathSpan_;
+    Span querySpan_;
+    std::array<Header, kMaxHeaders> headers_;
+    size_t headerCount_;
+
+    int64_t contentLength_;
+    bool chunked_;
+    bool keepAlive_;
+    bool expectContinue_;
+    bool continueSent_;
+
+    BodyState bodyState_;
+    ChunkState chunkState_;
+    uint64_t bodyRemaining_;  // Content-Length剩余 或者当前chunk剩余
+    size_t pendingConsume_;   // 上一次交出去的chunk 下一次读之前从输入缓冲区移走
+    PollResult lastPoll_;
+    std::string_view lastChunk_;
+    std::string bodyStorage_; // chunked请求体交给同步处理函数时的解码结果 / HTTP/2的请求体
+    // HTTP/2流式请求体: 读取时和bodyStorage_交换 交出去的块在下一次readBody之前不会被新的DATA覆盖
+    std::string bodyChunk_;
+    bool bodyEnded_; // 对端已经发完(END_STREAM)
+    std::coroutine_handle<> bodyWaiter_;
+    std::function<void(size_t)> bodyConsumed_; // 处理函数读完一块 归还流量控制窗口
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+class Buffer;
+
+/**
+ * HTTP响应 处理函数填好之后由HttpServer序列化进连接的输出缓冲区
+ * 头部字段按 "Name: Value\r\n" 直接拼在一个字符串里 每个连接复用同一个HttpResponse，
+ * 稳定运行后不再分配内存 Content-Length和Connection由HttpServer根据body和keep-alive状态生成
+ *
+ * 消息体三种来源 互斥 后设置的生效:
+ *   setBody/appendBody  拷贝进输出缓冲区
+ *   setSharedBody       共享的不可变消息 写完响应头后用sendShared按引用发送(内存缓存的小文件)
+ *   setFileBody         文件的一段 写完响应头后用sendFile零拷贝发送 owner保证发送期间fd不被关闭
+ **/
+class HttpResponse : noncopyable
+{
+public:
+    enum StatusCode
+    {
+        kUnknown = 0,
+        k101SwitchingProtocols = 101,
+        k200Ok = 200,
+        k204NoContent = 204,
+        k206PartialContent = 206,
+        k301MovedPermanently = 301,
+        k302Found = 302,
+        k304NotModified = 304,
+        k400BadRequest = 400,
+        k403Forbidden = 403,
+        k404NotFound = 404,
+        k405MethodNotAllowed = 405,
+        k413PayloadTooLarge = 413,
+        k416RangeNotSatisfiable = 416,
+        k426UpgradeRequired = 426,
+        k431HeaderFieldsTooLarge = 431,
+        k500InternalServerError = 500,
+        k501NotImplemented = 501,
+        k503ServiceUnavailable = 503,
+        k505VersionNotSupported = 505
+    };
+
+    HttpResponse() { reset(false); }
+
+    void reset(bool close);
+
+    void setStatusCode(int code) { statusCode_ = code; }
+    int statusCode() const { return statusCode_; }
+    // 不设置时使用状态码的标准描述
+    void setStatusMessage(std::string_view message) { statusMessage_.assign(message); }
+
+    void setCloseConnection(bool on) { closeConnection_ = on; }
+    bool closeConnection() const { return closeConnection_; }
+
+    void setContentType(std::string_view contentType) { addHeader("Content-Type", contentType); }
+    void addHeader(std::string_view name, std::string_view value);
+    // 按名字查找已经添加的头部(不区分大小写) 没有时返回空
+    std::string_view header(std::string_view name) const;
+    // 移除所有同名头部 返回是否移除了
+    bool removeHeader(std::string_view name);
+
+    void setBody(std::string_view body)
+    {
+        clearExternalBody();
+        body_.assign(body);
+    }
+    void appendBody(std::string_view data) { body_.append(data); }
+    std::string &body() { return body_; }
+
+    void setSharedBody(SharedMessage body);
+    void setFileBody(int fd, off_t offset, size_t length, std::shared_ptr<const void> owner);
+    const SharedMessage &sharedBody() const { return sharedBody_; }
+    bool hasFileBody() const { return fileFd_ >= 0; }
+    int fileFd() const { return fileFd_; }
+    off_t fileOffset() const { return fileOffset_; }
+    // 消息体的字节数 即Content-Length
+    size_t bodyLength() const;
+
+    // HEAD请求只写头部 Content-Length仍然是body的长度
+    // 共享消息体/文件消息体不写进output 由调用方随后发送
+    void appendToBuffer(Buffer *output, bool headOnly = false) const;
+
+    static const char *reasonPhrase(int code);
+
+private:
+    friend class Http2Connection; // 逐行读取headers_编码成HPACK
+
+    void clearExternalBody();
+
+    int statusCode_;
+    std::string statusMessage_;
+    bool closeConnection_;
+    std::string headers_;
+    std::string body_;
+    SharedMessage sharedBody_;
+    int fileFd_;
+    off_t fileOffset_;
+    size_t fileLength_;
+    std::shared_ptr<const void> fileOwner_;
+};
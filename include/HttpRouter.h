@@ -0,0 +1,591 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "noncopyable.h"
+#include "CoroutineSupport.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+namespace route_detail
+{
+struct Matcher;
+}
+
+/**
+ * 路径参数 值是指向请求路径(连接输入缓冲区)的string_view 没有拷贝也没有百分号解码
+ * 只在处理函数执行期间有效 协程处理函数跨co_await使用时请求对象必须还活着(HttpServer保证)
+ **/
+class RouteParams
+{
+public:
+    static constexpr size_t kMaxParams = 8;
+
+    // 不初始化values_ 匹配在热路径上 只有前count_个有效
+    RouteParams() : names_(nullptr), count_(0) {}
+
+    size_t size() const { return count_; }
+    std::string_view operator[](size_t i) const { return values_[i]; }
+    std::string_view name(size_t i) const { return names_[i]; }
+    // 按名字查找 没有时返回空
+    std::string_view get(std::string_view name) const;
+    // {name:int}参数 匹配时已经校验过是1~18位十进制数字 不会溢出
+    int64_t integer(size_t i) const;
+    int64_t integer(std::string_view name) const;
+
+private:
+    union
+    {
+        std::string_view values_[kMaxParams];
+    };
+    const std::string_view *names_;
+    size_t count_;
+
+    friend struct route_detail::Matcher;
+};
+
+struct RouteMatch
+{
+    int route = -1;         // 路由表里的下标 -1表示没有匹配
+    uint16_t allowMask = 0; // 没有匹配时: 路径匹配上但是方法不对的路由覆盖的方法(1 << Method) 非0应该回405
+    RouteParams params;
+
+    bool found() const { return route >= 0; }
+};
+
+namespace route_detail
+{
+
+constexpr size_t kMethodCount = HttpRequest::kTrace + 1;
+constexpr size_t kMaxRoutes = 0xfffe;
+constexpr size_t kMaxIntDigits = 18;
+
+// 扁平化之后的trie节点 下标0是根 子节点/路由编号用0表示没有(路由编号存的是下标+1)
+// 静态子节点在edges[edgeBegin, edgeBegin + edgeCount) 按(长度, 内容)排序
+struct Node
+{
+    uint16_t edgeBegin = 0;
+    uint16_t edgeCount = 0;
+    uint16_t paramChild = 0;           // {name}
+    uint16_t intChild = 0;             // {name:int}
+    uint16_t methodMask = 0;           // 在这个节点结束的路由覆盖的方法
+    uint16_t tailMask = 0;             // 在这个节点以{name*}结束的路由覆盖的方法
+    uint16_t routes[kMethodCount] = {};
+    uint16_t tailRoutes[kMethodCount] = {};
+};
+
+struct Edge
+{
+    std::string_view segment;
+    uint16_t child = 0;
+};
+
+// 匹配需要的全部数据 编译期路由表和运行时路由表都扁平化成这个形状 共用一个匹配函数
+struct TableView
+{
+    const Node *nodes;
+    const Edge *edges;
+    const std::string_view *names;   // 所有路由的参数名 按路由顺序拼在一起
+    const uint16_t *nameOffsets;     // 第i个路由的参数名从names[nameOffsets[i]]开始
+};
+
+struct Matcher
+{
+    static RouteMatch match(const TableView &table, HttpRequest::Method method, std::string_view path);
+};
+
+// 没有匹配时填好404或者405(带Allow)
+void respondUnmatched(const RouteMatch &m, HttpResponse *resp);
+
+// 编译期构造路由表时出错会落到这个函数上(它不是constexpr) 编译错误的调用链指出是哪一个路由
+void invalidRoute(const char *why);
+
+enum SegmentKind : uint8_t
+{
+    kStatic,
+    kParam,
+    kIntParam,
+    kTail
+};
+
+struct Segment
+{
+    SegmentKind kind = kStatic;
+    std::string_view text; // 静态段的内容 或者参数名
+};
+
+constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// 解析一个模式段 s不含'/' 出错返回错误描述
+constexpr const char *parseSegment(std::string_view s, Segment *seg)
+{
+    if (!s.empty() && s.front() == '{')
+    {
+        if (s.back() != '}' || s.size() < 3)
+        {
+            return "bad parameter segment";
+        }
+        std::string_view name = s.substr(1, s.size() - 2);
+        seg->kind = kParam;
+        if (name.back() == '*')
+        {
+            seg->kind = kTail;
+            name.remove_suffix(1);
+        }
+        else if (name.size() > 4 && name.substr(name.size() - 4) == ":int")
+        {
+            seg->kind = kIntParam;
+            name.remove_suffix(4);
+        }
+        if (name.empty())
+        {
+            return "empty parameter name";
+        }
+        for (char c : name)
+        {
+            if (!(isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'))
+            {
+                return "bad parameter name";
+            }
+        }
+        seg->text = name;
+        return nullptr;
+    }
+    for (char c : s)
+    {
+        if (c == '{' || c == '}' || c == '?' || c == '#')
+        {
+            return "bad character in static segment";
+        }
+    }
+    seg->kind = kStatic;
+    seg->text = s;
+    return nullptr;
+}
+
+// 构造路由表 节点用vector保存 之后扁平化进定长数组(编译期)或者vector(运行时)
+// 编译期使用时vector只在常量求值期间存在(C++20 transient allocation)
+class Builder
+{
+public:
+    constexpr Builder() : nodes_(1) {}
+
+    // 路由编号按add的顺序从0开始 成功返回nullptr
+    constexpr const char *add(HttpRequest::Method method, std::string_view pattern)
+    {
+        if (method <= HttpRequest::kInvalid || method >= static_cast<int>(kMethodCount))
+        {
+            return "bad method";
+        }
+        if (pattern.empty() || pattern.front() != '/')
+        {
+            return "pattern must start with '/'";
+        }
+        if (routeCount_ >= kMaxRoutes)
+        {
+            return "too many routes";
+        }
+        size_t route = routeCount_;
+        nameOffsets_.push_back(static_cast<uint16_t>(names_.size()));
+
+        size_t node = 0;
+        bool tail = false;
+        size_t params = 0;
+        // "/" 没有段 "/a/" 是 "a" 和一个空段
+        std::string_view rest = pattern.substr(1);
+        bool done = rest.empty();
+        while (!done)
+        {
+            size_t slash = rest.find('/');
+            std::string_view s = rest.substr(0, slash);
+            if (slash == std::string_view::npos)
+            {
+                done = true;
+            }
+            else
+            {
+                rest = rest.substr(slash + 1);
+            }
+
+            Segment seg;
+            if (const char *err = parseSegment(s, &seg))
+            {
+                return err;
+            }
+            if (seg.kind != kStatic)
+            {
+                if (++params > RouteParams::kMaxParams)
+                {
+                    return "too many parameters";
+                }
+                names_.push_back(seg.text);
+            }
+            if (seg.kind == kTail)
+            {
+                if (!done)
+                {
+                    return "{name*} must be the last segment";
+                }
+                tail = true;
+                break;
+            }
+            if (nodes_.size() >= kMaxRoutes)
+            {
+                return "too many nodes";
+            }
+            node = child(node, seg);
+        }
+
+        uint16_t *slot = tail ? &nodes_[node].tailRoutes[method] : &nodes_[node].routes[method];
+        if (*slot != 0)
+        {
+            return "duplicate route";
+        }
+        *slot = static_cast<uint16_t>(route + 1);
+        (tail ? nodes_[node].tailMask : nodes_[node].methodMask) |= static_cast<uint16_t>(1u << method);
+        ++routeCount_;
+        return nullptr;
+    }
+
+    constexpr size_t nodeCount() const { return nodes_.size(); }
+    constexpr size_t edgeCount() const
+    {
+        size_t n = 0;
+        for (const BuildNode &node : nodes_)
+        {
+            n += node.statics.size();
+        }
+        return n;
+    }
+    constexpr size_t nameCount() const { return names_.size(); }
+    constexpr size_t routeCount() const { return routeCount_; }
+
+    // 输出数组的大小分别是 nodeCount() edgeCount() nameCount() routeCount()+1
+    // 子节点总是比父节点后创建 节点按创建顺序输出就是按层次 只需要把每个节点的静态边排好序连续存放
+    constexpr void flatten(Node *nodes, Edge *edges, std::string_view *names, uint16_t *nameOffsets) const
+    {
+        size_t e = 0;
+        for (size_t i = 0; i < nodes_.size(); ++i)
+        {
+            const BuildNode &b = nodes_[i];
+            Node &n = nodes[i];
+            n.edgeBegin = static_cast<uint16_t>(e);
+            n.edgeCount = static_cast<uint16_t>(b.statics.size());
+            n.paramChild = static_cast<uint16_t>(b.param);
+            n.intChild = static_cast<uint16_t>(b.intParam);
+            n.methodMask = b.methodMask;
+            n.tailMask = b.tailMask;
+            for (size_t m = 0; m < kMethodCount; ++m)
+            {
+                n.routes[m] = b.routes[m];
+                n.tailRoutes[m] = b.tailRoutes[m];
+            }
+            for (const Edge &edge : b.statics)
+            {
+                edges[e++] = edge;
+            }
+            std::sort(edges + n.edgeBegin, edges + e, edgeLess);
+        }
+        for (size_t i = 0; i < names_.size(); ++i)
+        {
+            names[i] = names_[i];
+        }
+        for (size_t i = 0; i < routeCount_; ++i)
+        {
+            nameOffsets[i] = nameOffsets_[i];
+        }
+        nameOffsets[routeCount_] = static_cast<uint16_t>(names_.size());
+    }
+
+    static constexpr bool edgeLess(const Edge &a, const Edge &b)
+    {
+        return a.segment.size() != b.segment.size() ? a.segment.size() < b.segment.size() : a.segment < b.segment;
+    }
+
+private:
+    struct BuildNode
+    {
+        std::vector<Edge> statics;
+        size_t param = 0;
+        size_t intParam = 0;
+        uint16_t methodMask = 0;
+        uint16_t tailMask = 0;
+        uint16_t routes[kMethodCount] = {};
+        uint16_t tailRoutes[kMethodCount] = {};
+    };
+
+    // 找到或者创建子节点 参数名不影响树的形状 "/a/{x}"和"/a/{y}"走同一个节点
+    constexpr size_t child(size_t node, const Segment &seg)
+    {
+        if (seg.kind == kStatic)
+        {
+            for (const Edge &edge : nodes_[node].statics)
+            {
+                if (edge.segment == seg.text)
+                {
+                    return edge.child;
+                }
+            }
+        }
+        else
+        {
+            size_t existing = seg.kind == kParam ? nodes_[node].param : nodes_[node].intParam;
+            if (existing != 0)
+            {
+                return existing;
+            }
+        }
+        size_t created = nodes_.size();
+        nodes_.emplace_back();
+        if (seg.kind == kStatic)
+        {
+            nodes_[node].statics.push_back(Edge{seg.text, static_cast<uint16_t>(created)});
+        }
+        else if (seg.kind == kParam)
+        {
+            nodes_[node].param = created;
+        }
+        else
+        {
+            nodes_[node].intParam = created;
+        }
+        return created;
+    }
+
+    std::vector<BuildNode> nodes_;
+    std::vector<std::string_view> names_;
+    std::vector<uint16_t> nameOffsets_;
+    size_t routeCount_ = 0;
+};
+
+} // namespace route_detail
+
+/**
+ * 编译期路由表的一项 处理函数是函数指针(不捕获的lambda可以直接转换)
+ *   Callback 同步处理 和HttpServer::setHttpCallback一样请求体已经完整读入
+ *   Handler  协程处理 和HttpServer::setHandler一样
+ **/
+struct HttpRoute
+{
+    using Callback = void (*)(const HttpRequest &, HttpResponse *, const RouteParams &);
+    using Handler = AsyncTask (*)(HttpRequest &, HttpResponse &, const RouteParams &);
+
+    constexpr HttpRoute(HttpRequest::Method m, std::string_view p, Callback cb)
+        : method(m), pattern(p), callback(cb), handler(nullptr)
+    {
+    }
+    constexpr HttpRoute(HttpRequest::Method m, std::string_view p, Handler h)
+        : method(m), pattern(p), callback(nullptr), handler(h)
+    {
+    }
+
+    HttpRequest::Method method;
+    std::string_view pattern;
+    Callback callback;
+    Handler handler;
+};
+
+namespace route_detail
+{
+
+// 类内静态成员的初始化式里不能调用还没有定义完的成员函数 所以放在类外
+template <const auto &Routes>
+constexpr Builder buildRoutes()
+{
+    Builder b;
+    for (const HttpRoute &r : Routes)
+    {
+        if ((r.callback == nullptr) == (r.handler == nullptr))
+        {
+            invalidRoute("route needs exactly one handler");
+        }
+        if (const char *err = b.add(r.method, r.pattern))
+        {
+            invalidRoute(err);
+        }
+    }
+    return b;
+}
+
+} // namespace route_detail
+
+/**
+ * 编译期路由 路由表是一个constexpr HttpRoute数组 作为模板参数传入
+ *
+ * 模式按'/'切成段:
+ *   users        静态段 逐字节比较
+ *   {id}         任意非空段
+ *   {id:int}     1~18位十进制数字 不是数字时这条路由不匹配(继续尝试别的路由)
+ *   {path*}      剩下的整个路径(可以为空) 只能是最后一段
+ * "/"没有段 "/a/"和"/a"是不同的路径 路径按原样匹配 不做百分号解码和 "//" "." 的规范化
+ *
+ * 路由表在编译期构造成按段分叉的trie 扁平化进静态数组: 节点里的静态子节点按(长度, 内容)排好序，
+ * 参数子节点和每个方法的路由编号直接存在节点里; 匹配时每段先比较长度再比较内容，方法是数组下标，
+ * 不分配内存 不做哈希 路由数量只影响静态子节点的查找(少时线性 多时二分)
+ * 优先级: 静态段 > {x:int} > {x} > {x*} 优先级高的分支匹配不下去时回溯尝试下一个
+ * HEAD请求没有HEAD路由时使用GET路由(HttpServer不发送HEAD的响应体) 路径匹配但方法不匹配时回405和Allow
+ * 重复的路由、非法的模式在编译期报错(错误落在route_detail::invalidRoute上 调用链指出是哪一项)
+ *
+ * 用法:
+ *   void getUser(const HttpRequest &req, HttpResponse *resp, const RouteParams &p) { ... p.integer(0) ... }
+ *   AsyncTask upload(HttpRequest &req, HttpResponse &resp, const RouteParams &p) { ... co_await req.readBody() ... }
+ *   constexpr HttpRoute kRoutes[] = {
+ *       {HttpRequest::kGet, "/users/{id:int}", getUser},
+ *       {HttpRequest::kPost, "/files/{path*}", upload},
+ *   };
+ *   using Router = StaticHttpRouter<kRoutes>;
+ *   server.setHandler(Router::dispatch);
+ *   // 路由全部是同步处理函数时也可以: server.setHttpCallback(Router::handle);
+ *
+ * 路由需要在运行时才能确定(配置文件、插件)时用HttpRouter 两者匹配规则相同
+ **/
+template <const auto &Routes>
+class StaticHttpRouter
+{
+public:
+    static constexpr size_t kRouteCount = std::size(Routes);
+    static constexpr bool kAllSync = [] {
+        for (const HttpRoute &r : Routes)
+        {
+            if (r.callback == nullptr)
+            {
+                return false;
+            }
+        }
+        return true;
+    }();
+
+    static RouteMatch match(HttpRequest::Method method, std::string_view path)
+    {
+        return route_detail::Matcher::match(view(), method, path);
+    }
+
+    // 同步分发 没有匹配时填好404/405返回false 调用方可以改成自己的响应
+    static bool handle(const HttpRequest &req, HttpResponse *resp)
+        requires kAllSync
+    {
+        RouteMatch m = match(req.method(), req.path());
+        if (!m.found())
+        {
+            route_detail::respondUnmatched(m, resp);
+            return false;
+        }
+        Routes[m.route].callback(req, resp, m.params);
+        return true;
+    }
+
+    // 协程分发 可以直接作为HttpServer的处理函数
+    static AsyncTask dispatch(HttpRequest &req, HttpResponse &resp)
+    {
+        RouteMatch m = match(req.method(), req.path());
+        if (!m.found())
+        {
+            route_detail::respondUnmatched(m, &resp);
+            co_return;
+        }
+        const HttpRoute &r = Routes[m.route];
+        if (r.callback)
+        {
+            r.callback(req, &resp, m.params);
+        }
+        else
+        {
+            co_await r.handler(req, resp, m.params);
+        }
+    }
+
+private:
+    struct Sizes
+    {
+        size_t nodes;
+        size_t edges;
+        size_t names;
+    };
+
+    // 先构造一次得到各个数组的大小 再构造一次填进定长数组 vector都在常量求值期间释放
+    static constexpr Sizes kSizes = [] {
+        route_detail::Builder b = route_detail::buildRoutes<Routes>();
+        return Sizes{b.nodeCount(), b.edgeCount(), b.nameCount()};
+    }();
+
+    struct Table
+    {
+        std::array<route_detail::Node, kSizes.nodes> nodes;
+        std::array<route_detail::Edge, kSizes.edges> edges;
+        std::array<std::string_view, kSizes.names> names;
+        std::array<uint16_t, kRouteCount + 1> nameOffsets;
+    };
+
+    static constexpr Table kTable = [] {
+        Table t{};
+        route_detail::buildRoutes<Routes>().flatten(t.nodes.data(), t.edges.data(), t.names.data(), t.nameOffsets.data());
+        return t;
+    }();
+
+    static route_detail::TableView view()
+    {
+        return route_detail::TableView{kTable.nodes.data(), kTable.edges.data(), kTable.names.data(),
+                                       kTable.nameOffsets.data()};
+    }
+};
+
+/**
+ * 运行时注册的路由 模式语法、匹配规则和StaticHttpRouter相同 匹配用的也是同一份扁平化的表
+ * 每次add之后重建扁平表 路由必须在服务器启动前注册完 之后只读 多个loop线程可以同时匹配
+ * 模式非法或者重复时LOG_FATAL
+ * 用法:
+ *   HttpRouter router;
+ *   router.add(HttpRequest::kGet, "/users/{id:int}", [](const HttpRequest &req, HttpResponse *resp, const RouteParams &p) { ... });
+ *   server.setHandler([&router](HttpRequest &req, HttpResponse &resp) { return router.dispatch(req, resp); });
+ **/
+class HttpRouter : noncopyable
+{
+public:
+    using Callback = std::function<void(const HttpRequest &, HttpResponse *, const RouteParams &)>;
+    using Handler = std::function<AsyncTask(HttpRequest &, HttpResponse &, const RouteParams &)>;
+
+    HttpRouter();
+
+    void add(HttpRequest::Method method, std::string_view pattern, Callback cb);
+    void add(HttpRequest::Method method, std::string_view pattern, Handler handler);
+
+    size_t size() const { return routes_.size(); }
+
+    RouteMatch match(HttpRequest::Method method, std::string_view path) const
+    {
+        return route_detail::Matcher::match(view_, method, path);
+    }
+
+    // 同步分发 匹配到协程处理函数时回500 没有匹配时填好404/405返回false
+    bool handle(const HttpRequest &req, HttpResponse *resp) const;
+    AsyncTask dispatch(HttpRequest &req, HttpResponse &resp) const;
+
+private:
+    struct Entry
+    {
+        Callback callback;
+        Handler handler;
+    };
+
+    void addPattern(HttpRequest::Method method, std::string_view pattern);
+    // 由builder_重新生成扁平表
+    void rebuild();
+
+    std::deque<std::string> patterns_; // Builder和扁平表里的string_view指向这里 deque追加不移动元素
+    route_detail::Builder builder_;
+    std::vector<Entry> routes_;
+    std::vector<route_detail::Node> nodes_;
+    std::vector<route_detail::Edge> edges_;
+    std::vector<std::string_view> names_;
+    std::vector<uint16_t> nameOffsets_;
+    route_detail::TableView view_;
+};
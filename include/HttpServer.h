@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <functional>
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+#include "CoroutineSupport.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+class TlsContext;
+class HttpCompressor;
+class WebSocket;
+class Http2Connection;
+
+/**
+ * 构建在TcpServer和协程读接口之上的HTTP/1.1服务器
+ *
+ * 每个连接一个会话协程: 增量解析请求头(HttpParser 不拷贝) => 调用处理函数 => 响应按请求顺序写回
+ * keep-alive: HTTP/1.1默认保持 HTTP/1.0需要Connection: keep-alive
+ * pipelining: 输入缓冲区里已经到齐的请求连续处理 响应先攒在一起 需要等待新数据时才一次性发出
+ *
+ * 两种处理函数 二选一:
+ *   setHttpCallback(void(const HttpRequest&, HttpResponse*))  同步处理 请求体已经完整读入(上限maxBodySize)
+ *   setHandler(AsyncTask(HttpRequest&, HttpResponse&))       协程处理 可以co_await任何东西 请求体用req.readBody()流式读取
+ *                                                            处理函数没读完的请求体由服务器读掉丢弃
+ * WebSocket: setWebSocketHandler之后 升级请求由服务器完成握手(101) 连接交给WebSocket处理函数 不再回到HTTP;
+ *            处理函数返回时服务器发送close帧(如果还没发)并关闭连接
+ * HTTP/2: 连接以HTTP/2前言开头时(h2c prior knowledge)交给Http2Connection 每个流是一个独立的协程，
+ *         处理函数和HTTP/1.1相同 同一个连接上的请求并发执行 见Http2Connection
+ * 用法:
+ *   HttpServer server(&loop, InetAddress(8080), "http");
+ *   server.setHttpCallback([](const HttpRequest &req, HttpResponse *resp) { resp->setBody("hello"); });
+ *   server.setThreadNum(4);
+ *   server.start();
+ **/
+class HttpServer : noncopyable
+{
+public:
+    using HttpCallback = std::function<void(const HttpRequest &, HttpResponse *)>;
+    using HttpHandler = std::function<AsyncTask(HttpRequest &, HttpResponse &)>;
+    // req在整个WebSocket会话期间有效(请求头已经复制出输入缓冲区) 可以按path/query区分
+    using WebSocketHandler = std::function<AsyncTask(HttpRequest &, WebSocket &)>;
+
+    static const size_t kDefaultMaxBodySize = 8 * 1024 * 1024;
+    static const size_t kMaxPendingOutput = 64 * 1024; // pipelining时攒下的响应超过它就先发出去 发送队列超过它时等发完再读下一个请求
+    static constexpr double kDefaultHeaderTimeout = 30.0;
+    static constexpr double kDefaultIdleTimeout = 60.0;
+
+    HttpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name);
+
+    TcpServer &tcpServer() { return server_; }
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+
+    void setHttpCallback(const HttpCallback &cb) { httpCallback_ = cb; }
+    void setHandler(const HttpHandler &handler) { handler_ = handler; }
+    void setWebSocketHandler(const WebSocketHandler &handler) { webSocketHandler_ = handler; }
+
+    // 同步处理函数能接受的最大请求体 也是协程处理函数返回后替它丢弃请求体的上限 超过时返回413并关闭连接
+    void setMaxBodySize(size_t bytes) { maxBodySize_ = bytes; }
+    // keep-alive连接上两次请求之间的最长空闲时间 超时后直接关闭连接 默认60秒 <=0 表示不限制
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+    // 收到请求的第一批数据之后 请求头必须在这段时间内收全 否则关闭连接(防止慢速发送请求头占住连接) <=0 表示不限制
+    void setHeaderTimeout(double seconds) { headerTimeout_ = seconds; }
+    // 设置后连接建立时先做TLS握手(HTTPS) ctx由调用方持有
+    void setTlsContext(TlsContext *ctx) { tlsContext_ = ctx; }
+    // 设置后按Accept-Encoding压缩合适的响应(见HttpCompressor) compressor由调用方持有 可以被多个服务器共享
+    void setCompressor(HttpCompressor *compressor) { compressor_ = compressor; }
+    // 是否接受HTTP/2(h2c prior knowledge) 默认接受
+    void setHttp2(bool on) { http2_ = on; }
+
+    void start() { server_.start(); }
+
+private:
+    friend class Http2Connection;
+
+    void onConnection(const TcpConnectionPtr &conn);
+    Task session(TcpConnectionPtr conn);
+    AsyncTask webSocketSession(TcpConnectionPtr conn, HttpRequest &req);
+    void sendError(const TcpConnectionPtr &conn, Buffer *output, int status);
+
+    TcpServer server_;
+    HttpCallback httpCallback_;
+    HttpHandler handler_;
+    WebSocketHandler webSocketHandler_;
+    size_t maxBodySize_;
+    double idleTimeout_;
+    double headerTimeout_;
+    TlsContext *tlsContext_;
+    HttpCompressor *compressor_;
+    bool http2_;
+};
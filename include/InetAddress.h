@@ -2,25 +2,56 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <string>
 
-// 封装socket地址类型
+/**
+ * 封装socket地址类型
+ * 支持 AF_INET 和 AF_UNIX 两种地址族，Unix域地址的路径以'@'开头时表示抽象命名空间(不在文件系统中创建文件)
+ * 上层统一通过 getSockAddr()/getSockLen() 拿到 bind/connect 需要的参数，不再关心具体的地址族
+ **/
 class InetAddress
 {
 public:
     explicit InetAddress(uint16_t port = 0, std::string ip = "127.0.0.1");
     explicit InetAddress(const sockaddr_in &addr)
         : addr_(addr)
+        , len_(sizeof(sockaddr_in))
     {
     }
+    InetAddress(const sockaddr *addr, socklen_t len) { setSockAddr(addr, len); }
 
-    std::string toIp() const;
+    // Unix域socket地址 例如 "/tmp/app.sock" 或抽象地址 "@app" 路径超出sun_path时返回无效地址(valid()为false)
+    static InetAddress unixAddress(const std::string &path);
+
+    bool valid() const { return family() != AF_UNSPEC; }
+
+    sa_family_t family() const { return sa_.sa_family; }
+    bool isUnix() const { return family() == AF_UNIX; }
+    // 抽象命名空间地址 sun_path第一个字节为'\0'
+    bool isAbstract() const;
+
+    std::string toIp() const; // AF_UNIX时返回路径
     std::string toIpPort() const;
-    uint16_t toPort() const;
+    uint16_t toPort() const;  // AF_UNIX时返回0
+    std::string unixPath() const;
 
-    const sockaddr_in *getSockAddr() const { return &addr_; }
-    void setSockAddr(const sockaddr_in &addr) { addr_ = addr; }
+    const sockaddr *getSockAddr() const { return &sa_; }
+    socklen_t getSockLen() const { return len_; }
+    void setSockAddr(const sockaddr_in &addr)
+    {
+        addr_ = addr;
+        len_ = sizeof(sockaddr_in);
+    }
+    void setSockAddr(const sockaddr *addr, socklen_t len);
 
 private:
-    sockaddr_in addr_;
-};
\ No newline at end of file
+    union
+    {
+        sockaddr sa_;
+        sockaddr_in addr_;
+        sockaddr_un addrUn_;
+    };
+    socklen_t len_; // 有效地址长度 抽象/未命名的Unix域地址长度小于sizeof(sockaddr_un)
+};
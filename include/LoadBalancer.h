@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+
+// 后端节点 多个subloop并发读写 计数和健康状态都用原子变量
+struct Backend
+{
+    explicit Backend(const InetAddress &addr)
+        : addr(addr), active(0), healthy(true) {}
+
+    InetAddress addr;
+    std::atomic_int active;   // 当前正在代理的连接数 供最少连接策略使用
+    std::atomic_bool healthy; // 由健康检查更新
+};
+
+/**
+ * 四层负载均衡的后端选择器
+ * kRoundRobin     轮询
+ * kLeastConn      当前连接数最少的后端
+ * kConsistentHash 按客户端IP做一致性哈希 同一客户端总是落在同一后端 后端增减只影响相邻区间
+ * select() 会跳过不健康的后端 可在任意线程调用
+ **/
+class LoadBalancer : noncopyable
+{
+public:
+    enum Policy
+    {
+        kRoundRobin,
+        kLeastConn,
+        kConsistentHash,
+    };
+
+    LoadBalancer(Policy policy, const std::vector<InetAddress> &backends, int virtualNodes = 160);
+    ~LoadBalancer();
+
+    // 没有可用后端时返回nullptr
+    Backend *select(const InetAddress &clientAddr);
+
+    Policy policy() const { return policy_; }
+    const std::vector<std::unique_ptr<Backend>> &backends() const { return backends_; }
+
+    // "rr" / "leastconn" / "hash"
+    static bool parsePolicy(const std::string &name, Policy *policy);
+
+private:
+    Backend *selectRoundRobin();
+    Backend *selectLeastConn();
+    Backend *selectConsistentHash(const InetAddress &clientAddr);
+
+    using RingEntry = std::pair<uint32_t, Backend *>; // 哈希环上的虚拟节点 按哈希值排序
+
+    Policy policy_;
+    std::vector<std::unique_ptr<Backend>> backends_;
+    std::vector<RingEntry> ring_; // 构造后只读 无需加锁
+    std::atomic_uint next_;
+};
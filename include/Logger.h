@@ -58,6 +58,10 @@ public:
     static void setOutput(OutputFunc);
     static void setFlush(FlushFunc);
 
+    // 全局日志等级 低于该等级的日志不会格式化也不会输出
+    static LogLevel logLevel();
+    static void setLogLevel(LogLevel level);
+
 private:
     class Impl
     {
@@ -78,16 +82,24 @@ private:
     Impl impl_;
 };
 
+extern Logger::LogLevel g_logLevel;
+
+inline Logger::LogLevel Logger::logLevel()
+{
+    return g_logLevel;
+}
+
 // 获取errno信息
 const char* getErrnoMsg(int savedErrno);
 /**
  * 当日志等级小于对应等级才会输出
  * 比如设置等级为FATAL，则logLevel等级大于DEBUG和INFO，DEBUG和INFO等级的日志就不会输出
+ * 写成 if (!cond) {} else 的形式 宏后面跟else时不会被宏里的if吃掉
  */
 #ifdef OPEN_LOGGING
-#define LOG_DEBUG Logger(__FILE__, __LINE__, Logger::DEBUG).stream()
-#define LOG_INFO Logger(__FILE__, __LINE__, Logger::INFO).stream()
-#define LOG_WARN Logger(__FILE__, __LINE__, Logger::WARN).stream()
+#define LOG_DEBUG if (!(Logger::logLevel() <= Logger::DEBUG)) {} else Logger(__FILE__, __LINE__, Logger::DEBUG).stream()
+#define LOG_INFO if (!(Logger::logLevel() <= Logger::INFO)) {} else Logger(__FILE__, __LINE__, Logger::INFO).stream()
+#define LOG_WARN if (!(Logger::logLevel() <= Logger::WARN)) {} else Logger(__FILE__, __LINE__, Logger::WARN).stream()
 #define LOG_ERROR Logger(__FILE__, __LINE__, Logger::ERROR).stream()
 #define LOG_FATAL Logger(__FILE__, __LINE__, Logger::FATAL).stream()
 #else
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <stdint.h>
+#include <coroutine>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "noncopyable.h"
+#include "CoroutineSupport.h"
+#include "HttpRequest.h"
+
+/**
+ * multipart/form-data(RFC 7578)请求体的流式解析 建立在HttpRequest::readBody之上，
+ * 只能在协程处理函数(HttpServer::setHandler)里使用 HTTP/1.1和HTTP/2都可以
+ *
+ * 不缓存整个part: 数据原样从请求体的块里切出来交给调用方(string_view 不拷贝)，
+ * 只有可能是分隔符开头的块尾(不超过分隔符长度)和part的头部(上限kMaxHeaderBytes)会被复制
+ * 背压来自readBody: 调用方不读 请求体就不再从连接上读取(HTTP/2不归还流量控制窗口) 每个上传占用的内存有上限
+ *
+ * 用法:
+ *   MultipartReader form(req);
+ *   if (!form.valid()) { resp.setStatusCode(400); co_return; }
+ *   while (const MultipartReader::Part *part = co_await form.nextPart()) {
+ *       if (part->filename.empty()) {
+ *           std::string value;
+ *           while (true) { std::string_view d = co_await form.read(); if (d.empty()) break; value.append(d); }
+ *       } else {
+ *           int64_t n = co_await form.saveToFile("/data/upload.tmp");  // 或者 saveTo(fd) / saveTo(sink)
+ *       }
+ *   }
+ *   if (form.failed()) ...
+ *
+ * 文件写入用write(2)在loop线程里完成(写的是页缓存) 不能用splice: 查找分隔符需要数据经过用户态，
+ * 而且请求体可能是chunked编码、TLS加密或者HTTP/2 DATA帧
+ * 所有接口在连接所属loop线程使用 同一时间只能有一个co_await在进行
+ **/
+class MultipartReader : noncopyable
+{
+public:
+    static constexpr size_t kMaxBoundary = 70;        // RFC 2046
+    static constexpr size_t kMaxHeaderBytes = 16 * 1024; // 一个part的头部
+
+    struct Part
+    {
+        std::string_view name;        // Content-Disposition的name
+        std::string_view filename;    // 普通表单字段为空
+        std::string_view contentType; // 没有时为空(按RFC 7578是text/plain)
+        std::string_view headers;     // 原始的头部行 用header()查找其他字段
+
+        std::string_view header(std::string_view name) const;
+    };
+
+    // 数据写到哪里: 返回false表示出错 停止保存
+    using Sink = std::function<bool(std::string_view)>;
+
+    explicit MultipartReader(HttpRequest &req);
+
+    // Content-Type是multipart并且有合法的boundary
+    bool valid() const { return !delimiter_.empty(); }
+    // 请求体不是合法的multipart、头部过长、请求体中途断开、写文件失败
+    bool failed() const { return state_ == kError; }
+    // 读到了结束分隔符
+    bool finished() const { return state_ == kEpilogue; }
+
+    // 从Content-Type取出boundary 不合法时返回空
+    static std::string_view boundaryOf(std::string_view contentType);
+
+    // ============ 协程接口 ============
+
+    // 下一个part(当前part没读完的数据被跳过) 没有更多part或者出错时返回nullptr
+    // 返回的Part在下一次nextPart之前有效
+    struct PartAwaiter
+    {
+        MultipartReader *reader_;
+
+        bool await_ready() { return reader_->step(kWantPart); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) { return reader_->pump(kWantPart, h); }
+        const Part *await_resume() { return reader_->partResult(); }
+    };
+    // 当前part的下一块数据 part结束(或者出错)时返回空 数据在下一次co_await之前有效
+    struct ReadAwaiter
+    {
+        MultipartReader *reader_;
+
+        bool await_ready() { return reader_->step(kWantData); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) { return reader_->pump(kWantData, h); }
+        std::string_view await_resume() { return reader_->data_; }
+    };
+    // 把当前part剩下的数据交给sink/写进fd 返回字节数 出错返回-1(failed()为true)
+    struct SaveAwaiter
+    {
+        MultipartReader *reader_;
+        Sink sink_;
+
+        bool await_ready() { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> h);
+        int64_t await_resume() { return reader_->saved_; }
+    };
+
+    PartAwaiter nextPart() { return PartAwaiter{this}; }
+    ReadAwaiter read() { return ReadAwaiter{this}; }
+    SaveAwaiter saveTo(Sink sink) { return SaveAwaiter{this, std::move(sink)}; }
+    // fd由调用方打开和关闭
+    SaveAwaiter saveTo(int fd);
+    // 创建(截断)文件写入 打不开时返回-1
+    SaveAwaiter saveToFile(const std::string &path, int mode = 0644);
+
+private:
+    enum State
+    {
+        kPreamble, // 第一个分隔符之前 丢弃
+        kHeaders,  // 分隔符之后 收集part的头部
+        kData,     // part的数据
+        kEpilogue, // 结束分隔符之后 丢弃
+        kError
+    };
+    enum Want
+    {
+        kWantPart,
+        kWantData
+    };
+    enum Poll
+    {
+        kPollData,    // data_是当前part的一块数据
+        kPollPartEnd, // 当前part结束
+        kPollPart,    // 新的part头部解析好了
+        kPollEnd,     // 结束分隔符
+        kPollNeedMore,
+        kPollError
+    };
+
+    // 用已有的数据推进 能给出want要的结果时返回true 需要更多请求体时返回false
+    bool step(Want want);
+    // 需要更多请求体: 启动一个协程循环readBody直到step成功 结束时恢复h
+    std::coroutine_handle<> pump(Want want, std::coroutine_handle<> h);
+    AsyncTask fill(Want want);
+    AsyncTask save(Sink sink);
+    const Part *partResult() const { return state_ == kData && partFresh_ ? &part_ : nullptr; }
+
+    Poll poll();
+    // kPreamble/kData: 在chunk_里找分隔符 跨块的分隔符前缀暂存在carry_
+    Poll scanData();
+    Poll scanHeaders();
+    bool parseHeaders(std::string_view block);
+    void fail() { state_ = kError; }
+
+    HttpRequest &req_;
+    std::string delimiter_; // "\r\n--" + boundary
+    State state_;
+    std::string_view chunk_; // 当前请求体块里还没处理的部分 在下一次readBody之前有效
+    bool bodyEnded_;
+    std::string carry_;  // 上一块末尾可能是分隔符开头的几个字节(一定是delimiter_的真前缀)
+    std::string emit_;   // 从carry_里交出去的数据
+    std::string header_; // 正在收集的part头部 Part的字段指向这里
+    Part part_;
+    bool partFresh_;     // part_是nextPart要返回的结果
+    std::string_view data_;
+    int64_t saved_;
+
+    std::optional<AsyncTask> fill_;
+    std::optional<AsyncTask> save_;
+};
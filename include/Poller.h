@@ -25,6 +25,8 @@ public:
 
     // 判断参数channel是否在当前的Poller当中
     bool hasChannel(Channel *channel) const;
+    // 注册过(还没有remove)的channel个数
+    size_t numChannels() const { return channels_.size(); }
 
     // EventLoop可以通过该接口获取默认的IO复用的具体实现
     static Poller *newDefaultPoller(EventLoop *loop);
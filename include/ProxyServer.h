@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+#include "LoadBalancer.h"
+#include "CoroutineSupport.h"
+
+/**
+ * 四层反向代理 / 负载均衡
+ * 下游连接由TcpServer接入 => LoadBalancer选择后端 => TcpClient在同一个subloop上连接后端
+ * => 两个方向各一个 pump 协程搬运数据
+ *
+ * 背压: 一端的输出缓冲区超过高水位时 停止读另一端 等输出排空后再继续读
+ * 这样内存占用只取决于高水位 而不取决于两端速度差
+ **/
+class ProxyServer : noncopyable
+{
+public:
+    static constexpr size_t kDefaultHighWaterMark = 1024 * 1024;
+
+    ProxyServer(EventLoop *loop,
+                const InetAddress &listenAddr,
+                const std::string &nameArg,
+                LoadBalancer::Policy policy,
+                const std::vector<InetAddress> &backends);
+    ~ProxyServer();
+
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    // 健康检查间隔 <=0 表示关闭主动健康检查
+    void setHealthCheckInterval(double seconds) { healthCheckInterval_ = seconds; }
+    void setConnectTimeout(double seconds) { connectTimeout_ = seconds; }
+    void setHighWaterMark(size_t bytes) { highWaterMark_ = bytes; }
+
+    LoadBalancer &balancer() { return balancer_; }
+
+    void start();
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+
+    Task proxySession(TcpConnectionPtr downstream);
+    // 把 from 读到的数据原样转发给 to backend非空时 在结束时归还后端的连接计数
+    Task pump(TcpConnectionPtr from, TcpConnectionPtr to, Backend *backend);
+
+    void checkHealth();
+    Task probe(Backend *backend);
+
+    EventLoop *loop_;
+    const std::string name_;
+    TcpServer server_;
+    LoadBalancer balancer_;
+    double healthCheckInterval_;
+    double connectTimeout_;
+    size_t highWaterMark_;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <atomic>
+#include <coroutine>
+
+#include "noncopyable.h"
+#include "Buffer.h"
+#include "Channel.h"
+
+class EventLoop;
+
+/**
+ * 同一台机器上两个进程之间的共享内存传输
+ *
+ * 一块memfd里放两个单生产者单消费者(SPSC)的字节环，每个方向一个; 两个eventfd作为门铃，
+ * 每一端在自己的EventLoop里通过Channel监听自己的门铃。数据直接拷进/拷出共享内存，不经过内核协议栈
+ *
+ * 门铃只在对端真正挂起时才按: 消费者挂起前在环头部置consumerWaiting，生产者写入后检查并清除该标记再写eventfd;
+ * 生产者因环满而挂起时置producerWaiting，消费者腾出空间后同样处理。持续收发的时候没有任何系统调用
+ * setBusyPoll(n) 让读协程挂起前先自旋检查n次，用一点CPU换掉 epoll唤醒 的延迟(会占住所在loop)
+ *
+ * 建立连接:
+ *   ShmConnection::Descriptor desc;
+ *   ShmConnection::createDescriptor(1 << 20, &desc);   // 创建memfd和两个eventfd
+ *   fork() 之后或者通过Unix域socket(sendDescriptor/recvDescriptor 用SCM_RIGHTS传递fd)交给对端进程
+ *   auto conn = std::make_shared<ShmConnection>(loop, desc, 0, "shm");  // 对端使用side 1 必须由shared_ptr持有
+ *   ShmConnection::closeDescriptor(&desc);             // 构造函数已经复制了需要的fd
+ *
+ * 协程接口与TcpConnection一致: co_await conn->read() / write(data, highWaterMark) / drain()
+ * 对端进程异常退出时不会有关闭通知，需要上层自己做心跳
+ * 共享内存对端可以随意改写: 环头部的head/tail不合法时按协议错误处理 本端关闭连接并通知对端
+ * 没有协程在read()上等待时不搬运数据 环满之后对端的写自然挂起
+ * 包括构造和析构在内的所有接口都必须在所属loop线程调用
+ **/
+class ShmConnection : noncopyable, private ChannelHandler, public std::enable_shared_from_this<ShmConnection>
+{
+public:
+    static const size_t kDefaultCapacity = 1024 * 1024;
+    static constexpr size_t kDefaultHighWaterMark = 64 * 1024 * 1024;
+
+    struct Descriptor
+    {
+        int memfd = -1;
+        int doorbells[2] = {-1, -1}; // doorbells[i] 是side i监听的门铃
+    };
+
+    // capacity会向上取整到2的幂 失败返回false
+    static bool createDescriptor(size_t capacity, Descriptor *desc);
+    static void closeDescriptor(Descriptor *desc);
+    // 通过Unix域socket传递Descriptor中的三个fd
+    static bool sendDescriptor(int unixSockfd, const Descriptor &desc);
+    static bool recvDescriptor(int unixSockfd, Descriptor *desc);
+
+    ShmConnection(EventLoop *loop, const Descriptor &desc, int side, const std::string &name);
+    ~ShmConnection();
+
+    EventLoop *getLoop() const { return loop_; }
+    const std::string &name() const { return name_; }
+    bool valid() const { return shared_ != nullptr; }
+    // 本端可以继续发送: 没有shutdown 对端也没有销毁
+    bool connected() const;
+    size_t capacity() const { return capacity_; }
+
+    Buffer *inputBuffer() { return &inputBuffer_; }
+    Buffer *outputBuffer() { return &outputBuffer_; }
+
+    void setBusyPoll(int spins) { busyPollSpins_ = spins; }
+
+    // 尽量直接写入共享环 放不下的部分暂存在outputBuffer_ 对端腾出空间后继续写
+    void send(const void *data, size_t len);
+    void send(const std::string &data) { send(data.data(), data.size()); }
+    void send(Buffer *buf);
+    // 关闭本端的发送方向 对端读完剩余数据后read()返回空缓冲区
+    void shutdown();
+
+    // ================== 协程接口 ==================
+
+    // 用法: Buffer* buf = co_await conn->read();  对端关闭且没有剩余数据时返回空缓冲区
+    struct ReadAwaiter
+    {
+        ShmConnection *conn_;
+        ReadAwaiter(ShmConnection *conn) : conn_(conn) {}
+
+        bool await_ready() const;
+        bool await_suspend(std::coroutine_handle<> h);
+        Buffer *await_resume();
+    };
+
+    struct DrainAwaiter
+    {
+        ShmConnection *conn_;
+        DrainAwaiter(ShmConnection *conn) : conn_(conn) {}
+
+        bool await_ready() const;
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() {}
+    };
+
+    // 与TcpConnection::WriteAwaiter相同: outputBuffer_超过高水位时挂起 回落到一半以下时恢复再发送
+    struct WriteAwaiter
+    {
+        ShmConnection *conn_;
+        std::string data_;
+        size_t highWaterMark_;
+
+        WriteAwaiter(ShmConnection *conn, std::string data, size_t highWaterMark)
+            : conn_(conn), data_(std::move(data)), highWaterMark_(highWaterMark) {}
+
+        bool await_ready() const;
+        void await_suspend(std::coroutine_handle<> h);
+        size_t await_resume();
+    };
+
+    ReadAwaiter read() { return ReadAwaiter(this); }
+    DrainAwaiter drain() { return DrainAwaiter(this); }
+    WriteAwaiter write(std::string data, size_t highWaterMark = kDefaultHighWaterMark)
+    {
+        return WriteAwaiter(this, std::move(data), highWaterMark);
+    }
+
+private:
+    struct RingHeader;
+    struct SharedControl;
+
+    void onReadable(Timestamp receiveTime) override;
+
+    size_t pushRing(const char *data, size_t len); // 写入tx环 返回写入的字节数
+    size_t pullRing();                             // rx环 -> inputBuffer_ 返回读出的字节数
+    void flushOutput();
+    void ringPeer();
+    bool peerClosed() const;   // 对端关闭了发送方向
+    bool peerGone() const;     // 对端已经销毁 不会再消费数据
+    void protocolError(const char *what); // 环状态被破坏 关闭两个方向
+    void resumeWriter();
+
+    EventLoop *loop_;
+    const std::string name_;
+    int side_;
+    size_t capacity_;
+    size_t mapLength_;
+    SharedControl *shared_;
+    RingHeader *tx_;
+    RingHeader *rx_;
+    char *txData_;
+    char *rxData_;
+    int doorbellFd_;     // 本端监听的门铃
+    int peerDoorbellFd_; // 对端的门铃
+    std::unique_ptr<Channel> channel_;
+
+    Buffer inputBuffer_;
+    Buffer outputBuffer_;
+    bool closed_;
+    bool broken_; // 发生过协议错误 见 protocolError
+    int busyPollSpins_;
+    size_t writeResumeThreshold_;
+
+    std::coroutine_handle<> readCoroutine_;
+    std::coroutine_handle<> writeCoroutine_;
+};
+
+using ShmConnectionPtr = std::shared_ptr<ShmConnection>;
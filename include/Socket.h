@@ -1,8 +1,11 @@
 #pragma once
 
+#include <sys/socket.h>
+
 #include "noncopyable.h"
 
 class InetAddress;
+struct SocketOptions;
 
 // 封装socket fd
 class Socket : noncopyable
@@ -25,6 +28,21 @@ public:
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    // 接收缓冲区里至少有bytes字节时才报告可读
+    bool setRecvLowat(int bytes);
+
+    void setSendBufferSize(int bytes);
+    void setRecvBufferSize(int bytes);
+    void setTcpQuickAck(bool on);
+    void setTcpNotSentLowat(int bytes);
+    void setTcpUserTimeout(int ms);
+    void setKeepAliveParams(int idleSecs, int intervalSecs, int count);
+
+    // 应用一组调优参数 tcpOptions为false时(Unix域socket)跳过TCP层的选项
+    void applyOptions(const SocketOptions &options, bool tcpOptions = true);
+
+    // Unix域socket对端进程的 pid/uid/gid (SO_PEERCRED)
+    bool getPeerCred(ucred *cred) const;
 
 private:
     const int sockfd_;
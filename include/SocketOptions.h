@@ -0,0 +1,33 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+/**
+ * 一组socket调优参数 TcpServer在accept之后应用到每个新连接上 也可以对单个连接调用
+ * TcpConnection::applySocketOptions 覆盖
+ * 未设置(std::nullopt)的项保持内核默认值
+ *
+ * 预置的profile:
+ *   latency  请求/响应型的小消息: 关闭Nagle 开启QUICKACK 用较小的NOTSENT_LOWAT压低发送队列里的排队时延
+ *   bulk     大块数据传输: 保留Nagle 放大收发缓冲区 更长的超时
+ **/
+struct SocketOptions
+{
+    std::optional<int> sendBufferSize;  // SO_SNDBUF 显式设置后内核不再自动调整该方向的缓冲区
+    std::optional<int> recvBufferSize;  // SO_RCVBUF
+    std::optional<bool> tcpNoDelay;     // TCP_NODELAY
+    std::optional<bool> tcpQuickAck;    // TCP_QUICKACK 内核会自动清除 TcpConnection每次读之后重新设置
+    std::optional<int> notSentLowat;    // TCP_NOTSENT_LOWAT 未发送数据低于该值才报告可写 写协程按真实的发送队列空间恢复
+    std::optional<int> userTimeoutMs;   // TCP_USER_TIMEOUT 已发送数据超过该时间未被确认就断开连接
+    std::optional<bool> keepAlive;      // SO_KEEPALIVE
+    std::optional<int> keepIdleSecs;    // TCP_KEEPIDLE
+    std::optional<int> keepIntervalSecs; // TCP_KEEPINTVL
+    std::optional<int> keepCount;       // TCP_KEEPCNT
+
+    static SocketOptions latency();
+    static SocketOptions bulk();
+
+    // 按名字查找预置profile("latency" "bulk" "default") 找不到返回false
+    static bool fromProfile(const std::string &name, SocketOptions *options);
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "noncopyable.h"
+#include "FileCache.h"
+
+class HttpRequest;
+class HttpResponse;
+
+/**
+ * 静态文件处理: 把请求路径映射到root目录下的文件
+ *
+ * 文件来自FileCache 命中时不再有open/fstat系统调用
+ *   - 小文件: 内容缓存在内存里 响应体是共享的不可变消息(sendShared 不拷贝)
+ *   - 大文件: 响应体是文件的一段 由HttpServer用sendfile零拷贝发送
+ * 条件请求: ETag/Last-Modified由缓存的stat算好 If-None-Match/If-Modified-Since命中返回304
+ * 预压缩: 客户端接受gzip并且文件旁边有不比它旧的 file.gz 时直接发送.gz(Content-Encoding: gzip)
+ *         不存在的.gz也由FileCache缓存 探测不产生系统调用; 没有.gz的小文本文件由HttpCompressor按需压缩
+ * 范围请求: 支持单个 bytes=a-b / a- / -n 区间(返回206) If-Range不匹配时忽略Range返回整个文件
+ *           多个区间不支持 按RFC 7233允许忽略Range 返回200和整个文件
+ * 只接受GET/HEAD 路径中含 ".." 段或者NUL时返回403 请求目录时返回301跳到带'/'的路径 再找indexFile
+ *
+ * 同步处理函数 可以直接挂到HttpServer上 也可以在协程处理函数里调用:
+ *   FileCache cache(&loop);
+ *   StaticFileHandler files(&cache, "/var/www");
+ *   server.setHttpCallback([&files](const HttpRequest &req, HttpResponse *resp) { files.handle(req, resp); });
+ **/
+class StaticFileHandler : noncopyable
+{
+public:
+    StaticFileHandler(FileCache *cache, const std::string &root);
+
+    void setIndexFile(const std::string &name) { indexFile_ = name; }
+    // 非空时每个文件响应都带上 Cache-Control 例如 "max-age=3600"
+    void setCacheControl(const std::string &value) { cacheControl_ = value; }
+    // 是否查找预压缩的.gz文件 默认开启
+    void setPrecompressed(bool on) { precompressed_ = on; }
+
+    // 返回false表示没有对应的文件(resp已经设置好404/403/405) 调用方可以改成自己的响应
+    bool handle(const HttpRequest &req, HttpResponse *resp);
+
+    // 按扩展名猜测Content-Type
+    static std::string_view mimeType(std::string_view path);
+
+private:
+    // 百分号解码并检查路径 不合法返回false
+    static bool decodePath(std::string_view path, std::string *out);
+    // 解析单个bytes区间 返回 1:合法 0:忽略Range 返回整个文件 -1:不可满足(416)
+    static int parseRange(std::string_view range, size_t size, size_t *first, size_t *last);
+    bool notModified(const HttpRequest &req, const FileCache::File &file) const;
+
+    FileCache *cache_;
+    std::string root_;
+    std::string indexFile_;
+    std::string cacheControl_;
+    bool precompressed_;
+};
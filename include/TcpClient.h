@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+
+#include "noncopyable.h"
+#include "Connector.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+
+class EventLoop;
+
+/**
+ * TcpClient = Connector + TcpConnection
+ * Connector拿到已连接的sockfd后 打包为TcpConnection 之后的读写与服务端连接完全一致
+ *
+ * 用法: TcpConnectionPtr conn = co_await client.connect(3.0); // 失败返回nullptr
+ * 连接建立后由TcpConnection自己持有自己 直到连接关闭 所以TcpClient对象可以先于连接销毁
+ **/
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg);
+    ~TcpClient();
+
+    EventLoop *getLoop() const { return loop_; }
+    const std::string &name() const { return name_; }
+    int lastError() const { return lastError_; }
+
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+
+    struct ConnectAwaiter
+    {
+        TcpClient *client_;
+        Connector::ConnectAwaiter connectAwaiter_;
+
+        ConnectAwaiter(TcpClient *client, double timeoutSecs)
+            : client_(client), connectAwaiter_(client->connector_.connect(timeoutSecs)) {}
+
+        bool await_ready() { return connectAwaiter_.await_ready(); }
+        void await_suspend(std::coroutine_handle<> h) { connectAwaiter_.await_suspend(h); }
+        TcpConnectionPtr await_resume();
+    };
+
+    ConnectAwaiter connect(double timeoutSecs = 0.0) { return ConnectAwaiter(this, timeoutSecs); }
+
+private:
+    TcpConnectionPtr newConnection(int sockfd);
+
+    EventLoop *loop_;
+    Connector connector_;
+    const std::string name_;
+    ConnectionCallback connectionCallback_;
+    int nextConnId_;
+    int lastError_;
+};
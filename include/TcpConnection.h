@@ -1,9 +1,12 @@
 #pragma once
 
 #include <memory>
+#include <deque>
+#include <vector>
 #include <string>
 #include <atomic>
 #include <coroutine> // [新增]
+#include <functional>
 
 #include "noncopyable.h"
 #include "InetAddress.h"
@@ -12,10 +15,13 @@
 #include "Timestamp.h"
 #include "Logger.h"
 #include "TimerId.h"
+#include "SocketOptions.h"
+#include "Channel.h"
 
-class Channel;
 class EventLoop;
 class Socket;
+class TlsContext;
+class TlsSession;
 
 /**
  * TcpServer => Acceptor => 有一个新用户连接，通过accept函数拿到connfd
@@ -27,7 +33,7 @@ class Socket;
  * 1. 内置 read() 和 drain() 的 Awaitable 支持。
  * 2. 内部维护 readCoroutine_ 和 writeCoroutine_ 句柄。
  */
-class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
+class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>, private ChannelHandler
 {
 public:
     TcpConnection(EventLoop *loop,
@@ -37,7 +43,7 @@ public:
                   const InetAddress &peerAddr);
     ~TcpConnection();
 
-    EventLoop *getLoop() const { return loop_; }
+    EventLoop *getLoop() const { return loop_.load(std::memory_order_acquire); }
     const std::string &name() const { return name_; }
     const InetAddress &localAddress() const { return localAddr_; }
     const InetAddress &peerAddress() const { return peerAddr_; }
@@ -52,9 +58,123 @@ public:
 
     // 发送数据
     void send(const std::string &buf);
+    // 发送Buffer中全部可读数据 并清空该Buffer(必须在loop线程调用)
+    void send(Buffer *buf);
     
     // 关闭半连接
     void shutdown();
+    // 强制关闭连接 挂起在该连接上的读写协程会被唤醒
+    void forceClose();
+
+    void setTcpNoDelay(bool on);
+    // 覆盖TcpServer统一设置的调优参数 只修改options中设置了的项
+    void applySocketOptions(const SocketOptions &options);
+
+    /**
+     * 写合并: 开启后 send() 不再立即 write，而是追加到 outputBuffer_，
+     * 同一轮事件循环里的多次 send 在循环末尾(EventLoop::queueAfterDispatch)合并成一次系统调用发出
+     * 例如先发header再发body 只产生一个TCP段和一次write
+     * 建议同时开启 TCP_NODELAY: 合并已经在用户态完成 不需要再让Nagle等待ACK
+     * 关闭时会立即把积攒的数据发出 必须在loop线程调用
+     **/
+    void setWriteCoalescing(bool on);
+    bool writeCoalescing() const { return writeCoalescing_; }
+
+    // 输入输出缓冲区切换为双映射环形缓冲区(见Buffer::enableMirroredRing) 适合持续流式收发且每次只消费一部分数据的场景
+    // 必须在loop线程调用 失败时返回false并继续使用普通Buffer
+    bool enableMirroredBuffers(size_t capacity = Buffer::kDefaultRingSize);
+    // Unix域socket对端进程的凭证(SO_PEERCRED) TCP连接返回false
+    bool peerCredentials(ucred *cred) const;
+
+    /**
+     * 连接迁移: 把已建立的连接(Channel注册、输入输出缓冲区、挂起在read/drain/readAtLeast上的协程)移到另一个EventLoop
+     * 迁移在原loop线程中进行: 从原Poller摘下Channel 切换loop_ 再在新loop中按原来的关注事件重新注册，
+     * 之后的读写事件、协程恢复都发生在新loop线程。原loop队列里残留的针对该连接的回调会被转发到新loop执行
+     * 以下情况拒绝迁移: 连接未处于kConnected、sendFile进行中、readWithTimeout挂起中(它的定时器属于原loop)、
+     * 连接被标记为busy(见 beginBusy)
+     * migrateTo 只在安全点迁移: 会话协程正挂起在连接自己的read/readAtLeast/readUntil/drain上，
+     * 会话停在 loop->sleep、WorkerPool 或其他awaiter上时它会在原loop恢复 此时拒绝迁移
+     **/
+    // 线程安全 异步执行 结果通过MigrateCallback通知
+    void migrateTo(EventLoop *target);
+
+    // 在会话协程内部迁移自己: bool ok = co_await conn->migrate(target);
+    // 成功时协程在新loop线程中恢复
+    struct MigrateAwaiter
+    {
+        TcpConnection *conn_;
+        EventLoop *target_;
+        bool ok_ = false;
+
+        MigrateAwaiter(TcpConnection *conn, EventLoop *target) : conn_(conn), target_(target) {}
+
+        bool await_ready() const { return false; }
+        bool await_suspend(std::coroutine_handle<> h);
+        bool await_resume() const { return ok_; }
+    };
+    MigrateAwaiter migrate(EventLoop *target) { return MigrateAwaiter(this, target); }
+
+    /**
+     * 会话的一部分工作离开了连接自己的awaiter(交给WorkerPool、等定时器、HTTP/2的流/写协程)
+     * 期间恢复会发生在原loop上 不能迁移 beginBusy/endBusy 成对调用 可以嵌套 只能在所属loop线程调用
+     * WorkerPool::run(conn, fn) 会自动标记
+     **/
+    void beginBusy() { ++busy_; }
+    void endBusy() { --busy_; }
+    bool busy() const { return busy_ > 0; }
+
+    // 迁移成功后在原loop线程中调用 TcpServer用它维护每个loop上的连接数
+    void setMigrateCallback(const MigrateCallback &cb) { migrateCallback_ = cb; }
+
+    // 累计收发字节数 用于按负载做迁移决策(任意线程读取)
+    uint64_t bytesTransferred() const { return bytesTransferred_.load(std::memory_order_relaxed); }
+
+    /**
+     * 发送一条共享的不可变消息 用于广播(见 Broadcaster): 多个连接引用同一块内存 不拷贝进outputBuffer_
+     * 发不完的部分按引用排在发送队列里 之后send()的数据排在它们后面 顺序不变
+     * 任意线程可调用
+     **/
+    void sendShared(const SharedMessage &msg);
+    // 尚未发出的字节数: outputBuffer_ + 排队的共享消息
+    size_t pendingOutputBytes() const { return outputBuffer_.readableBytes() + sharedQueueBytes_; }
+    // 丢弃排队中还没开始发送的共享消息 直到释放至少bytes字节 返回丢弃的消息条数(loop线程调用)
+    size_t dropQueuedShared(size_t bytes);
+
+    // 输入/输出缓冲区当前占用的内存 计入 BufferBudget(loop线程读取)
+    size_t bufferBytes() const { return bufferBytes_; }
+    // 因为全局缓冲区预算超限而暂停了读
+    bool readPausedByBudget() const { return budgetPaused_; }
+    // 把空闲(没有未读/未发数据)的缓冲区缩回初始大小 loop线程调用 连接已经迁走时转发到新的loop
+    void shrinkBuffers();
+
+    /**
+     * TLS: 在已建立的连接上做TLS握手 之后read/send/write/sendFile等接口收发的都是明文
+     * 用法: if (!co_await conn->startTls(&ctx)) co_return;          // 服务端
+     *      co_await conn->startTls(&clientCtx, "example.com");       // 客户端 serverName用于SNI和主机名校验
+     * 握手失败时连接会被关闭 必须在任何读写之前调用 握手期间send的数据在握手完成后发出
+     * 握手完成后如果内核接管了发送方向的加密(kTLS) sendFile仍然是零拷贝 否则在用户态加密
+     **/
+    struct TlsHandshakeAwaiter
+    {
+        TcpConnection *conn_;
+        TlsContext *ctx_;
+        std::string serverName_;
+
+        TlsHandshakeAwaiter(TcpConnection *conn, TlsContext *ctx, std::string serverName)
+            : conn_(conn), ctx_(ctx), serverName_(std::move(serverName)) {}
+
+        bool await_ready() const { return false; }
+        bool await_suspend(std::coroutine_handle<> h);
+        bool await_resume() const { return conn_->tlsEstablished_; }
+    };
+    TlsHandshakeAwaiter startTls(TlsContext *ctx, std::string serverName = std::string())
+    {
+        return TlsHandshakeAwaiter(this, ctx, std::move(serverName));
+    }
+    bool tlsEstablished() const { return tlsEstablished_; }
+    // 发送方向的记录加密已经交给内核(kTLS)
+    bool kernelTls() const;
+    TlsSession *tlsSession() const { return tls_.get(); }
 
     // ================== 协程核心接口 ==================
 
@@ -82,8 +202,50 @@ public:
         void await_resume();
     };
 
+    // [ReadAtLeast Awaiter]
+    // 用法: Buffer* buf = co_await conn->readAtLeast(n);
+    // 输入缓冲区至少有n字节(或者连接断开)时才恢复协程，适合定长帧/已知长度的消息体
+    // 通过SO_RCVLOWAT让内核攒够数据再唤醒 内核没有攒够就唤醒时在回调里继续读 不会恢复协程
+    struct ReadAtLeastAwaiter
+    {
+        TcpConnection *conn_;
+        size_t n_;
+        ReadAtLeastAwaiter(TcpConnection *conn, size_t n) : conn_(conn), n_(n) {}
+
+        bool await_ready() const;
+        void await_suspend(std::coroutine_handle<> h);
+        Buffer *await_resume();
+    };
+
+    // [ReadExactly Awaiter]
+    // 用法: std::string frame = co_await conn->readExactly(n);
+    // 从输入缓冲区取走恰好n字节 连接在凑够之前断开时返回空串
+    struct ReadExactlyAwaiter : ReadAtLeastAwaiter
+    {
+        using ReadAtLeastAwaiter::ReadAtLeastAwaiter;
+        std::string await_resume();
+    };
+
+    // [ReadUntil Awaiter]
+    // 用法: Buffer* buf = co_await conn->readUntil([&parser](Buffer *b) { return parser.parse(b) != kIncomplete; });
+    // 每读入一批数据就调用一次pred 返回true(或者连接断开)时才恢复协程 适合按分隔符/协议状态判断消息是否完整
+    // pred会被反复调用 必须是幂等的增量检查
+    struct ReadUntilAwaiter
+    {
+        TcpConnection *conn_;
+        std::function<bool(Buffer *)> pred_;
+        ReadUntilAwaiter(TcpConnection *conn, std::function<bool(Buffer *)> pred) : conn_(conn), pred_(std::move(pred)) {}
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> h);
+        Buffer *await_resume();
+    };
+
     // 获取读等待器
     ReadAwaiter read() { return ReadAwaiter(this); }
+    ReadUntilAwaiter readUntil(std::function<bool(Buffer *)> pred) { return ReadUntilAwaiter(this, std::move(pred)); }
+    ReadAtLeastAwaiter readAtLeast(size_t n) { return ReadAtLeastAwaiter(this, n); }
+    ReadExactlyAwaiter readExactly(size_t n) { return ReadExactlyAwaiter(this, n); }
     // 获取写排空等待器
     DrainAwaiter drain() { return DrainAwaiter(this); }
 
@@ -184,6 +346,9 @@ public:
     { connectionCallback_ = cb; }
     void setCloseCallback(const CloseCallback &cb)
     { closeCallback_ = cb; }
+    // 连接关闭时额外通知的观察者(Broadcaster等) 在closeCallback_之前于所属loop线程调用 每个只调用一次
+    // 线程安全 连接已经关闭时立即在loop线程调用
+    void addCloseObserver(const CloseCallback &cb);
 
     // 供 Server 调用
     // 连接建立
@@ -194,6 +359,8 @@ public:
     // 给 Awaiter 用的内部接口
     void enableReading(); 
     void enableWriting();
+    // 暂停监听读事件 下一次 co_await read() 会重新开启 用于背压
+    void disableReading();
 
 private:
     enum StateE
@@ -205,17 +372,45 @@ private:
     };
     void setState(StateE state) { state_ = state; }
 
-    // void handleRead(Timestamp receiveTime);
+    // ChannelHandler: readResume_ 优先于默认的处理
+    void onReadable(Timestamp receiveTime) override;
+    void onWritable() override;
+    void onHangup() override;
+    void onError() override { handleError(); }
+
+    void handleRead(Timestamp receiveTime); // 没有协程等待读时的读事件
+    void handleReadAtLeast();               // readAtLeast/readUntil 挂起期间的读事件
+    void handleReadWithTimeout();           // readWithTimeout 挂起期间的读事件
+    bool readSatisfied();                   // readAtLeast/readUntil 等待的数据是否已经到齐
+    void setRecvLowat(size_t bytes);
+    void rearmQuickAck();
     void handleWrite();//处理写事件
     void handleClose();
     void handleError();
 
     void sendInLoop(const void *data, size_t len);
+    void flushCoalesced(); // 写合并模式下 本轮事件循环末尾把outputBuffer_一次性写出
     void shutdownInLoop();
-    EventLoop *loop_; // 这里是baseloop还是subloop由TcpServer中创建的线程数决定 若为多Reactor 该loop_指向subloop 若为单Reactor 该loop_指向baseloop
+    void forceCloseInLoop();
+    bool migrateInLoop(EventLoop *target, std::coroutine_handle<> resumeOnTarget);
+    // 当前线程不是连接所属的loop(连接已经迁移走)时 把f转发给新loop并返回true
+    bool forwardIfMigrated(std::function<void()> f);
+    // 只有所属loop线程写 用relaxed的load+store代替原子加
+    void addTraffic(ssize_t n)
+    {
+        if (n > 0)
+            bytesTransferred_.store(bytesTransferred_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    std::atomic<EventLoop *> loop_; // 连接迁移时会被修改 这里是baseloop还是subloop由TcpServer中创建的线程数决定 若为多Reactor 该loop_指向subloop 若为单Reactor 该loop_指向baseloop
     const std::string name_;
     std::atomic_int state_;
     bool reading_;//连接是否在监听读事件
+    bool writeCoalescing_; // 是否开启写合并
+    bool flushScheduled_;  // 本轮事件循环是否已经登记过flush
+    size_t readAtLeast_;   // readAtLeast 正在等待的字节数
+    int rcvLowat_;         // 当前socket上的SO_RCVLOWAT 避免重复setsockopt
+    bool quickAck_;        // 每次读之后重新设置TCP_QUICKACK
+    int busy_ = 0;         // 见 beginBusy 大于0时拒绝迁移
 
     // Socket Channel 这里和Acceptor类似    Acceptor => mainloop    TcpConnection => subloop
     std::unique_ptr<Socket> socket_;
@@ -227,7 +422,48 @@ private:
     // 这些回调TcpServer也有 用户通过写入TcpServer注册 TcpServer再将注册的回调传递给TcpConnection TcpConnection再将回调注册到Channel中
     ConnectionCallback connectionCallback_;       // 有新连接时的回调
     CloseCallback closeCallback_; // 关闭连接的回调
-
+    MigrateCallback migrateCallback_;
+    std::vector<CloseCallback> closeObservers_;
+    void notifyCloseObservers();
+    std::atomic<uint64_t> bytesTransferred_{0};
+
+    // 排在outputBuffer_之后的共享消息 队头可能已经发出去sharedQueueOffset_字节
+    void enqueueShared(SharedMessage msg, size_t offset);
+    ssize_t writeOutput(int *savedErrno); // writev发送outputBuffer_和共享消息 返回写出的字节数
+    std::deque<SharedMessage> sharedQueue_;
+    size_t sharedQueueOffset_ = 0;
+    size_t sharedQueueBytes_ = 0;
+
+    // TLS 见 startTls
+    bool stepHandshake();     // 推进握手 结束(成功或失败)时返回true
+    void continueHandshake(); // 握手期间的读写事件
+    bool userspaceTls() const; // 需要在用户态加解密(未开启kTLS)
+    ssize_t readInput(int *savedErrno); // socket -> inputBuffer_ TLS连接读出的是明文
+    ssize_t writeTls(const void *data, size_t len);
+    ssize_t sendFileChunk(int fileFd, off_t *offset, size_t count); // sendfile 用户态TLS时用pread+SSL_write代替
+    std::unique_ptr<TlsSession> tls_;
+    std::coroutine_handle<> handshakeCoroutine_ = nullptr;
+    bool tlsEstablished_ = false;
+
+    // 缓冲区内存预算 见 BufferBudget
+    static constexpr double kBudgetRecheckInterval = 0.1; // 暂停读之后检查能否恢复的间隔
+    void chargeBuffers();      // 缓冲区容量变化后记账 超限时暂停读/收缩空闲缓冲区
+    void pauseForBudget();
+    void checkBudgetResume();
+    size_t bufferBytes_ = 0;
+    bool budgetPaused_ = false;
+
+
+    // 连接建立到销毁期间持有自身 保证Channel在Poller中时TcpConnection一定存活 取代Channel::tie
+    TcpConnectionPtr selfRef_;
+
+    // 读事件的自定义处理(readWithTimeout/readAtLeast/TLS握手) 设置后读事件不再直接唤醒channel上的协程
+    // 用成员函数指针而不是std::function: 每次co_await都会设置一次 不能有堆分配
+    using ReadResume = void (TcpConnection::*)();
+    ReadResume readResume_ = nullptr;
+    std::shared_ptr<ReadWithTimeoutAwaiter::State> readTimeoutState_; // readWithTimeout 正在等待的状态
+    std::coroutine_handle<> readAtLeastCoroutine_ = nullptr; // readAtLeast 和 readUntil 共用
+    std::function<bool(Buffer *)> readUntil_;
 
     // 协程句柄 (取代了 std::function 回调)
     std::coroutine_handle<> writeCoroutine_ = nullptr;
@@ -19,9 +19,12 @@
 #include "TcpConnection.h"
 #include "Buffer.h"
 #include "CoroutineSupport.h" // 必须包含 Task 定义
+#include "SocketOptions.h"
+#include "TcpServerBase.h"
 
-// 对外的服务器编程使用的类
-class TcpServer
+// 对外的服务器编程使用的类 连接事件通过运行时设置的回调(std::function)分发
+// accept、连接表、连接数上限等和 TcpServerT 共用 见 TcpServerBase
+class TcpServer : public TcpServerBase
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop *)>;
@@ -36,15 +39,32 @@ public:
               const InetAddress &listenAddr,
               const std::string &nameArg,
               Option option = kNoReusePort);
-    ~TcpServer();
+    ~TcpServer() override;
 
     void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
     void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    // 连接迁移完成后在原loop线程调用 用于搬迁业务自己挂在loop上的状态(定时器等)
+    void setMigrateCallback(const MigrateCallback &cb) { migrateCallback_ = cb; }
     // void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
     // void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
 
-    // 设置底层subloop的个数
-    void setThreadNum(int numThreads);
+    // 按名字选择预置的调优profile("latency" "bulk" "default") 名字无效时返回false且不做修改
+    bool setTuningProfile(const std::string &profile);
+
+    /**
+     * 设置进程级的连接缓冲区内存预算(BufferBudget::global) 0表示只统计不限制
+     * 超过预算时拒绝新连接 占用大的连接暂停读; 同时每隔一段时间让所有连接收缩空闲的缓冲区
+     * 统计可以随时通过 BufferBudget::global() 和 EventLoop::bufferBytes() 查询
+     **/
+    void setBufferBudget(size_t bytes, double sweepIntervalSecs = 1.0);
+
+    /**
+     * 开启自动负载均衡: 每隔intervalSecs统计一次各subloop在这段时间内的收发字节数，
+     * 最忙的loop超过最闲的loop的imbalanceRatio倍时，把它上面的一个连接迁移到最闲的loop。
+     * 每轮最多迁移一个连接 避免连接在loop之间来回抖动
+     * 必须在start之后、baseLoop线程中调用
+     **/
+    void enableRebalancing(double intervalSecs, double imbalanceRatio = 2.0);
     /**
      * 如果没有监听, 就启动服务器(监听).
      * 多次调用没有副作用.
@@ -53,33 +73,24 @@ public:
     void start();
 
 private:
-    // void newConnection(int sockfd, const InetAddress &peerAddr);
-    // 改为普通的内部函数供协程调用
-    void handleNewConnection(int sockfd, const InetAddress &peerAddr);
-    void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
-
-    // [新增] 专门负责 Accept 的协程
-    Task acceptLoop();
-
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
-
-    EventLoop *loop_; // baseloop 用户自定义的loop
-
-    const std::string ipPort_;
-    const std::string name_;
-
-    std::unique_ptr<Acceptor> acceptor_; // 运行在mainloop 任务就是监听新连接事件
-
-    std::shared_ptr<EventLoopThreadPool> threadPool_; // one loop per thread
+    void setupConnection(const TcpConnectionPtr &conn) override;
+    void connectionMigrated(const TcpConnectionPtr &conn, EventLoop *from, EventLoop *to) override;
+    void connectionRemoved(const TcpConnectionPtr &conn) override;
+    void sweepBuffers();
+    void rebalance();
 
     ConnectionCallback connectionCallback_;       //有新连接时的回调
+    MigrateCallback migrateCallback_;             // 连接迁移完成后的回调
     MessageCallback messageCallback_;             // 有读写事件发生时的回调
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成后的回调
 
     ThreadInitCallback threadInitCallback_; // loop线程初始化的回调
-    int numThreads_;//线程池中线程的数量。
-    std::atomic_int started_;
-    int nextConnId_;
-    ConnectionMap connections_; // 保存所有的连接
-};
\ No newline at end of file
+
+    double imbalanceRatio_;
+    bool rebalanceArmed_;
+    TimerId rebalanceTimer_;
+    std::unordered_map<std::string, uint64_t> lastBytes_; // 上一轮统计时每个连接的累计收发字节数
+
+    bool sweepArmed_;
+    TimerId sweepTimer_;
+};
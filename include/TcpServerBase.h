@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+
+#include "noncopyable.h"
+#include "EventLoop.h"
+#include "Acceptor.h"
+#include "InetAddress.h"
+#include "EventLoopThreadPool.h"
+#include "Callbacks.h"
+#include "TcpConnection.h"
+#include "SocketOptions.h"
+#include "CoroutineSupport.h"
+
+/**
+ * TcpServer 和 TcpServerT<Handler> 共用的部分: 监听、accept协程、连接命名和subloop分配、
+ * 连接表、连接数上限、fd耗尽时的退避、缓冲区预算超限时拒绝新连接、线程池伸缩和连接迁移的计数
+ *
+ * 派生类只决定连接交给谁处理:
+ *   setupConnection     新连接建立之前在baseLoop调用 设置连接上的回调(ConnectionCallback/CloseCallback)
+ *   connectionReady     connectEstablished之后在连接所属subloop调用
+ *   connectionMigrated  连接迁移完成后在原loop线程调用
+ *   connectionRemoved   连接从连接表删除时在baseLoop调用
+ * 这些钩子每个连接只调用一次 连接上的读写事件不经过这里
+ **/
+class TcpServerBase : noncopyable
+{
+public:
+    const std::string &name() const { return name_; }
+    const std::string &ipPort() const { return ipPort_; }
+    EventLoop *getLoop() const { return loop_; }
+    size_t numConnections() const { return connections_.size(); }
+
+    // 每个新连接accept之后都会应用这组调优参数 单个连接可以再用 TcpConnection::applySocketOptions 覆盖
+    void setSocketOptions(const SocketOptions &options) { socketOptions_ = options; }
+    // 连接数上限 达到上限后暂停accept 有连接关闭时恢复 0表示不限制(默认)
+    void setMaxConnections(size_t maxConnections) { maxConnections_ = maxConnections; }
+    // fd耗尽时暂停accept的时长 到期或者有连接关闭时恢复
+    void setAcceptRetryDelay(double seconds) { acceptRetryDelay_ = seconds; }
+
+    // 设置底层subloop的个数
+    void setThreadNum(int numThreads);
+    // 运行期间调整subloop的个数(线程安全) 缩容时被摘掉的loop等其上的连接全部关闭后退出
+    void resizeThreadPool(int numThreads);
+    // 把连接迁移到另一个subloop(线程安全) 连接不在安全点时放弃 见 TcpConnection::migrateTo
+    void migrateConnection(const TcpConnectionPtr &conn, EventLoop *target);
+
+protected:
+    TcpServerBase(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg, bool reuseport);
+    virtual ~TcpServerBase();
+
+    // 启动线程池并开始监听 多次调用没有副作用 线程安全
+    void startServer(const EventLoopThreadPool::ThreadInitCallback &cb);
+    // 连接关闭后从连接表删除并销毁(可以在任意线程调用) 派生类的CloseCallback最后要调用它
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    virtual void setupConnection(const TcpConnectionPtr &conn) = 0;
+    virtual void connectionReady(const TcpConnectionPtr &) {}
+    virtual void connectionMigrated(const TcpConnectionPtr &, EventLoop *, EventLoop *) {}
+    virtual void connectionRemoved(const TcpConnectionPtr &) {}
+
+    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+
+    EventLoop *loop_; // baseloop 用户自定义的loop
+    const std::string ipPort_;
+    const std::string name_;
+    std::unique_ptr<Acceptor> acceptor_;              // 运行在mainloop 任务就是监听新连接事件
+    std::shared_ptr<EventLoopThreadPool> threadPool_; // one loop per thread
+    ConnectionMap connections_;                       // 保存所有的连接 只在baseLoop访问
+
+private:
+    // 专门负责 Accept 的协程
+    Task acceptLoop();
+    void handleNewConnection(int sockfd, const InetAddress &peerAddr);
+    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    // 暂停接收新连接 retryDelay > 0 时同时启动一个定时器到期后尝试恢复
+    void pauseAccepting(double retryDelay);
+    // 连接数回落到上限以下时恢复接收新连接
+    void maybeResumeAccepting();
+
+    SocketOptions socketOptions_; // 应用到每个新连接上的调优参数
+    std::atomic_int started_;
+    int nextConnId_;
+
+    size_t maxConnections_; // 0表示不限制
+    double acceptRetryDelay_;
+    bool retryTimerArmed_;
+    TimerId retryTimer_;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <concepts>
+
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "EventLoopThreadPool.h"
+#include "TcpConnection.h"
+#include "TcpServerBase.h"
+
+/**
+ * 业务处理类型需要满足的约束
+ * 必须提供: onConnection(conn)     连接建立后在conn所属的subloop中调用 通常在这里启动会话协程
+ * 可选提供: onDisconnection(conn)  连接关闭时在conn所属的subloop中调用
+ *          onThreadInit(loop)     每个subloop线程启动时调用
+ **/
+template <typename H>
+concept ServerHandler = requires(H &h, const TcpConnectionPtr &conn) {
+    h.onConnection(conn);
+};
+
+template <typename H>
+concept HasDisconnectionHook = requires(H &h, const TcpConnectionPtr &conn) {
+    h.onDisconnection(conn);
+};
+
+template <typename H>
+concept HasThreadInitHook = requires(H &h, EventLoop *loop) {
+    h.onThreadInit(loop);
+};
+
+/**
+ * 编译期绑定业务处理类型的 TcpServer
+ *
+ * TcpServer 通过 std::function 保存 ConnectionCallback，每次连接建立/断开都是一次类型擦除的调用；
+ * TcpServerT<Handler> 把 Handler 作为模板参数按值保存，连接事件直接调用 handler_.onConnection(conn)，
+ * 编译器可以把业务代码(包括协程入口)内联进来。Handler 缺少必须的接口时在编译期报错。
+ *
+ * 用法:
+ *   struct Echo { Task onConnection(const TcpConnectionPtr &conn); };
+ *   TcpServerT<Echo> server(&loop, InetAddress(8000), "echo");
+ *   server.setThreadNum(4);
+ *   server.start();
+ *
+ * 接收连接、分配subloop、fd耗尽/连接数上限的处理和 TcpServer 是同一份代码(TcpServerBase)，
+ * 每个连接只在建立时经过一次虚函数 运行时回调版本的 TcpServer 仍然是默认选择
+ **/
+template <ServerHandler Handler>
+class TcpServerT : public TcpServerBase
+{
+public:
+    template <typename... Args>
+    TcpServerT(EventLoop *loop,
+               const InetAddress &listenAddr,
+               const std::string &nameArg,
+               Args &&...handlerArgs)
+        : TcpServerBase(loop, listenAddr, nameArg, true)
+        , handler_(std::forward<Args>(handlerArgs)...)
+    {
+    }
+
+    Handler &handler() { return handler_; }
+
+    void start()
+    {
+        if constexpr (HasThreadInitHook<Handler>)
+        {
+            startServer([this](EventLoop *loop) { handler_.onThreadInit(loop); });
+        }
+        else
+        {
+            startServer(EventLoopThreadPool::ThreadInitCallback());
+        }
+    }
+
+private:
+    void setupConnection(const TcpConnectionPtr &conn) override
+    {
+        // 不设置ConnectionCallback 连接建立后由connectionReady直接调用handler_
+        if constexpr (HasDisconnectionHook<Handler>)
+        {
+            conn->setCloseCallback([this](const TcpConnectionPtr &c) {
+                handler_.onDisconnection(c);
+                removeConnection(c);
+            });
+        }
+    }
+
+    void connectionReady(const TcpConnectionPtr &conn) override { handler_.onConnection(conn); }
+
+    Handler handler_;
+};
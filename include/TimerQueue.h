@@ -7,11 +7,12 @@
 
 #include <vector>
 #include <set>
+#include <functional>
 
 class EventLoop;
 class Timer;
 
-class TimerQueue
+class TimerQueue : private ChannelHandler
 {
 public:
     using TimerCallback = std::function<void()>;
@@ -27,6 +28,9 @@ public:
     // [新增] 取消接口
     void cancel(TimerId timerId);
 
+    // 还没有到期(或者周期性)的定时器个数 只能在loop线程调用
+    size_t size() const { return timers_.size(); }
+
 private:
     using Entry = std::pair<Timestamp, Timer*>; // 以时间戳作为键值获取定时器
     using TimerList = std::set<Entry>;          // 底层使用红黑树管理，自动按照时间戳进行排序
@@ -41,6 +45,7 @@ private:
     void cancelInLoop(TimerId timerId);
 
     // 定时器读事件触发的函数
+    void onReadable(Timestamp) override { handleRead(); }
     void handleRead();
 
     // 重新设置timerfd_
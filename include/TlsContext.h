@@ -0,0 +1,113 @@
+#pragma once
+
+#include <string>
+#include <sys/types.h>
+#include <openssl/types.h>
+
+#include "noncopyable.h"
+
+class Buffer;
+
+/**
+ * TLS配置(对SSL_CTX的封装) 一个TlsContext可以被任意多个连接共享 构造之后只读
+ *
+ * 握手在用户态由OpenSSL完成，握手结束后OpenSSL尝试为socket开启kTLS(TCP_ULP "tls")，
+ * 把会话密钥交给内核，之后的记录加密由内核完成:
+ *   - 发送方向进了内核后 write/writev/sendfile 直接写明文 sendFile的零拷贝路径在加密连接上照常工作
+ *   - 内核、OpenSSL或者协商出的加密套件不支持kTLS时 退化为用户态 SSL_read/SSL_write，sendFile改为 pread+SSL_write
+ * TcpConnection::kernelTls() 可以查到最终走的是哪条路径
+ *
+ * 服务端:
+ *   TlsContext ctx(TlsContext::kServer);
+ *   ctx.loadCertificate("server.crt", "server.key");   // 或者 ctx.useSelfSigned("localhost") 用于测试
+ *   会话协程里: if (!co_await conn->startTls(&ctx)) co_return;
+ * 客户端:
+ *   TlsContext ctx(TlsContext::kClient);
+ *   ctx.trustCertificatePem(serverCtx.certificatePem()); // 或 loadVerifyLocations 不设置时不校验对端
+ *   co_await conn->startTls(&ctx, "localhost");
+ **/
+class TlsContext : noncopyable
+{
+public:
+    enum Mode
+    {
+        kServer,
+        kClient
+    };
+
+    explicit TlsContext(Mode mode);
+    ~TlsContext();
+
+    bool valid() const { return ctx_ != nullptr; }
+    Mode mode() const { return mode_; }
+    SSL_CTX *native() const { return ctx_; }
+
+    // PEM格式的证书链和私钥
+    bool loadCertificate(const std::string &certFile, const std::string &keyFile);
+    // 现场生成P-256私钥和自签名证书(CN=commonName 有效期一年) 用于测试和回环环境
+    bool useSelfSigned(const std::string &commonName = "localhost");
+    // 当前使用的证书(PEM) 交给测试客户端作为信任锚
+    std::string certificatePem() const;
+
+    // 设置信任的CA后会校验对端证书 客户端startTls时给出serverName还会校验主机名
+    bool loadVerifyLocations(const std::string &caFile);
+    bool trustCertificatePem(const std::string &pem);
+
+    // 握手结束后是否尝试开启kTLS 默认开启 关闭后始终在用户态加解密(用于对比测试)
+    void setKernelTls(bool on);
+    bool kernelTls() const { return kernelTls_; }
+
+private:
+    void enableVerify();
+
+    Mode mode_;
+    SSL_CTX *ctx_;
+    bool kernelTls_;
+};
+
+/**
+ * 一个连接上的TLS会话 由TcpConnection::startTls创建并持有 只在连接所属的loop线程使用
+ * OpenSSL直接读写socket(kTLS要求使用socket BIO) 这里把它的返回值翻译成与read/write一致的 返回值+errno
+ **/
+class TlsSession : noncopyable
+{
+public:
+    enum Status
+    {
+        kDone,
+        kWantRead,
+        kWantWrite,
+        kFailed
+    };
+
+    TlsSession(TlsContext *ctx, int sockfd, const std::string &serverName);
+    ~TlsSession();
+
+    bool valid() const { return ssl_ != nullptr; }
+
+    // 推进一次非阻塞握手
+    Status handshake();
+    // 握手完成后 各方向的记录加解密是否已经交给内核
+    bool kernelSend() const { return kernelSend_; }
+    bool kernelRecv() const { return kernelRecv_; }
+    // OpenSSL内部还有已经解密但没取走的数据 epoll不会再为它们通知
+    bool hasPending() const;
+
+    // 读出所有可用的明文追加到buf 语义同Buffer::readFd: 对端关闭返回0 暂无数据返回-1且*savedErrno=EAGAIN
+    ssize_t read(Buffer *buf, int *savedErrno);
+    // 加密发送 语义同write: 可能只发出一部分 发不出去时返回-1且*savedErrno=EAGAIN
+    // 返回EAGAIN之后必须用同样开头的数据重试(OpenSSL的要求 调用方的缓冲区天然满足)
+    ssize_t write(const void *data, size_t len, int *savedErrno);
+    // 发送close_notify 不等待对端回应
+    void shutdown();
+
+    std::string version() const;
+    std::string cipher() const;
+
+private:
+    int translateError(int ret, int *savedErrno);
+
+    SSL *ssl_;
+    bool kernelSend_;
+    bool kernelRecv_;
+};
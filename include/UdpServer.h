@@ -0,0 +1,53 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "UdpSocket.h"
+#include "CoroutineSupport.h"
+
+class EventLoop;
+class EventLoopThreadPool;
+
+/**
+ * UDP服务器: 每个subloop各自绑定一个 SO_REUSEPORT 的 UdpSocket，由内核按四元组分流
+ * 每个socket上运行一个接收协程 对一批数据报逐个回调 DatagramCallback
+ * 回调里可以直接 sock->sendTo() 回复 回复会在本轮事件循环结束时批量发出
+ **/
+class UdpServer : noncopyable
+{
+public:
+    using DatagramCallback = std::function<void(UdpSocket *, const UdpSocket::Datagram &)>;
+    using ThreadInitCallback = std::function<void(EventLoop *)>;
+
+    UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg);
+    ~UdpServer();
+
+    void setThreadNum(int numThreads);
+    void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    void setDatagramCallback(const DatagramCallback &cb) { datagramCallback_ = cb; }
+    // 在start之前设置 对每个socket生效
+    void setGro(bool on) { gro_ = on; }
+    void setGso(bool on) { gso_ = on; }
+
+    void start();
+
+private:
+    Task recvLoop(UdpSocket *sock);
+
+    EventLoop *loop_;
+    const InetAddress listenAddr_;
+    const std::string name_;
+    std::shared_ptr<EventLoopThreadPool> threadPool_;
+    DatagramCallback datagramCallback_;
+    ThreadInitCallback threadInitCallback_;
+    bool gro_;
+    bool gso_;
+    std::atomic_int started_;
+    std::vector<std::unique_ptr<UdpSocket>> sockets_; // 每个loop一个 只在start时写入
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <coroutine>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Socket.h"
+#include "Channel.h"
+
+class EventLoop;
+
+/**
+ * UDP socket，与 TcpConnection 一样挂在 EventLoop/Channel 上
+ *
+ * 接收: recvmmsg 一次系统调用读一批数据报 写入预先分配好的一组固定槽位(ring)，
+ *      co_await sock->recv() 返回这一批数据报的视图，下一次 recv 之前有效
+ * 发送: sendTo 只是把数据报放入发送队列，同一轮事件循环里的所有数据报
+ *      在本轮事件循环末尾(queueAfterDispatch)用 sendmmsg 一次性发出
+ * GRO: 开启后内核会把同一条流的多个数据报合并成一个大包交上来，这里按 gso_size 拆回独立的数据报
+ * GSO: sendSegmented 把一大块数据交给内核按 segmentSize 切分成多个数据报，只需一次拷贝一次系统调用
+ *
+ * 除构造外所有接口都必须在所属 loop 线程调用
+ **/
+class UdpSocket : noncopyable, private ChannelHandler
+{
+public:
+    static const int kBatchSize = 64;             // 一次 recvmmsg/sendmmsg 最多处理的数据报个数
+    static const size_t kSlotSize = 2048;         // 未开启GRO时每个接收槽位的大小 足够容纳一个以太网MTU的数据报
+    static const size_t kGroSlotSize = 65536;     // 开启GRO后合并包最大64KB
+    static const size_t kMaxQueuedBytes = 4 * 1024 * 1024; // 发送队列上限 超过后丢弃新的数据报
+
+    // 数据报视图 data指向接收槽位 下一次 recv 之前有效
+    struct Datagram
+    {
+        const char *data;
+        size_t len;
+        InetAddress peer;
+    };
+
+    UdpSocket(EventLoop *loop, const InetAddress &localAddr, bool reuseport = false);
+    ~UdpSocket();
+
+    EventLoop *getLoop() const { return loop_; }
+    int fd() const { return socket_.fd(); }
+    const InetAddress &localAddress() const { return localAddr_; }
+
+    // 开启UDP GRO 内核不支持时返回false
+    bool setGro(bool on);
+    // 探测内核是否支持UDP GSO 不支持时 sendSegmented 退化为逐个数据报入队
+    bool enableGso();
+    bool groEnabled() const { return groEnabled_; }
+    bool gsoEnabled() const { return gsoEnabled_; }
+
+    // 放入发送队列 本轮事件循环结束时统一 flush
+    void sendTo(const InetAddress &peer, const void *data, size_t len);
+    void sendTo(const InetAddress &peer, const std::string &data) { sendTo(peer, data.data(), data.size()); }
+    // 把data按segmentSize切分成多个发往同一个peer的数据报
+    void sendSegmented(const InetAddress &peer, const void *data, size_t len, size_t segmentSize);
+
+    size_t queuedBytes() const { return sendBuffer_.size(); }
+    uint64_t droppedDatagrams() const { return dropped_; }
+
+    // ================= 协程接口 =================
+
+    // 用法: const auto &batch = co_await sock->recv();
+    struct RecvAwaiter
+    {
+        UdpSocket *sock_;
+        RecvAwaiter(UdpSocket *sock) : sock_(sock) {}
+
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        const std::vector<Datagram> &await_resume();
+    };
+
+    RecvAwaiter recv() { return RecvAwaiter(this); }
+
+private:
+    struct PendingDatagram
+    {
+        InetAddress peer;
+        size_t offset;      // 在sendBuffer_中的偏移
+        size_t len;
+        uint16_t segmentSize; // 0表示普通数据报 否则使用GSO
+    };
+
+    void setupRecvRing();
+    void recvBatch();
+    void scheduleFlush();
+    void flush();
+    void onReadable(Timestamp) override { handleRead(); }
+    void onWritable() override { handleWrite(); }
+    void handleRead(); // 没有协程等待时的读事件
+    void handleWrite();
+
+    EventLoop *loop_;
+    Socket socket_;
+    InetAddress localAddr_;
+    std::unique_ptr<Channel> channel_;
+
+    bool groEnabled_;
+    bool gsoEnabled_;
+
+    // 接收环: kBatchSize个固定槽位 以及对应的 mmsghdr/iovec/地址/控制消息缓冲区
+    size_t slotSize_;
+    std::vector<char> recvSlots_;
+    std::vector<mmsghdr> recvMsgs_;
+    std::vector<iovec> recvIovecs_;
+    std::vector<sockaddr_in> recvAddrs_;
+    std::vector<char> recvControl_;
+    std::vector<Datagram> datagrams_;
+
+    // 发送队列: 数据连续存放 flush 时再组装 mmsghdr
+    std::string sendBuffer_;
+    std::vector<PendingDatagram> pending_;
+    size_t pendingHead_; // 上一次flush因EAGAIN没发完时 下一个待发送的位置
+    bool flushScheduled_;
+    uint64_t dropped_;
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Buffer.h"
+#include "TcpConnection.h"
+
+class HttpRequest;
+class HttpResponse;
+
+/**
+ * RFC 6455 WebSocket 服务端 构建在TcpConnection的协程读接口之上
+ *
+ * 握手由HttpServer完成(setWebSocketHandler) 也可以自己调用acceptHandshake生成101响应 之后把连接交给WebSocket
+ *
+ * 接收: 两种粒度 二选一
+ *   Frame   f = co_await ws.readFrame();    // 一个数据帧 分片消息的后续帧opcode是kContinuation
+ *   Message m = co_await ws.readMessage();  // 一条完整消息 分片在内部拼好
+ * 返回的payload/data指向连接的输入缓冲区(帧已经原地去掉掩码) 或者拼接分片用的内部缓冲区，
+ * 在下一次读之前有效; 单帧消息(绝大多数)不拷贝
+ * 控制帧在内部处理 不交给调用方: ping自动回pong pong忽略 close回应close并关闭连接，
+ * 之后读到 opcode == kClose(closeCode是对方的状态码 连接异常断开时是kAbnormalClosure)
+ * 控制帧的负载最多125字节 回应写进预先分配好的缓冲区 稳定运行后不分配内存
+ *
+ * 帧的负载就地去掩码 文本消息做UTF-8校验(跨分片增量校验 非法时用1007关闭)
+ * 两者都有SSE2/AVX2实现 运行时按CPU选择 和Buffer的扫描内核一样可以用 KAMA_SCAN_ISA=scalar|sse2 强制降级
+ *
+ * 协议错误(保留位、未知opcode、客户端帧没有掩码、控制帧分片或过长、分片顺序错误)用1002关闭
+ * 消息超过maxMessageSize用1009关闭 不支持扩展(permessage-deflate)和子协议
+ *
+ * 发送: sendText/sendBinary 直接写帧; 推送给大量连接时用makeFrame编码一次 再对每个连接sendFrame(或Broadcaster)共享同一块内存
+ * 所有接口在连接所属loop线程使用
+ * 用法:
+ *   server.setWebSocketHandler([](HttpRequest &req, WebSocket &ws) -> AsyncTask {
+ *       while (true) {
+ *           WebSocket::Message msg = co_await ws.readMessage();
+ *           if (msg.opcode == WebSocket::kClose) break;
+ *           ws.send(msg.opcode, msg.data);
+ *       }
+ *   });
+ **/
+class WebSocket : noncopyable
+{
+public:
+    enum Opcode
+    {
+        kContinuation = 0x0,
+        kText = 0x1,
+        kBinary = 0x2,
+        kClose = 0x8,
+        kPing = 0x9,
+        kPong = 0xA
+    };
+
+    enum CloseCode
+    {
+        kNormalClosure = 1000,
+        kGoingAway = 1001,
+        kProtocolError = 1002,
+        kUnsupportedData = 1003,
+        kNoStatus = 1005,       // 只用于上报 不能出现在close帧里
+        kAbnormalClosure = 1006, // 只用于上报 没收到close帧连接就断了
+        kInvalidPayload = 1007,
+        kPolicyViolation = 1008,
+        kMessageTooBig = 1009,
+        kInternalError = 1011
+    };
+
+    static constexpr size_t kDefaultMaxMessageSize = 16 * 1024 * 1024;
+    static constexpr size_t kMaxControlPayload = 125;
+
+    struct Frame
+    {
+        Opcode opcode;
+        bool fin;
+        std::string_view payload;
+        uint16_t closeCode; // opcode == kClose 时有效 payload是原因
+    };
+
+    struct Message
+    {
+        Opcode opcode; // kText/kBinary/kClose
+        std::string_view data;
+        uint16_t closeCode;
+    };
+
+    explicit WebSocket(const TcpConnectionPtr &conn);
+
+    const TcpConnectionPtr &connection() const { return conn_; }
+    void setMaxMessageSize(size_t bytes) { maxMessageSize_ = bytes; }
+    // 收到或者发出了close帧(或者连接已经断开) 之后读到的都是kClose
+    bool closing() const { return closeCode_ != 0; }
+
+    // ================= 握手 =================
+
+    // GET + Upgrade: websocket + Connection: upgrade
+    static bool isUpgradeRequest(const HttpRequest &req);
+    // 校验升级请求并填好101响应 版本不是13时填426 其他错误填400 返回false
+    static bool acceptHandshake(const HttpRequest &req, HttpResponse *resp);
+    // Sec-WebSocket-Accept = base64(SHA1(key + GUID))
+    static std::string acceptKey(std::string_view key);
+
+    // ================= 接收 =================
+
+    struct FrameAwaiter
+    {
+        WebSocket *ws_;
+        TcpConnection::ReadUntilAwaiter read_;
+
+        explicit FrameAwaiter(WebSocket *ws);
+
+        bool await_ready() { return read_.await_ready(); }
+        void await_suspend(std::coroutine_handle<> h) { read_.await_suspend(h); }
+        Frame await_resume();
+    };
+
+    struct MessageAwaiter
+    {
+        WebSocket *ws_;
+        TcpConnection::ReadUntilAwaiter read_;
+
+        explicit MessageAwaiter(WebSocket *ws);
+
+        bool await_ready() { return read_.await_ready(); }
+        void await_suspend(std::coroutine_handle<> h) { read_.await_suspend(h); }
+        Message await_resume();
+    };
+
+    FrameAwaiter readFrame() { return FrameAwaiter(this); }
+    MessageAwaiter readMessage() { return MessageAwaiter(this); }
+
+    // ================= 发送 =================
+
+    void send(Opcode opcode, std::string_view payload);
+    void sendText(std::string_view text) { send(kText, text); }
+    void sendBinary(std::string_view data) { send(kBinary, data); }
+    // 已经编码好的帧(makeFrame) 按引用排进发送队列
+    void sendFrame(const SharedMessage &frame);
+    void ping(std::string_view payload = std::string_view());
+    // 发送close帧并关闭写方向 之后的读返回kClose 重复调用无效
+    void close(uint16_t code = kNormalClosure, std::string_view reason = std::string_view());
+
+    // 编码一个服务端帧(不带掩码) 用于一次编码推送给多个连接
+    static SharedMessage makeFrame(Opcode opcode, std::string_view payload);
+    // 写帧头 返回字节数(最多10)
+    static size_t encodeHeader(char *out, Opcode opcode, bool fin, size_t payloadLen);
+
+    // ================= 向量化内核(WebSocketCodec.cc) =================
+
+    // 就地异或掩码 mask是帧里的4字节掩码 data从掩码的第0个字节开始对齐
+    static void unmask(char *data, size_t len, const char mask[4]);
+    static bool validUtf8(const char *data, size_t len);
+    // 当前使用的内核: "scalar" / "sse2" / "avx2"
+    static const char *codecIsa();
+
+private:
+    enum PollMode
+    {
+        kPollFrame,
+        kPollMessage
+    };
+    enum PollResult
+    {
+        kNeedMore,
+        kGotFrame,
+        kGotMessage,
+        kClosed
+    };
+
+    // 分片边界可能切开一个多字节字符 不完整的尾部留到下一片一起校验
+    struct Utf8Stream
+    {
+        char pending[4];
+        size_t pendingLen = 0;
+
+        bool feed(const char *data, size_t len, bool last);
+        void reset() { pendingLen = 0; }
+    };
+
+    // 从输入缓冲区处理帧 直到得到一个数据帧/完整消息 需要更多数据或者连接进入关闭状态
+    PollResult poll(Buffer *in, PollMode mode);
+    void handleControl(Opcode opcode, const char *payload, size_t len);
+    // 协议错误: 发送close帧并关闭 之后读到kClose
+    void fail(uint16_t code);
+    // 帧头和负载写进output_一次发出
+    void sendRaw(Opcode opcode, const char *payload, size_t len);
+    // 进入关闭状态 记下上报给调用方的状态码和原因
+    void finishClose(uint16_t code, const char *reason, size_t len);
+
+    TcpConnectionPtr conn_;
+    size_t maxMessageSize_;
+
+    PollResult lastPoll_;
+    size_t pendingConsume_;    // 上一次交出去的帧 下一次读之前从输入缓冲区移走
+    Frame frame_;              // 最近一次poll得到的数据帧
+    bool fragmented_;          // 正在接收分片消息
+    Opcode messageOpcode_;     // 分片消息第一帧的opcode
+    size_t messageBytes_;      // 当前消息已经收到的负载字节数
+    std::string message_;      // 拼接分片 容量复用
+    Utf8Stream utf8_;
+
+    bool closeSent_;
+    uint16_t closeCode_; // 非0表示已经进入关闭状态
+    char closeReason_[kMaxControlPayload];
+    size_t closeReasonLen_;
+
+    Buffer output_; // 帧的发送缓冲 容量复用 回应ping/close不分配内存
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <optional>
+#include <exception>
+#include <coroutine>
+#include <type_traits>
+#include <string>
+
+#include "noncopyable.h"
+#include "Thread.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+/**
+ * 计算线程池(work stealing)
+ *
+ * IO loop 只负责收发和协议处理，解析、压缩、加解密这类耗CPU的工作交给这里，
+ * 避免一个连接上的重计算拖住同一个loop上的所有连接
+ *
+ * 每个worker有自己的双端队列: worker自己提交的任务从尾部入队、从尾部取(LIFO 缓存更热)，
+ * 空闲的worker从其他worker队列的头部偷任务; 非worker线程提交的任务轮询放入各个worker的队列
+ *
+ * 协程用法(在EventLoop线程中):
+ *   auto digest = co_await pool.run([data = std::move(data)] { return sha256(data); });
+ * 协程被挂起 fn在worker线程执行 结果带回原来的EventLoop线程再恢复协程; fn抛出的异常在co_await处重新抛出
+ *
+ * 会话协程替某个连接做计算时用 run(conn, fn): 执行期间连接标记为busy(不会被迁移)，
+ * 完成时在conn当时所属的loop上恢复
+ **/
+class WorkerPool : noncopyable
+{
+public:
+    using Job = std::function<void()>;
+
+    explicit WorkerPool(int numThreads, const std::string &name = std::string("WorkerPool"));
+    ~WorkerPool();
+
+    void start();
+    // 执行完已经提交的任务后退出 之后提交的任务直接在调用线程执行
+    void stop();
+
+    // 线程安全
+    void submit(Job job);
+
+    int numThreads() const { return numThreads_; }
+    uint64_t numStolen() const { return stolen_.load(std::memory_order_relaxed); }
+
+    template <typename F>
+    struct RunAwaiter
+    {
+        using Result = std::invoke_result_t<F &>;
+        using Storage = std::conditional_t<std::is_void_v<Result>, bool, std::optional<Result>>;
+
+        WorkerPool *pool_;
+        F fn_;
+        TcpConnectionPtr conn_;
+        EventLoop *loop_ = nullptr;
+        Storage result_{};
+        std::exception_ptr error_;
+
+        RunAwaiter(WorkerPool *pool, F fn, TcpConnectionPtr conn = TcpConnectionPtr())
+            : pool_(pool), fn_(std::move(fn)), conn_(std::move(conn)) {}
+
+        bool await_ready() const { return false; }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            // 不在loop线程中co_await时没有可以返回的loop 协程直接在worker线程中恢复
+            // 任务执行期间loop不能被线程池回收 retain到结果投递回去为止
+            loop_ = EventLoop::currentLoop();
+            if (loop_)
+            {
+                loop_->retain();
+                if (conn_)
+                {
+                    conn_->beginBusy();
+                }
+            }
+            pool_->submit([this, h]() {
+                try
+                {
+                    if constexpr (std::is_void_v<Result>)
+                    {
+                        fn_();
+                    }
+                    else
+                    {
+                        result_.emplace(fn_());
+                    }
+                }
+                catch (...)
+                {
+                    error_ = std::current_exception();
+                }
+                if (EventLoop *loop = loop_)
+                {
+                    // 连接所属的loop以完成时为准
+                    TcpConnectionPtr conn = conn_;
+                    EventLoop *target = conn ? conn->getLoop() : loop;
+                    target->queueInLoop([loop, conn, h]() {
+                        loop->release();
+                        if (conn)
+                        {
+                            conn->endBusy();
+                        }
+                        h.resume();
+                    });
+                }
+                else
+                {
+                    h.resume();
+                }
+            });
+        }
+
+        Result await_resume()
+        {
+            if (error_)
+            {
+                std::rethrow_exception(error_);
+            }
+            if constexpr (!std::is_void_v<Result>)
+            {
+                return std::move(*result_);
+            }
+        }
+    };
+
+    template <typename F>
+    RunAwaiter<std::decay_t<F>> run(F &&fn)
+    {
+        return RunAwaiter<std::decay_t<F>>(this, std::forward<F>(fn));
+    }
+
+    template <typename F>
+    RunAwaiter<std::decay_t<F>> run(const TcpConnectionPtr &conn, F &&fn)
+    {
+        return RunAwaiter<std::decay_t<F>>(this, std::forward<F>(fn), conn);
+    }
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        std::unique_ptr<Thread> thread;
+    };
+
+    void workerFunc(int index);
+    bool popLocal(int index, Job *job);
+    bool steal(int thief, Job *job);
+
+    const std::string name_;
+    const int numThreads_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::atomic_bool running_;
+    std::atomic<size_t> pending_;     // 所有队列中尚未取走的任务数 worker据此决定是否睡眠
+    std::atomic<unsigned> nextWorker_; // 外部提交的轮询位置
+    std::atomic<uint64_t> stolen_;
+    std::mutex sleepMutex_;
+    std::condition_variable cond_;
+};
@@ -1,14 +1,17 @@
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <Acceptor.h>
 #include <Logger.h>
 #include <InetAddress.h>
 
-static int createNonblocking()
+static int createNonblocking(sa_family_t family)
 {
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    int protocol = (family == AF_UNIX) ? 0 : IPPROTO_TCP;
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
     if (sockfd < 0)
     {
          LOG_FATAL << "listen socket create err " << errno;
@@ -18,13 +21,53 @@ static int createNonblocking()
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop)
-    , acceptSocket_(createNonblocking())
+    , acceptSocket_(createNonblocking(listenAddr.family()))
     , acceptChannel_(new Channel(loop, acceptSocket_.fd()))
+    , listenAddr_(listenAddr)
     , listenning_(false)
+    , paused_(false)
+    , idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
+    , socketDev_(0)
+    , socketIno_(0)
 {
-    acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
+    if (!listenAddr.valid())
+    {
+        LOG_FATAL << "Acceptor: invalid listen address";
+    }
+    bool pathSocket = listenAddr.isUnix() && !listenAddr.isAbstract() && !listenAddr.unixPath().empty();
+    if (pathSocket)
+    {
+        // 文件系统路径上残留的socket文件(上次进程没有正常退出)会导致bind失败 先删除
+        // 只删除socket文件 配置错误指向普通文件时让bind失败 不能把文件删掉
+        struct stat st;
+        if (::lstat(listenAddr.unixPath().c_str(), &st) == 0)
+        {
+            if (S_ISSOCK(st.st_mode))
+            {
+                ::unlink(listenAddr.unixPath().c_str());
+            }
+            else
+            {
+                LOG_ERROR << "Acceptor: " << listenAddr.unixPath() << " exists and is not a socket";
+            }
+        }
+    }
+    else if (!listenAddr.isUnix())
+    {
+        acceptSocket_.setReuseAddr(true);
+        acceptSocket_.setReusePort(true);
+    }
     acceptSocket_.bindAddress(listenAddr);
+    if (pathSocket)
+    {
+        // 记下自己创建的socket文件 析构时只删除它(路径可能已经被别的进程重新bind)
+        struct stat st;
+        if (::lstat(listenAddr.unixPath().c_str(), &st) == 0)
+        {
+            socketDev_ = st.st_dev;
+            socketIno_ = st.st_ino;
+        }
+    }
     // TcpServer::start() => Acceptor.listen() 如果有新用户连接 要执行一个回调(accept => connfd => 打包成Channel => 唤醒subloop)
     // baseloop监听到有事件发生 => acceptChannel_(listenfd) => 执行该回调函数
     // acceptChannel_.setReadCallback(
@@ -36,6 +79,20 @@ Acceptor::~Acceptor()
     acceptChannel_->disableAll();    // 把从Poller中感兴趣的事件删除掉
     acceptChannel_->remove();        // 调用EventLoop->removeChannel => Poller->removeChannel 把Poller的ChannelMap对应的部分删除
     delete acceptChannel_;
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
+    if (socketIno_ != 0)
+    {
+        struct stat st;
+        std::string path = listenAddr_.unixPath();
+        if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode) && st.st_dev == socketDev_ &&
+            st.st_ino == socketIno_)
+        {
+            ::unlink(path.c_str());
+        }
+    }
 }
 
 void Acceptor::listen()
@@ -45,4 +102,51 @@ void Acceptor::listen()
     acceptSocket_.listen();         // listen
     // acceptChannel_.enableReading(); // acceptChannel_注册至Poller !重要
     LOG_DEBUG << "Acceptor::listen() end";
-}
\ No newline at end of file
+}
+
+void Acceptor::pauseAccepting()
+{
+    if (paused_)
+    {
+        return;
+    }
+    paused_ = true;
+    if (acceptChannel_->isReading())
+    {
+        acceptChannel_->disableReading();
+    }
+}
+
+void Acceptor::resumeAccepting()
+{
+    if (!paused_)
+    {
+        return;
+    }
+    paused_ = false;
+    // 只有accept协程正在等待时才重新监听 否则由下一次 co_await accept() 开启
+    if (acceptChannel_->readCoroutine() && !acceptChannel_->isReading())
+    {
+        acceptChannel_->enableReading();
+    }
+}
+
+/**
+ * 进程fd耗尽(EMFILE)时accept失败 连接一直留在全连接队列里 LT模式下listenfd会不停地触发可读
+ * 先关闭预留的idleFd_腾出一个fd 接收这个连接后立即关闭(对端收到FIN而不是一直等待) 再重新占住预留fd
+ **/
+void Acceptor::dropPendingConnection()
+{
+    if (idleFd_ < 0)
+    {
+        return;
+    }
+    ::close(idleFd_);
+    int connfd = ::accept4(acceptSocket_.fd(), nullptr, nullptr, SOCK_CLOEXEC);
+    if (connfd >= 0)
+    {
+        ::close(connfd);
+    }
+    idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    LOG_WARN << "Acceptor: file descriptors exhausted, dropped one pending connection";
+}
@@ -0,0 +1,250 @@
+#include <Broadcaster.h>
+#include <TcpConnection.h>
+#include <EventLoop.h>
+#include <Logger.h>
+
+Broadcaster::Broadcaster(const std::string &name)
+    : name_(name)
+    , alive_(std::make_shared<int>(0))
+    , numSubscribers_(0)
+    , dropped_(0)
+    , disconnected_(0)
+{
+}
+
+Broadcaster::~Broadcaster()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &item : groups_)
+    {
+        item.first->release();
+    }
+}
+
+Broadcaster::LoopGroupPtr Broadcaster::groupForLocked(EventLoop *loop)
+{
+    LoopGroupPtr &group = groups_[loop];
+    if (!group)
+    {
+        group = std::make_shared<LoopGroup>();
+        group->loop = loop;
+        loop->retain(); // 组存在期间还会向这个loop投递
+    }
+    return group;
+}
+
+void Broadcaster::leaveLocked(const LoopGroupPtr &group)
+{
+    if (--group->members > 0)
+    {
+        return;
+    }
+    auto it = groups_.find(group->loop);
+    if (it != groups_.end() && it->second == group)
+    {
+        groups_.erase(it);
+        group->loop->release();
+    }
+}
+
+void Broadcaster::forgetLocked(TcpConnection *key, const LoopGroupPtr &group)
+{
+    auto it = members_.find(key);
+    if (it == members_.end() || it->second != group)
+    {
+        return; // 已经退订
+    }
+    members_.erase(it);
+    numSubscribers_.fetch_sub(1, std::memory_order_relaxed);
+    leaveLocked(group);
+}
+
+void Broadcaster::subscribe(const TcpConnectionPtr &conn, OverflowPolicy policy, size_t maxQueuedBytes)
+{
+    TcpConnection *key = conn.get();
+    Subscriber sub{conn, key, policy, maxQueuedBytes, false};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (members_.count(key))
+        {
+            LOG_WARN << "Broadcaster [" << name_ << "] " << conn->name() << " already subscribed";
+            return;
+        }
+        LoopGroupPtr group = groupForLocked(conn->getLoop());
+        ++group->members;
+        members_[key] = group;
+        numSubscribers_.fetch_add(1, std::memory_order_relaxed);
+        group->loop->queueInLoop([this, group, sub]() { addInLoop(group, sub); });
+    }
+    // 连接关闭时立即退订 不用等下一次publish才发现
+    std::weak_ptr<int> alive = alive_;
+    conn->addCloseObserver([this, alive](const TcpConnectionPtr &c) {
+        if (alive.lock())
+        {
+            unsubscribe(c);
+        }
+    });
+}
+
+void Broadcaster::addInLoop(const LoopGroupPtr &group, Subscriber sub)
+{
+    group->subscribers.push_back(std::move(sub));
+}
+
+void Broadcaster::unsubscribe(const TcpConnectionPtr &conn)
+{
+    TcpConnection *key = conn.get();
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = members_.find(key);
+    if (it == members_.end())
+    {
+        return;
+    }
+    // 按记录的组删除 连接可能已经迁移 不能用conn->getLoop()找组
+    LoopGroupPtr group = it->second;
+    members_.erase(it);
+    numSubscribers_.fetch_sub(1, std::memory_order_relaxed);
+    group->loop->queueInLoop([this, group, key]() { removeInLoop(group, key); });
+    leaveLocked(group);
+}
+
+void Broadcaster::removeInLoop(const LoopGroupPtr &group, TcpConnection *key)
+{
+    auto &subs = group->subscribers;
+    for (auto it = subs.begin(); it != subs.end(); ++it)
+    {
+        if (it->key == key)
+        {
+            if (it->congested)
+            {
+                group->congested.fetch_sub(1, std::memory_order_relaxed);
+            }
+            subs.erase(it);
+            return;
+        }
+    }
+}
+
+void Broadcaster::publish(const SharedMessage &msg)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 每个loop一次投递 而不是每个连接一次
+    for (auto &item : groups_)
+    {
+        LoopGroupPtr group = item.second;
+        group->loop->queueInLoop([this, group, msg]() { dispatchInLoop(group, msg); });
+    }
+}
+
+size_t Broadcaster::congestedSubscribers() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t n = 0;
+    for (auto &item : groups_)
+    {
+        n += item.second->congested.load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+void Broadcaster::dispatchInLoop(const LoopGroupPtr &group, const SharedMessage &msg)
+{
+    auto &subs = group->subscribers;
+    size_t kept = 0;
+    for (size_t i = 0; i < subs.size(); ++i)
+    {
+        Subscriber &sub = subs[i];
+        TcpConnectionPtr conn = sub.conn.lock();
+        bool keep = false;
+        if (conn && conn->connected())
+        {
+            if (conn->getLoop() != group->loop)
+            {
+                // 连接已经迁移到别的loop 换到对应的组里 这条消息也在那边发
+                if (sub.congested)
+                {
+                    sub.congested = false;
+                    group->congested.fetch_sub(1, std::memory_order_relaxed);
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = members_.find(sub.key);
+                if (it != members_.end() && it->second == group)
+                {
+                    LoopGroupPtr target = groupForLocked(conn->getLoop());
+                    ++target->members;
+                    it->second = target;
+                    target->loop->queueInLoop([this, target, moved = sub, msg]() {
+                        addInLoop(target, moved);
+                        Subscriber &sub = target->subscribers.back();
+                        if (TcpConnectionPtr conn = sub.conn.lock())
+                        {
+                            deliver(*target, sub, conn, msg);
+                        }
+                    });
+                    leaveLocked(group);
+                }
+                continue;
+            }
+            keep = deliver(*group, sub, conn, msg);
+        }
+        if (!keep)
+        {
+            if (sub.congested)
+            {
+                group->congested.fetch_sub(1, std::memory_order_relaxed);
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            forgetLocked(sub.key, group);
+            continue;
+        }
+        if (kept != i)
+        {
+            subs[kept] = std::move(sub);
+        }
+        ++kept;
+    }
+    subs.resize(kept);
+}
+
+bool Broadcaster::deliver(LoopGroup &group, Subscriber &sub, const TcpConnectionPtr &conn, const SharedMessage &msg)
+{
+    size_t pending = conn->pendingOutputBytes();
+    bool overflow = pending + msg->size() > sub.maxQueuedBytes;
+
+    if (sub.policy == kBackpressure && overflow != sub.congested)
+    {
+        sub.congested = overflow;
+        if (overflow)
+        {
+            group.congested.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            group.congested.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (overflow)
+    {
+        switch (sub.policy)
+        {
+        case kDropNewest:
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        case kDropOldest:
+            dropped_.fetch_add(conn->dropQueuedShared(pending + msg->size() - sub.maxQueuedBytes),
+                               std::memory_order_relaxed);
+            break;
+        case kDisconnect:
+            LOG_WARN << "Broadcaster [" << name_ << "] subscriber " << conn->name()
+                     << " too slow (" << pending << " bytes queued), disconnect";
+            disconnected_.fetch_add(1, std::memory_order_relaxed);
+            conn->forceClose();
+            return false;
+        case kBackpressure:
+            break;
+        }
+    }
+    conn->sendShared(msg);
+    return true;
+}
@@ -1,5 +1,8 @@
 #include <errno.h>
+#include <string.h>
+#include <new>
 #include <sys/uio.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include <Buffer.h>
@@ -52,7 +55,7 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
     }
     else // extrabuf里面也写入了n-writable长度的数据
     {
-        writerIndex_ = buffer_.size();
+        writerIndex_ += writable;
         append(extrabuf, n - writable); // 对buffer_扩容 并将extrabuf存储的另一部分数据追加至buffer_
     }
     return n;
@@ -68,4 +71,97 @@ ssize_t Buffer::writeFd(int fd, int *saveErrno)
         *saveErrno = errno;
     }
     return n;
-}
\ No newline at end of file
+}
+
+// 映射 [addr, addr+cap) 和 [addr+cap, addr+2cap) 到同一个memfd 失败返回nullptr
+static char *createMirroredRegion(size_t capacity)
+{
+    int fd = ::memfd_create("kama-buffer", MFD_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    if (::ftruncate(fd, capacity) < 0)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    // 先占住两倍大小的连续地址空间 再用MAP_FIXED把memfd映射到前后两半
+    void *base = ::mmap(nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+    char *addr = static_cast<char *>(base);
+    if (::mmap(addr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        ::mmap(addr + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        ::munmap(base, capacity * 2);
+        ::close(fd);
+        return nullptr;
+    }
+    ::close(fd); // 映射会持有memfd的引用
+    return addr;
+}
+
+static size_t roundUpToPage(size_t len)
+{
+    static const size_t kPageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return (len + kPageSize - 1) / kPageSize * kPageSize;
+}
+
+Buffer::~Buffer()
+{
+    if (ring_)
+    {
+        ::munmap(ring_, ringCapacity_ * 2);
+    }
+}
+
+bool Buffer::enableMirroredRing(size_t capacity)
+{
+    if (mirrored())
+    {
+        return true;
+    }
+    size_t readable = readableBytes();
+    size_t cap = roundUpToPage(std::max(capacity, readable));
+    char *region = createMirroredRegion(cap);
+    if (!region)
+    {
+        return false;
+    }
+
+    ::memcpy(region, peek(), readable);
+    std::vector<char>().swap(buffer_);
+    ring_ = region;
+    ringCapacity_ = cap;
+    readerIndex_ = 0;
+    writerIndex_ = readable;
+    return true;
+}
+
+void Buffer::growRing(size_t len)
+{
+    size_t readable = readableBytes();
+    size_t cap = ringCapacity_ * 2;
+    while (cap < readable + len)
+    {
+        cap *= 2;
+    }
+    char *region = createMirroredRegion(cap);
+    if (!region)
+    {
+        // 地址空间或者fd耗尽 与vector::resize抛bad_alloc的行为保持一致
+        throw std::bad_alloc();
+    }
+
+    ::memcpy(region, peek(), readable);
+    ::munmap(ring_, ringCapacity_ * 2);
+    ring_ = region;
+    ringCapacity_ = cap;
+    readerIndex_ = 0;
+    writerIndex_ = readable;
+}
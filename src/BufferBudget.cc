@@ -0,0 +1,55 @@
+#include <BufferBudget.h>
+#include <EventLoop.h>
+
+BufferBudget &BufferBudget::global()
+{
+    static BufferBudget budget;
+    return budget;
+}
+
+BufferBudget::BufferBudget()
+    : limit_(0)
+    , resumeRatio_(0.8)
+    , used_(0)
+    , connections_(0)
+    , paused_(0)
+{
+}
+
+size_t BufferBudget::used() const
+{
+    int64_t used = used_.load(std::memory_order_relaxed);
+    return used > 0 ? static_cast<size_t>(used) : 0;
+}
+
+bool BufferBudget::exceeded() const
+{
+    size_t limit = limit_.load(std::memory_order_relaxed);
+    return limit > 0 && used() >= limit;
+}
+
+bool BufferBudget::belowResumeMark() const
+{
+    size_t limit = limit_.load(std::memory_order_relaxed);
+    return limit == 0 || static_cast<double>(used()) < limit * resumeRatio_.load(std::memory_order_relaxed);
+}
+
+bool BufferBudget::shouldPause(size_t connBytes) const
+{
+    if (!exceeded())
+    {
+        return false;
+    }
+    size_t conns = connections_.load(std::memory_order_relaxed);
+    return conns == 0 || connBytes >= used() / conns;
+}
+
+void BufferBudget::charge(EventLoop *loop, int64_t delta)
+{
+    if (delta == 0)
+    {
+        return;
+    }
+    used_.fetch_add(delta, std::memory_order_relaxed);
+    loop->addBufferBytes(delta);
+}
@@ -0,0 +1,299 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <Buffer.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define KAMA_SCAN_X86 1
+#endif
+
+/**
+ * Buffer 的字节扫描内核
+ *
+ * 三套实现: scalar(memchr/memmem) / SSE2(16字节) / AVX2(32字节)
+ * 向量版本一次比较一整块 用movemask把比较结果压成位图 位图非零时ctz就是第一个命中的位置
+ * 多字节模式(CRLF/双CRLF)把错开1~3字节的几次加载分别比较再按位与 不需要逐字节回溯
+ * 剩下不足一块的尾部交给下一级实现 所以不会越过end读取
+ * 单字节查找直接用glibc的memchr: 它本身就是按CPU分派的展开过的向量实现 比这里的简单循环更快
+ *
+ * x86_64 上SSE2是基线指令集 AVX2在运行时用cpuid检测 AVX2内核用target属性单独编译，
+ * 整个库不需要 -mavx2 也能在老CPU上运行 环境变量 KAMA_SCAN_ISA=scalar|sse2 可以强制降级 便于对比
+ */
+
+namespace
+{
+
+const size_t kMaxVectorSet = 16; // findAnyOf向量化时最多支持的字节集合大小 再多用查表
+
+// ================= scalar =================
+
+const char *byteScalar(const char *p, const char *end, char c)
+{
+    return p < end ? static_cast<const char *>(::memchr(p, c, end - p)) : nullptr;
+}
+
+const char *crlfScalar(const char *p, const char *end)
+{
+    while (end - p >= 2)
+    {
+        const char *cr = static_cast<const char *>(::memchr(p, '\r', end - p - 1));
+        if (cr == nullptr)
+        {
+            return nullptr;
+        }
+        if (cr[1] == '\n')
+        {
+            return cr;
+        }
+        p = cr + 1;
+    }
+    return nullptr;
+}
+
+const char *doubleCRLFScalar(const char *p, const char *end)
+{
+    return p < end ? static_cast<const char *>(::memmem(p, end - p, "\r\n\r\n", 4)) : nullptr;
+}
+
+const char *anyOfScalar(const char *p, const char *end, std::string_view set)
+{
+    bool table[256] = {false};
+    for (char c : set)
+    {
+        table[static_cast<unsigned char>(c)] = true;
+    }
+    for (; p < end; ++p)
+    {
+        if (table[static_cast<unsigned char>(*p)])
+        {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+#ifdef KAMA_SCAN_X86
+
+// ================= SSE2 =================
+
+inline __m128i load16(const char *p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+const char *crlfSse2(const char *p, const char *end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    // 第二次加载从p+1开始 所以每块需要17个字节
+    for (; end - p >= 17; p += 16)
+    {
+        __m128i hit = _mm_and_si128(_mm_cmpeq_epi8(load16(p), cr), _mm_cmpeq_epi8(load16(p + 1), lf));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return crlfScalar(p, end);
+}
+
+const char *doubleCRLFSse2(const char *p, const char *end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for (; end - p >= 19; p += 16)
+    {
+        __m128i hit = _mm_and_si128(_mm_cmpeq_epi8(load16(p), cr), _mm_cmpeq_epi8(load16(p + 1), lf));
+        hit = _mm_and_si128(hit, _mm_cmpeq_epi8(load16(p + 2), cr));
+        hit = _mm_and_si128(hit, _mm_cmpeq_epi8(load16(p + 3), lf));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return doubleCRLFScalar(p, end);
+}
+
+const char *anyOfSse2(const char *p, const char *end, std::string_view set)
+{
+    if (set.size() > kMaxVectorSet)
+    {
+        return anyOfScalar(p, end, set);
+    }
+    __m128i needles[kMaxVectorSet];
+    for (size_t i = 0; i < set.size(); ++i)
+    {
+        needles[i] = _mm_set1_epi8(set[i]);
+    }
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = load16(p);
+        __m128i hit = _mm_setzero_si128();
+        for (size_t i = 0; i < set.size(); ++i)
+        {
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, needles[i]));
+        }
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return anyOfScalar(p, end, set);
+}
+
+// ================= AVX2 =================
+
+#define KAMA_AVX2 __attribute__((target("avx2")))
+
+KAMA_AVX2 inline __m256i load32(const char *p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+KAMA_AVX2 const char *crlfAvx2(const char *p, const char *end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; end - p >= 33; p += 32)
+    {
+        __m256i hit = _mm256_and_si256(_mm256_cmpeq_epi8(load32(p), cr), _mm256_cmpeq_epi8(load32(p + 1), lf));
+        unsigned mask = _mm256_movemask_epi8(hit);
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return crlfSse2(p, end);
+}
+
+KAMA_AVX2 const char *doubleCRLFAvx2(const char *p, const char *end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; end - p >= 35; p += 32)
+    {
+        __m256i hit = _mm256_and_si256(_mm256_cmpeq_epi8(load32(p), cr), _mm256_cmpeq_epi8(load32(p + 1), lf));
+        hit = _mm256_and_si256(hit, _mm256_cmpeq_epi8(load32(p + 2), cr));
+        hit = _mm256_and_si256(hit, _mm256_cmpeq_epi8(load32(p + 3), lf));
+        unsigned mask = _mm256_movemask_epi8(hit);
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return doubleCRLFSse2(p, end);
+}
+
+KAMA_AVX2 const char *anyOfAvx2(const char *p, const char *end, std::string_view set)
+{
+    if (set.size() > kMaxVectorSet)
+    {
+        return anyOfScalar(p, end, set);
+    }
+    __m256i needles[kMaxVectorSet];
+    for (size_t i = 0; i < set.size(); ++i)
+    {
+        needles[i] = _mm256_set1_epi8(set[i]);
+    }
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = load32(p);
+        __m256i hit = _mm256_setzero_si256();
+        for (size_t i = 0; i < set.size(); ++i)
+        {
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, needles[i]));
+        }
+        unsigned mask = _mm256_movemask_epi8(hit);
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return anyOfSse2(p, end, set);
+}
+
+#undef KAMA_AVX2
+
+#endif // KAMA_SCAN_X86
+
+// ================= 运行时分派 =================
+
+struct ScanKernels
+{
+    const char *name;
+    const char *(*crlf)(const char *, const char *);
+    const char *(*anyOf)(const char *, const char *, std::string_view);
+    const char *(*doubleCRLF)(const char *, const char *);
+};
+
+const ScanKernels kScalarKernels = {"scalar", crlfScalar, anyOfScalar, doubleCRLFScalar};
+#ifdef KAMA_SCAN_X86
+const ScanKernels kSse2Kernels = {"sse2", crlfSse2, anyOfSse2, doubleCRLFSse2};
+const ScanKernels kAvx2Kernels = {"avx2", crlfAvx2, anyOfAvx2, doubleCRLFAvx2};
+#endif
+
+const ScanKernels &selectKernels()
+{
+    const char *forced = ::getenv("KAMA_SCAN_ISA");
+    if (forced != nullptr && ::strcmp(forced, "scalar") == 0)
+    {
+        return kScalarKernels;
+    }
+#ifdef KAMA_SCAN_X86
+    __builtin_cpu_init();
+    bool wantAvx2 = forced == nullptr || ::strcmp(forced, "sse2") != 0;
+    if (wantAvx2 && __builtin_cpu_supports("avx2"))
+    {
+        return kAvx2Kernels;
+    }
+    return kSse2Kernels;
+#else
+    return kScalarKernels;
+#endif
+}
+
+// 第一次使用时选定 之后只是一次已经初始化的静态变量检查 其他模块的静态初始化里调用也是安全的
+inline const ScanKernels &kernels()
+{
+    static const ScanKernels &k = selectKernels();
+    return k;
+}
+
+} // namespace
+
+const char *Buffer::scanCRLF(const char *begin, const char *end)
+{
+    return kernels().crlf(begin, end);
+}
+
+const char *Buffer::scanByte(const char *begin, const char *end, char c)
+{
+    return byteScalar(begin, end, c);
+}
+
+const char *Buffer::scanAnyOf(const char *begin, const char *end, std::string_view set)
+{
+    if (set.empty())
+    {
+        return nullptr;
+    }
+    if (set.size() == 1)
+    {
+        return byteScalar(begin, end, set[0]);
+    }
+    return kernels().anyOf(begin, end, set);
+}
+
+const char *Buffer::scanDoubleCRLF(const char *begin, const char *end)
+{
+    return kernels().doubleCRLF(begin, end);
+}
+
+const char *Buffer::scanIsa()
+{
+    return kernels().name;
+}
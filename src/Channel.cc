@@ -11,74 +11,60 @@ const int Channel::kWriteEvent = EPOLLOUT; //写事件
 // EventLoop: ChannelList Poller
 Channel::Channel(EventLoop *loop, int fd)
     : loop_(loop)
+    , handler_(nullptr)
+    , readCoroutine_(nullptr)
     , fd_(fd)
     , events_(0)
     , revents_(0)
     , index_(-1)
-    , tied_(false)
+    , logHup_(true)
+    , alive_(nullptr)
 {
 }
 
 Channel::~Channel()
 {
+    // 在自己的handleEvent中被析构(协程或handler释放了owner) 通知handleEvent不要再往下分发
+    if (alive_)
+    {
+        *alive_ = false;
+    }
 }
 
-// channel的tie方法什么时候调用过?  TcpConnection => channel
-/**
- * TcpConnection中注册了Channel对应的回调函数，传入的回调函数均为TcpConnection
- * 对象的成员方法，因此可以说明一点就是：Channel的结束一定晚于TcpConnection对象！
- * 此处用tie去解决TcpConnection和Channel的生命周期时长问题，从而保证了Channel对象能够在
- * TcpConnection销毁前销毁。
- **/
-void Channel::tie(const std::shared_ptr<void> &obj)
-{
-    LOG_DEBUG << "Channel::tie start";
-    tie_ = obj;
-    tied_ = true;
-    LOG_DEBUG << "Channel::tie end";
-}
 //update 和remove => EpollPoller 更新channel在poller中的状态
 /**
  * 当改变channel所表示的fd的events事件后，update负责再poller里面更改fd相应的事件epoll_ctl
  **/
 void Channel::update()
 {
-    LOG_DEBUG << "Channel::update start";
     // 通过channel所属的eventloop，调用poller的相应方法，注册fd的events事件
     loop_->updateChannel(this);
-    LOG_DEBUG << "Channel::update end";
 }
 
 // 在channel所属的EventLoop中把当前的channel删除掉
 void Channel::remove()
 {
-    LOG_DEBUG << "Channel::remove start";
     loop_->removeChannel(this);
-    LOG_DEBUG << "Channel::remove end";
 }
 
 void Channel::handleEvent(Timestamp receiveTime)
 {
-    LOG_DEBUG << "Channel::handleEvent start";
-    if (tied_)
-    {
-        std::shared_ptr<void> guard = tie_.lock();
-        if (guard)
-        {
-            handleEventWithGuard(receiveTime);
-        }
-        // 如果提升失败了 就不做任何处理 说明Channel的TcpConnection对象已经不存在了
-    }
-    else
+    bool alive = true;
+    alive_ = &alive;
+    handleEventWithGuard(receiveTime, alive);
+    if (alive)
     {
-        handleEventWithGuard(receiveTime);
+        alive_ = nullptr;
     }
-    LOG_DEBUG << "Channel::handleEvent end";
 }
 
-void Channel::handleEventWithGuard(Timestamp receiveTime)
+// 每个分支都可能恢复协程或者调用handler 它们可以关闭连接、释放owner甚至析构Channel本身
+// 所以每个分支之后都要确认Channel还在、handler没有被摘掉(setHandler(nullptr)) 否则不再分发
+void Channel::handleEventWithGuard(Timestamp receiveTime, const bool &alive)
 {
-    LOG_INFO<<"channel handleEvent revents:"<<revents_;
+    LOG_DEBUG << "channel handleEvent revents:" << revents_;
+    ChannelHandler *const handler = handler_;
+    auto detached = [this, handler, &alive]() { return !alive || handler_ != handler; };
     // 关闭
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN)) // 当TcpConnection对应Channel 通过shutdown 关闭写端 epoll触发EPOLLHUP
     {
@@ -87,51 +73,53 @@ void Channel::handleEventWithGuard(Timestamp receiveTime)
             LOG_WARN << "fd = " << fd_ << " Channel::handle_event() EPOLLHUP";
         }
 
-        if (readResumeCallback_)
+        if (readCoroutine_)
         {
-            readResumeCallback_();
+            readCoroutine_.resume();
         }
-        else if (readCoroutine_)
+        else if (handler_)
         {
-            readCoroutine_.resume();
+            handler_->onHangup();
         }
-        else if (closeCallback_)
+        if (detached())
         {
-            closeCallback_();
+            return;
         }
     }
     // 错误
     if (revents_ & EPOLLERR)
     {
-        if (errorCallback_)
+        if (handler_)
+        {
+            handler_->onError();
+        }
+        if (detached())
         {
-            errorCallback_();
+            return;
         }
     }
     // 读
     if (revents_ & (EPOLLIN | EPOLLPRI))
     {
-        if (readResumeCallback_)
+        if (readCoroutine_)
         {
-            readResumeCallback_();
+            readCoroutine_.resume();
         }
-        else if (readCoroutine_)
+        else if (handler_)
         {
-            readCoroutine_.resume();
+            handler_->onReadable(receiveTime);
         }
-        else if (readCallback_)
+        if (detached())
         {
-            readCallback_(receiveTime);
+            return;
         }
     }
     // 写
     if (revents_ & EPOLLOUT)
     {
-        if (writeCallback_)
+        if (handler_)
         {
-            writeCallback_();
+            handler_->onWritable();
         }
     }
-
-    LOG_DEBUG << "Channel::handleEventWithGuard end";
-}
\ No newline at end of file
+}
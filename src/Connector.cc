@@ -0,0 +1,172 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <Connector.h>
+#include <Channel.h>
+#include <EventLoop.h>
+#include <Logger.h>
+
+static int createNonblocking(sa_family_t family)
+{
+    int protocol = (family == AF_UNIX) ? 0 : IPPROTO_TCP;
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
+    if (sockfd < 0)
+    {
+        LOG_ERROR << "Connector::createNonblocking error " << errno;
+    }
+    return sockfd;
+}
+
+static int getSocketError(int sockfd)
+{
+    int optval = 0;
+    socklen_t optlen = sizeof optval;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        return errno;
+    }
+    return optval;
+}
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , sockfd_(-1)
+    , err_(0)
+    , timerArmed_(false)
+{
+}
+
+Connector::~Connector()
+{
+    // 正常情况下 connect 的结果已经交给了调用方 这里只处理连接中途被丢弃的情况
+    if (timerArmed_)
+    {
+        loop_->cancel(timerId_);
+    }
+    resetChannel();
+    if (sockfd_ >= 0)
+    {
+        ::close(sockfd_);
+    }
+}
+
+// ================= ConnectAwaiter 实现 =================
+
+bool Connector::ConnectAwaiter::await_ready()
+{
+    Connector *c = connector_;
+    c->err_ = 0;
+    c->sockfd_ = createNonblocking(c->serverAddr_.family());
+    if (c->sockfd_ < 0)
+    {
+        c->err_ = errno;
+        return true;
+    }
+
+    int ret = ::connect(c->sockfd_, c->serverAddr_.getSockAddr(), c->serverAddr_.getSockLen());
+    if (ret == 0)
+    {
+        return true; // 本机连接有可能立即成功
+    }
+    int savedErrno = errno;
+    // Unix域socket监听队列满时返回EAGAIN 连接并没有在进行中 按失败处理
+    if (savedErrno == EINPROGRESS || savedErrno == EINTR)
+    {
+        return false; // 需要等待sockfd可写
+    }
+
+    LOG_ERROR << "Connector::connect " << c->serverAddr_.toIpPort() << " error " << savedErrno;
+    ::close(c->sockfd_);
+    c->sockfd_ = -1;
+    c->err_ = savedErrno;
+    return true;
+}
+
+void Connector::ConnectAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    Connector *c = connector_;
+    c->coroutine_ = h;
+    c->channel_.reset(new Channel(c->loop_, c->sockfd_));
+    c->channel_->setHandler(c);
+    c->channel_->enableWriting();
+
+    if (timeoutSecs_ > 0.0)
+    {
+        c->timerArmed_ = true;
+        c->timerId_ = c->loop_->runAfter(timeoutSecs_, std::bind(&Connector::handleTimeout, c));
+    }
+}
+
+Connector::ConnectResult Connector::ConnectAwaiter::await_resume()
+{
+    Connector *c = connector_;
+    int sockfd = c->sockfd_;
+    c->sockfd_ = -1; // sockfd的所有权交给调用方
+    return {sockfd, c->err_};
+}
+
+// ================= 事件处理 =================
+
+void Connector::handleWrite()
+{
+    if (!channel_)
+    {
+        return;
+    }
+    finish(getSocketError(sockfd_));
+}
+
+void Connector::handleTimeout()
+{
+    timerArmed_ = false;
+    if (!channel_)
+    {
+        return;
+    }
+    LOG_WARN << "Connector::connect " << serverAddr_.toIpPort() << " timed out";
+    finish(ETIMEDOUT);
+}
+
+void Connector::finish(int err)
+{
+    if (timerArmed_)
+    {
+        timerArmed_ = false;
+        loop_->cancel(timerId_);
+    }
+    resetChannel();
+
+    if (err != 0)
+    {
+        LOG_ERROR << "Connector::connect " << serverAddr_.toIpPort() << " SO_ERROR=" << err;
+        ::close(sockfd_);
+        sockfd_ = -1;
+    }
+    err_ = err;
+
+    if (coroutine_)
+    {
+        // 当前在channel_的handleEvent或者定时器回调里 协程恢复后可能直接结束
+        // 连同栈帧里的Connector一起析构 所以放到pendingFunctors里恢复 不在分发途中恢复
+        auto co = coroutine_;
+        coroutine_ = nullptr;
+        loop_->queueInLoop([co]() { co.resume(); });
+    }
+}
+
+// 当前可能正处于channel_的handleEvent中 不能直接析构channel_ 交给pendingFunctors延后释放
+void Connector::resetChannel()
+{
+    if (!channel_)
+    {
+        return;
+    }
+    channel_->disableAll();
+    channel_->remove();
+    channel_->setHandler(nullptr); // 正在进行的handleEvent不再分发剩下的事件
+    std::shared_ptr<Channel> channel(channel_.release());
+    loop_->queueInLoop([channel]() {});
+}
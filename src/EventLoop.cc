@@ -53,6 +53,9 @@ EventLoop::EventLoop()
     , timerQueue_(new TimerQueue(this))
     , wakeupFd_(createEventfd())
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , callingAfterDispatchFunctors_(false)
+    , bufferBytes_(0)
+    , users_(0)
 {
     LOG_DEBUG<<"EventLoop created "<<this<<" in thread"<<threadId_;
     if (t_loopInThisThread)
@@ -64,13 +67,17 @@ EventLoop::EventLoop()
         t_loopInThisThread = this;
     }
     
-    wakeupChannel_->setReadCallback(
-        std::bind(&EventLoop::handleRead, this)); // 设置wakeupfd的事件类型以及发生事件后的回调操作
+    wakeupChannel_->setHandler(this); // 设置wakeupfd发生事件后的处理对象 读事件交给handleRead
     
     wakeupChannel_->enableReading(); // 每一个EventLoop都将监听wakeupChannel_的EPOLL读事件了
 
     LOG_DEBUG<<"EventLoop::EventLoop() end";
 }
+EventLoop *EventLoop::currentLoop()
+{
+    return t_loopInThisThread;
+}
+
 EventLoop::~EventLoop()
 {
     wakeupChannel_->disableAll(); // 给Channel移除所有感兴趣的事件
@@ -128,6 +135,8 @@ void EventLoop::loop()
          * mainloop调用queueInLoop将回调加入subloop（该回调需要subloop执行 但subloop还在poller_->poll处阻塞） queueInLoop通过wakeup将subloop唤醒
          **/
         doPendingFunctors();
+        // 本轮所有回调都执行完了 再统一flush这一轮积攒下来的写操作
+        doAfterDispatchFunctors();
     }
     LOG_INFO<<"EventLoopstop looping "<<this;
     looping_ = false;
@@ -182,13 +191,18 @@ void EventLoop::queueInLoop(Functor cb)
      * 唤醒相应的需要执行上面回调操作的loop的线程 让loop()下一次poller_->poll()不再阻塞（阻塞的话会延迟前一次新加入的回调的执行），然后
      * 继续执行pendingFunctors_中的回调函数
      **/
-    if (!isInLoopThread() || callingPendingFunctors_)
+    if (!isInLoopThread() || callingPendingFunctors_ || callingAfterDispatchFunctors_)
     {
         wakeup(); // 唤醒loop所在线程
     }
     LOG_DEBUG << "EventLoop::queueInLoop end [cb=" << &cb << "]";
 }
 
+void EventLoop::queueAfterDispatch(Functor cb)
+{
+    afterDispatchFunctors_.emplace_back(std::move(cb));
+}
+
 void EventLoop::handleRead()
 {
     LOG_DEBUG<<"EventLoop::handleRead() start";
@@ -236,6 +250,21 @@ bool EventLoop::hasChannel(Channel *channel)
     return poller_->hasChannel(channel);
 }
 
+bool EventLoop::idle()
+{
+    if (users_.load(std::memory_order_acquire) != 0 || !afterDispatchFunctors_.empty() || timerQueue_->size() != 0)
+    {
+        return false;
+    }
+    // wakeupChannel_ 和 TimerQueue 的 timerfd channel 一直注册在Poller里
+    if (poller_->numChannels() > 2)
+    {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    return pendingFunctors_.empty();
+}
+
 void EventLoop::doPendingFunctors()
 {
     LOG_DEBUG<<"EventLoop::doPendingFunctors start";
@@ -255,3 +284,19 @@ void EventLoop::doPendingFunctors()
     callingPendingFunctors_ = false;
     LOG_DEBUG << "EventLoop::doPendingFunctors end";
 }
+
+void EventLoop::doAfterDispatchFunctors()
+{
+    callingAfterDispatchFunctors_ = true;
+    // flush过程中可能唤醒协程 协程又产生新的写操作 循环直到本轮没有新的flush
+    while (!afterDispatchFunctors_.empty())
+    {
+        std::vector<Functor> functors;
+        functors.swap(afterDispatchFunctors_);
+        for (const Functor &functor : functors)
+        {
+            functor();
+        }
+    }
+    callingAfterDispatchFunctors_ = false;
+}
@@ -35,6 +35,53 @@ EventLoop *EventLoopThread::startLoop()
     return loop;
 }
 
+void EventLoopThread::stop()
+{
+    EventLoop *loop = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        loop = loop_;
+    }
+    if (loop != nullptr)
+    {
+        // quit也通过队列投递 保证在它之前投递的回调(例如connectDestroyed)都已经执行
+        loop->queueInLoop([loop]() { loop->quit(); });
+        thread_.join();
+    }
+}
+
+namespace
+{
+
+const double kIdleCheckInterval = 0.05;
+
+// 在loop线程中检查 不空闲时过一会再看 自己的定时器到期时已经从TimerQueue摘掉 不影响判断
+void quitWhenIdle(EventLoop *loop)
+{
+    if (loop->idle())
+    {
+        loop->quit();
+        return;
+    }
+    loop->runAfter(kIdleCheckInterval, [loop]() { quitWhenIdle(loop); });
+}
+
+} // namespace
+
+void EventLoopThread::stopWhenIdle()
+{
+    EventLoop *loop = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        loop = loop_;
+    }
+    if (loop != nullptr)
+    {
+        loop->queueInLoop([loop]() { quitWhenIdle(loop); });
+        thread_.join();
+    }
+}
+
 // 下面这个方法 是在单独的新线程里运行的
 void EventLoopThread::threadFunc()
 {
@@ -1,10 +1,11 @@
 #include <memory>
+#include <thread>
 
 #include <EventLoopThreadPool.h>
 #include <EventLoopThread.h>
 #include <Logger.h>
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg)
-    : baseLoop_(baseLoop), name_(nameArg), started_(false), numThreads_(0), next_(0)
+    : baseLoop_(baseLoop), name_(nameArg), started_(false), numThreads_(0), next_(0), nextThreadId_(0)
 {
 }
 
@@ -16,14 +17,11 @@ EventLoopThreadPool::~EventLoopThreadPool()
 void EventLoopThreadPool::start(const ThreadInitCallback &cb)
 {
     started_ = true;
+    initCallback_ = cb;
 
     for (int i = 0; i < numThreads_; ++i)
     {
-        char buf[name_.size() + 32];
-        snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
-        EventLoopThread *t = new EventLoopThread(cb, buf);
-        threads_.push_back(std::unique_ptr<EventLoopThread>(t));
-        loops_.push_back(t->startLoop()); // 底层创建线程 绑定一个新的EventLoop 并返回该loop的地址
+        startThread(nextThreadId_++);
     }
 
     if (numThreads_ == 0 && cb) // 整个服务端只有一个线程运行baseLoop
@@ -32,6 +30,89 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     }
 }
 
+void EventLoopThreadPool::startThread(int index)
+{
+    char buf[name_.size() + 32];
+    snprintf(buf, sizeof buf, "%s%d", name_.c_str(), index);
+    EventLoopThread *t = new EventLoopThread(initCallback_, buf);
+    threads_.push_back(std::unique_ptr<EventLoopThread>(t));
+    loops_.push_back(t->startLoop()); // 底层创建线程 绑定一个新的EventLoop 并返回该loop的地址
+}
+
+void EventLoopThreadPool::resize(int numThreads)
+{
+    if (numThreads < 0)
+    {
+        numThreads = 0;
+    }
+    numThreads_ = numThreads;
+    if (!started_)
+    {
+        return;
+    }
+
+    while (static_cast<int>(loops_.size()) < numThreads)
+    {
+        startThread(nextThreadId_++);
+    }
+    while (static_cast<int>(loops_.size()) > numThreads)
+    {
+        // 从轮询列表中摘掉 之后getNextLoop不会再选中它
+        EventLoop *loop = loops_.back();
+        loops_.pop_back();
+        retiring_.emplace_back(loop, std::move(threads_.back()));
+        threads_.pop_back();
+        LOG_INFO << "EventLoopThreadPool [" << name_ << "] retiring a loop with " << connections_[loop] << " connections";
+        retireIfIdle(loop);
+    }
+    if (next_ >= static_cast<int>(loops_.size()))
+    {
+        next_ = 0;
+    }
+}
+
+void EventLoopThreadPool::connectionAttached(EventLoop *loop)
+{
+    ++connections_[loop];
+}
+
+void EventLoopThreadPool::connectionDetached(EventLoop *loop)
+{
+    auto it = connections_.find(loop);
+    if (it != connections_.end() && it->second > 0)
+    {
+        --it->second;
+    }
+    retireIfIdle(loop);
+}
+
+void EventLoopThreadPool::retireIfIdle(EventLoop *loop)
+{
+    auto it = connections_.find(loop);
+    if (it != connections_.end() && it->second > 0)
+    {
+        return;
+    }
+    for (auto r = retiring_.begin(); r != retiring_.end(); ++r)
+    {
+        if (r->first == loop)
+        {
+            // 连接数为0不代表没有别人引用这个loop(定时器、WorkerPool任务、还在排队的回调...)
+            // 由loop自己等到EventLoop::idle()再退出 join放到单独的线程里 不阻塞baseLoop上的accept
+            // EventLoopThread随这个线程一起销毁 loop对象在它最后一个回调执行完之后才析构
+            std::unique_ptr<EventLoopThread> thread = std::move(r->second);
+            retiring_.erase(r);
+            connections_.erase(loop);
+            std::string name = name_;
+            std::thread([thread = std::move(thread), name]() {
+                thread->stopWhenIdle();
+                LOG_INFO << "EventLoopThreadPool [" << name << "] a retiring loop exited";
+            }).detach();
+            return;
+        }
+    }
+}
+
 // 如果工作在多线程中，baseLoop_(mainLoop)会默认以轮询的方式分配Channel给subLoop
 EventLoop *EventLoopThreadPool::getNextLoop()
 {
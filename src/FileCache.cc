@@ -0,0 +1,318 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include <FileCache.h>
+#include <EventLoop.h>
+#include <LFU.h>
+#include <Logger.h>
+
+namespace
+{
+
+// 文件内容或元数据发生变化的事件 目录本身被删除/移走时内核随后还会发IN_IGNORED
+// IN_CREATE/IN_MOVED_TO 让"文件不存在"的缓存项在文件出现时失效
+const uint32_t kWatchMask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                            IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+int createInotify()
+{
+    int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_WARN << "FileCache inotify_init1 failed errno=" << errno << ", open file cache disabled";
+    }
+    return fd;
+}
+
+// 路径所在的目录 没有'/'时是当前目录
+std::string directoryOf(const std::string &path)
+{
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos)
+    {
+        return ".";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+// directoryOf的逆运算 必须和缓存键的写法一致 事件里的文件名才能找回缓存项
+std::string joinPath(const std::string &dir, const char *name)
+{
+    if (dir == ".")
+    {
+        return name;
+    }
+    return dir == "/" ? "/" + std::string(name) : dir + "/" + name;
+}
+
+} // namespace
+
+FileCache::File::~File()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+FileCache::FileCache(EventLoop *loop, size_t maxFiles, int maxMemoryFiles, size_t maxMemoryFileSize)
+    : loop_(loop)
+    , inotifyFd_(createInotify())
+    , inotifyChannel_(loop, inotifyFd_)
+    , maxFiles_(maxFiles)
+    , maxMemoryFileSize_(maxMemoryFileSize)
+    , contents_(new KamaCache::KLfuCache<std::string, ContentPtr>(maxMemoryFiles))
+    , hits_(0)
+    , misses_(0)
+    , invalidations_(0)
+{
+    if (inotifyFd_ >= 0)
+    {
+        inotifyChannel_.setHandler(this);
+        inotifyChannel_.enableReading();
+    }
+}
+
+FileCache::~FileCache()
+{
+    if (inotifyFd_ >= 0)
+    {
+        inotifyChannel_.disableAll();
+        inotifyChannel_.remove();
+        ::close(inotifyFd_);
+    }
+}
+
+size_t FileCache::cachedFiles() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return files_.size();
+}
+
+FileCache::FilePtr FileCache::open(const std::string &path)
+{
+    if (inotifyFd_ >= 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = files_.find(path);
+        if (it != files_.end())
+        {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            if (!it->second)
+            {
+                errno = ENOENT;
+            }
+            return it->second;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+
+    // 先监视、记下代数再打开: 打开之后才发生的修改一定会产生事件 事件在放进缓存之前处理时由代数发现
+    uint64_t generation = 0;
+    bool cacheable = inotifyFd_ >= 0 && watchDirectory(path, &generation);
+
+    auto file = std::make_shared<File>();
+    file->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file->fd < 0)
+    {
+        if (errno == ENOENT && cacheable)
+        {
+            remember(path, nullptr, generation);
+            errno = ENOENT;
+        }
+        return nullptr;
+    }
+    if (::fstat(file->fd, &file->st) < 0)
+    {
+        return nullptr;
+    }
+    if (!S_ISREG(file->st.st_mode))
+    {
+        int err = S_ISDIR(file->st.st_mode) ? EISDIR : EACCES;
+        file.reset();
+        errno = err;
+        return nullptr;
+    }
+
+    char buf[64];
+    uint64_t mtimeNs = static_cast<uint64_t>(file->st.st_mtim.tv_sec) * 1000000000ULL + file->st.st_mtim.tv_nsec;
+    snprintf(buf, sizeof buf, "\"%lx-%lx-%lx\"", static_cast<unsigned long>(file->st.st_ino),
+             static_cast<unsigned long>(file->st.st_size), static_cast<unsigned long>(mtimeNs));
+    file->etag = buf;
+    file->lastModified = formatHttpDate(file->st.st_mtime);
+
+    if (cacheable)
+    {
+        remember(path, file, generation);
+    }
+    return file;
+}
+
+uint64_t FileCache::generationLocked(const std::string &dir) const
+{
+    auto it = generations_.find(dir);
+    return overflows_ + (it == generations_.end() ? 0 : it->second);
+}
+
+void FileCache::remember(const std::string &path, const FilePtr &file, uint64_t generation)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generationLocked(directoryOf(path)) != generation)
+    {
+        return; // 打开期间目录下有变化 这次的结果可能已经过时 下次再缓存
+    }
+    if (files_.size() >= maxFiles_)
+    {
+        files_.erase(files_.begin()); // 满了随便淘汰一个 只是多一次open 正确性不受影响
+    }
+    files_[path] = file;
+}
+
+SharedMessage FileCache::content(const std::string &path, const FilePtr &file)
+{
+    if (file->size() > maxMemoryFileSize_)
+    {
+        return nullptr;
+    }
+
+    ContentPtr cached;
+    if (contents_->get(path, cached) && cached && cached->ino == file->st.st_ino && cached->size == file->st.st_size &&
+        cached->mtime.tv_sec == file->st.st_mtim.tv_sec && cached->mtime.tv_nsec == file->st.st_mtim.tv_nsec)
+    {
+        return cached->data;
+    }
+
+    std::string data(file->size(), '\0');
+    size_t done = 0;
+    while (done < data.size())
+    {
+        ssize_t n = ::pread(file->fd, &data[done], data.size() - done, done);
+        if (n <= 0)
+        {
+            return nullptr; // 出错或者文件在读的过程中变短了 交给sendFile路径
+        }
+        done += n;
+    }
+
+    auto content = std::make_shared<Content>();
+    content->ino = file->st.st_ino;
+    content->size = file->st.st_size;
+    content->mtime = file->st.st_mtim;
+    content->data = std::make_shared<const std::string>(std::move(data));
+    contents_->put(path, content);
+    return content->data;
+}
+
+bool FileCache::watchDirectory(const std::string &path, uint64_t *generation)
+{
+    std::string dir = directoryOf(path);
+    int wd = ::inotify_add_watch(inotifyFd_, dir.c_str(), kWatchMask | IN_ONLYDIR);
+    if (wd < 0)
+    {
+        LOG_WARN << "FileCache inotify_add_watch " << dir << " failed errno=" << errno;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    watches_[wd] = dir;
+    *generation = generationLocked(dir);
+    return true;
+}
+
+void FileCache::removeDirectoryLocked(const std::string &dir)
+{
+    for (auto it = files_.begin(); it != files_.end();)
+    {
+        if (directoryOf(it->first) == dir)
+        {
+            it = files_.erase(it);
+            invalidations_.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void FileCache::handleRead()
+{
+    alignas(struct inotify_event) char buf[4096];
+    while (true)
+    {
+        ssize_t n = ::read(inotifyFd_, buf, sizeof buf);
+        if (n <= 0)
+        {
+            if (n < 0 && errno != EAGAIN)
+            {
+                LOG_ERROR << "FileCache read inotify errno=" << errno;
+            }
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (char *p = buf; p < buf + n;)
+        {
+            const struct inotify_event *ev = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW)
+            {
+                // 事件丢了 不知道哪些文件变了 全部失效
+                invalidations_.fetch_add(files_.size(), std::memory_order_relaxed);
+                files_.clear();
+                ++overflows_;
+                continue;
+            }
+            auto w = watches_.find(ev->wd);
+            if (w == watches_.end())
+            {
+                continue;
+            }
+            ++generations_[w->second];
+            if (ev->mask & IN_IGNORED)
+            {
+                // 目录被删除/移走或者所在文件系统卸载 监视已经被内核移除
+                removeDirectoryLocked(w->second);
+                watches_.erase(w);
+            }
+            else if (ev->len > 0)
+            {
+                invalidations_.fetch_add(files_.erase(joinPath(w->second, ev->name)), std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+std::string FileCache::formatHttpDate(time_t t)
+{
+    struct tm tm;
+    ::gmtime_r(&t, &tm);
+    char buf[64];
+    size_t n = ::strftime(buf, sizeof buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, n);
+}
+
+time_t FileCache::parseHttpDate(std::string_view s)
+{
+    char buf[64];
+    if (s.size() >= sizeof buf)
+    {
+        return -1;
+    }
+    memcpy(buf, s.data(), s.size());
+    buf[s.size()] = '\0';
+
+    struct tm tm;
+    memset(&tm, 0, sizeof tm);
+    const char *end = ::strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == nullptr || *end != '\0')
+    {
+        return -1;
+    }
+    return ::timegm(&tm);
+}
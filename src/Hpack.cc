@@ -0,0 +1,655 @@
+#include <string.h>
+#include <algorithm>
+
+#include <Hpack.h>
+
+namespace
+{
+
+struct StaticEntry
+{
+    const char *name;
+    const char *value;
+};
+
+// RFC 7541 附录A
+const StaticEntry kStaticTable[HpackTable::kStaticEntries] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+// RFC 7541 附录B 符号0~255的Huffman编码(右对齐)和位数 EOS(256)是30个1
+const uint32_t kHuffmanCodes[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+const uint8_t kHuffmanCodeLengths[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+const uint32_t kHuffmanEos = 0x3fffffff;
+const int kHuffmanEosLength = 30;
+
+/**
+ * 这张Huffman码是规范码(canonical): 同样长度的码字连续递增 长度增加时左移
+ * 解码时逐位累积 每种长度只需要比较一次区间 [first, first + count)
+ **/
+struct HuffmanDecodeTable
+{
+    uint32_t first[kHuffmanEosLength + 1];  // 每种长度的第一个码字
+    uint16_t count[kHuffmanEosLength + 1];  // 每种长度的码字个数
+    uint16_t offset[kHuffmanEosLength + 1]; // 每种长度的第一个符号在symbols里的位置
+    uint16_t symbols[257];                  // 按(长度, 码字)排好序的符号 256是EOS
+
+    HuffmanDecodeTable()
+    {
+        memset(count, 0, sizeof count);
+        for (int s = 0; s < 256; ++s)
+        {
+            ++count[kHuffmanCodeLengths[s]];
+        }
+        ++count[kHuffmanEosLength];
+        uint16_t next = 0;
+        for (int len = 0; len <= kHuffmanEosLength; ++len)
+        {
+            offset[len] = next;
+            first[len] = UINT32_MAX;
+            next += count[len];
+        }
+        uint16_t filled[kHuffmanEosLength + 1] = {0};
+        for (int s = 0; s <= 256; ++s)
+        {
+            int len = s < 256 ? kHuffmanCodeLengths[s] : kHuffmanEosLength;
+            uint32_t code = s < 256 ? kHuffmanCodes[s] : kHuffmanEos;
+            symbols[offset[len] + filled[len]++] = static_cast<uint16_t>(s);
+            first[len] = std::min(first[len], code);
+        }
+    }
+};
+
+const HuffmanDecodeTable &huffmanDecodeTable()
+{
+    static const HuffmanDecodeTable table;
+    return table;
+}
+
+// 编码器按名字决定要不要放进动态表: 每次都不一样的值放进去只会挤掉有用的条目
+bool worthIndexing(std::string_view name)
+{
+    static const char *const kVolatile[] = {
+        "content-length", "date", "etag", "last-modified", "content-range", "age", "expires", "location",
+    };
+    for (const char *n : kVolatile)
+    {
+        if (name == n)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 敏感字段用"永不索引"的字面量 中间代理也不能把它放进动态表
+bool sensitive(std::string_view name)
+{
+    return name == "set-cookie" || name == "authorization" || name == "proxy-authorization";
+}
+
+} // namespace
+
+// ================= HpackTable =================
+
+std::string_view HpackTable::staticName(size_t index)
+{
+    return kStaticTable[index - 1].name;
+}
+
+std::string_view HpackTable::staticValue(size_t index)
+{
+    return kStaticTable[index - 1].value;
+}
+
+bool HpackTable::get(size_t index, std::string_view *name, std::string_view *value) const
+{
+    if (index == 0)
+    {
+        return false;
+    }
+    if (index <= kStaticEntries)
+    {
+        *name = kStaticTable[index - 1].name;
+        *value = kStaticTable[index - 1].value;
+        return true;
+    }
+    index -= kStaticEntries + 1;
+    if (index >= entries_.size())
+    {
+        return false;
+    }
+    *name = entries_[index].name;
+    *value = entries_[index].value;
+    return true;
+}
+
+void HpackTable::add(std::string_view name, std::string_view value)
+{
+    size_t entrySize = name.size() + value.size() + kEntryOverhead;
+    ++inserted_;
+    if (entrySize > maxSize_)
+    {
+        // 比整张表还大: 清空表 条目本身也不加入(RFC 7541 4.4)
+        evictTo(0);
+        return;
+    }
+    evictTo(maxSize_ - entrySize);
+    entries_.push_front(Entry{std::string(name), std::string(value), inserted_ - 1});
+    size_ += entrySize;
+}
+
+void HpackTable::setMaxSize(size_t maxSize)
+{
+    maxSize_ = maxSize;
+    evictTo(maxSize);
+}
+
+void HpackTable::evictTo(size_t maxSize)
+{
+    while (size_ > maxSize && !entries_.empty())
+    {
+        const Entry &e = entries_.back();
+        size_ -= e.name.size() + e.value.size() + kEntryOverhead;
+        entries_.pop_back();
+    }
+}
+
+// ================= HpackDecoder =================
+
+HpackDecoder::HpackDecoder(size_t maxTableSize)
+    : table_(maxTableSize)
+    , settingsMaxSize_(maxTableSize)
+{
+}
+
+bool HpackDecoder::decode(const char *data, size_t len, const FieldCallback &cb)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+    const uint8_t *end = p + len;
+    bool fieldSeen = false;
+
+    // 读一个字符串字面量: 不是Huffman编码时直接指向输入 否则解码进buf
+    auto readString = [&p, end](std::string *buf, std::string_view *out) {
+        if (p >= end)
+        {
+            return false;
+        }
+        bool huffman = *p & 0x80;
+        uint64_t n;
+        if (!HpackEncoder::decodeInteger(&p, end, 7, &n) || n > static_cast<uint64_t>(end - p))
+        {
+            return false;
+        }
+        if (huffman)
+        {
+            buf->clear();
+            if (!HpackEncoder::huffmanDecode(p, n, buf))
+            {
+                return false;
+            }
+            *out = *buf;
+        }
+        else
+        {
+            *out = std::string_view(reinterpret_cast<const char *>(p), n);
+        }
+        p += n;
+        return true;
+    };
+
+    while (p < end)
+    {
+        uint8_t b = *p;
+        uint64_t index;
+        std::string_view name;
+        std::string_view value;
+
+        if (b & 0x80)
+        {
+            // 1xxxxxxx 索引字段
+            if (!HpackEncoder::decodeInteger(&p, end, 7, &index) || !table_.get(index, &name, &value))
+            {
+                return false;
+            }
+            cb(name, value);
+            fieldSeen = true;
+            continue;
+        }
+        if ((b & 0xE0) == 0x20)
+        {
+            // 001xxxxx 动态表大小更新 只能出现在头部块开头
+            if (fieldSeen || !HpackEncoder::decodeInteger(&p, end, 5, &index) || index > settingsMaxSize_)
+            {
+                return false;
+            }
+            table_.setMaxSize(index);
+            continue;
+        }
+
+        // 01xxxxxx 带增量索引 / 0000xxxx 不索引 / 0001xxxx 永不索引 的字面量
+        bool indexing = (b & 0xC0) == 0x40;
+        int prefix = indexing ? 6 : 4;
+        if (!HpackEncoder::decodeInteger(&p, end, prefix, &index))
+        {
+            return false;
+        }
+        if (index > 0)
+        {
+            std::string_view ignored;
+            if (!table_.get(index, &name, &ignored))
+            {
+                return false;
+            }
+            if (indexing)
+            {
+                // 加入动态表可能淘汰名字所在的条目 先拷贝出来
+                nameBuf_.assign(name);
+                name = nameBuf_;
+            }
+        }
+        else if (!readString(&nameBuf_, &name))
+        {
+            return false;
+        }
+        if (!readString(&valueBuf_, &value))
+        {
+            return false;
+        }
+        if (indexing)
+        {
+            table_.add(name, value);
+        }
+        cb(name, value);
+        fieldSeen = true;
+    }
+    return true;
+}
+
+// ================= HpackEncoder =================
+
+HpackEncoder::HpackEncoder(size_t maxTableSize)
+    : table_(maxTableSize)
+    , preferredMaxSize_(maxTableSize)
+    , pendingSizeUpdate_(SIZE_MAX)
+{
+}
+
+void HpackEncoder::setMaxTableSize(size_t peerMaxSize)
+{
+    size_t size = std::min(peerMaxSize, preferredMaxSize_);
+    if (size != table_.maxSize() || pendingSizeUpdate_ != SIZE_MAX)
+    {
+        // 两个头部块之间多次变化时 要先通知其中最小的值 再通知最终的值(RFC 7541 4.2)
+        pendingSizeUpdate_ = pendingSizeUpdate_ == SIZE_MAX ? size : std::min(pendingSizeUpdate_, size);
+        table_.setMaxSize(size);
+    }
+}
+
+void HpackEncoder::beginBlock(std::string *out)
+{
+    if (pendingSizeUpdate_ != SIZE_MAX)
+    {
+        if (pendingSizeUpdate_ != table_.maxSize())
+        {
+            encodeInteger(pendingSizeUpdate_, 5, 0x20, out);
+        }
+        encodeInteger(table_.maxSize(), 5, 0x20, out);
+        pendingSizeUpdate_ = SIZE_MAX;
+    }
+}
+
+size_t HpackEncoder::find(std::string_view name, std::string_view value, bool *exact) const
+{
+    // 静态表: 名字 => 第一个位置 以及完整匹配
+    static const std::unordered_map<std::string, size_t> kStaticIndex = [] {
+        std::unordered_map<std::string, size_t> index;
+        for (size_t i = HpackTable::kStaticEntries; i >= 1; --i)
+        {
+            std::string name(kStaticTable[i - 1].name);
+            index[name] = i;
+            index[name + '\0' + kStaticTable[i - 1].value] = i;
+        }
+        return index;
+    }();
+
+    // 动态表里的条目只要序号还没被淘汰就有效
+    uint64_t oldest = table_.inserted() - table_.dynamicCount();
+    auto toIndex = [this](uint64_t seq) {
+        return HpackTable::kStaticEntries + 1 + static_cast<size_t>(table_.inserted() - 1 - seq);
+    };
+
+    std::string &key = key_;
+    key.assign(name);
+    key += '\0';
+    key.append(value);
+    auto s = kStaticIndex.find(key);
+    if (s != kStaticIndex.end())
+    {
+        *exact = true;
+        return s->second;
+    }
+    auto d = dynamicIndex_.find(key);
+    if (d != dynamicIndex_.end() && d->second >= oldest)
+    {
+        *exact = true;
+        return toIndex(d->second);
+    }
+
+    *exact = false;
+    key.resize(name.size());
+    s = kStaticIndex.find(key);
+    if (s != kStaticIndex.end())
+    {
+        return s->second;
+    }
+    d = dynamicNames_.find(key);
+    if (d != dynamicNames_.end() && d->second >= oldest)
+    {
+        return toIndex(d->second);
+    }
+    return 0;
+}
+
+void HpackEncoder::addEntry(std::string_view name, std::string_view value)
+{
+    table_.add(name, value);
+    if (table_.dynamicCount() == 0 || table_.entries_.front().seq != table_.inserted() - 1)
+    {
+        return; // 条目太大没有加入
+    }
+    uint64_t seq = table_.inserted() - 1;
+    key_.assign(name);
+    dynamicNames_[key_] = seq;
+    key_ += '\0';
+    key_.append(value);
+    dynamicIndex_[key_] = seq;
+
+    // 淘汰的条目在查找时按序号判断失效 映射表积累太多时按当前的表重建
+    if (dynamicIndex_.size() > 4 * table_.dynamicCount() + 64)
+    {
+        dynamicIndex_.clear();
+        dynamicNames_.clear();
+        for (auto it = table_.entries_.rbegin(); it != table_.entries_.rend(); ++it)
+        {
+            dynamicNames_[it->name] = it->seq;
+            dynamicIndex_[it->name + '\0' + it->value] = it->seq;
+        }
+    }
+}
+
+void HpackEncoder::encode(std::string_view name, std::string_view value, std::string *out)
+{
+    bool exact = false;
+    size_t index = find(name, value, &exact);
+    if (exact)
+    {
+        encodeInteger(index, 7, 0x80, out);
+        return;
+    }
+
+    if (sensitive(name))
+    {
+        encodeInteger(index, 4, 0x10, out); // 永不索引
+    }
+    else if (worthIndexing(name) && name.size() + value.size() + HpackTable::kEntryOverhead <= table_.maxSize() / 2)
+    {
+        encodeInteger(index, 6, 0x40, out); // 带增量索引
+        if (index == 0)
+        {
+            encodeString(name, out);
+        }
+        encodeString(value, out);
+        addEntry(name, value);
+        return;
+    }
+    else
+    {
+        encodeInteger(index, 4, 0x00, out); // 不索引
+    }
+    if (index == 0)
+    {
+        encodeString(name, out);
+    }
+    encodeString(value, out);
+}
+
+void HpackEncoder::encodeInteger(uint64_t value, int prefixBits, uint8_t first, std::string *out)
+{
+    uint64_t max = (1u << prefixBits) - 1;
+    if (value < max)
+    {
+        out->push_back(static_cast<char>(first | value));
+        return;
+    }
+    out->push_back(static_cast<char>(first | max));
+    value -= max;
+    while (value >= 128)
+    {
+        out->push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+bool HpackEncoder::decodeInteger(const uint8_t **p, const uint8_t *end, int prefixBits, uint64_t *value)
+{
+    const uint8_t *q = *p;
+    if (q >= end)
+    {
+        return false;
+    }
+    uint64_t max = (1u << prefixBits) - 1;
+    uint64_t v = *q++ & max;
+    if (v == max)
+    {
+        int shift = 0;
+        while (true)
+        {
+            if (q >= end || shift > 56)
+            {
+                return false; // 截断 或者大得不合理
+            }
+            uint8_t b = *q++;
+            v += static_cast<uint64_t>(b & 0x7F) << shift;
+            shift += 7;
+            if ((b & 0x80) == 0)
+            {
+                break;
+            }
+        }
+    }
+    *value = v;
+    *p = q;
+    return true;
+}
+
+void HpackEncoder::encodeString(std::string_view s, std::string *out)
+{
+    size_t huffman = huffmanLength(s);
+    if (huffman < s.size())
+    {
+        encodeInteger(huffman, 7, 0x80, out);
+        huffmanEncode(s, out);
+    }
+    else
+    {
+        encodeInteger(s.size(), 7, 0x00, out);
+        out->append(s);
+    }
+}
+
+size_t HpackEncoder::huffmanLength(std::string_view s)
+{
+    size_t bits = 0;
+    for (unsigned char c : s)
+    {
+        bits += kHuffmanCodeLengths[c];
+    }
+    return (bits + 7) / 8;
+}
+
+void HpackEncoder::huffmanEncode(std::string_view s, std::string *out)
+{
+    uint64_t acc = 0; // 低bits位有效
+    int bits = 0;
+    for (unsigned char c : s)
+    {
+        acc = (acc << kHuffmanCodeLengths[c]) | kHuffmanCodes[c];
+        bits += kHuffmanCodeLengths[c];
+        while (bits >= 8)
+        {
+            bits -= 8;
+            out->push_back(static_cast<char>(acc >> bits));
+        }
+    }
+    if (bits > 0)
+    {
+        // 用EOS的高位(全1)填满最后一个字节
+        out->push_back(static_cast<char>((acc << (8 - bits)) | (0xFF >> bits)));
+    }
+}
+
+bool HpackEncoder::huffmanDecode(const uint8_t *data, size_t len, std::string *out)
+{
+    const HuffmanDecodeTable &t = huffmanDecodeTable();
+    uint32_t code = 0;
+    int codeLen = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        for (int bit = 7; bit >= 0; --bit)
+        {
+            code = (code << 1) | ((data[i] >> bit) & 1);
+            ++codeLen;
+            if (codeLen >= 5 && t.count[codeLen] > 0 && code >= t.first[codeLen] &&
+                code - t.first[codeLen] < t.count[codeLen])
+            {
+                uint16_t sym = t.symbols[t.offset[codeLen] + code - t.first[codeLen]];
+                if (sym == 256)
+                {
+                    return false; // 字符串里不能出现EOS
+                }
+                out->push_back(static_cast<char>(sym));
+                code = 0;
+                codeLen = 0;
+            }
+            else if (codeLen > kHuffmanEosLength)
+            {
+                return false;
+            }
+        }
+    }
+    // 剩下的填充位最多7位 而且必须全是1(EOS的前缀)
+    return codeLen <= 7 && code == (1u << codeLen) - 1;
+}
@@ -0,0 +1,1211 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include <Http2Connection.h>
+#include <HttpServer.h>
+#include <HttpCompressor.h>
+#include <EventLoop.h>
+#include <Logger.h>
+
+namespace
+{
+
+const char kPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const int64_t kMaxWindow = 0x7fffffff;
+
+enum SettingsId
+{
+    kSettingsHeaderTableSize = 0x1,
+    kSettingsEnablePush = 0x2,
+    kSettingsMaxConcurrentStreams = 0x3,
+    kSettingsInitialWindowSize = 0x4,
+    kSettingsMaxFrameSize = 0x5,
+    kSettingsMaxHeaderListSize = 0x6
+};
+
+uint32_t readUint32(const char *p)
+{
+    const uint8_t *u = reinterpret_cast<const uint8_t *>(p);
+    return (static_cast<uint32_t>(u[0]) << 24) | (u[1] << 16) | (u[2] << 8) | u[3];
+}
+
+void writeUint32(char *p, uint32_t v)
+{
+    p[0] = static_cast<char>(v >> 24);
+    p[1] = static_cast<char>(v >> 16);
+    p[2] = static_cast<char>(v >> 8);
+    p[3] = static_cast<char>(v);
+}
+
+void encodeFrameHeader(char *out, size_t len, uint8_t type, uint8_t flags, uint32_t streamId)
+{
+    out[0] = static_cast<char>(len >> 16);
+    out[1] = static_cast<char>(len >> 8);
+    out[2] = static_cast<char>(len);
+    out[3] = static_cast<char>(type);
+    out[4] = static_cast<char>(flags);
+    writeUint32(out + 5, streamId & 0x7fffffff);
+}
+
+// 响应里不能出现的连接专用头部 Content-Length由我们按消息体生成
+bool skipResponseHeader(std::string_view name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade" || name == "content-length";
+}
+
+} // namespace
+
+Http2Connection::Stream::Stream(uint32_t streamId, int64_t initialWindow)
+    : id(streamId)
+    , started(false)
+    , remoteClosed(false)
+    , headersSent(false)
+    , localClosed(false)
+    , reset(false)
+    , errorStatus(0)
+    , streaming(false)
+    , discardBody(false)
+    , bodyReceived(0)
+    , windowCredit(0)
+    , sendWindow(initialWindow)
+    , recvWindow(kStreamWindow)
+    , bodyOffset(0)
+    , bodyLength(0)
+    , headOnly(false)
+{
+}
+
+Http2Connection::PrefaceMatch Http2Connection::matchPreface(const Buffer *in)
+{
+    size_t n = std::min(in->readableBytes(), kPrefaceLength);
+    if (::memcmp(in->peek(), kPreface, n) != 0)
+    {
+        return kPrefaceMismatch;
+    }
+    return n < kPrefaceLength ? kPrefacePartial : kPrefaceMatched;
+}
+
+Http2Connection::Http2Connection(HttpServer *server, const TcpConnectionPtr &conn)
+    : server_(server)
+    , conn_(conn)
+    , lastStreamId_(0)
+    , running_(0)
+    , peerInitialWindow_(kDefaultWindow)
+    , peerMaxFrameSize_(kMaxFrameSize)
+    , connSendWindow_(kDefaultWindow)
+    , connRecvWindow_(kConnectionWindow)
+    , continuationStream_(0)
+    , headerFlags_(0)
+    , settingsReceived_(false)
+    , peerGoAway_(false)
+    , goAwaySent_(false)
+    , failed_(false)
+    , stopping_(false)
+    , writeRequested_(false)
+    , wakeScheduled_(false)
+    , writerHandle_(nullptr)
+    , streamsHandle_(nullptr)
+    , readerHandle_(nullptr)
+    , controlWindowStart_(0)
+    , controlFrames_(0)
+{
+}
+
+Http2Connection::~Http2Connection() = default;
+
+AsyncTask Http2Connection::run()
+{
+    Buffer *in = conn_->inputBuffer();
+    in->retrieve(kPrefaceLength);
+    // 各个流的响应和控制帧的回应在同一轮事件循环里合并成一次write
+    conn_->setWriteCoalescing(true);
+    // 流协程和写协程各自挂在不同的地方 没有统一的安全点 会话期间不允许迁移
+    conn_->beginBusy();
+    sendSettings();
+    flush();
+
+    AsyncTask writer = writeLoop();
+    writer.start();
+
+    while (conn_->connected())
+    {
+        if (!processFrames(in))
+        {
+            break;
+        }
+        if (peerGoAway_ && streams_.empty())
+        {
+            break;
+        }
+        if (conn_->pendingOutputBytes() >= kHighWaterMark)
+        {
+            co_await OutputAwaiter{this};
+            continue; // 缓冲区里可能还有没处理的帧
+        }
+        if (in->readableBytes() == 0 && server_->idleTimeout_ > 0.0)
+        {
+            // 流可能在等待期间结束 超时的时候还有流没结束就继续等
+            auto [buf, timedOut] = co_await conn_->readWithTimeout(server_->idleTimeout_);
+            if (timedOut && streams_.empty())
+            {
+                LOG_DEBUG << "Http2Connection idle timeout " << conn_->name();
+                break;
+            }
+            continue;
+        }
+        co_await conn_->readUntil(&Http2Connection::frameReady);
+        if (!frameReady(in))
+        {
+            break; // 帧没收全连接就断了
+        }
+    }
+
+    // 读方向结束: 告诉对端不会再处理新的流 等流协程和写协程收尾
+    if (!goAwaySent_ && conn_->connected())
+    {
+        goAway(kNoError);
+        flush();
+    }
+    stopping_ = true;
+    for (auto &entry : streams_)
+    {
+        failBody(entry.second.get()); // 请求体不会再来了
+    }
+    co_await StreamsAwaiter{this};
+    wakeWriter();
+    co_await writer;
+    flush();
+    conn_->endBusy();
+    conn_->shutdown();
+}
+
+// ================= 读方向 =================
+
+bool Http2Connection::frameReady(Buffer *in)
+{
+    if (in->readableBytes() < kFrameHeaderLength)
+    {
+        return false;
+    }
+    const uint8_t *h = reinterpret_cast<const uint8_t *>(in->peek());
+    size_t len = (static_cast<size_t>(h[0]) << 16) | (h[1] << 8) | h[2];
+    return len > kMaxFrameSize || in->readableBytes() >= kFrameHeaderLength + len;
+}
+
+bool Http2Connection::processFrames(Buffer *in)
+{
+    bool ok = true;
+    // 回应堆到高水位就先停下 剩下的帧等发送队列降下来再处理
+    while (ok && frameReady(in) && output_.readableBytes() + conn_->pendingOutputBytes() < kHighWaterMark)
+    {
+        const char *p = in->peek();
+        const uint8_t *h = reinterpret_cast<const uint8_t *>(p);
+        size_t len = (static_cast<size_t>(h[0]) << 16) | (h[1] << 8) | h[2];
+        uint8_t type = h[3];
+        uint8_t flags = h[4];
+        uint32_t streamId = readUint32(p + 5) & 0x7fffffff;
+
+        if (len > kMaxFrameSize)
+        {
+            ok = connectionError(kFrameSizeError, "frame too large");
+            break;
+        }
+        if (!settingsReceived_ && type != kSettings)
+        {
+            ok = connectionError(kProtocolError, "first frame is not SETTINGS");
+            break;
+        }
+        // 头部块必须连续 中间不能插入其他帧
+        if (continuationStream_ != 0 && (type != kContinuation || streamId != continuationStream_))
+        {
+            ok = connectionError(kProtocolError, "expected CONTINUATION");
+            break;
+        }
+        if (!countControlFrame(type))
+        {
+            ok = connectionError(kEnhanceYourCalm, "control frame flood");
+            break;
+        }
+        ok = handleFrame(type, flags, streamId, p + kFrameHeaderLength, len);
+        in->retrieve(kFrameHeaderLength + len);
+    }
+    flush();
+    return ok;
+}
+
+bool Http2Connection::handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const char *payload, size_t len)
+{
+    switch (type)
+    {
+    case kData:
+        return handleData(flags, streamId, payload, len);
+    case kHeaders:
+        return handleHeaders(flags, streamId, payload, len);
+    case kPriority:
+        // 优先级在RFC 9113里已经废弃 只检查格式
+        if (streamId == 0)
+        {
+            return connectionError(kProtocolError, "PRIORITY on stream 0");
+        }
+        if (len != 5)
+        {
+            resetStream(streamId, kFrameSizeError);
+        }
+        return true;
+    case kRstStream:
+        return handleRstStream(streamId, payload, len);
+    case kSettings:
+        return handleSettings(flags, streamId, payload, len);
+    case kPushPromise:
+        return connectionError(kProtocolError, "PUSH_PROMISE from client");
+    case kPing:
+        if (streamId != 0)
+        {
+            return connectionError(kProtocolError, "PING on stream");
+        }
+        if (len != 8)
+        {
+            return connectionError(kFrameSizeError, "PING size");
+        }
+        if (!(flags & kFlagAck))
+        {
+            appendFrameHeader(8, kPing, kFlagAck, 0);
+            output_.append(payload, 8);
+        }
+        return true;
+    case kGoAway:
+        if (streamId != 0)
+        {
+            return connectionError(kProtocolError, "GOAWAY on stream");
+        }
+        if (len < 8)
+        {
+            return connectionError(kFrameSizeError, "GOAWAY size");
+        }
+        peerGoAway_ = true;
+        wakeWriter();
+        return true;
+    case kWindowUpdate:
+        return handleWindowUpdate(streamId, payload, len);
+    case kContinuation:
+        if (continuationStream_ == 0)
+        {
+            return connectionError(kProtocolError, "unexpected CONTINUATION");
+        }
+        return handleContinuation(flags, streamId, payload, len);
+    default:
+        return true; // 未知类型的帧必须忽略
+    }
+}
+
+bool Http2Connection::handleData(uint8_t flags, uint32_t streamId, const char *payload, size_t len)
+{
+    if (streamId == 0)
+    {
+        return connectionError(kProtocolError, "DATA on stream 0");
+    }
+    // 流量控制按整个负载(含填充)计算 即使流已经关闭也要计入连接窗口
+    if (static_cast<int64_t>(len) > connRecvWindow_)
+    {
+        return connectionError(kFlowControlError, "connection window exceeded");
+    }
+    connRecvWindow_ -= len;
+    if (connRecvWindow_ < kConnectionWindow / 2)
+    {
+        sendWindowUpdate(0, static_cast<uint32_t>(kConnectionWindow - connRecvWindow_));
+        connRecvWindow_ = kConnectionWindow;
+    }
+
+    const char *data = payload;
+    size_t n = len;
+    if (flags & kFlagPadded)
+    {
+        size_t pad = len > 0 ? static_cast<uint8_t>(payload[0]) : 0;
+        if (len == 0 || pad >= len)
+        {
+            return connectionError(kProtocolError, "DATA padding");
+        }
+        data = payload + 1;
+        n = len - 1 - pad;
+    }
+
+    auto it = streams_.find(streamId);
+    if (it == streams_.end())
+    {
+        if (streamId > lastStreamId_)
+        {
+            return connectionError(kProtocolError, "DATA on idle stream");
+        }
+        return true; // 多半是我们RST_STREAM之后对端还在途的数据 忽略
+    }
+    Stream *stream = it->second.get();
+    if (stream->reset)
+    {
+        return true;
+    }
+    if (stream->remoteClosed)
+    {
+        resetStream(streamId, kStreamClosed);
+        return true;
+    }
+    if (static_cast<int64_t>(len) > stream->recvWindow)
+    {
+        resetStream(streamId, kFlowControlError);
+        return true;
+    }
+    stream->recvWindow -= len;
+    stream->bodyReceived += n;
+    HttpRequest &req = stream->req;
+    if (req.contentLength() >= 0 && stream->bodyReceived > static_cast<uint64_t>(req.contentLength()))
+    {
+        resetStream(streamId, kProtocolError); // DATA比content-length多
+        return true;
+    }
+
+    if (stream->streaming)
+    {
+        if (stream->discardBody)
+        {
+            if (stream->localClosed)
+            {
+                // 响应已经发完 不用再收了(RFC 9113 8.1)
+                resetStream(streamId, kNoError);
+                return true;
+            }
+            creditWindow(stream, len);
+        }
+        else
+        {
+            req.bodyStorage_.append(data, n);
+            creditWindow(stream, len - n); // 填充不交给处理函数 直接归还
+        }
+        if (flags & kFlagEndStream)
+        {
+            endRemote(stream);
+        }
+        else if (n > 0 && !stream->discardBody)
+        {
+            wakeBody(stream); // 只有填充的DATA没有新数据 不唤醒
+        }
+        return true;
+    }
+
+    if (stream->errorStatus == 0)
+    {
+        std::string &body = req.bodyStorage_;
+        if (body.size() + n > server_->maxBodySize_)
+        {
+            body.clear();
+            stream->errorStatus = HttpResponse::k413PayloadTooLarge;
+        }
+        else
+        {
+            body.append(data, n);
+        }
+    }
+
+    if (flags & kFlagEndStream)
+    {
+        endRemote(stream);
+    }
+    else if (stream->errorStatus != 0)
+    {
+        startStream(stream); // 不等请求体收完 直接回错误
+    }
+    else if (stream->recvWindow < kStreamWindow / 2)
+    {
+        sendWindowUpdate(streamId, static_cast<uint32_t>(kStreamWindow - stream->recvWindow));
+        stream->recvWindow = kStreamWindow;
+    }
+    return true;
+}
+
+bool Http2Connection::handleHeaders(uint8_t flags, uint32_t streamId, const char *payload, size_t len)
+{
+    if (streamId == 0 || (streamId & 1) == 0)
+    {
+        return connectionError(kProtocolError, "HEADERS on invalid stream");
+    }
+    const char *p = payload;
+    const char *end = payload + len;
+    size_t pad = 0;
+    if (flags & kFlagPadded)
+    {
+        if (p == end)
+        {
+            return connectionError(kFrameSizeError, "HEADERS padding");
+        }
+        pad = static_cast<uint8_t>(*p++);
+    }
+    if (flags & kFlagPriority)
+    {
+        if (end - p < 5)
+        {
+            return connectionError(kFrameSizeError, "HEADERS priority");
+        }
+        if ((readUint32(p) & 0x7fffffff) == streamId)
+        {
+            return connectionError(kProtocolError, "stream depends on itself");
+        }
+        p += 5;
+    }
+    if (pad > static_cast<size_t>(end - p))
+    {
+        return connectionError(kProtocolError, "HEADERS padding");
+    }
+    end -= pad;
+
+    headerBlock_.assign(p, end - p);
+    if (!(flags & kFlagEndHeaders))
+    {
+        continuationStream_ = streamId;
+        headerFlags_ = flags;
+        return true;
+    }
+    return finishHeaders(streamId, flags);
+}
+
+bool Http2Connection::handleContinuation(uint8_t flags, uint32_t streamId, const char *payload, size_t len)
+{
+    if (headerBlock_.size() + len > kMaxHeaderBlock)
+    {
+        return connectionError(kEnhanceYourCalm, "header block too large");
+    }
+    headerBlock_.append(payload, len);
+    if (!(flags & kFlagEndHeaders))
+    {
+        return true;
+    }
+    continuationStream_ = 0;
+    return finishHeaders(streamId, headerFlags_);
+}
+
+bool Http2Connection::finishHeaders(uint32_t streamId, uint8_t flags)
+{
+    // 不管这个头部块最后是否被接受 都要完整解码 让动态表和对端保持一致
+    auto discard = [](std::string_view, std::string_view) {};
+
+    auto it = streams_.find(streamId);
+    if (it != streams_.end())
+    {
+        // 已经打开的流上的第二个头部块是trailer 内容忽略
+        Stream *stream = it->second.get();
+        if (!decoder_.decode(headerBlock_.data(), headerBlock_.size(), discard))
+        {
+            return connectionError(kCompressionError, "HPACK decoding failed");
+        }
+        if (stream->reset)
+        {
+            return true;
+        }
+        if (stream->remoteClosed)
+        {
+            return connectionError(kStreamClosed, "HEADERS on half-closed stream");
+        }
+        if (!(flags & kFlagEndStream))
+        {
+            resetStream(streamId, kProtocolError);
+            return true;
+        }
+        endRemote(stream);
+        return true;
+    }
+
+    if (streamId <= lastStreamId_ || goAwaySent_)
+    {
+        if (!decoder_.decode(headerBlock_.data(), headerBlock_.size(), discard))
+        {
+            return connectionError(kCompressionError, "HPACK decoding failed");
+        }
+        if (goAwaySent_)
+        {
+            return true; // GOAWAY之后开启的流不处理
+        }
+        return connectionError(kStreamClosed, "HEADERS on closed stream");
+    }
+    lastStreamId_ = streamId;
+
+    if (streams_.size() >= kMaxConcurrentStreams)
+    {
+        if (!decoder_.decode(headerBlock_.data(), headerBlock_.size(), discard))
+        {
+            return connectionError(kCompressionError, "HPACK decoding failed");
+        }
+        resetStream(streamId, kRefusedStream);
+        return true;
+    }
+
+    auto stream = std::make_unique<Stream>(streamId, peerInitialWindow_);
+    Stream *s = stream.get();
+    parser_.beginHttp2(&s->req, &conn_);
+    bool valid = true;
+    bool decoded = decoder_.decode(headerBlock_.data(), headerBlock_.size(),
+                                   [this, s, &valid](std::string_view name, std::string_view value) {
+                                       if (valid)
+                                       {
+                                           valid = parser_.addHttp2Field(name, value, &s->req);
+                                       }
+                                   });
+    if (!decoded)
+    {
+        return connectionError(kCompressionError, "HPACK decoding failed");
+    }
+    if (valid)
+    {
+        valid = parser_.endHttp2Fields(&s->req);
+    }
+    if (!valid && parser_.errorStatus() == 0)
+    {
+        resetStream(streamId, kProtocolError); // 畸形请求
+        return true;
+    }
+    s->errorStatus = valid ? 0 : parser_.errorStatus();
+    // 协程处理函数自己读请求体 不受maxBodySize限制(和HTTP/1.1一样)
+    s->streaming = s->errorStatus == 0 && !server_->httpCallback_ && server_->handler_ && !(flags & kFlagEndStream);
+    if (s->errorStatus == 0 && !s->streaming && s->req.contentLength() > static_cast<int64_t>(server_->maxBodySize_))
+    {
+        s->errorStatus = HttpResponse::k413PayloadTooLarge;
+    }
+    s->headOnly = s->req.method() == HttpRequest::kHead;
+    if (s->streaming)
+    {
+        s->req.memoryStream_ = true;
+        s->req.bodyState_ = HttpRequest::kBodyStreaming;
+        s->req.bodyConsumed_ = [this, s](size_t n) { creditWindow(s, n); };
+    }
+    else
+    {
+        s->req.bodyState_ = HttpRequest::kBodyBuffered;
+    }
+    streams_.emplace(streamId, std::move(stream));
+
+    if (flags & kFlagEndStream)
+    {
+        endRemote(s);
+    }
+    else if (s->errorStatus != 0 || s->streaming)
+    {
+        startStream(s);
+    }
+    return true;
+}
+
+bool Http2Connection::handleSettings(uint8_t flags, uint32_t streamId, const char *payload, size_t len)
+{
+    if (streamId != 0)
+    {
+        return connectionError(kProtocolError, "SETTINGS on stream");
+    }
+    if (flags & kFlagAck)
+    {
+        return len == 0 ? true : connectionError(kFrameSizeError, "SETTINGS ack with payload");
+    }
+    if (len % 6 != 0)
+    {
+        return connectionError(kFrameSizeError, "SETTINGS size");
+    }
+    for (size_t i = 0; i < len; i += 6)
+    {
+        const uint8_t *u = reinterpret_cast<const uint8_t *>(payload + i);
+        uint16_t id = static_cast<uint16_t>((u[0] << 8) | u[1]);
+        uint32_t value = readUint32(payload + i + 2);
+        switch (id)
+        {
+        case kSettingsHeaderTableSize:
+            encoder_.setMaxTableSize(value);
+            break;
+        case kSettingsEnablePush:
+            if (value > 1)
+            {
+                return connectionError(kProtocolError, "SETTINGS_ENABLE_PUSH");
+            }
+            break;
+        case kSettingsInitialWindowSize:
+        {
+            if (value > kMaxWindow)
+            {
+                return connectionError(kFlowControlError, "SETTINGS_INITIAL_WINDOW_SIZE");
+            }
+            // 变化量作用到所有已经打开的流 窗口可能因此变成负数
+            int64_t delta = static_cast<int64_t>(value) - peerInitialWindow_;
+            for (auto &entry : streams_)
+            {
+                entry.second->sendWindow += delta;
+                if (entry.second->sendWindow > kMaxWindow)
+                {
+                    return connectionError(kFlowControlError, "stream window overflow");
+                }
+            }
+            peerInitialWindow_ = value;
+            break;
+        }
+        case kSettingsMaxFrameSize:
+            if (value < kMaxFrameSize || value > 0xffffff)
+            {
+                return connectionError(kProtocolError, "SETTINGS_MAX_FRAME_SIZE");
+            }
+            peerMaxFrameSize_ = std::min<size_t>(value, kMaxSendFrameSize);
+            break;
+        default:
+            break; // MAX_CONCURRENT_STREAMS(我们不主动开流) MAX_HEADER_LIST_SIZE 以及未知的设置
+        }
+    }
+    settingsReceived_ = true;
+    appendFrameHeader(0, kSettings, kFlagAck, 0);
+    wakeWriter();
+    return true;
+}
+
+bool Http2Connection::handleWindowUpdate(uint32_t streamId, const char *payload, size_t len)
+{
+    if (len != 4)
+    {
+        return connectionError(kFrameSizeError, "WINDOW_UPDATE size");
+    }
+    uint32_t increment = readUint32(payload) & 0x7fffffff;
+    if (streamId == 0)
+    {
+        if (increment == 0)
+        {
+            return connectionError(kProtocolError, "WINDOW_UPDATE increment 0");
+        }
+        connSendWindow_ += increment;
+        if (connSendWindow_ > kMaxWindow)
+        {
+            return connectionError(kFlowControlError, "connection window overflow");
+        }
+    }
+    else
+    {
+        auto it = streams_.find(streamId);
+        if (it == streams_.end())
+        {
+            // 已经关闭的流上的WINDOW_UPDATE可能是在途的 忽略
+            return streamId > lastStreamId_ ? connectionError(kProtocolError, "WINDOW_UPDATE on idle stream") : true;
+        }
+        Stream *stream = it->second.get();
+        if (stream->reset)
+        {
+            return true;
+        }
+        if (increment == 0)
+        {
+            resetStream(streamId, kProtocolError);
+            return true;
+        }
+        stream->sendWindow += increment;
+        if (stream->sendWindow > kMaxWindow)
+        {
+            resetStream(streamId, kFlowControlError);
+            return true;
+        }
+    }
+    wakeWriter();
+    return true;
+}
+
+bool Http2Connection::handleRstStream(uint32_t streamId, const char *payload, size_t len)
+{
+    (void)payload;
+    if (streamId == 0 || streamId > lastStreamId_)
+    {
+        return connectionError(kProtocolError, "RST_STREAM on idle stream");
+    }
+    if (len != 4)
+    {
+        return connectionError(kFrameSizeError, "RST_STREAM size");
+    }
+    auto it = streams_.find(streamId);
+    if (it != streams_.end())
+    {
+        // 流协程可能还在运行 由写协程等它结束后释放
+        it->second->reset = true;
+        failBody(it->second.get());
+        wakeWriter();
+    }
+    return true;
+}
+
+void Http2Connection::endRemote(Stream *stream)
+{
+    stream->remoteClosed = true;
+    if (stream->reset || (stream->started && !stream->streaming))
+    {
+        return;
+    }
+    HttpRequest &req = stream->req;
+    if (stream->errorStatus == 0 && req.contentLength() >= 0 &&
+        static_cast<uint64_t>(req.contentLength()) != stream->bodyReceived)
+    {
+        resetStream(stream->id, kProtocolError); // content-length和DATA的总长不一致是畸形请求
+        return;
+    }
+    if (stream->streaming)
+    {
+        req.bodyEnded_ = true;
+        wakeBody(stream);
+        return;
+    }
+    startStream(stream);
+}
+
+void Http2Connection::creditWindow(Stream *stream, size_t n)
+{
+    stream->windowCredit += n;
+    // 对端已经发完或者流已经关闭 不需要归还; 攒到窗口的1/4再归还 避免每读一块就发一个WINDOW_UPDATE
+    if (stream->remoteClosed || stream->reset || stream->windowCredit < static_cast<int64_t>(kStreamWindow / 4))
+    {
+        return;
+    }
+    sendWindowUpdate(stream->id, static_cast<uint32_t>(stream->windowCredit));
+    stream->recvWindow += stream->windowCredit;
+    stream->windowCredit = 0;
+    wakeWriter(); // 处理函数里调用时由写协程发出
+}
+
+// 只在readBody有东西可交时唤醒(新数据、结束或出错) 流式读取期间处理函数不会拿到空块误以为请求体结束
+void Http2Connection::wakeBody(Stream *stream)
+{
+    std::coroutine_handle<> h = stream->req.bodyWaiter_;
+    if (h && stream->req.memoryBodyReady())
+    {
+        stream->req.bodyWaiter_ = nullptr;
+        h.resume();
+    }
+}
+
+void Http2Connection::failBody(Stream *stream)
+{
+    if (!stream->streaming)
+    {
+        return;
+    }
+    HttpRequest &req = stream->req;
+    if (req.bodyState_ == HttpRequest::kBodyStreaming)
+    {
+        req.bodyState_ = HttpRequest::kBodyError;
+    }
+    wakeBody(stream);
+}
+
+void Http2Connection::discardBody(Stream *stream)
+{
+    HttpRequest &req = stream->req;
+    stream->discardBody = true;
+    req.bodyConsumed_ = nullptr;
+    creditWindow(stream, req.bodyStorage_.size() + req.pendingConsume_);
+    req.bodyStorage_.clear();
+    req.pendingConsume_ = 0;
+}
+
+void Http2Connection::startStream(Stream *stream)
+{
+    if (stream->started)
+    {
+        return;
+    }
+    stream->started = true;
+    ++running_;
+    stream->task.emplace(runStream(stream));
+    stream->task->start();
+}
+
+AsyncTask Http2Connection::runStream(Stream *stream)
+{
+    HttpRequest &req = stream->req;
+    HttpResponse &resp = stream->resp;
+    try
+    {
+        if (stream->errorStatus != 0)
+        {
+            resp.setStatusCode(stream->errorStatus);
+        }
+        else if (server_->httpCallback_)
+        {
+            server_->httpCallback_(req, &resp);
+        }
+        else if (server_->handler_)
+        {
+            co_await server_->handler_(req, resp);
+        }
+        else
+        {
+            resp.setStatusCode(HttpResponse::k404NotFound);
+        }
+
+        HttpCompressor *compressor = server_->compressor_;
+        if (compressor && !stream->reset && compressor->shouldCompress(req, resp))
+        {
+            co_await compressor->compress(req, resp);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERROR << "Http2Connection handler exception: " << e.what();
+        resp.reset(false);
+        resp.setStatusCode(HttpResponse::k500InternalServerError);
+    }
+
+    if (stream->streaming)
+    {
+        discardBody(stream);
+    }
+    if (!stream->reset && !failed_)
+    {
+        sendQueue_.push_back(stream->id);
+    }
+    wakeWriter();
+    if (--running_ == 0 && streamsHandle_)
+    {
+        // 不能在这里直接恢复run(): 它接着会释放流对象 而这个协程还没有执行完
+        conn_->getLoop()->queueInLoop([this]() {
+            std::coroutine_handle<> h = streamsHandle_;
+            streamsHandle_ = nullptr;
+            h.resume();
+        });
+    }
+}
+
+// ================= 写方向 =================
+
+AsyncTask Http2Connection::writeLoop()
+{
+    while (true)
+    {
+        // 读协程在等发送队列降下来 不能在这里直接恢复(它可能结束会话) 推迟到本轮事件之后
+        if (readerHandle_ && (!conn_->connected() || conn_->pendingOutputBytes() < kHighWaterMark))
+        {
+            std::coroutine_handle<> h = readerHandle_;
+            readerHandle_ = nullptr;
+            conn_->getLoop()->queueInLoop([h]() { h.resume(); });
+        }
+        bool more = false;
+        if (!failed_ && conn_->connected())
+        {
+            more = writeStreams();
+            flush();
+        }
+        reapStreams();
+        if (stopping_ && running_ == 0)
+        {
+            break;
+        }
+        // 对端GOAWAY之后 最后一个流发完就关闭连接
+        if (peerGoAway_ && streams_.empty() && !goAwaySent_ && conn_->connected())
+        {
+            goAway(kNoError);
+            flush();
+            conn_->shutdown();
+        }
+        if (conn_->connected() && (more || conn_->pendingOutputBytes() >= kHighWaterMark))
+        {
+            co_await conn_->drain();
+            continue;
+        }
+        co_await WakeAwaiter{this};
+    }
+}
+
+bool Http2Connection::writeStreams()
+{
+    // 每轮给每个就绪的流写一帧 直到都写完、都被窗口挡住 或者发送队列到了高水位
+    bool progress = true;
+    while (progress && !sendQueue_.empty())
+    {
+        progress = false;
+        size_t rounds = sendQueue_.size();
+        for (size_t i = 0; i < rounds; ++i)
+        {
+            uint32_t id = sendQueue_.front();
+            sendQueue_.pop_front();
+            auto it = streams_.find(id);
+            if (it == streams_.end() || it->second->reset)
+            {
+                continue;
+            }
+            Stream *stream = it->second.get();
+            if (!stream->headersSent)
+            {
+                writeHeaders(stream);
+                progress = true;
+            }
+            else if (writeData(stream))
+            {
+                progress = true;
+            }
+            if (stream->localClosed)
+            {
+                // 请求体还没发完(比如413)时 响应结束后让对端停止发送
+                if (!stream->remoteClosed && !stream->reset)
+                {
+                    resetStream(id, kNoError);
+                }
+                continue;
+            }
+            if (!stream->reset)
+            {
+                sendQueue_.push_back(id);
+            }
+            if (output_.readableBytes() + conn_->pendingOutputBytes() >= kHighWaterMark)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void Http2Connection::writeHeaders(Stream *stream)
+{
+    HttpResponse &resp = stream->resp;
+    int status = resp.statusCode();
+    bool bodyAllowed = status >= 200 && status != HttpResponse::k204NoContent && status != HttpResponse::k304NotModified;
+    size_t length = bodyAllowed ? resp.bodyLength() : 0;
+    stream->bodyLength = stream->headOnly ? 0 : length;
+
+    headerOut_.clear();
+    encoder_.beginBlock(&headerOut_);
+    char buf[32];
+    snprintf(buf, sizeof buf, "%d", status);
+    encoder_.encode(":status", buf, &headerOut_);
+    if (bodyAllowed)
+    {
+        snprintf(buf, sizeof buf, "%zu", length);
+        encoder_.encode("content-length", buf, &headerOut_);
+    }
+    // headers_里每一行是 "Name: Value\r\n" HTTP/2要求字段名小写
+    const std::string &headers = resp.headers_;
+    size_t pos = 0;
+    while (pos < headers.size())
+    {
+        size_t eol = headers.find("\r\n", pos);
+        if (eol == std::string::npos)
+        {
+            break;
+        }
+        size_t colon = headers.find(':', pos);
+        if (colon != std::string::npos && colon < eol)
+        {
+            scratch_.assign(headers, pos, colon - pos);
+            std::transform(scratch_.begin(), scratch_.end(), scratch_.begin(),
+                           [](char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + 32) : c; });
+            std::string_view value(headers.data() + colon + 1, eol - colon - 1);
+            while (!value.empty() && value.front() == ' ')
+            {
+                value.remove_prefix(1);
+            }
+            if (!skipResponseHeader(scratch_))
+            {
+                encoder_.encode(scratch_, value, &headerOut_);
+            }
+        }
+        pos = eol + 2;
+    }
+
+    // 头部块超过对端的帧大小时拆成HEADERS + CONTINUATION 中间不能插入其他帧
+    bool endStream = stream->bodyLength == 0;
+    size_t offset = 0;
+    do
+    {
+        size_t n = std::min(headerOut_.size() - offset, peerMaxFrameSize_);
+        bool last = offset + n == headerOut_.size();
+        uint8_t flags = last ? kFlagEndHeaders : 0;
+        if (offset == 0 && endStream)
+        {
+            flags |= kFlagEndStream;
+        }
+        appendFrameHeader(n, offset == 0 ? kHeaders : kContinuation, flags, stream->id);
+        output_.append(headerOut_.data() + offset, n);
+        offset += n;
+    } while (offset < headerOut_.size());
+
+    stream->headersSent = true;
+    stream->localClosed = endStream;
+}
+
+bool Http2Connection::writeData(Stream *stream)
+{
+    size_t remaining = stream->bodyLength - stream->bodyOffset;
+    int64_t window = std::min(stream->sendWindow, connSendWindow_);
+    if (remaining == 0 || window <= 0)
+    {
+        return false;
+    }
+    size_t n = std::min({remaining, static_cast<size_t>(window), peerMaxFrameSize_});
+    bool last = n == remaining;
+    HttpResponse &resp = stream->resp;
+
+    // 帧头和负载直接写进output_ 文件内容pread进来 不经过中间缓冲
+    output_.ensureWritableBytes(kFrameHeaderLength + n);
+    char *frame = output_.beginWrite();
+    char *data = frame + kFrameHeaderLength;
+    if (resp.sharedBody())
+    {
+        ::memcpy(data, resp.sharedBody()->data() + stream->bodyOffset, n);
+    }
+    else if (resp.hasFileBody())
+    {
+        size_t got = 0;
+        while (got < n)
+        {
+            ssize_t r = ::pread(resp.fileFd(), data + got, n - got, resp.fileOffset() + stream->bodyOffset + got);
+            if (r <= 0)
+            {
+                // 文件在发送期间被截断 Content-Length已经发出去了 只能取消这个流
+                LOG_WARN << "Http2Connection pread short read " << conn_->name() << " stream " << stream->id;
+                resetStream(stream->id, kInternalError);
+                return false;
+            }
+            got += r;
+        }
+    }
+    else
+    {
+        ::memcpy(data, resp.body().data() + stream->bodyOffset, n);
+    }
+    encodeFrameHeader(frame, n, kData, last ? kFlagEndStream : 0, stream->id);
+    output_.hasWritten(kFrameHeaderLength + n);
+
+    stream->bodyOffset += n;
+    stream->sendWindow -= n;
+    connSendWindow_ -= n;
+    stream->localClosed = last;
+    return true;
+}
+
+void Http2Connection::reapStreams()
+{
+    for (auto it = streams_.begin(); it != streams_.end();)
+    {
+        Stream *stream = it->second.get();
+        bool closed = stream->reset || (stream->localClosed && stream->remoteClosed);
+        bool idle = !stream->task || stream->task->done();
+        if (closed && idle)
+        {
+            it = streams_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+// ================= 帧编码 =================
+
+void Http2Connection::appendFrameHeader(size_t len, uint8_t type, uint8_t flags, uint32_t streamId)
+{
+    char header[kFrameHeaderLength];
+    encodeFrameHeader(header, len, type, flags, streamId);
+    output_.append(header, sizeof header);
+}
+
+void Http2Connection::sendSettings()
+{
+    const std::pair<uint16_t, uint32_t> settings[] = {
+        {kSettingsMaxConcurrentStreams, kMaxConcurrentStreams},
+        {kSettingsInitialWindowSize, kStreamWindow},
+        {kSettingsMaxHeaderListSize, static_cast<uint32_t>(HttpParser::kMaxHeaderBytes)},
+    };
+    appendFrameHeader(sizeof settings / sizeof settings[0] * 6, kSettings, 0, 0);
+    for (const auto &setting : settings)
+    {
+        char buf[6];
+        buf[0] = static_cast<char>(setting.first >> 8);
+        buf[1] = static_cast<char>(setting.first);
+        writeUint32(buf + 2, setting.second);
+        output_.append(buf, sizeof buf);
+    }
+    // 连接级窗口没有对应的设置项 只能用WINDOW_UPDATE放大
+    sendWindowUpdate(0, kConnectionWindow - kDefaultWindow);
+}
+
+void Http2Connection::sendWindowUpdate(uint32_t streamId, uint32_t increment)
+{
+    appendFrameHeader(4, kWindowUpdate, 0, streamId);
+    char buf[4];
+    writeUint32(buf, increment);
+    output_.append(buf, sizeof buf);
+}
+
+void Http2Connection::resetStream(uint32_t streamId, ErrorCode code)
+{
+    appendFrameHeader(4, kRstStream, 0, streamId);
+    char buf[4];
+    writeUint32(buf, code);
+    output_.append(buf, sizeof buf);
+    auto it = streams_.find(streamId);
+    if (it != streams_.end())
+    {
+        it->second->reset = true;
+        failBody(it->second.get());
+    }
+}
+
+bool Http2Connection::countControlFrame(uint8_t type)
+{
+    if (type != kPing && type != kSettings && type != kPriority && type != kRstStream)
+    {
+        return true;
+    }
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    if (now - controlWindowStart_ >= Timestamp::kMicroSecondsPerSecond)
+    {
+        controlWindowStart_ = now;
+        controlFrames_ = 0;
+    }
+    return ++controlFrames_ <= kMaxControlFrames;
+}
+
+bool Http2Connection::connectionError(ErrorCode code, const char *what)
+{
+    LOG_WARN << "Http2Connection " << conn_->name() << " connection error " << code << ": " << what;
+    if (!goAwaySent_)
+    {
+        goAway(code);
+    }
+    failed_ = true;
+    flush();
+    return false;
+}
+
+void Http2Connection::goAway(ErrorCode code)
+{
+    appendFrameHeader(8, kGoAway, 0, 0);
+    char buf[8];
+    writeUint32(buf, lastStreamId_);
+    writeUint32(buf + 4, code);
+    output_.append(buf, sizeof buf);
+    goAwaySent_ = true;
+}
+
+void Http2Connection::flush()
+{
+    if (output_.readableBytes() > 0 && conn_->connected())
+    {
+        conn_->send(&output_);
+    }
+    output_.retrieveAll();
+}
+
+void Http2Connection::wakeWriter()
+{
+    writeRequested_ = true;
+    if (writerHandle_ && !wakeScheduled_)
+    {
+        // 推迟到本轮事件处理之后 同一轮里就绪的流在一次写里发出
+        wakeScheduled_ = true;
+        conn_->getLoop()->queueInLoop([this]() {
+            wakeScheduled_ = false;
+            if (writerHandle_)
+            {
+                std::coroutine_handle<> h = writerHandle_;
+                writerHandle_ = nullptr;
+                h.resume();
+            }
+        });
+    }
+}
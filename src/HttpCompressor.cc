@@ -0,0 +1,347 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+#include <openssl/evp.h>
+
+#include <HttpCompressor.h>
+#include <HttpRequest.h>
+#include <HttpResponse.h>
+#include <WorkerPool.h>
+#include <Logger.h>
+
+namespace
+{
+
+std::string_view trim(std::string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+    {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+    {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    return a.size() == b.size() && ::strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+// 在Accept-Encoding里找编码name的q值 没有列出返回-1 "*"的q值通过star带回
+double qualityOf(std::string_view acceptEncoding, std::string_view name, std::string_view alias, double *star)
+{
+    double result = -1.0;
+    *star = -1.0;
+    while (!acceptEncoding.empty())
+    {
+        size_t comma = acceptEncoding.find(',');
+        std::string_view item = acceptEncoding.substr(0, comma);
+        acceptEncoding.remove_prefix(comma == std::string_view::npos ? acceptEncoding.size() : comma + 1);
+
+        size_t semi = item.find(';');
+        std::string_view coding = trim(item.substr(0, semi));
+        double q = 1.0;
+        if (semi != std::string_view::npos)
+        {
+            std::string_view param = trim(item.substr(semi + 1));
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+            {
+                q = ::strtod(std::string(param.substr(2)).c_str(), nullptr);
+            }
+        }
+        if (equalsIgnoreCase(coding, name) || (!alias.empty() && equalsIgnoreCase(coding, alias)))
+        {
+            result = q;
+        }
+        else if (coding == "*")
+        {
+            *star = q;
+        }
+    }
+    return result;
+}
+
+double effectiveQuality(std::string_view acceptEncoding, HttpCompressor::Encoding enc)
+{
+    double star = -1.0;
+    double q = enc == HttpCompressor::kGzip ? qualityOf(acceptEncoding, "gzip", "x-gzip", &star)
+                                            : qualityOf(acceptEncoding, "deflate", "", &star);
+    return q >= 0.0 ? q : star;
+}
+
+// 没有ETag、超过这个大小的响应体在WorkerPool里做摘要 不占用loop线程
+const size_t kInlineDigestLimit = 64 * 1024;
+
+// ETag只在同一个资源内区分版本 和Host+完整的请求目标(包括查询串)一起才能代表内容
+// 静态文件的ETag由inode/大小/修改时间构成 不需要读内容
+std::string etagKey(const HttpRequest &req, std::string_view etag)
+{
+    std::string key("E");
+    key.append(req.header("Host"));
+    key.push_back('\n');
+    key.append(req.target());
+    key.push_back('\n');
+    key.append(etag);
+    return key;
+}
+
+// 没有ETag时对内容做摘要
+std::string digestKey(std::string_view body)
+{
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    EVP_Digest(body.data(), body.size(), md, &len, EVP_sha256(), nullptr);
+    std::string key("H");
+    key.append(reinterpret_cast<const char *>(md), len);
+    return key;
+}
+
+} // namespace
+
+HttpCompressor::HttpCompressor(WorkerPool *pool, size_t cacheBytes)
+    : pool_(pool)
+    , level_(Z_DEFAULT_COMPRESSION)
+    , minLength_(kDefaultMinLength)
+    , maxLength_(kDefaultMaxLength)
+    , cacheBytes_(0)
+    , cacheCapacity_(cacheBytes)
+    , hits_(0)
+    , misses_(0)
+{
+}
+
+HttpCompressor::Encoding HttpCompressor::negotiate(std::string_view acceptEncoding)
+{
+    if (acceptEncoding.empty())
+    {
+        return kIdentity;
+    }
+    double gzip = effectiveQuality(acceptEncoding, kGzip);
+    double deflate = effectiveQuality(acceptEncoding, kDeflate);
+    if (gzip <= 0.0 && deflate <= 0.0)
+    {
+        return kIdentity;
+    }
+    return gzip >= deflate ? kGzip : kDeflate;
+}
+
+bool HttpCompressor::accepts(std::string_view acceptEncoding, Encoding enc)
+{
+    return enc == kIdentity || effectiveQuality(acceptEncoding, enc) > 0.0;
+}
+
+bool HttpCompressor::compressible(std::string_view contentType)
+{
+    contentType = trim(contentType.substr(0, contentType.find(';')));
+    if (contentType.size() > 5 && ::strncasecmp(contentType.data(), "text/", 5) == 0)
+    {
+        return true;
+    }
+    static const char *const kTypes[] = {
+        "application/json", "application/javascript", "application/xml", "application/wasm",
+        "image/svg+xml",    "image/x-icon",           "font/ttf",        "font/otf",
+    };
+    for (const char *type : kTypes)
+    {
+        if (equalsIgnoreCase(contentType, type))
+        {
+            return true;
+        }
+    }
+    // application/xxx+json, application/xxx+xml
+    return contentType.ends_with("+json") || contentType.ends_with("+xml");
+}
+
+const char *HttpCompressor::encodingName(Encoding enc)
+{
+    switch (enc)
+    {
+    case kGzip: return "gzip";
+    case kDeflate: return "deflate";
+    default: return "identity";
+    }
+}
+
+std::string HttpCompressor::compressData(std::string_view data, Encoding enc, int level)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof zs);
+    // windowBits 15+16 输出gzip格式 15 输出zlib格式(HTTP的deflate编码)
+    int windowBits = enc == kGzip ? 15 + 16 : 15;
+    if (deflateInit2(&zs, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return std::string();
+    }
+    std::string out(deflateBound(&zs, data.size()) + 32, '\0'); // gzip头尾比bound多几个字节
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    int ret = deflate(&zs, Z_FINISH);
+    size_t produced = zs.total_out;
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END)
+    {
+        LOG_ERROR << "HttpCompressor deflate failed ret=" << ret;
+        return std::string();
+    }
+    out.resize(produced);
+    return out;
+}
+
+bool HttpCompressor::shouldCompress(const HttpRequest &req, const HttpResponse &resp) const
+{
+    // HEAD只发头部 压缩了也没有意义
+    if (req.method() == HttpRequest::kHead || resp.statusCode() != HttpResponse::k200Ok || resp.hasFileBody() ||
+        !resp.header("Content-Encoding").empty())
+    {
+        return false;
+    }
+    size_t length = resp.bodyLength();
+    return length >= minLength_ && length <= maxLength_ && compressible(resp.header("Content-Type"));
+}
+
+AsyncTask HttpCompressor::compress(const HttpRequest &req, HttpResponse &resp)
+{
+    // 表示随Accept-Encoding变化 不压缩的回应也要带上 否则共享缓存可能把原文发给支持压缩的客户端
+    if (resp.header("Vary").empty())
+    {
+        resp.addHeader("Vary", "Accept-Encoding");
+    }
+    Encoding enc = negotiate(req.header("Accept-Encoding"));
+    if (enc == kIdentity)
+    {
+        co_return;
+    }
+
+    SharedMessage body = resp.sharedBody();
+    if (!body)
+    {
+        body = std::make_shared<const std::string>(std::move(resp.body()));
+        resp.setSharedBody(body);
+    }
+    // 大的无ETag响应体的摘要和压缩一起放到WorkerPool里 key留空由job计算
+    std::string key;
+    std::string_view etag = resp.header("ETag");
+    if (!etag.empty())
+    {
+        key = etagKey(req, etag);
+    }
+    else if (!pool_ || body->size() <= kInlineDigestLimit)
+    {
+        key = digestKey(*body);
+    }
+
+    SharedMessage compressed;
+    if (!key.empty())
+    {
+        key += encodingName(enc);
+        if (lookup(key, &compressed))
+        {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (!compressed)
+    {
+        int level = level_;
+        auto job = [this, body, enc, level, key]() mutable {
+            SharedMessage result;
+            if (key.empty())
+            {
+                key = digestKey(*body);
+                key += encodingName(enc);
+                if (lookup(key, &result))
+                {
+                    hits_.fetch_add(1, std::memory_order_relaxed);
+                    return result;
+                }
+            }
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            std::string out = compressData(*body, enc, level);
+            if (out.size() >= body->size())
+            {
+                out.clear(); // 压不小 记一个空标记
+            }
+            result = std::make_shared<const std::string>(std::move(out));
+            insert(key, result);
+            return result;
+        };
+        if (pool_ && req.hasConnection())
+        {
+            compressed = co_await pool_->run(req.connection(), std::move(job));
+        }
+        else if (pool_)
+        {
+            compressed = co_await pool_->run(std::move(job)); // HTTP/2 整个会话期间连接都不会迁移
+        }
+        else
+        {
+            compressed = job();
+        }
+    }
+
+    if (compressed->empty())
+    {
+        co_return;
+    }
+    resp.setSharedBody(compressed);
+    resp.addHeader("Content-Encoding", encodingName(enc));
+    etag = resp.header("ETag"); // addHeader之后重新取
+    if (!etag.empty() && !etag.starts_with("W/"))
+    {
+        std::string weak("W/");
+        weak.append(etag);
+        resp.removeHeader("ETag");
+        resp.addHeader("ETag", weak);
+    }
+}
+
+size_t HttpCompressor::cachedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cacheBytes_;
+}
+
+bool HttpCompressor::lookup(const std::string &key, SharedMessage *data)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end())
+    {
+        return false;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    *data = it->second->data;
+    return true;
+}
+
+void HttpCompressor::insert(const std::string &key, const SharedMessage &data)
+{
+    size_t bytes = key.size() + data->size();
+    if (bytes > cacheCapacity_)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end())
+    {
+        // 两个连接同时未命中压缩了同一份内容 保留先放进来的
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return;
+    }
+    lru_.push_front(CacheEntry{key, data});
+    index_[key] = lru_.begin();
+    cacheBytes_ += bytes;
+    while (cacheBytes_ > cacheCapacity_)
+    {
+        CacheEntry &victim = lru_.back();
+        cacheBytes_ -= victim.key.size() + victim.data->size();
+        index_.erase(victim.key);
+        lru_.pop_back();
+    }
+}
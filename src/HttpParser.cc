@@ -0,0 +1,511 @@
+#include <string.h>
+#include <strings.h>
+#include <string_view>
+
+#include <HttpParser.h>
+#include <HttpRequest.h>
+#include <Buffer.h>
+
+namespace
+{
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    return a.size() == b.size() && ::strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+// RFC 7230 token字符
+bool isTokenChar(unsigned char c)
+{
+    static const char kSeparators[] = "()<>@,;:\\\"/[]?={} \t";
+    return c > 0x20 && c < 0x7f && ::strchr(kSeparators, c) == nullptr;
+}
+
+std::string_view trimOws(const char *begin, const char *end)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\t'))
+        ++begin;
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+    return std::string_view(begin, end - begin);
+}
+
+// 逗号分隔的列表里是否有token(不区分大小写) 用于Connection头
+bool hasToken(std::string_view list, std::string_view token)
+{
+    while (!list.empty())
+    {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        item = trimOws(item.data(), item.data() + item.size());
+        if (equalsIgnoreCase(item, token))
+        {
+            return true;
+        }
+        if (comma == std::string_view::npos)
+        {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+HttpRequest::Method parseMethod(std::string_view m)
+{
+    switch (m.size())
+    {
+    case 3:
+        if (m == "GET") return HttpRequest::kGet;
+        if (m == "PUT") return HttpRequest::kPut;
+        break;
+    case 4:
+        if (m == "POST") return HttpRequest::kPost;
+        if (m == "HEAD") return HttpRequest::kHead;
+        break;
+    case 5:
+        if (m == "PATCH") return HttpRequest::kPatch;
+        if (m == "TRACE") return HttpRequest::kTrace;
+        break;
+    case 6:
+        if (m == "DELETE") return HttpRequest::kDelete;
+        break;
+    case 7:
+        if (m == "OPTIONS") return HttpRequest::kOptions;
+        if (m == "CONNECT") return HttpRequest::kConnect;
+        break;
+    }
+    return HttpRequest::kInvalid;
+}
+
+} // namespace
+
+HttpParser::Result HttpParser::parse(Buffer *buf, HttpRequest *req)
+{
+    // 请求之间允许多余的空行(RFC 7230 3.5)
+    if (scanned_ == 0)
+    {
+        while (buf->readableBytes() >= 2 && buf->peek()[0] == '\r' && buf->peek()[1] == '\n')
+        {
+            buf->retrieve(2);
+        }
+    }
+
+    const char *begin = buf->peek();
+    size_t len = buf->readableBytes();
+    // 结束标记可能跨越上一次扫描的边界 往回退3个字节
+    size_t from = scanned_ > 3 ? scanned_ - 3 : 0;
+    const char *found = buf->findDoubleCRLF(begin + from);
+    if (found == nullptr)
+    {
+        scanned_ = len;
+        if (len > kMaxHeaderBytes)
+        {
+            errorStatus_ = 431;
+            return kError;
+        }
+        return kIncomplete;
+    }
+
+    size_t headBytes = found - begin + 4;
+    if (headBytes > kMaxHeaderBytes)
+    {
+        errorStatus_ = 431;
+        return kError;
+    }
+    scanned_ = headBytes;
+    return parseHead(begin, headBytes, req) ? kComplete : kError;
+}
+
+bool HttpParser::parseHead(const char *begin, size_t len, HttpRequest *req)
+{
+    req->headBytes_ = len;
+    const char *end = begin + len - 2; // 最后一个头部行的CRLF之后 结尾空行之前
+    const char *lineEnd = Buffer::scanByte(begin, end, '\n');
+    if (lineEnd == nullptr || lineEnd == begin || lineEnd[-1] != '\r')
+    {
+        return fail(400);
+    }
+    if (!parseRequestLine(begin, lineEnd - 1, req))
+    {
+        return false;
+    }
+
+    const char *line = lineEnd + 1;
+    while (line < end)
+    {
+        lineEnd = Buffer::scanByte(line, end, '\n');
+        if (lineEnd == nullptr || lineEnd[-1] != '\r')
+        {
+            return fail(400);
+        }
+        if (!parseHeader(begin, line, lineEnd - 1, req))
+        {
+            return false;
+        }
+        line = lineEnd + 1;
+    }
+
+    if (req->chunked_ && req->contentLength_ >= 0)
+    {
+        return fail(400); // 两者同时出现是请求走私的典型手法 直接拒绝
+    }
+    if (req->version_ == HttpRequest::kHttp11)
+    {
+        std::string_view conn = req->header("Connection");
+        req->keepAlive_ = !hasToken(conn, "close");
+    }
+    else
+    {
+        req->keepAlive_ = hasToken(req->header("Connection"), "keep-alive");
+    }
+    return true;
+}
+
+bool HttpParser::parseRequestLine(const char *begin, const char *end, HttpRequest *req)
+{
+    auto span = [begin](const char *p, const char *q) {
+        return HttpRequest::Span{static_cast<uint32_t>(p - begin), static_cast<uint32_t>(q - p)};
+    };
+
+    const char *sp1 = static_cast<const char *>(::memchr(begin, ' ', end - begin));
+    if (sp1 == nullptr || sp1 == begin)
+    {
+        return fail(400);
+    }
+    const char *target = sp1 + 1;
+    const char *sp2 = static_cast<const char *>(::memchr(target, ' ', end - target));
+    if (sp2 == nullptr || sp2 == target)
+    {
+        return fail(400);
+    }
+
+    req->methodSpan_ = span(begin, sp1);
+    req->method_ = parseMethod(std::string_view(begin, sp1 - begin));
+    if (req->method_ == HttpRequest::kInvalid)
+    {
+        for (const char *p = begin; p < sp1; ++p)
+        {
+            if (!isTokenChar(*p))
+            {
+                return fail(400);
+            }
+        }
+        return fail(501);
+    }
+
+    req->targetSpan_ = span(target, sp2);
+    const char *question = static_cast<const char *>(::memchr(target, '?', sp2 - target));
+    if (question != nullptr)
+    {
+        req->pathSpan_ = span(target, question);
+        req->querySpan_ = span(question + 1, sp2);
+    }
+    else
+    {
+        req->pathSpan_ = span(target, sp2);
+        req->querySpan_ = span(sp2, sp2);
+    }
+
+    std::string_view version(sp2 + 1, end - sp2 - 1);
+    if (version == "HTTP/1.1")
+    {
+        req->version_ = HttpRequest::kHttp11;
+    }
+    else if (version == "HTTP/1.0")
+    {
+        req->version_ = HttpRequest::kHttp10;
+    }
+    else if (version.size() == 8 && version.substr(0, 5) == "HTTP/")
+    {
+        return fail(505);
+    }
+    else
+    {
+        return fail(400);
+    }
+    return true;
+}
+
+bool HttpParser::parseHeader(const char *begin, const char *line, const char *lineEnd, HttpRequest *req)
+{
+    if (*line == ' ' || *line == '\t')
+    {
+        return fail(400); // obs-fold 已经被RFC 7230废弃
+    }
+    const char *colon = static_cast<const char *>(::memchr(line, ':', lineEnd - line));
+    if (colon == nullptr || colon == line)
+    {
+        return fail(400);
+    }
+    for (const char *p = line; p < colon; ++p)
+    {
+        if (!isTokenChar(*p))
+        {
+            return fail(400); // 字段名和冒号之间不允许有空白
+        }
+    }
+    if (req->headerCount_ == HttpRequest::kMaxHeaders)
+    {
+        return fail(431);
+    }
+
+    std::string_view name(line, colon - line);
+    std::string_view value = trimOws(colon + 1, lineEnd);
+    HttpRequest::Header &h = req->headers_[req->headerCount_++];
+    h.name = {static_cast<uint32_t>(line - begin), static_cast<uint32_t>(name.size())};
+    h.value = {static_cast<uint32_t>(value.data() - begin), static_cast<uint32_t>(value.size())};
+
+    // 只关心影响消息边界和连接管理的字段
+    switch (name.size())
+    {
+    case 6:
+        if (equalsIgnoreCase(name, "Expect"))
+        {
+            req->expectContinue_ = equalsIgnoreCase(value, "100-continue");
+        }
+        break;
+    case 14:
+        if (equalsIgnoreCase(name, "Content-Length"))
+        {
+            if (value.empty() || value.size() > 18)
+            {
+                return fail(400);
+            }
+            int64_t length = 0;
+            for (char c : value)
+            {
+                if (c < '0' || c > '9')
+                {
+                    return fail(400);
+                }
+                length = length * 10 + (c - '0');
+            }
+            if (req->contentLength_ >= 0 && req->contentLength_ != length)
+            {
+                return fail(400);
+            }
+            req->contentLength_ = length;
+        }
+        break;
+    case 17:
+        if (equalsIgnoreCase(name, "Transfer-Encoding"))
+        {
+            // 只支持单独的chunked 其他编码(gzip, chunked等)不认识时无法确定消息边界
+            if (!equalsIgnoreCase(value, "chunked") || req->chunked_)
+            {
+                return fail(501);
+            }
+            req->chunked_ = true;
+        }
+        break;
+    }
+    return true;
+}
+
+// ================= HTTP/2 =================
+
+namespace
+{
+
+enum PseudoHeader
+{
+    kPseudoMethod = 1,
+    kPseudoScheme = 2,
+    kPseudoPath = 4,
+    kPseudoAuthority = 8
+};
+
+// 连接专用的头部在HTTP/2里没有意义 出现就是畸形请求(RFC 9113 8.2.2)
+bool connectionSpecific(std::string_view name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+} // namespace
+
+void HttpParser::beginHttp2(HttpRequest *req, const TcpConnectionPtr *conn)
+{
+    reset();
+    req->reset(conn);
+    req->input_ = nullptr;
+    req->detached_ = true;
+    req->memoryBody_ = true;
+    req->headStorage_.clear();
+    req->version_ = HttpRequest::kHttp20;
+    req->keepAlive_ = true;
+    regularSeen_ = false;
+    pseudoSeen_ = 0;
+    cookies_.clear();
+    authority_ = authorityLen_ = 0;
+}
+
+bool HttpParser::addHttp2Field(std::string_view name, std::string_view value, HttpRequest *req)
+{
+    std::string &storage = req->headStorage_;
+    if (storage.size() + name.size() + value.size() > kMaxHeaderBytes)
+    {
+        return fail(431);
+    }
+    auto store = [&storage](std::string_view s) {
+        HttpRequest::Span span{static_cast<uint32_t>(storage.size()), static_cast<uint32_t>(s.size())};
+        storage.append(s);
+        return span;
+    };
+
+    if (!name.empty() && name[0] == ':')
+    {
+        unsigned bit = 0;
+        if (name == ":method")
+            bit = kPseudoMethod;
+        else if (name == ":scheme")
+            bit = kPseudoScheme;
+        else if (name == ":path")
+            bit = kPseudoPath;
+        else if (name == ":authority")
+            bit = kPseudoAuthority;
+        // 未知的伪头部 重复的伪头部 普通字段之后的伪头部都是畸形请求
+        if (bit == 0 || (pseudoSeen_ & bit) || regularSeen_)
+        {
+            return false;
+        }
+        pseudoSeen_ |= bit;
+        switch (bit)
+        {
+        case kPseudoMethod:
+            req->methodSpan_ = store(value);
+            req->method_ = parseMethod(value);
+            break;
+        case kPseudoScheme:
+            store(value);
+            break;
+        case kPseudoPath:
+            if (value.empty())
+            {
+                return false;
+            }
+            req->targetSpan_ = store(value);
+            break;
+        case kPseudoAuthority:
+            authority_ = storage.size();
+            authorityLen_ = value.size();
+            store(value);
+            break;
+        }
+        return true;
+    }
+
+    regularSeen_ = true;
+    if (name.empty())
+    {
+        return false;
+    }
+    for (char c : name)
+    {
+        // 字段名必须是小写
+        if ((c >= 'A' && c <= 'Z') || !isTokenChar(c))
+        {
+            return false;
+        }
+    }
+    if (connectionSpecific(name) || (name == "te" && value != "trailers"))
+    {
+        return false;
+    }
+    if (name == "cookie")
+    {
+        if (!cookies_.empty())
+        {
+            cookies_.append("; ");
+        }
+        cookies_.append(value);
+        return true;
+    }
+    if (req->headerCount_ == HttpRequest::kMaxHeaders)
+    {
+        return fail(431);
+    }
+    if (name == "content-length")
+    {
+        if (value.empty() || value.size() > 18)
+        {
+            return false;
+        }
+        int64_t length = 0;
+        for (char c : value)
+        {
+            if (c < '0' || c > '9')
+            {
+                return false;
+            }
+            length = length * 10 + (c - '0');
+        }
+        if (req->contentLength_ >= 0 && req->contentLength_ != length)
+        {
+            return false;
+        }
+        req->contentLength_ = length;
+    }
+
+    HttpRequest::Header &h = req->headers_[req->headerCount_++];
+    h.name = store(name);
+    h.value = store(value);
+    return true;
+}
+
+bool HttpParser::endHttp2Fields(HttpRequest *req)
+{
+    unsigned required = kPseudoMethod | kPseudoScheme | kPseudoPath;
+    if ((pseudoSeen_ & required) != required)
+    {
+        return false; // CONNECT(只有:method和:authority)也不支持
+    }
+    if (req->method_ == HttpRequest::kInvalid)
+    {
+        return fail(501);
+    }
+
+    std::string &storage = req->headStorage_;
+    auto add = [req, &storage](std::string_view name, size_t valueOffset, size_t valueLen) {
+        if (req->headerCount_ == HttpRequest::kMaxHeaders)
+        {
+            return false;
+        }
+        HttpRequest::Header &h = req->headers_[req->headerCount_++];
+        h.name = {static_cast<uint32_t>(storage.size()), static_cast<uint32_t>(name.size())};
+        storage.append(name);
+        h.value = {static_cast<uint32_t>(valueOffset), static_cast<uint32_t>(valueLen)};
+        return true;
+    };
+    if (!cookies_.empty())
+    {
+        size_t offset = storage.size();
+        storage.append(cookies_);
+        if (!add("cookie", offset, cookies_.size()))
+        {
+            return fail(431);
+        }
+    }
+    // HTTP/1.1的处理函数习惯从Host取主机名
+    if ((pseudoSeen_ & kPseudoAuthority) && !req->hasHeader("host") && !add("host", authority_, authorityLen_))
+    {
+        return fail(431);
+    }
+
+    HttpRequest::Span target = req->targetSpan_;
+    std::string_view t = req->view(target);
+    size_t question = t.find('?');
+    if (question != std::string_view::npos)
+    {
+        req->pathSpan_ = {target.offset, static_cast<uint32_t>(question)};
+        req->querySpan_ = {static_cast<uint32_t>(target.offset + question + 1),
+                           static_cast<uint32_t>(t.size() - question - 1)};
+    }
+    else
+    {
+        req->pathSpan_ = target;
+        req->querySpan_ = {target.offset + target.len, 0};
+    }
+    return true;
+}
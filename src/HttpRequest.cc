@@ -0,0 +1,337 @@
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+
+#include <HttpRequest.h>
+#include <Buffer.h>
+
+HttpRequest::HttpRequest()
+    : conn_(nullptr)
+    , input_(nullptr)
+{
+    reset(nullptr);
+}
+
+void HttpRequest::reset(const TcpConnectionPtr *conn)
+{
+    conn_ = conn;
+    input_ = conn != nullptr ? (*conn)->inputBuffer() : nullptr;
+    detached_ = false;
+    memoryBody_ = false;
+    memoryStream_ = false;
+    headBytes_ = 0;
+    method_ = kInvalid;
+    version_ = kUnknown;
+    methodSpan_ = targetSpan_ = pathSpan_ = querySpan_ = Span();
+    headerCount_ = 0;
+    contentLength_ = -1;
+    chunked_ = false;
+    keepAlive_ = false;
+    expectContinue_ = false;
+    continueSent_ = false;
+    bodyState_ = kBodyNone;
+    chunkState_ = kChunkSize;
+    bodyRemaining_ = 0;
+    pendingConsume_ = 0;
+    lastPoll_ = kPollNeedMore;
+    lastChunk_ = std::string_view();
+    bodyStorage_.clear();
+    bodyChunk_.clear();
+    bodyEnded_ = false;
+    bodyWaiter_ = nullptr;
+    bodyConsumed_ = nullptr;
+}
+
+std::string_view HttpRequest::header(std::string_view name) const
+{
+    const char *b = base();
+    for (size_t i = 0; i < headerCount_; ++i)
+    {
+        const Header &h = headers_[i];
+        if (h.name.len == name.size() && ::strncasecmp(b + h.name.offset, name.data(), name.size()) == 0)
+        {
+            return std::string_view(b + h.value.offset, h.value.len);
+        }
+    }
+    return std::string_view();
+}
+
+bool HttpRequest::hasHeader(std::string_view name) const
+{
+    const char *b = base();
+    for (size_t i = 0; i < headerCount_; ++i)
+    {
+        const Header &h = headers_[i];
+        if (h.name.len == name.size() && ::strncasecmp(b + h.name.offset, name.data(), name.size()) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string_view HttpRequest::body() const
+{
+    if (memoryBody_)
+    {
+        return bodyStorage_;
+    }
+    if (bodyState_ != kBodyBuffered || (!chunked_ && contentLength_ <= 0))
+    {
+        return std::string_view();
+    }
+    if (chunked_)
+    {
+        return bodyStorage_;
+    }
+    return std::string_view(base() + headBytes_, static_cast<size_t>(contentLength_));
+}
+
+void HttpRequest::finish()
+{
+    if (input_ == nullptr)
+    {
+        return;
+    }
+    if (!detached_)
+    {
+        size_t consumed = headBytes_;
+        if (bodyState_ == kBodyBuffered && contentLength_ > 0)
+        {
+            consumed += static_cast<size_t>(contentLength_);
+        }
+        input_->retrieve(consumed);
+    }
+    else if (pendingConsume_ > 0)
+    {
+        input_->retrieve(pendingConsume_);
+    }
+    pendingConsume_ = 0;
+}
+
+void HttpRequest::beginBodyStream()
+{
+    if (bodyState_ != kBodyNone)
+    {
+        return;
+    }
+    headStorage_.assign(input_->peek(), headBytes_);
+    input_->retrieve(headBytes_);
+    detached_ = true;
+    bodyState_ = hasBody() ? kBodyStreaming : kBodyDone;
+    chunkState_ = kChunkSize;
+    bodyRemaining_ = chunked_ ? 0 : static_cast<uint64_t>(contentLength_ > 0 ? contentLength_ : 0);
+
+    if (expectContinue_ && !continueSent_ && bodyState_ == kBodyStreaming && (*conn_)->connected())
+    {
+        continueSent_ = true;
+        (*conn_)->send(std::string("HTTP/1.1 100 Continue\r\n\r\n"));
+    }
+}
+
+HttpRequest::PollResult HttpRequest::pollBody(Buffer *in)
+{
+    static const size_t kMaxChunkLine = 1024; // chunk-size行(含扩展)和trailer行的上限
+
+    if (pendingConsume_ > 0)
+    {
+        in->retrieve(pendingConsume_);
+        pendingConsume_ = 0;
+    }
+    if (bodyState_ == kBodyDone)
+    {
+        return kPollEnd;
+    }
+    if (bodyState_ != kBodyStreaming)
+    {
+        return kPollError;
+    }
+
+    if (!chunked_)
+    {
+        if (bodyRemaining_ == 0)
+        {
+            bodyState_ = kBodyDone;
+            return kPollEnd;
+        }
+        size_t avail = static_cast<size_t>(std::min<uint64_t>(in->readableBytes(), bodyRemaining_));
+        if (avail == 0)
+        {
+            return kPollNeedMore;
+        }
+        lastChunk_ = std::string_view(in->peek(), avail);
+        pendingConsume_ = avail;
+        bodyRemaining_ -= avail;
+        return kPollChunk;
+    }
+
+    while (true)
+    {
+        const char *p = in->peek();
+        size_t readable = in->readableBytes();
+        switch (chunkState_)
+        {
+        case kChunkSize:
+        case kChunkTrailer:
+        {
+            const char *lf = Buffer::scanByte(p, p + std::min(readable, kMaxChunkLine), '\n');
+            if (lf == nullptr)
+            {
+                if (readable >= kMaxChunkLine)
+                {
+                    bodyState_ = kBodyError;
+                    return kPollError;
+                }
+                return kPollNeedMore;
+            }
+            if (lf == p || lf[-1] != '\r')
+            {
+                bodyState_ = kBodyError;
+                return kPollError;
+            }
+            size_t lineLen = lf - p + 1;
+            if (chunkState_ == kChunkTrailer)
+            {
+                in->retrieve(lineLen);
+                if (lineLen == 2)
+                {
+                    bodyState_ = kBodyDone; // 空行 请求体结束
+                    return kPollEnd;
+                }
+                continue; // trailer字段直接丢弃
+            }
+
+            uint64_t size = 0;
+            const char *q = p;
+            for (; q < lf - 1; ++q)
+            {
+                int digit;
+                if (*q >= '0' && *q <= '9')
+                    digit = *q - '0';
+                else if (*q >= 'a' && *q <= 'f')
+                    digit = *q - 'a' + 10;
+                else if (*q >= 'A' && *q <= 'F')
+                    digit = *q - 'A' + 10;
+                else
+                    break;
+                if (size >> 60)
+                {
+                    bodyState_ = kBodyError;
+                    return kPollError;
+                }
+                size = size * 16 + digit;
+            }
+            // 至少一位十六进制数 之后只能是chunk扩展(';'开头 忽略)
+            if (q == p || (q < lf - 1 && *q != ';' && *q != ' ' && *q != '\t'))
+            {
+                bodyState_ = kBodyError;
+                return kPollError;
+            }
+            in->retrieve(lineLen);
+            if (size == 0)
+            {
+                chunkState_ = kChunkTrailer;
+            }
+            else
+            {
+                bodyRemaining_ = size;
+                chunkState_ = kChunkData;
+            }
+            continue;
+        }
+        case kChunkData:
+        {
+            size_t avail = static_cast<size_t>(std::min<uint64_t>(readable, bodyRemaining_));
+            if (avail == 0)
+            {
+                return kPollNeedMore;
+            }
+            lastChunk_ = std::string_view(p, avail);
+            pendingConsume_ = avail;
+            bodyRemaining_ -= avail;
+            if (bodyRemaining_ == 0)
+            {
+                chunkState_ = kChunkDataEnd;
+            }
+            return kPollChunk;
+        }
+        case kChunkDataEnd:
+            if (readable < 2)
+            {
+                return kPollNeedMore;
+            }
+            if (p[0] != '\r' || p[1] != '\n')
+            {
+                bodyState_ = kBodyError;
+                return kPollError;
+            }
+            in->retrieve(2);
+            chunkState_ = kChunkSize;
+            continue;
+        }
+    }
+}
+
+// ================= BodyAwaiter 实现 =================
+
+HttpRequest::BodyAwaiter::BodyAwaiter(HttpRequest *req)
+    : req_(req)
+    , read_((*req->conn_).get(), [req](Buffer *in) {
+        req->lastPoll_ = req->pollBody(in);
+        return req->lastPoll_ != kPollNeedMore;
+    })
+{
+    req->beginBodyStream();
+    req->lastPoll_ = kPollNeedMore;
+    req->lastChunk_ = std::string_view();
+    if (req->memoryStream_ && req->pendingConsume_ > 0)
+    {
+        // 上一块已经处理完 归还窗口让对端继续发
+        size_t consumed = req->pendingConsume_;
+        req->pendingConsume_ = 0;
+        if (req->bodyConsumed_)
+        {
+            req->bodyConsumed_(consumed);
+        }
+    }
+}
+
+std::string_view HttpRequest::BodyAwaiter::await_resume()
+{
+    if (req_->memoryBody_)
+    {
+        // 整个请求体作为一块交出去 之后返回空表示结束
+        if (req_->bodyState_ == kBodyBuffered)
+        {
+            req_->bodyState_ = kBodyDone;
+            return req_->bodyStorage_;
+        }
+        if (req_->bodyState_ == kBodyStreaming)
+        {
+            if (!req_->bodyStorage_.empty())
+            {
+                req_->bodyChunk_.swap(req_->bodyStorage_);
+                req_->bodyStorage_.clear();
+                req_->pendingConsume_ = req_->bodyChunk_.size();
+                return req_->bodyChunk_;
+            }
+            if (req_->bodyEnded_)
+            {
+                req_->bodyState_ = kBodyDone;
+            }
+        }
+        return std::string_view();
+    }
+    read_.await_resume();
+    switch (req_->lastPoll_)
+    {
+    case kPollChunk:
+        return req_->lastChunk_;
+    case kPollNeedMore:
+        req_->bodyState_ = kBodyError; // 请求体没读完连接就断了
+        break;
+    default:
+        break;
+    }
+    return std::string_view();
+}
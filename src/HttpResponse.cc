@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <HttpResponse.h>
+#include <Buffer.h>
+
+void HttpResponse::reset(bool close)
+{
+    statusCode_ = k200Ok;
+    statusMessage_.clear();
+    closeConnection_ = close;
+    headers_.clear();
+    body_.clear();
+    clearExternalBody();
+}
+
+void HttpResponse::clearExternalBody()
+{
+    sharedBody_.reset();
+    fileFd_ = -1;
+    fileOffset_ = 0;
+    fileLength_ = 0;
+    fileOwner_.reset();
+}
+
+void HttpResponse::setSharedBody(SharedMessage body)
+{
+    body_.clear();
+    clearExternalBody();
+    sharedBody_ = std::move(body);
+}
+
+void HttpResponse::setFileBody(int fd, off_t offset, size_t length, std::shared_ptr<const void> owner)
+{
+    body_.clear();
+    clearExternalBody();
+    fileFd_ = fd;
+    fileOffset_ = offset;
+    fileLength_ = length;
+    fileOwner_ = std::move(owner);
+}
+
+size_t HttpResponse::bodyLength() const
+{
+    if (sharedBody_)
+    {
+        return sharedBody_->size();
+    }
+    return fileFd_ >= 0 ? fileLength_ : body_.size();
+}
+
+void HttpResponse::addHeader(std::string_view name, std::string_view value)
+{
+    headers_.append(name);
+    headers_.append(": ");
+    headers_.append(value);
+    headers_.append("\r\n");
+}
+
+// headers_里每一行是 "Name: Value\r\n" 找到name开头的行 返回行首位置 没有时返回npos
+static size_t findHeaderLine(const std::string &headers, std::string_view name, size_t from)
+{
+    while (from < headers.size())
+    {
+        size_t eol = headers.find("\r\n", from);
+        if (eol == std::string::npos)
+        {
+            break;
+        }
+        if (eol - from > name.size() && headers[from + name.size()] == ':' &&
+            ::strncasecmp(headers.data() + from, name.data(), name.size()) == 0)
+        {
+            return from;
+        }
+        from = eol + 2;
+    }
+    return std::string::npos;
+}
+
+std::string_view HttpResponse::header(std::string_view name) const
+{
+    size_t line = findHeaderLine(headers_, name, 0);
+    if (line == std::string::npos)
+    {
+        return std::string_view();
+    }
+    size_t value = line + name.size() + 2; // 跳过 ": "
+    return std::string_view(headers_).substr(value, headers_.find("\r\n", line) - value);
+}
+
+bool HttpResponse::removeHeader(std::string_view name)
+{
+    bool removed = false;
+    size_t line = 0;
+    while ((line = findHeaderLine(headers_, name, line)) != std::string::npos)
+    {
+        headers_.erase(line, headers_.find("\r\n", line) + 2 - line);
+        removed = true;
+    }
+    return removed;
+}
+
+void HttpResponse::appendToBuffer(Buffer *output, bool headOnly) const
+{
+    char buf[64];
+    int n = snprintf(buf, sizeof buf, "HTTP/1.1 %d ", statusCode_);
+    output->append(buf, n);
+    if (statusMessage_.empty())
+    {
+        const char *reason = reasonPhrase(statusCode_);
+        output->append(reason, strlen(reason));
+    }
+    else
+    {
+        output->append(statusMessage_.data(), statusMessage_.size());
+    }
+    output->append("\r\n", 2);
+
+    if (statusCode_ == k101SwitchingProtocols)
+    {
+        // 协议升级 Connection: Upgrade 由调用方和Upgrade一起加在头部里
+    }
+    else if (closeConnection_)
+    {
+        output->append("Connection: close\r\n", 19);
+    }
+    else
+    {
+        output->append("Connection: keep-alive\r\n", 24);
+    }
+    // 1xx/204/304不能带消息体 也不发Content-Length
+    if (statusCode_ >= 200 && statusCode_ != k204NoContent && statusCode_ != k304NotModified)
+    {
+        n = snprintf(buf, sizeof buf, "Content-Length: %zu\r\n", bodyLength());
+        output->append(buf, n);
+    }
+    output->append(headers_.data(), headers_.size());
+    output->append("\r\n", 2);
+    if (!headOnly)
+    {
+        output->append(body_.data(), body_.size());
+    }
+}
+
+const char *HttpResponse::reasonPhrase(int code)
+{
+    switch (code)
+    {
+    case 100: return "Continue";
+    case 101: return "Switching Protocols";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 416: return "Range Not Satisfiable";
+    case 426: return "Upgrade Required";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default: return "Unknown";
+    }
+}
@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <charconv>
+#include <string.h>
+
+#include <HttpRouter.h>
+#include <Logger.h>
+
+namespace
+{
+
+using route_detail::Edge;
+using route_detail::Node;
+using route_detail::TableView;
+
+// 静态子节点不超过这个数时线性查找 长度不同的直接跳过 通常第一次比较就能排除
+constexpr uint16_t kLinearEdges = 8;
+
+const char *const kMethodNames[route_detail::kMethodCount] = {
+    "", "GET", "POST", "HEAD", "PUT", "DELETE", "OPTIONS", "PATCH", "CONNECT", "TRACE"};
+
+bool isInteger(std::string_view s)
+{
+    if (s.empty() || s.size() > route_detail::kMaxIntDigits)
+    {
+        return false;
+    }
+    for (char c : s)
+    {
+        if (!route_detail::isDigit(c))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 一次匹配的状态 参数按路径顺序压栈 回溯时弹出
+struct Walk
+{
+    Walk(const TableView &t, int m, std::string_view *v)
+        : table(t), method(m), values(v), count(0), route(-1), allowMask(0)
+    {
+    }
+
+    const TableView &table;
+    int method;
+    std::string_view *values; // 直接写进结果的RouteParams
+    size_t count;
+    int route;
+    uint16_t allowMask;
+
+    // 节点上这个方法的路由 HEAD没有时用GET 方法不匹配时记下Allow
+    bool accept(const uint16_t *routes, uint16_t mask)
+    {
+        uint16_t r = routes[method];
+        if (r == 0 && method == HttpRequest::kHead)
+        {
+            r = routes[HttpRequest::kGet];
+        }
+        if (r != 0)
+        {
+            route = r - 1;
+            return true;
+        }
+        allowMask |= mask;
+        return false;
+    }
+
+    bool acceptTail(const Node &n, std::string_view rest)
+    {
+        if (n.tailMask == 0)
+        {
+            return false;
+        }
+        values[count++] = rest;
+        if (accept(n.tailRoutes, n.tailMask))
+        {
+            return true;
+        }
+        --count;
+        return false;
+    }
+
+    const Edge *findEdge(const Node &n, std::string_view seg) const
+    {
+        const Edge *first = table.edges + n.edgeBegin;
+        const Edge *last = first + n.edgeCount;
+        if (n.edgeCount <= kLinearEdges)
+        {
+            for (const Edge *e = first; e != last; ++e)
+            {
+                if (e->segment.size() == seg.size() && memcmp(e->segment.data(), seg.data(), seg.size()) == 0)
+                {
+                    return e;
+                }
+            }
+            return nullptr;
+        }
+        const Edge *e = std::lower_bound(first, last, Edge{seg, 0}, route_detail::Builder::edgeLess);
+        return e != last && e->segment == seg ? e : nullptr;
+    }
+
+    bool child(uint16_t node, std::string_view rest, bool done, std::string_view value)
+    {
+        values[count++] = value;
+        if (walk(node, rest, done))
+        {
+            return true;
+        }
+        --count;
+        return false;
+    }
+
+    // rest是还没有匹配的路径(不含开头的'/') done表示路径已经没有段了
+    bool walk(uint16_t node, std::string_view rest, bool done)
+    {
+        const Node &n = table.nodes[node];
+        if (done)
+        {
+            return accept(n.routes, n.methodMask) || acceptTail(n, std::string_view(rest.data(), 0));
+        }
+
+        // 段通常只有几个字节 直接扫描比调用memchr快
+        const char *p = rest.data();
+        const char *end = p + rest.size();
+        const char *slash = p;
+        while (slash != end && *slash != '/')
+        {
+            ++slash;
+        }
+        std::string_view seg(p, slash - p);
+        bool nextDone = slash == end;
+        std::string_view next = nextDone ? std::string_view(end, 0) : std::string_view(slash + 1, end - slash - 1);
+
+        if (n.edgeCount != 0)
+        {
+            const Edge *e = findEdge(n, seg);
+            if (e && walk(e->child, next, nextDone))
+            {
+                return true;
+            }
+        }
+        if (n.intChild != 0 && isInteger(seg) && child(n.intChild, next, nextDone, seg))
+        {
+            return true;
+        }
+        if (n.paramChild != 0 && !seg.empty() && child(n.paramChild, next, nextDone, seg))
+        {
+            return true;
+        }
+        return acceptTail(n, rest);
+    }
+};
+
+} // namespace
+
+std::string_view RouteParams::get(std::string_view name) const
+{
+    for (size_t i = 0; i < count_; ++i)
+    {
+        if (names_[i] == name)
+        {
+            return values_[i];
+        }
+    }
+    return std::string_view();
+}
+
+int64_t RouteParams::integer(size_t i) const
+{
+    int64_t value = 0;
+    std::string_view s = values_[i];
+    std::from_chars(s.data(), s.data() + s.size(), value);
+    return value;
+}
+
+int64_t RouteParams::integer(std::string_view name) const
+{
+    for (size_t i = 0; i < count_; ++i)
+    {
+        if (names_[i] == name)
+        {
+            return integer(i);
+        }
+    }
+    return 0;
+}
+
+RouteMatch route_detail::Matcher::match(const TableView &table, HttpRequest::Method method, std::string_view path)
+{
+    RouteMatch m;
+    if (path.empty() || path.front() != '/' || method <= HttpRequest::kInvalid ||
+        method >= static_cast<int>(kMethodCount))
+    {
+        return m;
+    }
+    Walk w(table, method, m.params.values_);
+    std::string_view rest = path.substr(1);
+    if (w.walk(0, rest, rest.empty()))
+    {
+        m.route = w.route;
+        m.params.names_ = table.names + table.nameOffsets[w.route];
+        m.params.count_ = w.count;
+    }
+    else
+    {
+        m.allowMask = w.allowMask;
+    }
+    return m;
+}
+
+void route_detail::respondUnmatched(const RouteMatch &m, HttpResponse *resp)
+{
+    if (m.allowMask == 0)
+    {
+        resp->setStatusCode(HttpResponse::k404NotFound);
+        return;
+    }
+    // GET隐含HEAD
+    uint16_t mask = m.allowMask;
+    if (mask & (1u << HttpRequest::kGet))
+    {
+        mask |= 1u << HttpRequest::kHead;
+    }
+    std::string allow;
+    for (size_t i = 1; i < kMethodCount; ++i)
+    {
+        if (mask & (1u << i))
+        {
+            if (!allow.empty())
+            {
+                allow.append(", ");
+            }
+            allow.append(kMethodNames[i]);
+        }
+    }
+    resp->setStatusCode(HttpResponse::k405MethodNotAllowed);
+    resp->addHeader("Allow", allow);
+}
+
+void route_detail::invalidRoute(const char *why)
+{
+    LOG_FATAL << "invalid route: " << why;
+}
+
+HttpRouter::HttpRouter()
+    : view_{nullptr, nullptr, nullptr, nullptr}
+{
+    rebuild();
+}
+
+void HttpRouter::addPattern(HttpRequest::Method method, std::string_view pattern)
+{
+    patterns_.emplace_back(pattern);
+    if (const char *err = builder_.add(method, patterns_.back()))
+    {
+        LOG_FATAL << "invalid route " << patterns_.back() << ": " << err;
+    }
+    rebuild();
+}
+
+void HttpRouter::rebuild()
+{
+    nodes_.assign(builder_.nodeCount(), Node());
+    edges_.assign(builder_.edgeCount(), Edge());
+    names_.assign(builder_.nameCount(), std::string_view());
+    nameOffsets_.assign(builder_.routeCount() + 1, 0);
+    builder_.flatten(nodes_.data(), edges_.data(), names_.data(), nameOffsets_.data());
+    view_ = TableView{nodes_.data(), edges_.data(), names_.data(), nameOffsets_.data()};
+}
+
+void HttpRouter::add(HttpRequest::Method method, std::string_view pattern, Callback cb)
+{
+    addPattern(method, pattern);
+    routes_.push_back(Entry{std::move(cb), Handler()});
+}
+
+void HttpRouter::add(HttpRequest::Method method, std::string_view pattern, Handler handler)
+{
+    addPattern(method, pattern);
+    routes_.push_back(Entry{Callback(), std::move(handler)});
+}
+
+bool HttpRouter::handle(const HttpRequest &req, HttpResponse *resp) const
+{
+    RouteMatch m = match(req.method(), req.path());
+    if (!m.found())
+    {
+        route_detail::respondUnmatched(m, resp);
+        return false;
+    }
+    const Entry &e = routes_[m.route];
+    if (!e.callback)
+    {
+        LOG_ERROR << "route " << patterns_[m.route] << " needs HttpRouter::dispatch";
+        resp->setStatusCode(HttpResponse::k500InternalServerError);
+        return true;
+    }
+    e.callback(req, resp, m.params);
+    return true;
+}
+
+AsyncTask HttpRouter::dispatch(HttpRequest &req, HttpResponse &resp) const
+{
+    RouteMatch m = match(req.method(), req.path());
+    if (!m.found())
+    {
+        route_detail::respondUnmatched(m, &resp);
+        co_return;
+    }
+    const Entry &e = routes_[m.route];
+    if (e.callback)
+    {
+        e.callback(req, &resp, m.params);
+    }
+    else
+    {
+        co_await e.handler(req, resp, m.params);
+    }
+}
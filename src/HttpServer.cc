@@ -0,0 +1,389 @@
+#include <HttpServer.h>
+#include <HttpParser.h>
+#include <HttpCompressor.h>
+#include <WebSocket.h>
+#include <Http2Connection.h>
+#include <Logger.h>
+
+namespace
+{
+// 请求头期限: 到期时还没收全就关闭连接 离开作用域时取消
+// 定时器属于创建时的loop 等待期间连接可能被迁移 取消时用记下的loop
+class HeaderDeadline : noncopyable
+{
+public:
+    HeaderDeadline(const TcpConnectionPtr &conn, double seconds)
+        : loop_(conn->getLoop())
+        , armed_(seconds > 0.0)
+    {
+        if (armed_)
+        {
+            std::weak_ptr<TcpConnection> weakConn(conn);
+            timer_ = loop_->runAfter(seconds, [weakConn]() {
+                if (TcpConnectionPtr c = weakConn.lock())
+                {
+                    LOG_WARN << "HttpServer header timeout " << c->name();
+                    c->forceClose();
+                }
+            });
+        }
+    }
+    ~HeaderDeadline()
+    {
+        if (armed_)
+        {
+            loop_->cancel(timer_);
+        }
+    }
+
+private:
+    EventLoop *loop_;
+    bool armed_;
+    TimerId timer_;
+};
+} // namespace
+
+HttpServer::HttpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name)
+    : server_(loop, listenAddr, name)
+    , maxBodySize_(kDefaultMaxBodySize)
+    , idleTimeout_(kDefaultIdleTimeout)
+    , headerTimeout_(kDefaultHeaderTimeout)
+    , tlsContext_(nullptr)
+    , compressor_(nullptr)
+    , http2_(true)
+{
+    server_.setConnectionCallback(std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
+}
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        session(conn);
+    }
+}
+
+void HttpServer::sendError(const TcpConnectionPtr &conn, Buffer *output, int status)
+{
+    HttpResponse resp;
+    resp.reset(true);
+    resp.setStatusCode(status);
+    resp.appendToBuffer(output);
+    conn->send(output);
+    conn->shutdown();
+}
+
+Task HttpServer::session(TcpConnectionPtr conn)
+{
+    if (tlsContext_ && !co_await conn->startTls(tlsContext_))
+    {
+        co_return;
+    }
+
+    HttpParser parser;
+    HttpRequest req;
+    HttpResponse resp;
+    Buffer output; // pipelining时攒下的响应
+    Buffer *input = conn->inputBuffer();
+    HttpParser::Result result = HttpParser::kIncomplete;
+    bool detectHttp2 = http2_;
+
+    // 每读入一批数据调用一次 只在请求头完整或出错时恢复会话协程
+    auto headComplete = [&parser, &req, &result](Buffer *buf) {
+        result = parser.parse(buf, &req);
+        return result != HttpParser::kIncomplete;
+    };
+
+    while (conn->connected())
+    {
+        req.reset(&conn);
+        parser.reset();
+
+        // ================= 等待请求头 =================
+        if (input->readableBytes() == 0)
+        {
+            // 缓冲区已经处理空了 这一批的响应发出去再等下一个请求
+            if (output.readableBytes() > 0)
+            {
+                conn->send(&output);
+            }
+            if (idleTimeout_ > 0.0)
+            {
+                auto [buf, timedOut] = co_await conn->readWithTimeout(idleTimeout_);
+                if (timedOut)
+                {
+                    LOG_DEBUG << "HttpServer idle timeout " << conn->name();
+                    conn->forceClose(); // 只半关闭的话 对端不关就一直占着fd 和请求头超时一样直接关
+                    break;
+                }
+            }
+        }
+
+        // ================= HTTP/2前言 =================
+        if (detectHttp2)
+        {
+            // 只在连接的第一个请求之前检查 前言没收全时先等够24字节或者确定不是前言
+            detectHttp2 = false;
+            auto decided = [](Buffer *buf) { return Http2Connection::matchPreface(buf) != Http2Connection::kPrefacePartial; };
+            if (input->readableBytes() == 0)
+            {
+                co_await conn->readAtLeast(1); // 同下: 第一批数据到了才开始计算请求头期限
+                if (input->readableBytes() == 0)
+                {
+                    break;
+                }
+            }
+            if (!decided(input))
+            {
+                HeaderDeadline deadline(conn, headerTimeout_);
+                co_await conn->readUntil(decided);
+            }
+            if (Http2Connection::matchPreface(input) == Http2Connection::kPrefaceMatched)
+            {
+                Http2Connection h2(this, conn);
+                co_await h2.run();
+                break;
+            }
+        }
+
+        result = parser.parse(input, &req);
+        if (result == HttpParser::kIncomplete)
+        {
+            if (output.readableBytes() > 0)
+            {
+                conn->send(&output);
+            }
+            if (input->readableBytes() == 0)
+            {
+                // 空闲的keep-alive连接只受idleTimeout_约束 新请求的第一批数据到了才开始计算请求头期限
+                co_await conn->readAtLeast(1);
+                if (input->readableBytes() == 0)
+                {
+                    break;
+                }
+                result = parser.parse(input, &req);
+            }
+        }
+        if (result == HttpParser::kIncomplete)
+        {
+            HeaderDeadline deadline(conn, headerTimeout_);
+            co_await conn->readUntil(std::ref(headComplete));
+            if (result == HttpParser::kIncomplete)
+            {
+                break; // 请求头没收全连接就断了
+            }
+        }
+        if (result == HttpParser::kError)
+        {
+            sendError(conn, &output, parser.errorStatus());
+            break;
+        }
+        // HTTP/1.1的请求必须带Host(RFC 9112 3.2)
+        if (req.version() == HttpRequest::kHttp11 && !req.hasHeader("host"))
+        {
+            sendError(conn, &output, HttpResponse::k400BadRequest);
+            break;
+        }
+
+        resp.reset(!req.keepAlive());
+        bool bodyOk = true;
+
+        // ================= WebSocket升级 =================
+        if (webSocketHandler_ && WebSocket::isUpgradeRequest(req))
+        {
+            if (!WebSocket::acceptHandshake(req, &resp))
+            {
+                resp.appendToBuffer(&output);
+                conn->send(&output);
+                conn->shutdown();
+                break;
+            }
+            resp.appendToBuffer(&output);
+            conn->send(&output);
+            co_await webSocketSession(conn, req);
+            break;
+        }
+
+        // ================= 调用处理函数 =================
+        if (httpCallback_)
+        {
+            // 同步处理函数: 请求体完整读入
+            if (req.contentLength() > static_cast<int64_t>(maxBodySize_))
+            {
+                sendError(conn, &output, HttpResponse::k413PayloadTooLarge);
+                break;
+            }
+            if (req.chunked())
+            {
+                if (output.readableBytes() > 0)
+                {
+                    conn->send(&output);
+                }
+                while (true)
+                {
+                    std::string_view chunk = co_await req.readBody();
+                    if (chunk.empty())
+                    {
+                        break;
+                    }
+                    if (req.bodyStorage_.size() + chunk.size() > maxBodySize_)
+                    {
+                        bodyOk = false;
+                        break;
+                    }
+                    req.bodyStorage_.append(chunk);
+                }
+                if (!bodyOk || !req.bodyComplete())
+                {
+                    sendError(conn, &output, bodyOk ? HttpResponse::k400BadRequest : HttpResponse::k413PayloadTooLarge);
+                    break;
+                }
+            }
+            else if (req.contentLength() > 0)
+            {
+                size_t total = req.headBytes_ + static_cast<size_t>(req.contentLength());
+                if (input->readableBytes() < total)
+                {
+                    if (output.readableBytes() > 0)
+                    {
+                        conn->send(&output);
+                    }
+                    if (req.expectContinue())
+                    {
+                        req.continueSent_ = true;
+                        conn->send(std::string("HTTP/1.1 100 Continue\r\n\r\n"));
+                    }
+                    co_await conn->readAtLeast(total);
+                    if (input->readableBytes() < total)
+                    {
+                        break;
+                    }
+                }
+            }
+            req.bodyState_ = HttpRequest::kBodyBuffered;
+            httpCallback_(req, &resp);
+        }
+        else if (handler_)
+        {
+            AsyncTask task = handler_(req, resp);
+            task.start();
+            if (!task.done())
+            {
+                // 处理函数挂起了 之前攒下的响应不能跟着等
+                if (output.readableBytes() > 0)
+                {
+                    conn->send(&output);
+                }
+            }
+            try
+            {
+                co_await task;
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR << "HttpServer handler exception: " << e.what();
+                resp.reset(true);
+                resp.setStatusCode(HttpResponse::k500InternalServerError);
+            }
+
+            // 处理函数没读完的请求体读掉丢弃 保持下一个请求的边界
+            size_t drained = 0;
+            while (req.hasBody() && !req.bodyComplete() && !req.bodyError() && conn->connected())
+            {
+                std::string_view chunk = co_await req.readBody();
+                drained += chunk.size();
+                if (chunk.empty() || drained > maxBodySize_)
+                {
+                    break;
+                }
+            }
+            bodyOk = !req.hasBody() || req.bodyComplete();
+        }
+        else
+        {
+            resp.setStatusCode(HttpResponse::k404NotFound);
+            resp.setCloseConnection(true); // 没读请求体 无法继续解析下一个请求
+        }
+
+        if (!conn->connected())
+        {
+            break;
+        }
+        if (!bodyOk)
+        {
+            resp.setCloseConnection(true);
+        }
+
+        // ================= 压缩 =================
+        if (compressor_ && compressor_->shouldCompress(req, resp))
+        {
+            AsyncTask task = compressor_->compress(req, resp);
+            task.start();
+            if (!task.done() && output.readableBytes() > 0)
+            {
+                conn->send(&output); // 缓存未命中 压缩期间先把攒下的响应发出去
+            }
+            co_await task;
+            if (!conn->connected())
+            {
+                break;
+            }
+        }
+
+        // ================= 写响应 =================
+        bool headOnly = req.method() == HttpRequest::kHead;
+        resp.appendToBuffer(&output, headOnly);
+        req.finish();
+        if (!headOnly && resp.sharedBody())
+        {
+            // 共享消息体按引用排在响应头后面
+            conn->send(&output);
+            conn->sendShared(resp.sharedBody());
+        }
+        else if (!headOnly && resp.hasFileBody() && resp.bodyLength() > 0)
+        {
+            // 响应头先进发送缓冲区 sendFile会先把它发完(写合并时用MSG_MORE和文件数据一起组包)
+            conn->send(&output);
+            ssize_t sent = co_await conn->sendFile(resp.fileFd(), resp.fileOffset(), resp.bodyLength());
+            if (sent != static_cast<ssize_t>(resp.bodyLength()))
+            {
+                // 文件在发送期间被截断或者连接出错 Content-Length已经发出去了 只能关闭连接
+                LOG_WARN << "HttpServer sendFile short write " << conn->name();
+                conn->shutdown();
+                break;
+            }
+        }
+        if (resp.closeConnection())
+        {
+            conn->send(&output);
+            conn->shutdown();
+            break;
+        }
+        if (output.readableBytes() >= kMaxPendingOutput)
+        {
+            conn->send(&output);
+        }
+        // 对端只管发请求不读响应时 发送队列不能无限增长: 超过上限先等它发完再处理下一个请求
+        if (conn->pendingOutputBytes() > kMaxPendingOutput)
+        {
+            co_await conn->drain();
+        }
+    }
+}
+
+AsyncTask HttpServer::webSocketSession(TcpConnectionPtr conn, HttpRequest &req)
+{
+    // 请求头移出输入缓冲区 之后缓冲区里的都是帧
+    req.beginBodyStream();
+    WebSocket ws(conn);
+    try
+    {
+        co_await webSocketHandler_(req, ws);
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERROR << "HttpServer websocket handler exception: " << e.what();
+        ws.close(WebSocket::kInternalError);
+    }
+    ws.close();
+}
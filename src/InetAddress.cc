@@ -1,18 +1,87 @@
 #include <strings.h>
 #include <string.h>
+#include <stddef.h>
+#include <algorithm>
 
 #include <InetAddress.h>
+#include <Logger.h>
 
 InetAddress::InetAddress(uint16_t port, std::string ip)
 {
-    ::memset(&addr_, 0, sizeof(addr_));
+    ::memset(&addrUn_, 0, sizeof(addrUn_));
     addr_.sin_family = AF_INET;
     addr_.sin_port = ::htons(port); // 本地字节序转为网络字节序
     addr_.sin_addr.s_addr = ::inet_addr(ip.c_str());
+    len_ = sizeof(sockaddr_in);
+}
+
+InetAddress InetAddress::unixAddress(const std::string &path)
+{
+    sockaddr_un un;
+    ::memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+
+    // sun_path最多108字节 路径名需要结尾的'\0' 抽象地址需要开头的'\0' 超长时不截断(会变成另一个地址) 返回无效地址
+    size_t maxLen = sizeof(un.sun_path) - 1;
+    bool abstract = !path.empty() && path[0] == '@';
+    size_t n = abstract ? path.size() - 1 : path.size();
+    if (n > maxLen)
+    {
+        LOG_ERROR << "unix socket path too long (" << path.size() << " bytes): " << path;
+        un.sun_family = AF_UNSPEC;
+        return InetAddress(reinterpret_cast<const sockaddr *>(&un), sizeof(sa_family_t));
+    }
+    socklen_t len;
+    if (abstract)
+    {
+        // 抽象命名空间: sun_path[0]为'\0' 名字不以'\0'结尾 长度必须精确给出
+        ::memcpy(un.sun_path + 1, path.data() + 1, n);
+        len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + n);
+    }
+    else
+    {
+        ::memcpy(un.sun_path, path.data(), n);
+        len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + n + 1);
+    }
+    return InetAddress(reinterpret_cast<const sockaddr *>(&un), len);
+}
+
+void InetAddress::setSockAddr(const sockaddr *addr, socklen_t len)
+{
+    ::memset(&addrUn_, 0, sizeof(addrUn_));
+    if (len > sizeof(addrUn_))
+    {
+        len = sizeof(addrUn_);
+    }
+    ::memcpy(&addrUn_, addr, len);
+    len_ = len;
+}
+
+bool InetAddress::isAbstract() const
+{
+    return isUnix() && len_ > offsetof(sockaddr_un, sun_path) && addrUn_.sun_path[0] == '\0';
+}
+
+std::string InetAddress::unixPath() const
+{
+    if (!isUnix() || len_ <= offsetof(sockaddr_un, sun_path))
+    {
+        return std::string(); // 未命名地址 例如客户端没有bind的socket
+    }
+    size_t n = len_ - offsetof(sockaddr_un, sun_path);
+    if (addrUn_.sun_path[0] == '\0')
+    {
+        return "@" + std::string(addrUn_.sun_path + 1, n - 1);
+    }
+    return std::string(addrUn_.sun_path, ::strnlen(addrUn_.sun_path, n));
 }
 
 std::string InetAddress::toIp() const
 {
+    if (isUnix())
+    {
+        return unixPath();
+    }
     // addr_
     char buf[64] = {0};
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
@@ -21,6 +90,10 @@ std::string InetAddress::toIp() const
 
 std::string InetAddress::toIpPort() const
 {
+    if (isUnix())
+    {
+        return "unix:" + unixPath();
+    }
     // ip:port
     char buf[64] = {0};
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
@@ -32,6 +105,10 @@ std::string InetAddress::toIpPort() const
 
 uint16_t InetAddress::toPort() const
 {
+    if (isUnix())
+    {
+        return 0;
+    }
     return ::ntohs(addr_.sin_port);
 }
 
@@ -42,4 +119,4 @@ int main()
     InetAddress addr(8080);
     std::cout << addr.toIpPort() << std::endl;
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <string.h>
+
+#include <LoadBalancer.h>
+
+// FNV-1a 32位哈希 计算简单且分布足够均匀
+static uint32_t fnv1a(const void *data, size_t len, uint32_t hash = 2166136261u)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    // 再做一次混淆 避免相邻输入落在环上相邻的位置
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+LoadBalancer::LoadBalancer(Policy policy, const std::vector<InetAddress> &backends, int virtualNodes)
+    : policy_(policy), next_(0)
+{
+    for (const InetAddress &addr : backends)
+    {
+        backends_.emplace_back(new Backend(addr));
+    }
+
+    if (policy_ == kConsistentHash)
+    {
+        for (auto &backend : backends_)
+        {
+            std::string key = backend->addr.toIpPort();
+            for (int i = 0; i < virtualNodes; ++i)
+            {
+                std::string vnode = key + "#" + std::to_string(i);
+                ring_.emplace_back(fnv1a(vnode.data(), vnode.size()), backend.get());
+            }
+        }
+        std::sort(ring_.begin(), ring_.end(),
+                  [](const RingEntry &a, const RingEntry &b) { return a.first < b.first; });
+    }
+}
+
+LoadBalancer::~LoadBalancer()
+{
+}
+
+bool LoadBalancer::parsePolicy(const std::string &name, Policy *policy)
+{
+    if (name == "rr" || name == "roundrobin")
+    {
+        *policy = kRoundRobin;
+    }
+    else if (name == "leastconn")
+    {
+        *policy = kLeastConn;
+    }
+    else if (name == "hash")
+    {
+        *policy = kConsistentHash;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+Backend *LoadBalancer::select(const InetAddress &clientAddr)
+{
+    if (backends_.empty())
+    {
+        return nullptr;
+    }
+    switch (policy_)
+    {
+    case kLeastConn:
+        return selectLeastConn();
+    case kConsistentHash:
+        return selectConsistentHash(clientAddr);
+    case kRoundRobin:
+    default:
+        return selectRoundRobin();
+    }
+}
+
+Backend *LoadBalancer::selectRoundRobin()
+{
+    size_t n = backends_.size();
+    size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < n; ++i)
+    {
+        Backend *backend = backends_[(start + i) % n].get();
+        if (backend->healthy.load(std::memory_order_relaxed))
+        {
+            return backend;
+        }
+    }
+    return nullptr;
+}
+
+Backend *LoadBalancer::selectLeastConn()
+{
+    // 连接数相同时从轮询位置开始比较 避免总是压在第一个后端上
+    size_t n = backends_.size();
+    size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+    Backend *best = nullptr;
+    int bestActive = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        Backend *backend = backends_[(start + i) % n].get();
+        if (!backend->healthy.load(std::memory_order_relaxed))
+        {
+            continue;
+        }
+        int active = backend->active.load(std::memory_order_relaxed);
+        if (best == nullptr || active < bestActive)
+        {
+            best = backend;
+            bestActive = active;
+        }
+    }
+    return best;
+}
+
+Backend *LoadBalancer::selectConsistentHash(const InetAddress &clientAddr)
+{
+    // 只按IP哈希 同一客户端的不同连接端口不同 也要落在同一后端
+    std::string ip = clientAddr.toIp();
+    uint32_t hash = fnv1a(ip.data(), ip.size());
+
+    auto it = std::lower_bound(ring_.begin(), ring_.end(), hash,
+                               [](const RingEntry &entry, uint32_t h) { return entry.first < h; });
+    // 顺时针找到第一个健康的虚拟节点
+    for (size_t i = 0; i < ring_.size(); ++i, ++it)
+    {
+        if (it == ring_.end())
+        {
+            it = ring_.begin();
+        }
+        if (it->second->healthy.load(std::memory_order_relaxed))
+        {
+            return it->second;
+        }
+    }
+    return nullptr;
+}
@@ -43,6 +43,7 @@ static void defaultFlush()
 }
 Logger::OutputFunc g_output = defaultOutput;
 Logger::FlushFunc g_flush = defaultFlush;
+Logger::LogLevel g_logLevel = Logger::DEBUG; // 默认输出全部日志
 
 Logger::Impl::Impl(Logger::LogLevel level, int savedErrno, const char *filename, int line)
     : time_(Timestamp::now()),
@@ -114,6 +115,11 @@ void Logger::setOutput(OutputFunc out)
     g_output = out;
 }
 
+void Logger::setLogLevel(Logger::LogLevel level)
+{
+    g_logLevel = level;
+}
+
 void Logger::setFlush(FlushFunc flush)
 {
     g_flush = flush;
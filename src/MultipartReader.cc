@@ -0,0 +1,482 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <memory>
+
+#include <MultipartReader.h>
+#include <Buffer.h>
+#include <Logger.h>
+
+namespace
+{
+
+std::string_view trim(std::string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+    {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+    {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    return a.size() == b.size() && ::strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+// 在 "type; k1=v1; k2="v2"" 里找参数 值去掉引号(不处理转义 浏览器会把引号编码成%22)
+std::string_view parameter(std::string_view value, std::string_view key)
+{
+    size_t semi = value.find(';');
+    while (semi != std::string_view::npos)
+    {
+        value.remove_prefix(semi + 1);
+        semi = value.find(';');
+        std::string_view param = trim(value.substr(0, semi));
+        size_t eq = param.find('=');
+        if (eq == std::string_view::npos || !equalsIgnoreCase(trim(param.substr(0, eq)), key))
+        {
+            continue;
+        }
+        std::string_view v = trim(param.substr(eq + 1));
+        if (v.size() >= 2 && v.front() == '"')
+        {
+            // 引号里可能有';' 重新从原始值里取到下一个引号为止
+            const char *start = v.data() + 1;
+            const char *valueEnd = value.data() + value.size();
+            const char *quote = static_cast<const char *>(::memchr(start, '"', valueEnd - start));
+            if (quote == nullptr)
+            {
+                return std::string_view();
+            }
+            return std::string_view(start, quote - start);
+        }
+        return v;
+    }
+    return std::string_view();
+}
+
+// 最长的、同时是delimiter真前缀的后缀长度 这部分要留到下一块一起判断
+size_t partialDelimiter(std::string_view data, std::string_view delimiter)
+{
+    size_t max = std::min(data.size(), delimiter.size() - 1);
+    for (size_t k = max; k > 0; --k)
+    {
+        if (data.substr(data.size() - k) == delimiter.substr(0, k))
+        {
+            return k;
+        }
+    }
+    return 0;
+}
+
+// 分隔符以CRLF开头 先用向量化的CRLF扫描找候选位置
+const char *findDelimiter(const char *begin, const char *end, std::string_view delimiter)
+{
+    const char *p = begin;
+    while (static_cast<size_t>(end - p) >= delimiter.size())
+    {
+        p = Buffer::scanCRLF(p, end - delimiter.size() + 2);
+        if (p == nullptr)
+        {
+            return nullptr;
+        }
+        if (::memcmp(p + 2, delimiter.data() + 2, delimiter.size() - 2) == 0)
+        {
+            return p;
+        }
+        p += 2;
+    }
+    return nullptr;
+}
+
+struct FileCloser : noncopyable
+{
+    explicit FileCloser(int f) : fd(f) {}
+    ~FileCloser() { ::close(fd); }
+    int fd;
+};
+
+bool writeAll(int fd, std::string_view data)
+{
+    while (!data.empty())
+    {
+        ssize_t n = ::write(fd, data.data(), data.size());
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERROR << "MultipartReader write error " << errno;
+            return false;
+        }
+        data.remove_prefix(n);
+    }
+    return true;
+}
+
+} // namespace
+
+std::string_view MultipartReader::Part::header(std::string_view name) const
+{
+    std::string_view rest = headers;
+    while (!rest.empty())
+    {
+        size_t eol = rest.find("\r\n");
+        std::string_view line = rest.substr(0, eol);
+        rest = eol == std::string_view::npos ? std::string_view() : rest.substr(eol + 2);
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos && equalsIgnoreCase(trim(line.substr(0, colon)), name))
+        {
+            return trim(line.substr(colon + 1));
+        }
+    }
+    return std::string_view();
+}
+
+std::string_view MultipartReader::boundaryOf(std::string_view contentType)
+{
+    size_t semi = contentType.find(';');
+    std::string_view type = trim(contentType.substr(0, semi));
+    if (type.size() < 10 || ::strncasecmp(type.data(), "multipart/", 10) != 0)
+    {
+        return std::string_view();
+    }
+    std::string_view boundary = parameter(contentType, "boundary");
+    if (boundary.empty() || boundary.size() > kMaxBoundary || boundary.back() == ' ')
+    {
+        return std::string_view();
+    }
+    return boundary;
+}
+
+MultipartReader::MultipartReader(HttpRequest &req)
+    : req_(req)
+    , state_(kPreamble)
+    , bodyEnded_(false)
+    , partFresh_(false)
+    , saved_(0)
+{
+    std::string_view boundary = boundaryOf(req.header("Content-Type"));
+    if (boundary.empty())
+    {
+        state_ = kError;
+        return;
+    }
+    delimiter_.reserve(4 + boundary.size());
+    delimiter_.append("\r\n--").append(boundary);
+    // 请求体可以直接以"--boundary"开头 当作前面有一个CRLF
+    carry_.assign("\r\n");
+}
+
+MultipartReader::SaveAwaiter MultipartReader::saveTo(int fd)
+{
+    return SaveAwaiter{this, [fd](std::string_view data) { return writeAll(fd, data); }};
+}
+
+MultipartReader::SaveAwaiter MultipartReader::saveToFile(const std::string &path, int mode)
+{
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if (fd < 0)
+    {
+        LOG_ERROR << "MultipartReader open " << path << " error " << errno;
+        return SaveAwaiter{this, nullptr};
+    }
+    // sink的最后一个拷贝销毁时关闭文件
+    auto file = std::make_shared<FileCloser>(fd);
+    return SaveAwaiter{this, [file](std::string_view data) { return writeAll(file->fd, data); }};
+}
+
+std::coroutine_handle<> MultipartReader::SaveAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    reader_->save_.emplace(reader_->save(std::move(sink_)));
+    return reader_->save_->await_suspend(h);
+}
+
+AsyncTask MultipartReader::save(Sink sink)
+{
+    saved_ = 0;
+    if (!sink)
+    {
+        saved_ = -1;
+        co_return;
+    }
+    while (true)
+    {
+        std::string_view data = co_await read();
+        if (data.empty())
+        {
+            break;
+        }
+        if (!sink(data))
+        {
+            saved_ = -1; // 剩下的数据由nextPart跳过
+            co_return;
+        }
+        saved_ += data.size();
+    }
+    if (failed())
+    {
+        saved_ = -1;
+    }
+}
+
+std::coroutine_handle<> MultipartReader::pump(Want want, std::coroutine_handle<> h)
+{
+    fill_.emplace(fill(want));
+    return fill_->await_suspend(h);
+}
+
+AsyncTask MultipartReader::fill(Want want)
+{
+    // step返回false时chunk_已经用完 可以读下一块(上一块的string_view随之失效)
+    do
+    {
+        chunk_ = co_await req_.readBody();
+        if (chunk_.empty())
+        {
+            bodyEnded_ = true;
+        }
+    } while (!step(want));
+}
+
+bool MultipartReader::step(Want want)
+{
+    if (want == kWantPart)
+    {
+        partFresh_ = false;
+    }
+    data_ = std::string_view();
+    while (true)
+    {
+        if (want == kWantData && state_ != kData)
+        {
+            return true; // part已经结束
+        }
+        switch (poll())
+        {
+        case kPollData:
+        case kPollPartEnd:
+            if (want == kWantData)
+            {
+                return true;
+            }
+            data_ = std::string_view(); // nextPart跳过当前part剩下的数据
+            break;
+        case kPollPart:
+            partFresh_ = true;
+            return true;
+        case kPollEnd:
+        case kPollError:
+            return true;
+        case kPollNeedMore:
+            if (!bodyEnded_)
+            {
+                return false;
+            }
+            if (state_ != kEpilogue)
+            {
+                fail(); // 没有结束分隔符请求体就结束了
+            }
+            return true;
+        }
+    }
+}
+
+MultipartReader::Poll MultipartReader::poll()
+{
+    switch (state_)
+    {
+    case kPreamble:
+    case kData:
+        return scanData();
+    case kHeaders:
+        return scanHeaders();
+    case kEpilogue:
+        chunk_ = std::string_view();
+        return kPollEnd;
+    default:
+        return kPollError;
+    }
+}
+
+MultipartReader::Poll MultipartReader::scanData()
+{
+    const std::string_view d = delimiter_;
+    std::string_view before;
+    while (true)
+    {
+        if (chunk_.empty())
+        {
+            return kPollNeedMore;
+        }
+        if (!carry_.empty())
+        {
+            // 上一块末尾是分隔符的前缀: 补上最多一个分隔符长度的字节再判断
+            size_t old = carry_.size();
+            size_t take = std::min(chunk_.size(), d.size());
+            carry_.append(chunk_.data(), take);
+            size_t pos = carry_.find(d);
+            if (pos != std::string::npos)
+            {
+                chunk_.remove_prefix(pos + d.size() - old);
+                emit_.assign(carry_, 0, pos);
+                carry_.clear();
+                before = emit_;
+                break;
+            }
+            if (take == d.size())
+            {
+                // 补够了整个分隔符长度还没找到 carry_原来的部分是普通数据 补上的字节留在chunk_里继续扫描
+                emit_.assign(carry_, 0, old);
+                carry_.clear();
+            }
+            else
+            {
+                chunk_ = std::string_view();
+                size_t keep = partialDelimiter(carry_, d);
+                emit_.assign(carry_, 0, carry_.size() - keep);
+                carry_.erase(0, carry_.size() - keep);
+            }
+            if (state_ == kData && !emit_.empty())
+            {
+                data_ = emit_;
+                return kPollData;
+            }
+            continue;
+        }
+
+        const char *begin = chunk_.data();
+        const char *end = begin + chunk_.size();
+        const char *p = findDelimiter(begin, end, d);
+        if (p != nullptr)
+        {
+            before = std::string_view(begin, p - begin);
+            chunk_.remove_prefix(p - begin + d.size());
+            break;
+        }
+        size_t keep = partialDelimiter(chunk_, d);
+        std::string_view data = chunk_.substr(0, chunk_.size() - keep);
+        carry_.assign(end - keep, keep);
+        chunk_ = std::string_view();
+        if (state_ == kData && !data.empty())
+        {
+            data_ = data;
+            return kPollData;
+        }
+        return kPollNeedMore;
+    }
+
+    // 找到了分隔符 之后是part的头部或者结束标记
+    bool inPart = state_ == kData;
+    state_ = kHeaders;
+    header_.clear();
+    if (inPart && !before.empty())
+    {
+        data_ = before;
+        return kPollData;
+    }
+    return kPollPartEnd;
+}
+
+MultipartReader::Poll MultipartReader::scanHeaders()
+{
+    // header_从分隔符之后开始: "--"表示结束 否则是 [空白] CRLF 头部行... CRLF
+    size_t scanned = header_.size() >= 3 ? header_.size() - 3 : 0;
+    size_t room = kMaxHeaderBytes - header_.size();
+    size_t take = std::min(chunk_.size(), room);
+    header_.append(chunk_.data(), take);
+
+    if (header_.size() >= 2 && header_[0] == '-' && header_[1] == '-')
+    {
+        state_ = kEpilogue;
+        chunk_ = std::string_view();
+        return kPollEnd;
+    }
+    size_t lineEnd = header_.find("\r\n");
+    if (lineEnd == std::string::npos)
+    {
+        chunk_.remove_prefix(take);
+        if (header_.size() >= kMaxHeaderBytes)
+        {
+            fail();
+            return kPollError;
+        }
+        return kPollNeedMore;
+    }
+    // 分隔符所在行的剩余部分只能是空白(transport padding)
+    for (size_t i = 0; i < lineEnd; ++i)
+    {
+        if (header_[i] != ' ' && header_[i] != '\t')
+        {
+            fail();
+            return kPollError;
+        }
+    }
+
+    // 头部在空行处结束 没有头部行时空行紧跟着分隔符行的CRLF
+    size_t from = std::max(scanned, lineEnd);
+    const char *blank = Buffer::scanDoubleCRLF(header_.data() + from, header_.data() + header_.size());
+    if (blank == nullptr)
+    {
+        chunk_.remove_prefix(take);
+        if (header_.size() >= kMaxHeaderBytes)
+        {
+            LOG_WARN << "MultipartReader part header too large";
+            fail();
+            return kPollError;
+        }
+        return kPollNeedMore;
+    }
+    size_t headerEnd = blank - header_.data() + 4;
+    // 多拷进来的是part的数据 还给chunk_
+    chunk_.remove_prefix(take - (header_.size() - headerEnd));
+    header_.resize(headerEnd);
+
+    std::string_view block(header_.data() + lineEnd + 2, headerEnd - lineEnd - 2);
+    if (!parseHeaders(block))
+    {
+        fail();
+        return kPollError;
+    }
+    state_ = kData;
+    return kPollPart;
+}
+
+bool MultipartReader::parseHeaders(std::string_view block)
+{
+    part_ = Part();
+    // block以CRLF CRLF结尾(没有头部行时就是单独的CRLF)
+    part_.headers = block.size() >= 2 ? block.substr(0, block.size() - 2) : std::string_view();
+    std::string_view rest = part_.headers;
+    while (!rest.empty())
+    {
+        size_t eol = rest.find("\r\n");
+        std::string_view line = rest.substr(0, eol);
+        rest = eol == std::string_view::npos ? std::string_view() : rest.substr(eol + 2);
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos || colon == 0)
+        {
+            return false;
+        }
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = trim(line.substr(colon + 1));
+        if (equalsIgnoreCase(name, "Content-Disposition"))
+        {
+            part_.name = parameter(value, "name");
+            part_.filename = parameter(value, "filename");
+        }
+        else if (equalsIgnoreCase(name, "Content-Type"))
+        {
+            part_.contentType = value;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,151 @@
+#include <unistd.h>
+
+#include <ProxyServer.h>
+#include <TcpClient.h>
+#include <Connector.h>
+#include <Socket.h>
+#include <Logger.h>
+
+ProxyServer::ProxyServer(EventLoop *loop,
+                         const InetAddress &listenAddr,
+                         const std::string &nameArg,
+                         LoadBalancer::Policy policy,
+                         const std::vector<InetAddress> &backends)
+    : loop_(loop)
+    , name_(nameArg)
+    , server_(loop, listenAddr, nameArg)
+    , balancer_(policy, backends)
+    , healthCheckInterval_(2.0)
+    , connectTimeout_(3.0)
+    , highWaterMark_(kDefaultHighWaterMark)
+{
+    server_.setConnectionCallback(
+        std::bind(&ProxyServer::onConnection, this, std::placeholders::_1));
+}
+
+ProxyServer::~ProxyServer()
+{
+}
+
+void ProxyServer::start()
+{
+    if (healthCheckInterval_ > 0.0)
+    {
+        loop_->runEvery(healthCheckInterval_, std::bind(&ProxyServer::checkHealth, this));
+    }
+    server_.start();
+}
+
+void ProxyServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        proxySession(conn);
+    }
+}
+
+Task ProxyServer::proxySession(TcpConnectionPtr downstream)
+{
+    // 后端连接建立之前先不读下游数据
+    downstream->disableReading();
+
+    Backend *backend = balancer_.select(downstream->peerAddress());
+    if (backend == nullptr)
+    {
+        LOG_WARN << "ProxyServer [" << name_ << "] no healthy backend for " << downstream->name();
+        downstream->forceClose();
+        co_return;
+    }
+    backend->active.fetch_add(1, std::memory_order_relaxed);
+
+    // 上游连接和下游连接放在同一个subloop上 两个方向的转发都不需要跨线程
+    TcpClient client(downstream->getLoop(), backend->addr, name_ + "-upstream");
+    TcpConnectionPtr upstream = co_await client.connect(connectTimeout_);
+    if (!upstream)
+    {
+        // 被动健康检查: 连接失败立即摘除 由主动健康检查负责恢复
+        LOG_ERROR << "ProxyServer [" << name_ << "] connect backend " << backend->addr.toIpPort()
+                  << " failed, err=" << client.lastError();
+        backend->healthy.store(false, std::memory_order_relaxed);
+        backend->active.fetch_sub(1, std::memory_order_relaxed);
+        downstream->forceClose();
+        co_return;
+    }
+    if (!downstream->connected())
+    {
+        backend->active.fetch_sub(1, std::memory_order_relaxed);
+        upstream->forceClose();
+        co_return;
+    }
+
+    // 代理转发的多是小包 关闭Nagle降低转发延迟
+    downstream->setTcpNoDelay(true);
+    upstream->setTcpNoDelay(true);
+
+    pump(upstream, downstream, backend);
+    pump(downstream, upstream, nullptr);
+}
+
+Task ProxyServer::pump(TcpConnectionPtr from, TcpConnectionPtr to, Backend *backend)
+{
+    while (from->connected() && to->connected())
+    {
+        Buffer *buf = co_await from->read();
+        if (buf->readableBytes() == 0)
+        {
+            continue;
+        }
+
+        // send(Buffer*) 先直接写socket 只有写不完的部分才进入对端的outputBuffer
+        to->send(buf);
+
+        if (to->outputBuffer()->readableBytes() >= highWaterMark_)
+        {
+            from->disableReading();
+            co_await to->drain();
+        }
+    }
+
+    if (from->disconnected())
+    {
+        // 源端关闭 等已缓冲的数据发送完再半关闭对端 把FIN传递过去
+        to->shutdown();
+    }
+    else
+    {
+        // 对端已经断开(或源端已被另一个方向半关闭) 源端没有必要再保持
+        from->forceClose();
+    }
+
+    if (backend != nullptr)
+    {
+        backend->active.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void ProxyServer::checkHealth()
+{
+    for (auto &backend : balancer_.backends())
+    {
+        probe(backend.get());
+    }
+}
+
+// 主动健康检查: 能在超时之内建立TCP连接即认为健康
+Task ProxyServer::probe(Backend *backend)
+{
+    Connector connector(loop_, backend->addr);
+    auto [sockfd, err] = co_await connector.connect(connectTimeout_);
+    bool healthy = sockfd >= 0;
+    if (sockfd >= 0)
+    {
+        ::close(sockfd);
+    }
+
+    bool wasHealthy = backend->healthy.exchange(healthy, std::memory_order_relaxed);
+    if (wasHealthy != healthy)
+    {
+        LOG_WARN << "ProxyServer [" << name_ << "] backend " << backend->addr.toIpPort()
+                 << (healthy ? " is up" : " is down") << " err=" << err;
+    }
+}
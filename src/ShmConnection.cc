@@ -0,0 +1,546 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include <ShmConnection.h>
+#include <EventLoop.h>
+#include <Logger.h>
+
+// 每个方向一个环 head只由消费者写 tail只由生产者写 分开放在不同的cache line上
+struct ShmConnection::RingHeader
+{
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint32_t> consumerWaiting; // 消费者挂起 生产者写入后需要按门铃
+    std::atomic<uint32_t> producerWaiting;             // 环满生产者挂起 消费者腾出空间后需要按门铃
+    std::atomic<uint32_t> producerClosed;
+    std::atomic<uint32_t> consumerClosed;
+};
+
+// memfd开头的控制页 rings[i]是side i发送方向的环
+struct ShmConnection::SharedControl
+{
+    uint64_t magic;
+    uint64_t capacity;
+    RingHeader rings[2];
+};
+
+namespace
+{
+const uint64_t kShmMagic = 0x6b616d6173686d31ULL; // "kamashm1"
+const size_t kDataOffset = 4096;                   // 数据区从控制页之后开始
+
+size_t roundUpPowerOfTwo(size_t n)
+{
+    size_t cap = 4096;
+    while (cap < n)
+    {
+        cap <<= 1;
+    }
+    return cap;
+}
+
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+}
+
+// ================= 建立连接 =================
+
+bool ShmConnection::createDescriptor(size_t capacity, Descriptor *desc)
+{
+    static_assert(sizeof(SharedControl) <= kDataOffset, "control page too large");
+    capacity = roundUpPowerOfTwo(capacity);
+    size_t length = kDataOffset + 2 * capacity;
+
+    int memfd = ::memfd_create("kama-shm", MFD_CLOEXEC);
+    if (memfd < 0)
+    {
+        LOG_ERROR << "ShmConnection::createDescriptor memfd_create error " << errno;
+        return false;
+    }
+    if (::ftruncate(memfd, length) < 0)
+    {
+        LOG_ERROR << "ShmConnection::createDescriptor ftruncate error " << errno;
+        ::close(memfd);
+        return false;
+    }
+    void *base = ::mmap(nullptr, kDataOffset, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (base == MAP_FAILED)
+    {
+        LOG_ERROR << "ShmConnection::createDescriptor mmap error " << errno;
+        ::close(memfd);
+        return false;
+    }
+    // ftruncate出来的页全是0 原子变量的初始值正好是0
+    SharedControl *control = static_cast<SharedControl *>(base);
+    control->capacity = capacity;
+    control->magic = kShmMagic;
+    ::munmap(base, kDataOffset);
+
+    desc->memfd = memfd;
+    for (int i = 0; i < 2; ++i)
+    {
+        desc->doorbells[i] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (desc->doorbells[i] < 0)
+        {
+            LOG_ERROR << "ShmConnection::createDescriptor eventfd error " << errno;
+            closeDescriptor(desc);
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShmConnection::closeDescriptor(Descriptor *desc)
+{
+    if (desc->memfd >= 0)
+    {
+        ::close(desc->memfd);
+        desc->memfd = -1;
+    }
+    for (int &fd : desc->doorbells)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+}
+
+bool ShmConnection::sendDescriptor(int unixSockfd, const Descriptor &desc)
+{
+    int fds[3] = {desc.memfd, desc.doorbells[0], desc.doorbells[1]};
+    char byte = 'S';
+    iovec iov = {&byte, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof fds)];
+    ::memset(control, 0, sizeof control);
+
+    msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof fds);
+    ::memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+
+    if (::sendmsg(unixSockfd, &msg, MSG_NOSIGNAL) != 1)
+    {
+        LOG_ERROR << "ShmConnection::sendDescriptor error " << errno;
+        return false;
+    }
+    return true;
+}
+
+bool ShmConnection::recvDescriptor(int unixSockfd, Descriptor *desc)
+{
+    int fds[3] = {-1, -1, -1};
+    char byte = 0;
+    iovec iov = {&byte, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof fds)];
+
+    msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    if (::recvmsg(unixSockfd, &msg, MSG_CMSG_CLOEXEC) != 1)
+    {
+        LOG_ERROR << "ShmConnection::recvDescriptor error " << errno;
+        return false;
+    }
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof fds))
+    {
+        LOG_ERROR << "ShmConnection::recvDescriptor no descriptors";
+        return false;
+    }
+    ::memcpy(fds, CMSG_DATA(cmsg), sizeof fds);
+    desc->memfd = fds[0];
+    desc->doorbells[0] = fds[1];
+    desc->doorbells[1] = fds[2];
+    return true;
+}
+
+ShmConnection::ShmConnection(EventLoop *loop, const Descriptor &desc, int side, const std::string &name)
+    : loop_(loop)
+    , name_(name)
+    , side_(side)
+    , capacity_(0)
+    , mapLength_(0)
+    , shared_(nullptr)
+    , tx_(nullptr)
+    , rx_(nullptr)
+    , txData_(nullptr)
+    , rxData_(nullptr)
+    , doorbellFd_(-1)
+    , peerDoorbellFd_(-1)
+    , closed_(false)
+    , broken_(false)
+    , busyPollSpins_(0)
+    , writeResumeThreshold_(0)
+{
+    struct stat st;
+    if ((side != 0 && side != 1) || ::fstat(desc.memfd, &st) < 0 || static_cast<size_t>(st.st_size) <= kDataOffset)
+    {
+        LOG_ERROR << "ShmConnection [" << name_ << "] invalid descriptor";
+        return;
+    }
+    void *base = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, desc.memfd, 0);
+    if (base == MAP_FAILED)
+    {
+        LOG_ERROR << "ShmConnection [" << name_ << "] mmap error " << errno;
+        return;
+    }
+    SharedControl *control = static_cast<SharedControl *>(base);
+    // capacity来自对端写的共享内存 必须是2的幂(环下标用 & (capacity-1) 取模) 并且和文件大小一致
+    uint64_t capacity = control->capacity;
+    if (control->magic != kShmMagic || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        capacity != (static_cast<size_t>(st.st_size) - kDataOffset) / 2 ||
+        kDataOffset + 2 * capacity != static_cast<size_t>(st.st_size))
+    {
+        LOG_ERROR << "ShmConnection [" << name_ << "] bad shared memory layout";
+        ::munmap(base, st.st_size);
+        return;
+    }
+
+    shared_ = control;
+    mapLength_ = st.st_size;
+    capacity_ = capacity;
+    tx_ = &control->rings[side];
+    rx_ = &control->rings[1 - side];
+    char *data = static_cast<char *>(base) + kDataOffset;
+    txData_ = data + side * capacity_;
+    rxData_ = data + (1 - side) * capacity_;
+
+    doorbellFd_ = ::dup(desc.doorbells[side]);
+    peerDoorbellFd_ = ::dup(desc.doorbells[1 - side]);
+    channel_.reset(new Channel(loop_, doorbellFd_));
+    channel_->setHandler(this);
+    channel_->enableReading();
+}
+
+ShmConnection::~ShmConnection()
+{
+    if (shared_ == nullptr)
+    {
+        return;
+    }
+    tx_->producerClosed.store(1, std::memory_order_release);
+    rx_->consumerClosed.store(1, std::memory_order_release);
+    ringPeer();
+
+    channel_->disableAll();
+    channel_->remove();
+    ::munmap(shared_, mapLength_);
+    ::close(doorbellFd_);
+    ::close(peerDoorbellFd_);
+}
+
+bool ShmConnection::connected() const
+{
+    return shared_ != nullptr && !closed_ && !peerGone();
+}
+
+bool ShmConnection::peerClosed() const
+{
+    return broken_ || rx_->producerClosed.load(std::memory_order_acquire) != 0;
+}
+
+bool ShmConnection::peerGone() const
+{
+    return broken_ || tx_->consumerClosed.load(std::memory_order_acquire) != 0;
+}
+
+void ShmConnection::protocolError(const char *what)
+{
+    LOG_ERROR << "ShmConnection [" << name_ << "] protocol error: " << what << ", close";
+    broken_ = true;
+    closed_ = true;
+    outputBuffer_.retrieveAll();
+    tx_->producerClosed.store(1, std::memory_order_release);
+    rx_->consumerClosed.store(1, std::memory_order_release);
+    ringPeer();
+    // 挂起的读写协程由自己的门铃事件唤醒 这里可能正处在它们的调用栈里
+    uint64_t one = 1;
+    if (::write(doorbellFd_, &one, sizeof one) != sizeof one && errno != EAGAIN)
+    {
+        LOG_ERROR << "ShmConnection [" << name_ << "] ring own doorbell error " << errno;
+    }
+}
+
+void ShmConnection::ringPeer()
+{
+    uint64_t one = 1;
+    if (::write(peerDoorbellFd_, &one, sizeof one) != sizeof one && errno != EAGAIN)
+    {
+        LOG_ERROR << "ShmConnection [" << name_ << "] ring doorbell error " << errno;
+    }
+}
+
+// ================= 环读写 =================
+
+size_t ShmConnection::pushRing(const char *data, size_t len)
+{
+    if (broken_)
+    {
+        return 0;
+    }
+    uint64_t head = tx_->head.load(std::memory_order_acquire);
+    uint64_t tail = tx_->tail.load(std::memory_order_relaxed);
+    // head由对端写 越过tail或者落后超过一个环都说明环被破坏了
+    uint64_t used = tail - head;
+    if (used > capacity_)
+    {
+        protocolError("tx ring head out of range");
+        return 0;
+    }
+    size_t n = std::min(len, capacity_ - static_cast<size_t>(used));
+    if (n == 0)
+    {
+        return 0;
+    }
+    size_t offset = tail & (capacity_ - 1);
+    size_t first = std::min(n, capacity_ - offset);
+    ::memcpy(txData_ + offset, data, first);
+    ::memcpy(txData_, data + first, n - first);
+    tx_->tail.store(tail + n, std::memory_order_release);
+
+    // 与消费者"置waiting再检查环"配对 两边至少有一方能看到对方的写
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (tx_->consumerWaiting.load(std::memory_order_relaxed) && tx_->consumerWaiting.exchange(0))
+    {
+        ringPeer();
+    }
+    return n;
+}
+
+size_t ShmConnection::pullRing()
+{
+    if (broken_)
+    {
+        return 0;
+    }
+    uint64_t tail = rx_->tail.load(std::memory_order_acquire);
+    uint64_t head = rx_->head.load(std::memory_order_relaxed);
+    uint64_t used = tail - head;
+    if (used > capacity_)
+    {
+        protocolError("rx ring tail out of range");
+        return 0;
+    }
+    size_t n = static_cast<size_t>(used);
+    if (n == 0)
+    {
+        return 0;
+    }
+    size_t offset = head & (capacity_ - 1);
+    size_t first = std::min(n, capacity_ - offset);
+    inputBuffer_.append(rxData_ + offset, first);
+    inputBuffer_.append(rxData_, n - first);
+    rx_->head.store(tail, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (rx_->producerWaiting.load(std::memory_order_relaxed) && rx_->producerWaiting.exchange(0))
+    {
+        ringPeer();
+    }
+    return n;
+}
+
+void ShmConnection::flushOutput()
+{
+    if (peerGone())
+    {
+        outputBuffer_.retrieveAll();
+    }
+    while (outputBuffer_.readableBytes() > 0)
+    {
+        size_t n = pushRing(outputBuffer_.peek(), outputBuffer_.readableBytes());
+        if (n > 0)
+        {
+            outputBuffer_.retrieve(n);
+            continue;
+        }
+        // 环满: 请对端腾出空间后按门铃 置位之后再试一次 防止对端恰好在置位前读空了环
+        tx_->producerWaiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        n = pushRing(outputBuffer_.peek(), outputBuffer_.readableBytes());
+        if (n == 0)
+        {
+            break;
+        }
+        outputBuffer_.retrieve(n);
+    }
+    if (closed_ && outputBuffer_.readableBytes() == 0 && !tx_->producerClosed.load(std::memory_order_relaxed))
+    {
+        tx_->producerClosed.store(1, std::memory_order_release);
+        ringPeer();
+    }
+}
+
+void ShmConnection::send(const void *data, size_t len)
+{
+    if (!connected())
+    {
+        LOG_ERROR << "ShmConnection [" << name_ << "] send on closed connection";
+        return;
+    }
+    const char *p = static_cast<const char *>(data);
+    if (outputBuffer_.readableBytes() == 0)
+    {
+        size_t n = pushRing(p, len);
+        p += n;
+        len -= n;
+    }
+    if (len > 0)
+    {
+        outputBuffer_.append(p, len);
+        flushOutput();
+    }
+}
+
+void ShmConnection::send(Buffer *buf)
+{
+    send(buf->peek(), buf->readableBytes());
+    buf->retrieveAll();
+}
+
+void ShmConnection::shutdown()
+{
+    if (shared_ == nullptr || closed_)
+    {
+        return;
+    }
+    closed_ = true;
+    flushOutput(); // 缓冲区已空时立即通知对端 否则等数据写完
+}
+
+// ================= 门铃事件 =================
+
+void ShmConnection::onReadable(Timestamp)
+{
+    uint64_t count;
+    ::read(doorbellFd_, &count, sizeof count);
+
+    // 恢复的协程可能释放最后一个引用
+    std::shared_ptr<ShmConnection> guard = weak_from_this().lock();
+
+    // 没有协程在等数据时不搬运 数据留在环里 环满之后对端的写自然挂起
+    bool eof = peerClosed();
+    if (readCoroutine_)
+    {
+        pullRing();
+    }
+    flushOutput();
+
+    if (readCoroutine_ && (inputBuffer_.readableBytes() > 0 || eof))
+    {
+        auto h = readCoroutine_;
+        readCoroutine_ = nullptr;
+        rx_->consumerWaiting.store(0, std::memory_order_relaxed);
+        h.resume();
+    }
+    resumeWriter();
+}
+
+void ShmConnection::resumeWriter()
+{
+    if (writeCoroutine_ && (outputBuffer_.readableBytes() <= writeResumeThreshold_ || !connected()))
+    {
+        auto h = writeCoroutine_;
+        writeCoroutine_ = nullptr;
+        h.resume();
+    }
+}
+
+// ================= Awaiter 实现 =================
+
+bool ShmConnection::ReadAwaiter::await_ready() const
+{
+    ShmConnection *c = conn_;
+    if (c->shared_ == nullptr)
+    {
+        return true;
+    }
+    // 先看关闭标记再取数据: 对端在关闭之前写入的数据此时一定可见
+    bool eof = c->peerClosed();
+    c->pullRing();
+    return c->inputBuffer_.readableBytes() > 0 || eof;
+}
+
+bool ShmConnection::ReadAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    ShmConnection *c = conn_;
+    for (int i = 0; i < c->busyPollSpins_; ++i)
+    {
+        if (c->pullRing() > 0 || c->peerClosed())
+        {
+            return false;
+        }
+        cpuRelax();
+    }
+
+    c->rx_->consumerWaiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool eof = c->peerClosed();
+    if (c->pullRing() > 0 || eof)
+    {
+        c->rx_->consumerWaiting.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    c->readCoroutine_ = h;
+    return true;
+}
+
+Buffer *ShmConnection::ReadAwaiter::await_resume()
+{
+    return &conn_->inputBuffer_;
+}
+
+bool ShmConnection::DrainAwaiter::await_ready() const
+{
+    return conn_->outputBuffer_.readableBytes() == 0 || !conn_->connected();
+}
+
+void ShmConnection::DrainAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    conn_->writeResumeThreshold_ = 0;
+    conn_->writeCoroutine_ = h;
+}
+
+bool ShmConnection::WriteAwaiter::await_ready() const
+{
+    return conn_->outputBuffer_.readableBytes() < highWaterMark_ || !conn_->connected();
+}
+
+void ShmConnection::WriteAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    conn_->writeResumeThreshold_ = highWaterMark_ / 2;
+    conn_->writeCoroutine_ = h;
+}
+
+size_t ShmConnection::WriteAwaiter::await_resume()
+{
+    if (!conn_->connected())
+    {
+        return 0;
+    }
+    size_t len = data_.size();
+    conn_->send(data_);
+    return len;
+}
@@ -4,10 +4,12 @@
 #include <string.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <errno.h>
 
 #include <Socket.h>
 #include <Logger.h>
 #include <InetAddress.h>
+#include <SocketOptions.h>
 
 Socket::~Socket()
 {
@@ -18,7 +20,7 @@ void Socket::bindAddress(const InetAddress &localaddr)
 {
     LOG_DEBUG<<"Socket::bindAddress()";
 
-    if (0 != ::bind(sockfd_, (sockaddr *)localaddr.getSockAddr(), sizeof(sockaddr_in)))
+    if (0 != ::bind(sockfd_, localaddr.getSockAddr(), localaddr.getSockLen()))
     {
         LOG_FATAL<<"bind sockfd:"<<sockfd_ <<"fail";
     }
@@ -46,14 +48,14 @@ int Socket::accept(InetAddress *peeraddr)
      * Reactor模型 one loop per thread
      * poller + non-blocking IO
      **/
-    sockaddr_in addr;
+    sockaddr_storage addr; // 同时容纳 sockaddr_in 和 sockaddr_un
     socklen_t len = sizeof(addr);
     ::memset(&addr, 0, sizeof(addr));
     // fixed : int connfd = ::accept(sockfd_, (sockaddr *)&addr, &len);
     int connfd = ::accept4(sockfd_, (sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (connfd >= 0)
     {
-        peeraddr->setSockAddr(addr);
+        peeraddr->setSockAddr((sockaddr *)&addr, len);
     }
     LOG_DEBUG<<"Socket::accept() end";
     return connfd;
@@ -102,4 +104,109 @@ void Socket::setKeepAlive(bool on)
     // 这对于检测网络中失效的对等方非常有用。
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval));
+}
+
+void Socket::setSendBufferSize(int bytes)
+{
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes)) < 0)
+    {
+        LOG_ERROR << "Socket::setSendBufferSize error " << errno;
+    }
+}
+
+void Socket::setRecvBufferSize(int bytes)
+{
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) < 0)
+    {
+        LOG_ERROR << "Socket::setRecvBufferSize error " << errno;
+    }
+}
+
+void Socket::setTcpQuickAck(bool on)
+{
+    // TCP_QUICKACK 立即回复ACK而不是等待延迟确认 这个标志不是持久的 内核处理完后会自动清除
+    int optval = on ? 1 : 0;
+    ::setsockopt(sockfd_, IPPROTO_TCP, TCP_QUICKACK, &optval, sizeof(optval));
+}
+
+void Socket::setTcpNotSentLowat(int bytes)
+{
+    // TCP_NOTSENT_LOWAT 发送队列中尚未发出的数据低于该值时才报告EPOLLOUT
+    // 数据不会大量堆积在内核里 应用层能更晚地决定发什么 降低尾延迟
+    if (::setsockopt(sockfd_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes, sizeof(bytes)) < 0)
+    {
+        LOG_ERROR << "Socket::setTcpNotSentLowat error " << errno;
+    }
+}
+
+void Socket::setTcpUserTimeout(int ms)
+{
+    // TCP_USER_TIMEOUT 已发送的数据超过ms毫秒仍未被确认时内核关闭连接 比keepalive更快发现对端失联
+    unsigned int optval = static_cast<unsigned int>(ms);
+    if (::setsockopt(sockfd_, IPPROTO_TCP, TCP_USER_TIMEOUT, &optval, sizeof(optval)) < 0)
+    {
+        LOG_ERROR << "Socket::setTcpUserTimeout error " << errno;
+    }
+}
+
+void Socket::setKeepAliveParams(int idleSecs, int intervalSecs, int count)
+{
+    // 空闲idleSecs秒后开始探测 每intervalSecs秒一次 连续count次无响应则断开
+    ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPIDLE, &idleSecs, sizeof(idleSecs));
+    ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPINTVL, &intervalSecs, sizeof(intervalSecs));
+    ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+}
+
+void Socket::applyOptions(const SocketOptions &options, bool tcpOptions)
+{
+    if (options.sendBufferSize)
+        setSendBufferSize(*options.sendBufferSize);
+    if (options.recvBufferSize)
+        setRecvBufferSize(*options.recvBufferSize);
+    if (options.keepAlive)
+        setKeepAlive(*options.keepAlive);
+
+    if (!tcpOptions)
+    {
+        return;
+    }
+    if (options.tcpNoDelay)
+        setTcpNoDelay(*options.tcpNoDelay);
+    if (options.tcpQuickAck)
+        setTcpQuickAck(*options.tcpQuickAck);
+    if (options.notSentLowat)
+        setTcpNotSentLowat(*options.notSentLowat);
+    if (options.userTimeoutMs)
+        setTcpUserTimeout(*options.userTimeoutMs);
+    if (options.keepIdleSecs || options.keepIntervalSecs || options.keepCount)
+    {
+        // 只设置了其中一部分时 其余保持Linux的默认值
+        setKeepAliveParams(options.keepIdleSecs.value_or(7200),
+                           options.keepIntervalSecs.value_or(75),
+                           options.keepCount.value_or(9));
+    }
+}
+
+bool Socket::setRecvLowat(int bytes)
+{
+    // SO_RCVLOWAT 内核在接收队列达到该字节数之前不会唤醒 epoll 的可读事件(连接关闭除外)
+    // TCP 会把它限制在接收缓冲区的一半以内 所以它只是减少唤醒次数 上层不能依赖它一次凑齐数据
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_RCVLOWAT, &bytes, sizeof(bytes)) < 0)
+    {
+        LOG_ERROR << "Socket::setRecvLowat error " << errno;
+        return false;
+    }
+    return true;
+}
+
+bool Socket::getPeerCred(ucred *cred) const
+{
+    // 只对 AF_UNIX 有意义 内核在connect时记录下对端进程的凭证 不能被对端伪造
+    socklen_t len = sizeof(ucred);
+    if (::getsockopt(sockfd_, SOL_SOCKET, SO_PEERCRED, cred, &len) < 0)
+    {
+        LOG_ERROR << "Socket::getPeerCred error " << errno;
+        return false;
+    }
+    return true;
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include <SocketOptions.h>
+
+SocketOptions SocketOptions::latency()
+{
+    SocketOptions opts;
+    opts.tcpNoDelay = true;
+    opts.tcpQuickAck = true;
+    opts.notSentLowat = 16 * 1024;
+    opts.userTimeoutMs = 10 * 1000;
+    opts.keepAlive = true;
+    opts.keepIdleSecs = 30;
+    opts.keepIntervalSecs = 5;
+    opts.keepCount = 3;
+    return opts;
+}
+
+SocketOptions SocketOptions::bulk()
+{
+    SocketOptions opts;
+    opts.sendBufferSize = 4 * 1024 * 1024;
+    opts.recvBufferSize = 4 * 1024 * 1024;
+    opts.tcpNoDelay = false;
+    opts.tcpQuickAck = false;
+    opts.userTimeoutMs = 60 * 1000;
+    opts.keepAlive = true;
+    opts.keepIdleSecs = 60;
+    opts.keepIntervalSecs = 10;
+    opts.keepCount = 5;
+    return opts;
+}
+
+bool SocketOptions::fromProfile(const std::string &name, SocketOptions *options)
+{
+    if (name == "latency")
+    {
+        *options = latency();
+    }
+    else if (name == "bulk")
+    {
+        *options = bulk();
+    }
+    else if (name == "default")
+    {
+        *options = SocketOptions();
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
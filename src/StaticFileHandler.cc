@@ -0,0 +1,402 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <charconv>
+
+#include <StaticFileHandler.h>
+#include <HttpRequest.h>
+#include <HttpResponse.h>
+#include <HttpCompressor.h>
+
+namespace
+{
+
+std::string_view trim(std::string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+    {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+    {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool parseUint(std::string_view s, uint64_t *value)
+{
+    if (s.empty())
+    {
+        return false;
+    }
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), *value);
+    return ec == std::errc() && ptr == s.data() + s.size();
+}
+
+// If-None-Match: "*" 或者逗号分隔的ETag列表 按弱比较(忽略W/前缀)
+bool etagMatches(std::string_view list, std::string_view etag)
+{
+    list = trim(list);
+    if (list == "*")
+    {
+        return true;
+    }
+    while (!list.empty())
+    {
+        size_t comma = list.find(',');
+        std::string_view tag = trim(list.substr(0, comma));
+        if (tag.starts_with("W/"))
+        {
+            tag.remove_prefix(2);
+        }
+        if (tag == etag)
+        {
+            return true;
+        }
+        if (comma == std::string_view::npos)
+        {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+struct MimeType
+{
+    const char *ext;
+    const char *type;
+};
+
+const MimeType kMimeTypes[] = {
+    {"html", "text/html; charset=utf-8"},
+    {"htm", "text/html; charset=utf-8"},
+    {"css", "text/css; charset=utf-8"},
+    {"js", "text/javascript; charset=utf-8"},
+    {"mjs", "text/javascript; charset=utf-8"},
+    {"json", "application/json"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"xml", "application/xml"},
+    {"svg", "image/svg+xml"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"webp", "image/webp"},
+    {"ico", "image/x-icon"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"wasm", "application/wasm"},
+    {"pdf", "application/pdf"},
+    {"mp4", "video/mp4"},
+    {"mp3", "audio/mpeg"},
+    {"zip", "application/zip"},
+    {"gz", "application/gzip"},
+};
+
+} // namespace
+
+StaticFileHandler::StaticFileHandler(FileCache *cache, const std::string &root)
+    : cache_(cache)
+    , root_(root)
+    , indexFile_("index.html")
+    , precompressed_(true)
+{
+    // 请求路径总是以'/'开头 根目录去掉结尾的'/'再拼接
+    while (!root_.empty() && root_.back() == '/')
+    {
+        root_.pop_back();
+    }
+}
+
+std::string_view StaticFileHandler::mimeType(std::string_view path)
+{
+    size_t dot = path.rfind('.');
+    if (dot == std::string_view::npos || path.find('/', dot) != std::string_view::npos)
+    {
+        return "application/octet-stream";
+    }
+    std::string_view ext = path.substr(dot + 1);
+    for (const MimeType &m : kMimeTypes)
+    {
+        if (ext.size() == strlen(m.ext) && ::strncasecmp(ext.data(), m.ext, ext.size()) == 0)
+        {
+            return m.type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+bool StaticFileHandler::decodePath(std::string_view path, std::string *out)
+{
+    if (path.empty() || path[0] != '/')
+    {
+        return false;
+    }
+    out->clear();
+    out->reserve(path.size());
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        char c = path[i];
+        if (c == '%')
+        {
+            int hi = i + 2 < path.size() ? hexValue(path[i + 1]) : -1;
+            int lo = hi >= 0 ? hexValue(path[i + 2]) : -1;
+            if (lo < 0)
+            {
+                return false;
+            }
+            c = static_cast<char>(hi * 16 + lo);
+            i += 2;
+        }
+        if (c == '\0')
+        {
+            return false;
+        }
+        if (c == '/' && !out->empty() && out->back() == '/')
+        {
+            continue; // 合并连续的'/' 同一个文件只对应一个缓存键
+        }
+        out->push_back(c);
+    }
+
+    // 逐段检查 解码之后再查 "%2e%2e" 也挡得住
+    size_t start = 1;
+    while (start <= out->size())
+    {
+        size_t slash = out->find('/', start);
+        std::string_view seg(out->data() + start, (slash == std::string::npos ? out->size() : slash) - start);
+        if (seg == ".." || seg == ".")
+        {
+            return false;
+        }
+        if (slash == std::string::npos)
+        {
+            break;
+        }
+        start = slash + 1;
+    }
+    return true;
+}
+
+int StaticFileHandler::parseRange(std::string_view range, size_t size, size_t *first, size_t *last)
+{
+    range = trim(range);
+    if (!range.starts_with("bytes="))
+    {
+        return 0;
+    }
+    std::string_view spec = trim(range.substr(6));
+    if (spec.find(',') != std::string_view::npos)
+    {
+        return 0; // 多个区间 返回整个文件
+    }
+    size_t dash = spec.find('-');
+    if (dash == std::string_view::npos)
+    {
+        return 0;
+    }
+    std::string_view from = trim(spec.substr(0, dash));
+    std::string_view to = trim(spec.substr(dash + 1));
+
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (from.empty())
+    {
+        // bytes=-n 最后n个字节
+        if (!parseUint(to, &b))
+        {
+            return 0;
+        }
+        if (b == 0 || size == 0)
+        {
+            return -1;
+        }
+        *first = size - std::min<uint64_t>(b, size);
+        *last = size - 1;
+        return 1;
+    }
+    if (!parseUint(from, &a))
+    {
+        return 0;
+    }
+    if (!to.empty() && (!parseUint(to, &b) || b < a))
+    {
+        return 0;
+    }
+    if (a >= size)
+    {
+        return -1;
+    }
+    *first = a;
+    *last = to.empty() ? size - 1 : std::min<uint64_t>(b, size - 1);
+    return 1;
+}
+
+bool StaticFileHandler::notModified(const HttpRequest &req, const FileCache::File &file) const
+{
+    // 两者都有时以If-None-Match为准(RFC 7232 3.3)
+    std::string_view inm = req.header("If-None-Match");
+    if (!inm.empty())
+    {
+        return etagMatches(inm, file.etag);
+    }
+    std::string_view ims = req.header("If-Modified-Since");
+    if (!ims.empty())
+    {
+        time_t since = FileCache::parseHttpDate(trim(ims));
+        return since >= 0 && file.st.st_mtime <= since;
+    }
+    return false;
+}
+
+bool StaticFileHandler::handle(const HttpRequest &req, HttpResponse *resp)
+{
+    if (req.method() != HttpRequest::kGet && req.method() != HttpRequest::kHead)
+    {
+        resp->setStatusCode(HttpResponse::k405MethodNotAllowed);
+        resp->addHeader("Allow", "GET, HEAD");
+        return false;
+    }
+
+    std::string relative;
+    if (!decodePath(req.path(), &relative))
+    {
+        resp->setStatusCode(HttpResponse::k403Forbidden);
+        return false;
+    }
+    std::string path = root_ + relative;
+    if (path.back() == '/')
+    {
+        path += indexFile_;
+    }
+
+    FileCache::FilePtr file = cache_->open(path);
+    if (!file)
+    {
+        if (errno == EISDIR)
+        {
+            std::string location(req.path());
+            location += '/';
+            if (!req.query().empty())
+            {
+                location += '?';
+                location.append(req.query());
+            }
+            resp->setStatusCode(HttpResponse::k301MovedPermanently);
+            resp->addHeader("Location", location);
+            return true;
+        }
+        resp->setStatusCode(errno == ENOENT || errno == ENOTDIR ? HttpResponse::k404NotFound : HttpResponse::k403Forbidden);
+        return false;
+    }
+
+    // 预压缩: 旁边有不比原文件旧的 path.gz 并且客户端接受gzip时发送它 Content-Type仍然按原文件
+    // 之后的ETag/Last-Modified/Range都针对实际发送的.gz 它是另一个表示 ETag本来就不同
+    std::string_view contentType = mimeType(path);
+    const char *encoding = nullptr;
+    bool vary = false;
+    if (precompressed_ && HttpCompressor::compressible(contentType))
+    {
+        std::string gzPath = path + ".gz";
+        FileCache::FilePtr gz = cache_->open(gzPath);
+        if (gz)
+        {
+            vary = true;
+            const struct timespec &gzTime = gz->st.st_mtim;
+            const struct timespec &origTime = file->st.st_mtim;
+            bool fresh = gzTime.tv_sec > origTime.tv_sec ||
+                         (gzTime.tv_sec == origTime.tv_sec && gzTime.tv_nsec >= origTime.tv_nsec);
+            if (fresh && HttpCompressor::accepts(req.header("Accept-Encoding"), HttpCompressor::kGzip))
+            {
+                file = std::move(gz);
+                path.swap(gzPath);
+                encoding = "gzip";
+            }
+        }
+    }
+
+    resp->addHeader("Last-Modified", file->lastModified);
+    resp->addHeader("ETag", file->etag);
+    if (!cacheControl_.empty())
+    {
+        resp->addHeader("Cache-Control", cacheControl_);
+    }
+    if (vary)
+    {
+        resp->addHeader("Vary", "Accept-Encoding");
+    }
+    if (notModified(req, *file))
+    {
+        resp->setStatusCode(HttpResponse::k304NotModified);
+        return true;
+    }
+    resp->setContentType(contentType);
+    if (encoding)
+    {
+        resp->addHeader("Content-Encoding", encoding);
+    }
+    resp->addHeader("Accept-Ranges", "bytes");
+
+    size_t size = file->size();
+    size_t first = 0;
+    size_t last = size > 0 ? size - 1 : 0;
+    int ranged = 0;
+    std::string_view range = req.method() == HttpRequest::kGet ? req.header("Range") : std::string_view();
+    if (!range.empty())
+    {
+        // If-Range的校验值和当前文件不一致 说明客户端手里的片段已经过期 返回整个文件
+        std::string_view ifRange = trim(req.header("If-Range"));
+        if (ifRange.empty() || ifRange == file->etag || ifRange == file->lastModified)
+        {
+            ranged = parseRange(range, size, &first, &last);
+        }
+    }
+
+    char buf[96];
+    if (ranged < 0)
+    {
+        snprintf(buf, sizeof buf, "bytes */%zu", size);
+        resp->setStatusCode(HttpResponse::k416RangeNotSatisfiable);
+        resp->addHeader("Content-Range", buf);
+        return true;
+    }
+    size_t length = size;
+    if (ranged > 0)
+    {
+        length = last - first + 1;
+        snprintf(buf, sizeof buf, "bytes %zu-%zu/%zu", first, last, size);
+        resp->setStatusCode(HttpResponse::k206PartialContent);
+        resp->addHeader("Content-Range", buf);
+    }
+
+    // HEAD不需要内容 文件消息体只用来给出Content-Length
+    SharedMessage content = req.method() == HttpRequest::kGet ? cache_->content(path, file) : nullptr;
+    if (content && ranged == 0)
+    {
+        resp->setSharedBody(content);
+    }
+    else if (content)
+    {
+        resp->setBody(std::string_view(*content).substr(first, length));
+    }
+    else
+    {
+        resp->setFileBody(file->fd, static_cast<off_t>(first), length, file);
+    }
+    return true;
+}
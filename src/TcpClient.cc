@@ -0,0 +1,59 @@
+#include <string.h>
+
+#include <TcpClient.h>
+#include <TcpConnection.h>
+#include <EventLoop.h>
+#include <Logger.h>
+
+TcpClient::TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg)
+    : loop_(loop)
+    , connector_(loop, serverAddr)
+    , name_(nameArg)
+    , nextConnId_(1)
+    , lastError_(0)
+{
+}
+
+TcpClient::~TcpClient()
+{
+}
+
+TcpConnectionPtr TcpClient::ConnectAwaiter::await_resume()
+{
+    auto [sockfd, err] = connectAwaiter_.await_resume();
+    client_->lastError_ = err;
+    if (sockfd < 0)
+    {
+        return nullptr;
+    }
+    return client_->newConnection(sockfd);
+}
+
+TcpConnectionPtr TcpClient::newConnection(int sockfd)
+{
+    const InetAddress &peerAddr = connector_.serverAddress();
+    char buf[64] = {0};
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    std::string connName = name_ + buf;
+
+    sockaddr_storage local;
+    ::memset(&local, 0, sizeof(local));
+    socklen_t addrlen = sizeof(local);
+    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+    {
+        LOG_ERROR << "sockets::getLocalAddr";
+    }
+
+    TcpConnectionPtr conn(new TcpConnection(loop_, connName, sockfd, InetAddress((sockaddr *)&local, addrlen), peerAddr));
+    conn->setConnectionCallback(connectionCallback_);
+    // 客户端连接没有TcpServer的ConnectionMap持有 关闭回调捕获自身形成环 等connectDestroyed执行完再解开
+    conn->setCloseCallback([conn](const TcpConnectionPtr &) {
+        conn->getLoop()->queueInLoop([conn]() {
+            conn->connectDestroyed();
+            conn->setCloseCallback(CloseCallback());
+        });
+    });
+    conn->connectEstablished();
+    return conn;
+}
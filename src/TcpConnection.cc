@@ -1,4 +1,5 @@
 #include <functional>
+#include <algorithm>
 #include <string>
 #include <errno.h>
 #include <sys/types.h>
@@ -6,10 +7,13 @@
 #include <string.h>
 #include <netinet/tcp.h>
 #include <sys/sendfile.h>
+#include <sys/uio.h>
 #include <fcntl.h>  // for open
 #include <unistd.h> // for close
 
 #include <TcpConnection.h>
+#include <TlsContext.h>
+#include <BufferBudget.h>
 #include <Logger.h>
 #include <Socket.h>
 #include <Channel.h>
@@ -31,17 +35,12 @@ TcpConnection::TcpConnection(EventLoop *loop,
                              int sockfd,
                              const InetAddress &localAddr,
                              const InetAddress &peerAddr)
-    : loop_(CheckLoopNotNull(loop)), name_(nameArg), state_(kConnecting), reading_(true), socket_(new Socket(sockfd)), channel_(new Channel(loop, sockfd)), localAddr_(localAddr), peerAddr_(peerAddr)
+    : loop_(CheckLoopNotNull(loop)), name_(nameArg), state_(kConnecting), reading_(true), writeCoalescing_(false), flushScheduled_(false), readAtLeast_(0), rcvLowat_(1), quickAck_(false), socket_(new Socket(sockfd)), channel_(new Channel(loop, sockfd)), localAddr_(localAddr), peerAddr_(peerAddr)
 // , highWaterMark_(64 * 1024 * 1024) // 64M
 {
     LOG_DEBUG << "TcpConnection::TcpConnection start";
-    // 下面给channel设置相应的回调函数 poller给channel通知感兴趣的事件发生了 channel会回调相应的回调函数
-    channel_->setWriteCallback(
-        std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(
-        std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(
-        std::bind(&TcpConnection::handleError, this));
+    // poller给channel通知感兴趣的事件发生了 channel把事件分发给TcpConnection的onReadable/onWritable/onHangup/onError
+    channel_->setHandler(this);
 
     LOG_INFO << "TcpConnection::ctor:[" << name_.c_str() << "]at fd=" << sockfd;
     socket_->setKeepAlive(true);
@@ -65,6 +64,8 @@ bool TcpConnection::ReadAwaiter::await_ready() const
 
 void TcpConnection::ReadAwaiter::await_suspend(std::coroutine_handle<> h)
 {
+    // 之前的 readAtLeast 可能留下了较大的低水位 普通读需要有数据就唤醒
+    conn_->setRecvLowat(1);
     // 这里的 channel_ 是可见的，因为包含头文件了
     conn_->channel_->setReadCoroutine(h);
     conn_->enableReading();
@@ -72,32 +73,96 @@ void TcpConnection::ReadAwaiter::await_suspend(std::coroutine_handle<> h)
 
 Buffer *TcpConnection::ReadAwaiter::await_resume()
 {
+    // 安全起见，清理句柄
+    conn_->channel_->clearReadCoroutine();
+
+    // 被 forceClose 唤醒 不再读取
+    if (conn_->disconnected())
+    {
+        return &conn_->inputBuffer_;
+    }
+
     int savedErrno = 0;
-    // 这里 channel_->fd() 也是可见的
-    ssize_t n = conn_->inputBuffer_.readFd(conn_->channel_->fd(), &savedErrno);
+    ssize_t n = conn_->readInput(&savedErrno);
+    conn_->addTraffic(n);
+    conn_->rearmQuickAck();
+    conn_->chargeBuffers();
 
     if (n == 0)
     {
         conn_->handleClose();
     }
-    else if (n < 0)
+    else if (n < 0 && savedErrno != EAGAIN) // TLS记录没收全时SSL_read返回EAGAIN 返回空缓冲区让调用方继续读
     {
         errno = savedErrno;
         LOG_ERROR << "TcpConnection::readAwaiter error";
         conn_->handleError();
     }
 
-    // 安全起见，清理句柄
-    conn_->channel_->clearReadCoroutine();
+    return &conn_->inputBuffer_;
+}
+
+// ================= ReadAtLeastAwaiter 实现 =================
+
+bool TcpConnection::ReadAtLeastAwaiter::await_ready() const
+{
+    return conn_->inputBuffer_.readableBytes() >= n_ || !conn_->connected();
+}
+
+void TcpConnection::ReadAtLeastAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    conn_->readAtLeast_ = n_;
+    conn_->setRecvLowat(n_ - conn_->inputBuffer_.readableBytes());
+    // 读事件交给 handleReadAtLeast 处理 凑够数据或者连接关闭时再唤醒协程
+    conn_->readAtLeastCoroutine_ = h;
+    conn_->readResume_ = &TcpConnection::handleReadAtLeast;
+    conn_->enableReading();
+}
+
+Buffer *TcpConnection::ReadAtLeastAwaiter::await_resume()
+{
+    conn_->readAtLeast_ = 0;
+    return &conn_->inputBuffer_;
+}
+
+// ================= ReadUntilAwaiter 实现 =================
+
+bool TcpConnection::ReadUntilAwaiter::await_ready()
+{
+    // 连接断开后缓冲区里可能还有没处理完的数据 先交给pred
+    return pred_(&conn_->inputBuffer_) || !conn_->connected();
+}
+
+void TcpConnection::ReadUntilAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    conn_->setRecvLowat(1);
+    conn_->readUntil_ = std::move(pred_);
+    conn_->readAtLeastCoroutine_ = h;
+    conn_->readResume_ = &TcpConnection::handleReadAtLeast;
+    conn_->enableReading();
+}
 
+Buffer *TcpConnection::ReadUntilAwaiter::await_resume()
+{
+    conn_->readUntil_ = nullptr;
     return &conn_->inputBuffer_;
 }
 
+std::string TcpConnection::ReadExactlyAwaiter::await_resume()
+{
+    Buffer *buf = ReadAtLeastAwaiter::await_resume();
+    if (buf->readableBytes() < n_)
+    {
+        return std::string();
+    }
+    return buf->retrieveAsString(n_);
+}
+
 // ================= DrainAwaiter 实现 =================
 
 bool TcpConnection::DrainAwaiter::await_ready() const
 {
-    return conn_->outputBuffer_.readableBytes() == 0 || !conn_->connected();
+    return conn_->pendingOutputBytes() == 0 || !conn_->connected();
 }
 
 void TcpConnection::DrainAwaiter::await_suspend(std::coroutine_handle<> h)
@@ -127,9 +192,22 @@ void TcpConnection::SendFileAwaiter::await_suspend(std::coroutine_handle<> h)
     conn_->sendFileBytesSent_ = 0;
     conn_->writeCoroutine_ = h;
 
-    if (!conn_->channel_->isWriting() && conn_->outputBuffer_.readableBytes() == 0)
+    // 写合并模式下outputBuffer_里通常还有本轮send的响应头 用MSG_MORE先交给内核
+    // 内核会等紧接着的sendfile数据一起组包 头部不会单独成为一个小TCP段
+    // 用户态TLS没有MSG_MORE可用 排队数据由handleWrite先发
+    if (conn_->writeCoalescing_ && !conn_->userspaceTls() && !conn_->channel_->isWriting() && conn_->outputBuffer_.readableBytes() > 0)
     {
-        ssize_t n = ::sendfile(conn_->socket_->fd(), fileFd_, &conn_->sendFileOffset_, conn_->sendFileRemaining_);
+        Buffer &out = conn_->outputBuffer_;
+        ssize_t n = ::send(conn_->socket_->fd(), out.peek(), out.readableBytes(), MSG_MORE | MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            out.retrieve(n);
+        }
+    }
+
+    if (!conn_->channel_->isWriting() && conn_->pendingOutputBytes() == 0)
+    {
+        ssize_t n = conn_->sendFileChunk(fileFd_, &conn_->sendFileOffset_, conn_->sendFileRemaining_);
         if (n > 0)
         {
             conn_->sendFileRemaining_ -= n;
@@ -144,7 +222,8 @@ void TcpConnection::SendFileAwaiter::await_suspend(std::coroutine_handle<> h)
             return;
         }
 
-        if (n < 0 && errno != EWOULDBLOCK && errno != EAGAIN)
+        // 返回0说明文件比count短(发送期间被截断) 不会再有数据 按出错结束
+        if (n == 0 || (n < 0 && errno != EWOULDBLOCK && errno != EAGAIN))
         {
             LOG_ERROR << "TcpConnection::SendFileAwaiter initial sendfile error";
             conn_->sendFileFd_ = -1;
@@ -177,11 +256,12 @@ bool TcpConnection::ReadWithTimeoutAwaiter::await_ready() const
 void TcpConnection::ReadWithTimeoutAwaiter::await_suspend(std::coroutine_handle<> h)
 {
     state_->handle = h;
+    conn_->setRecvLowat(1);
 
     std::weak_ptr<State> weakState = state_;
     TcpConnection *conn = conn_;
 
-    state_->timerId = conn_->loop_->runAfter(timeoutSecs_, [weakState, conn]() {
+    state_->timerId = conn_->getLoop()->runAfter(timeoutSecs_, [weakState, conn]() {
         auto state = weakState.lock();
         if (!state)
             return;
@@ -190,31 +270,22 @@ void TcpConnection::ReadWithTimeoutAwaiter::await_suspend(std::coroutine_handle<
         if (state->resumed.compare_exchange_strong(expected, true))
         {
             state->timedOut = true;
-            conn->channel_->clearReadResumeCallback();
+            conn->readResume_ = nullptr;
+            conn->readTimeoutState_.reset();
             state->handle.resume();
         }
     });
 
-    conn_->channel_->setReadResumeCallback([weakState, conn]() {
-        auto state = weakState.lock();
-        if (!state)
-            return;
-
-        bool expected = false;
-        if (state->resumed.compare_exchange_strong(expected, true))
-        {
-            state->timedOut = false;
-            conn->loop_->cancel(state->timerId);
-            state->handle.resume();
-        }
-    });
+    conn_->readTimeoutState_ = state_;
+    conn_->readResume_ = &TcpConnection::handleReadWithTimeout;
 
     conn_->enableReading();
 }
 
 TcpConnection::ReadResult TcpConnection::ReadWithTimeoutAwaiter::await_resume()
 {
-    conn_->channel_->clearReadResumeCallback();
+    conn_->readResume_ = nullptr;
+    conn_->readTimeoutState_.reset();
 
     if (state_->timedOut)
     {
@@ -222,13 +293,16 @@ TcpConnection::ReadResult TcpConnection::ReadWithTimeoutAwaiter::await_resume()
     }
 
     int savedErrno = 0;
-    ssize_t n = conn_->inputBuffer_.readFd(conn_->channel_->fd(), &savedErrno);
+    ssize_t n = conn_->readInput(&savedErrno);
+    conn_->addTraffic(n);
+    conn_->rearmQuickAck();
+    conn_->chargeBuffers();
 
     if (n == 0)
     {
         conn_->handleClose();
     }
-    else if (n < 0)
+    else if (n < 0 && savedErrno != EAGAIN)
     {
         errno = savedErrno;
         LOG_ERROR << "TcpConnection::ReadWithTimeoutAwaiter error";
@@ -242,7 +316,7 @@ TcpConnection::ReadResult TcpConnection::ReadWithTimeoutAwaiter::await_resume()
 
 bool TcpConnection::WriteAwaiter::await_ready() const
 {
-    return conn_->outputBuffer_.readableBytes() < highWaterMark_ || !conn_->connected();
+    return conn_->pendingOutputBytes() < highWaterMark_ || !conn_->connected();
 }
 
 void TcpConnection::WriteAwaiter::await_suspend(std::coroutine_handle<> h)
@@ -270,19 +344,29 @@ void TcpConnection::send(const std::string &buf)
 
     if (state_ == kConnected)
     {
-        if (loop_->isInLoopThread()) // 这种是对于单个reactor的情况 用户调用conn->send时 loop_即为当前线程
+        if (getLoop()->isInLoopThread()) // 这种是对于单个reactor的情况 用户调用conn->send时 loop_即为当前线程
         {
             sendInLoop(buf.c_str(), buf.size());
         }
         else
         {
-            loop_->runInLoop(
-                std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size()));
+            // 跨线程发送时buf的生命周期无法保证 必须拷贝一份数据交给loop线程
+            getLoop()->runInLoop(
+                [self = shared_from_this(), data = buf]() { self->sendInLoop(data.data(), data.size()); });
         }
     }
     LOG_DEBUG << "TcpConnection::send end";
 }
 
+void TcpConnection::send(Buffer *buf)
+{
+    if (state_ == kConnected)
+    {
+        sendInLoop(buf->peek(), buf->readableBytes());
+    }
+    buf->retrieveAll();
+}
+
 /**
  * 发送数据 应用写的快 而内核发送数据慢 需要把待发送数据写入缓冲区，而且设置了水位回调
  **/
@@ -291,6 +375,13 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     LOG_DEBUG << "TcpConnection::sendInLoop [" << name_.c_str()
               << "] - data size: " << len;
 
+    if (forwardIfMigrated([self = shared_from_this(), data = std::string(static_cast<const char *>(data), len)]() {
+            self->sendInLoop(data.data(), data.size());
+        }))
+    {
+        return;
+    }
+
     ssize_t nwrote = 0;
     size_t remaining = len;
     bool faultError = false;
@@ -298,12 +389,43 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     if (state_ == kDisconnected) // 之前调用过该connection的shutdown 不能再进行发送了
     {
         LOG_ERROR << "disconnected, give up writing";
+        return;
+    }
+
+    // 前面还有排队的共享消息 为了保持顺序只能接在它们后面
+    if (!sharedQueue_.empty())
+    {
+        enqueueShared(std::make_shared<const std::string>(static_cast<const char *>(data), len), 0);
+        return;
+    }
+
+    // TLS握手还没完成 先攒着 握手结束后统一发出
+    if (handshakeCoroutine_)
+    {
+        outputBuffer_.append(static_cast<const char *>(data), len);
+        chargeBuffers();
+        return;
+    }
+
+    // 写合并模式: 先攒在outputBuffer_里 本轮事件循环末尾统一flush
+    // 如果已经在等EPOLLOUT 数据直接排在outputBuffer_后面 由handleWrite发送
+    if (writeCoalescing_)
+    {
+        outputBuffer_.append(static_cast<const char *>(data), len);
+        chargeBuffers();
+        if (!flushScheduled_ && !channel_->isWriting())
+        {
+            flushScheduled_ = true;
+            getLoop()->queueAfterDispatch(std::bind(&TcpConnection::flushCoalesced, shared_from_this()));
+        }
+        return;
     }
 
     // 表示channel_第一次开始写数据或者缓冲区没有待发送数据
     if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        nwrote = userspaceTls() ? writeTls(data, len) : ::write(channel_->fd(), data, len);
+        addTraffic(nwrote);
         if (nwrote >= 0)
         {
             remaining = len - nwrote;
@@ -336,6 +458,7 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     if (!faultError && remaining > 0)
     {
         outputBuffer_.append((char *)data + nwrote, remaining);
+        chargeBuffers();
         if (!channel_->isWriting())
         {
             channel_->enableWriting();
@@ -351,8 +474,8 @@ void TcpConnection::shutdown()
     if (state_ == kConnected)
     {
         setState(kDisconnecting);
-        loop_->runInLoop(
-            std::bind(&TcpConnection::shutdownInLoop, this));
+        getLoop()->runInLoop(
+            std::bind(&TcpConnection::shutdownInLoop, shared_from_this()));
     }
     LOG_DEBUG << "TcpConnection::shutdown end";
 }
@@ -360,25 +483,691 @@ void TcpConnection::shutdown()
 void TcpConnection::shutdownInLoop()
 {
     LOG_DEBUG << "TcpConnection::shutdownInLoop [" << name_.c_str() << "]";
+    if (forwardIfMigrated(std::bind(&TcpConnection::shutdownInLoop, shared_from_this())))
+    {
+        return;
+    }
 
-    if (!channel_->isWriting()) // 说明当前outputBuffer_的数据全部向外发送完成
+    if (!channel_->isWriting() && pendingOutputBytes() == 0) // 说明当前outputBuffer_的数据全部向外发送完成 写合并模式下可能还在等本轮末尾flush
     {
+        if (tlsEstablished_)
+        {
+            tls_->shutdown(); // 先发close_notify
+        }
         socket_->shutdownWrite();
     }
     LOG_DEBUG << "TcpConnection::shutdownInLoop end";
 }
 
+void TcpConnection::setTcpNoDelay(bool on)
+{
+    socket_->setTcpNoDelay(on);
+}
+
+void TcpConnection::applySocketOptions(const SocketOptions &options)
+{
+    bool tcp = !peerAddr_.isUnix();
+    socket_->applyOptions(options, tcp);
+    if (tcp && options.tcpQuickAck)
+    {
+        quickAck_ = *options.tcpQuickAck;
+    }
+}
+
+// 内核在发出一次ACK之后可能重新进入延迟确认模式 开启QUICKACK时每次读之后都要重新设置
+void TcpConnection::rearmQuickAck()
+{
+    if (quickAck_)
+    {
+        socket_->setTcpQuickAck(true);
+    }
+}
+
+void TcpConnection::setWriteCoalescing(bool on)
+{
+    writeCoalescing_ = on;
+    if (!on)
+    {
+        flushCoalesced();
+    }
+}
+
+bool TcpConnection::enableMirroredBuffers(size_t capacity)
+{
+    bool ok = inputBuffer_.enableMirroredRing(capacity);
+    ok = outputBuffer_.enableMirroredRing(capacity) && ok;
+    if (!ok)
+    {
+        LOG_WARN << "TcpConnection::enableMirroredBuffers [" << name_ << "] failed, errno=" << errno;
+    }
+    return ok;
+}
+
+void TcpConnection::flushCoalesced()
+{
+    if (forwardIfMigrated(std::bind(&TcpConnection::flushCoalesced, shared_from_this())))
+    {
+        return;
+    }
+    flushScheduled_ = false;
+    // 正在等EPOLLOUT时由handleWrite负责发送
+    if (state_ == kDisconnected || channel_->isWriting() || handshakeCoroutine_ || pendingOutputBytes() == 0)
+    {
+        return;
+    }
+
+    int savedErrno = 0;
+    ssize_t n = writeOutput(&savedErrno);
+    if (n < 0 && savedErrno != EWOULDBLOCK)
+    {
+        LOG_ERROR << "TcpConnection::flushCoalesced errno=" << savedErrno;
+        if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+        {
+            // 对端已经关闭 数据不可能再发出去 连接关闭由后续的EPOLLHUP/读0处理
+            outputBuffer_.retrieveAll();
+            sharedQueue_.clear();
+            sharedQueueOffset_ = 0;
+            sharedQueueBytes_ = 0;
+            return;
+        }
+    }
+
+    if (pendingOutputBytes() > 0)
+    {
+        channel_->enableWriting(); // 内核发送缓冲区满了 剩下的交给handleWrite
+    }
+    else if (state_ == kDisconnecting)
+    {
+        shutdownInLoop();
+    }
+}
+
+bool TcpConnection::peerCredentials(ucred *cred) const
+{
+    if (!peerAddr_.isUnix())
+    {
+        return false;
+    }
+    return socket_->getPeerCred(cred);
+}
+
+// ================= 共享消息 =================
+
+void TcpConnection::sendShared(const SharedMessage &msg)
+{
+    if (!getLoop()->isInLoopThread())
+    {
+        getLoop()->runInLoop([self = shared_from_this(), msg]() { self->sendShared(msg); });
+        return;
+    }
+    if (state_ != kConnected || msg->empty())
+    {
+        return;
+    }
+
+    size_t offset = 0;
+    if (!writeCoalescing_ && !channel_->isWriting() && !handshakeCoroutine_ && pendingOutputBytes() == 0)
+    {
+        ssize_t n = userspaceTls() ? writeTls(msg->data(), msg->size())
+                                   : ::send(channel_->fd(), msg->data(), msg->size(), MSG_NOSIGNAL);
+        addTraffic(n);
+        if (n > 0)
+        {
+            offset = n;
+        }
+        else if (n < 0 && errno != EWOULDBLOCK)
+        {
+            LOG_ERROR << "TcpConnection::sendShared [" << name_ << "] errno=" << errno;
+            return; // 连接关闭由后续的EPOLLHUP/读0处理
+        }
+    }
+    if (offset < msg->size())
+    {
+        enqueueShared(msg, offset);
+    }
+}
+
+void TcpConnection::enqueueShared(SharedMessage msg, size_t offset)
+{
+    if (sharedQueue_.empty())
+    {
+        sharedQueueOffset_ = offset;
+    }
+    sharedQueueBytes_ += msg->size() - offset;
+    sharedQueue_.push_back(std::move(msg));
+
+    if (channel_->isWriting() || handshakeCoroutine_)
+    {
+        return; // handleWrite会接着发 TLS握手期间等握手结束
+    }
+    if (writeCoalescing_)
+    {
+        if (!flushScheduled_)
+        {
+            flushScheduled_ = true;
+            getLoop()->queueAfterDispatch(std::bind(&TcpConnection::flushCoalesced, shared_from_this()));
+        }
+        return;
+    }
+    channel_->enableWriting();
+}
+
+size_t TcpConnection::dropQueuedShared(size_t bytes)
+{
+    // 队头可能已经发出去一部分 必须保留 否则对端会收到半条消息
+    size_t dropped = 0;
+    size_t freed = 0;
+    auto it = sharedQueue_.begin();
+    if (it != sharedQueue_.end() && (sharedQueueOffset_ > 0 || outputBuffer_.readableBytes() > 0))
+    {
+        ++it;
+    }
+    while (it != sharedQueue_.end() && freed < bytes)
+    {
+        bool front = (it == sharedQueue_.begin());
+        size_t len = (*it)->size() - (front ? sharedQueueOffset_ : 0);
+        freed += len;
+        sharedQueueBytes_ -= len;
+        if (front)
+        {
+            sharedQueueOffset_ = 0;
+        }
+        it = sharedQueue_.erase(it);
+        ++dropped;
+    }
+    return dropped;
+}
+
+// outputBuffer_在前 共享消息在后 用一次writev发出去
+ssize_t TcpConnection::writeOutput(int *savedErrno)
+{
+    static const int kMaxIov = 64;
+    iovec iov[kMaxIov];
+    int iovcnt = 0;
+    if (outputBuffer_.readableBytes() > 0)
+    {
+        iov[iovcnt].iov_base = const_cast<char *>(outputBuffer_.peek());
+        iov[iovcnt].iov_len = outputBuffer_.readableBytes();
+        ++iovcnt;
+    }
+    size_t offset = sharedQueueOffset_;
+    for (auto it = sharedQueue_.begin(); it != sharedQueue_.end() && iovcnt < kMaxIov; ++it)
+    {
+        iov[iovcnt].iov_base = const_cast<char *>((*it)->data()) + offset;
+        iov[iovcnt].iov_len = (*it)->size() - offset;
+        ++iovcnt;
+        offset = 0;
+    }
+    if (iovcnt == 0)
+    {
+        return 0;
+    }
+
+    ssize_t n = 0;
+    if (userspaceTls())
+    {
+        // SSL_write没有writev 逐段加密发送 某一段没发完就停下
+        for (int i = 0; i < iovcnt; ++i)
+        {
+            ssize_t w = writeTls(iov[i].iov_base, iov[i].iov_len);
+            if (w < 0)
+            {
+                n = n > 0 ? n : w;
+                break;
+            }
+            n += w;
+            if (static_cast<size_t>(w) < iov[i].iov_len)
+            {
+                break;
+            }
+        }
+    }
+    else
+    {
+        n = ::writev(channel_->fd(), iov, iovcnt);
+    }
+    if (n < 0)
+    {
+        *savedErrno = errno;
+        return n;
+    }
+    addTraffic(n);
+
+    size_t left = n;
+    size_t fromBuffer = std::min(left, outputBuffer_.readableBytes());
+    outputBuffer_.retrieve(fromBuffer);
+    left -= fromBuffer;
+    sharedQueueBytes_ -= left;
+    while (left > 0)
+    {
+        size_t avail = sharedQueue_.front()->size() - sharedQueueOffset_;
+        if (left < avail)
+        {
+            sharedQueueOffset_ += left;
+            break;
+        }
+        left -= avail;
+        sharedQueue_.pop_front();
+        sharedQueueOffset_ = 0;
+    }
+    return n;
+}
+
+// ================= 缓冲区内存预算 =================
+
+void TcpConnection::chargeBuffers()
+{
+    size_t held = inputBuffer_.capacity() + outputBuffer_.capacity();
+    BufferBudget &budget = BufferBudget::global();
+    if (held != bufferBytes_)
+    {
+        budget.charge(getLoop(), static_cast<int64_t>(held) - static_cast<int64_t>(bufferBytes_));
+        bufferBytes_ = held;
+    }
+    if (budget.exceeded())
+    {
+        shrinkBuffers();
+        // readAtLeast还没凑够时暂停读只会让协程永远等不到数据 帧长度的上限由业务自己校验
+        bool framePending = readUntil_ || (readAtLeast_ > 0 && inputBuffer_.readableBytes() < readAtLeast_);
+        if (!budgetPaused_ && !framePending && budget.shouldPause(bufferBytes_))
+        {
+            pauseForBudget();
+        }
+    }
+}
+
+void TcpConnection::shrinkBuffers()
+{
+    // sweepBuffers投递之后连接可能已经迁走 缓冲区只能在当前所属loop上动
+    if (forwardIfMigrated(std::bind(&TcpConnection::shrinkBuffers, shared_from_this())))
+    {
+        return;
+    }
+    const size_t idleCapacity = Buffer::kCheapPrepend + Buffer::kInitialSize;
+    bool shrunk = false;
+    if (inputBuffer_.readableBytes() == 0 && inputBuffer_.capacity() > idleCapacity)
+    {
+        inputBuffer_.shrink(Buffer::kInitialSize);
+        shrunk = true;
+    }
+    if (outputBuffer_.readableBytes() == 0 && outputBuffer_.capacity() > idleCapacity)
+    {
+        outputBuffer_.shrink(Buffer::kInitialSize);
+        shrunk = true;
+    }
+    if (shrunk)
+    {
+        size_t held = inputBuffer_.capacity() + outputBuffer_.capacity();
+        BufferBudget::global().charge(getLoop(), static_cast<int64_t>(held) - static_cast<int64_t>(bufferBytes_));
+        bufferBytes_ = held;
+    }
+}
+
+// 停止监听读事件 客户端的数据留在内核缓冲区 由TCP流控把压力传回对端
+void TcpConnection::pauseForBudget()
+{
+    budgetPaused_ = true;
+    BufferBudget::global().pausedChanged(1);
+    disableReading();
+    LOG_WARN << "TcpConnection [" << name_ << "] buffer budget exceeded, pause reading (holding "
+             << bufferBytes_ << " bytes)";
+
+    std::weak_ptr<TcpConnection> weakThis = shared_from_this();
+    getLoop()->runAfter(kBudgetRecheckInterval, [weakThis]() {
+        if (auto conn = weakThis.lock())
+        {
+            conn->checkBudgetResume();
+        }
+    });
+}
+
+void TcpConnection::checkBudgetResume()
+{
+    if (forwardIfMigrated(std::bind(&TcpConnection::checkBudgetResume, shared_from_this())))
+    {
+        return;
+    }
+    if (!budgetPaused_ || state_ == kDisconnected)
+    {
+        return;
+    }
+    BufferBudget &budget = BufferBudget::global();
+    if (!budget.belowResumeMark())
+    {
+        std::weak_ptr<TcpConnection> weakThis = shared_from_this();
+        getLoop()->runAfter(kBudgetRecheckInterval, [weakThis]() {
+            if (auto conn = weakThis.lock())
+            {
+                conn->checkBudgetResume();
+            }
+        });
+        return;
+    }
+
+    budgetPaused_ = false;
+    budget.pausedChanged(-1);
+    LOG_INFO << "TcpConnection [" << name_ << "] buffer budget recovered, resume reading";
+    // 有协程挂起在读上才需要重新开启 否则等下一次co_await read()
+    if (channel_->readCoroutine() || readResume_)
+    {
+        enableReading();
+    }
+}
+
+// ================= TLS =================
+
+bool TcpConnection::TlsHandshakeAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    TcpConnection *conn = conn_;
+    if (!conn->connected() || conn->tls_ || ctx_ == nullptr || !ctx_->valid())
+    {
+        return false; // 已经开启过TLS时await_resume返回之前的结果
+    }
+    conn->tls_.reset(new TlsSession(ctx_, conn->channel_->fd(), serverName_));
+    if (!conn->tls_->valid())
+    {
+        conn->tls_.reset();
+        return false;
+    }
+    conn->handshakeCoroutine_ = h;
+    conn->readResume_ = &TcpConnection::continueHandshake;
+    if (conn->stepHandshake())
+    {
+        conn->handshakeCoroutine_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool TcpConnection::stepHandshake()
+{
+    TlsSession::Status status = tls_->handshake();
+    if (status == TlsSession::kWantRead || status == TlsSession::kWantWrite)
+    {
+        // 握手期间的EPOLLOUT只用来推进握手 send攒下的数据等握手结束再开写事件
+        if (status == TlsSession::kWantWrite)
+        {
+            channel_->enableWriting();
+        }
+        else if (channel_->isWriting())
+        {
+            channel_->disableWriting();
+        }
+        enableReading();
+        return false;
+    }
+
+    readResume_ = nullptr;
+    if (status == TlsSession::kFailed)
+    {
+        channel_->disableWriting();
+        forceClose();
+        return true;
+    }
+
+    tlsEstablished_ = true;
+    LOG_INFO << "TcpConnection [" << name_ << "] TLS established " << tls_->version() << " " << tls_->cipher()
+             << " ktls send=" << tls_->kernelSend() << " recv=" << tls_->kernelRecv();
+    if (pendingOutputBytes() > 0)
+    {
+        channel_->enableWriting();
+    }
+    else if (channel_->isWriting())
+    {
+        channel_->disableWriting();
+    }
+    // 对端紧跟在握手后面发来的数据可能已经被OpenSSL读走 epoll不会再通知
+    if (tls_->hasPending())
+    {
+        int savedErrno = 0;
+        addTraffic(readInput(&savedErrno));
+        chargeBuffers();
+    }
+    return true;
+}
+
+void TcpConnection::continueHandshake()
+{
+    if (!handshakeCoroutine_ || !stepHandshake())
+    {
+        return;
+    }
+    auto co = handshakeCoroutine_;
+    handshakeCoroutine_ = nullptr;
+    co.resume();
+}
+
+void TcpConnection::onWritable()
+{
+    if (handshakeCoroutine_)
+    {
+        continueHandshake();
+    }
+    else
+    {
+        handleWrite();
+    }
+}
+
+bool TcpConnection::kernelTls() const
+{
+    return tlsEstablished_ && tls_->kernelSend();
+}
+
+bool TcpConnection::userspaceTls() const
+{
+    return tls_ && !tls_->kernelSend();
+}
+
+// 接收方向即使进了内核也通过SSL_read读: 内核把非应用数据的记录(alert、TLS1.3的NewSessionTicket等)交给OpenSSL处理
+ssize_t TcpConnection::readInput(int *savedErrno)
+{
+    if (tls_)
+    {
+        return tls_->read(&inputBuffer_, savedErrno);
+    }
+    return inputBuffer_.readFd(channel_->fd(), savedErrno);
+}
+
+// 失败时与write一样设置errno
+ssize_t TcpConnection::writeTls(const void *data, size_t len)
+{
+    int savedErrno = 0;
+    return tls_->write(data, len, &savedErrno);
+}
+
+ssize_t TcpConnection::sendFileChunk(int fileFd, off_t *offset, size_t count)
+{
+    if (!userspaceTls())
+    {
+        return ::sendfile(socket_->fd(), fileFd, offset, count); // 明文或者kTLS 由内核读文件并加密
+    }
+
+    // 用户态加密只能先把文件读上来 每次一条TLS记录大小
+    // EAGAIN之后从同一个offset重读同样长度的数据重试 满足SSL_write的重试要求
+    static const size_t kChunk = 16 * 1024;
+    static const size_t kMaxPerCall = 256 * 1024; // 一次可写事件最多发这么多 不让单个连接占住loop
+    char buf[kChunk];
+    ssize_t total = 0;
+    while (count > 0 && static_cast<size_t>(total) < kMaxPerCall)
+    {
+        ssize_t n = ::pread(fileFd, buf, std::min(count, kChunk), *offset);
+        if (n <= 0)
+        {
+            return total > 0 ? total : n;
+        }
+        ssize_t w = writeTls(buf, n);
+        if (w < 0)
+        {
+            return total > 0 ? total : w;
+        }
+        *offset += w;
+        count -= w;
+        total += w;
+        if (w < n)
+        {
+            break;
+        }
+    }
+    return total;
+}
+
+// ================= 连接迁移 =================
+
+bool TcpConnection::forwardIfMigrated(std::function<void()> f)
+{
+    EventLoop *loop = getLoop();
+    if (loop->isInLoopThread())
+    {
+        return false;
+    }
+    loop->queueInLoop(std::move(f));
+    return true;
+}
+
+void TcpConnection::addCloseObserver(const CloseCallback &cb)
+{
+    getLoop()->runInLoop([self = shared_from_this(), cb]() {
+        if (self->forwardIfMigrated([self, cb]() { self->addCloseObserver(cb); }))
+        {
+            return;
+        }
+        if (self->state_ == kDisconnected)
+        {
+            cb(self);
+            return;
+        }
+        self->closeObservers_.push_back(cb);
+    });
+}
+
+void TcpConnection::notifyCloseObservers()
+{
+    std::vector<CloseCallback> observers;
+    observers.swap(closeObservers_);
+    TcpConnectionPtr guardThis(shared_from_this());
+    for (auto &cb : observers)
+    {
+        cb(guardThis);
+    }
+}
+
+void TcpConnection::migrateTo(EventLoop *target)
+{
+    getLoop()->runInLoop([self = shared_from_this(), target]() {
+        if (self->forwardIfMigrated([self, target]() { self->migrateTo(target); }))
+        {
+            return;
+        }
+        // 会话协程不在连接自己的awaiter上时 它会在原loop恢复 不能迁移
+        Channel *channel = self->channel_.get();
+        if (!channel->readCoroutine() && !self->readAtLeastCoroutine_ && !self->writeCoroutine_)
+        {
+            LOG_WARN << "TcpConnection::migrate [" << self->name_ << "] not at a safe point, skip";
+            return;
+        }
+        self->migrateInLoop(target, nullptr);
+    });
+}
+
+bool TcpConnection::MigrateAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    // 协程已经挂起 此时原loop线程上没有任何针对该连接的代码在运行 可以安全地摘下Channel
+    // 成功后协程可能已经在新loop线程中恢复 awaiter属于协程帧 之后不能再访问成员
+    ok_ = true;
+    if (!conn_->migrateInLoop(target_, h))
+    {
+        ok_ = false;
+        return false; // 失败时不挂起 直接在原loop继续执行
+    }
+    return true;
+}
+
+bool TcpConnection::migrateInLoop(EventLoop *target, std::coroutine_handle<> resumeOnTarget)
+{
+    EventLoop *from = getLoop();
+    if (target == nullptr || target == from || state_ != kConnected)
+    {
+        return false;
+    }
+    // sendfile的进度和readWithTimeout的定时器都绑定在原loop上 不能迁移 TLS握手也要在同一个loop里做完
+    // busy: 有协程挂在WorkerPool/定时器等别处 会在原loop上恢复
+    if (busy_ > 0 || sendFileFd_ >= 0 || handshakeCoroutine_ || (readResume_ && readResume_ != &TcpConnection::handleReadAtLeast))
+    {
+        LOG_WARN << "TcpConnection::migrate [" << name_ << "] busy, skip";
+        return false;
+    }
+
+    // 本轮积攒的合并写先发出去 之后原loop上残留的flush回调会被转发
+    flushCoalesced();
+
+    TcpConnectionPtr guardThis(shared_from_this());
+    int events = channel_->events();
+    channel_->disableAll();
+    channel_->remove();
+    channel_->moveToLoop(target);
+    loop_.store(target, std::memory_order_release);
+    from->addBufferBytes(-static_cast<int64_t>(bufferBytes_));
+    target->addBufferBytes(bufferBytes_);
+
+    // 先通知上层 保证TcpServer中"迁移"的记录排在这个连接之后任何"关闭"记录之前
+    if (migrateCallback_)
+    {
+        migrateCallback_(guardThis, from, target);
+    }
+
+    target->queueInLoop([guardThis, events, resumeOnTarget]() {
+        if (guardThis->state_ != kDisconnected && events != 0)
+        {
+            guardThis->channel_->enableEvents(events);
+        }
+        if (resumeOnTarget)
+        {
+            resumeOnTarget.resume();
+        }
+    });
+    LOG_INFO << "TcpConnection::migrate [" << name_ << "] done";
+    return true;
+}
+
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        getLoop()->queueInLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (forwardIfMigrated(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this())))
+    {
+        return;
+    }
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose();
+    }
+}
+
 // 连接建立
 void TcpConnection::connectEstablished()
 {
     LOG_DEBUG << "TcpConnection::connectEstablished [" << name_.c_str() << "]";
 
     setState(kConnected);
-    channel_->tie(shared_from_this());
+    selfRef_ = shared_from_this(); // 从这里开始channel会出现在Poller中
+    BufferBudget::global().connectionAttached();
+    chargeBuffers();
     channel_->enableReading(); // 向poller注册channel的EPOLLIN读事件
 
     // 新连接建立 执行回调
-    connectionCallback_(shared_from_this());
+    if (connectionCallback_)
+    {
+        connectionCallback_(shared_from_this());
+    }
     LOG_DEBUG << "TcpConnection::connectEstablished end";
 }
 // 连接销毁
@@ -390,14 +1179,31 @@ void TcpConnection::connectDestroyed()
     {
         setState(kDisconnected);
         channel_->disableAll(); // 把channel的所有感兴趣的事件从poller中删除掉
-        connectionCallback_(shared_from_this());
+        if (connectionCallback_)
+        {
+            connectionCallback_(shared_from_this());
+        }
+        notifyCloseObservers();
     }
     channel_->remove(); // 把channel从poller中删除掉
+    if (selfRef_)
+    {
+        BufferBudget &budget = BufferBudget::global();
+        if (budgetPaused_)
+        {
+            budgetPaused_ = false;
+            budget.pausedChanged(-1);
+        }
+        budget.charge(getLoop(), -static_cast<int64_t>(bufferBytes_));
+        bufferBytes_ = 0;
+        budget.connectionDetached();
+    }
+    selfRef_.reset();   // 调用方(TcpServer/TcpClient)持有conn 这里释放不会立即析构
     LOG_DEBUG << "TcpConnection::connectDestroyed end";
 }
 
 // // 读是相对服务器而言的 当对端客户端有数据到达 服务器端检测到EPOLLIN 就会触发该fd上的回调 handleRead取读走对端发来的数据
-// void TcpConnection::handleRead(Timestamp receiveTime)
+// void TcpConnection::handleRead(Timestamp /*receiveTime*/)
 // {
 //     // [调试] 确认 Epoll 是否真的触发了
 //     LOG_DEBUG << "handleRead called! fd=" << channel_->fd();
@@ -459,15 +1265,140 @@ void TcpConnection::connectDestroyed()
 //     }
 // }
 
+void TcpConnection::onReadable(Timestamp receiveTime)
+{
+    if (readResume_)
+    {
+        (this->*readResume_)();
+    }
+    else
+    {
+        handleRead(receiveTime);
+    }
+}
+
+void TcpConnection::onHangup()
+{
+    // 自定义读处理会读到0并走关闭流程
+    if (readResume_)
+    {
+        (this->*readResume_)();
+    }
+    else
+    {
+        handleClose();
+    }
+}
+
+// readWithTimeout 挂起期间的读事件 和超时定时器谁先到谁恢复协程
+void TcpConnection::handleReadWithTimeout()
+{
+    std::shared_ptr<ReadWithTimeoutAwaiter::State> state = readTimeoutState_; // resume期间保持存活
+    if (!state)
+    {
+        return;
+    }
+    bool expected = false;
+    if (state->resumed.compare_exchange_strong(expected, true))
+    {
+        state->timedOut = false;
+        getLoop()->cancel(state->timerId);
+        state->handle.resume();
+    }
+}
+
+/**
+ * 读事件到达时没有协程在 co_await read()，Poller工作在LT模式 不处理会一直触发
+ * 先停止监听读事件 数据留在内核缓冲区 等下一次 co_await read() 再重新开启
+ **/
+void TcpConnection::handleRead(Timestamp /*receiveTime*/)
+{
+    LOG_DEBUG << "TcpConnection::handleRead no reader, pause reading fd=" << channel_->fd();
+    disableReading();
+}
+
+/**
+ * readAtLeast/readUntil 挂起期间的读事件 数据读进 inputBuffer_ 后判断是否凑够
+ * readAtLeast没凑够说明 SO_RCVLOWAT 没有生效(被内核截断 或者协议不支持) 调低水位后继续等待 协程保持挂起
+ * readUntil由调用方的谓词判断 没满足时同样保持挂起
+ **/
+void TcpConnection::handleReadAtLeast()
+{
+    int savedErrno = 0;
+    ssize_t n = readInput(&savedErrno);
+    addTraffic(n);
+    rearmQuickAck();
+    chargeBuffers();
+    if (n == 0)
+    {
+        handleClose(); // 会唤醒挂起的协程
+        return;
+    }
+    if (n < 0)
+    {
+        if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+        {
+            return;
+        }
+        // 读出错后连接不能再用 先进入关闭状态再唤醒协程(handleClose会唤醒)
+        // 否则readExactly返回空串时connected()仍为true 调用方的while(connected())会原地打转
+        errno = savedErrno;
+        LOG_ERROR << "TcpConnection::handleReadAtLeast error";
+        handleError();
+        handleClose();
+        return;
+    }
+    if (!readSatisfied())
+    {
+        if (readAtLeast_ > 0)
+        {
+            setRecvLowat(readAtLeast_ - inputBuffer_.readableBytes());
+        }
+        return;
+    }
+
+    readResume_ = nullptr;
+    auto co = readAtLeastCoroutine_;
+    readAtLeastCoroutine_ = nullptr;
+    if (co)
+    {
+        co.resume();
+    }
+}
+
+bool TcpConnection::readSatisfied()
+{
+    if (readUntil_)
+    {
+        return readUntil_(&inputBuffer_);
+    }
+    return inputBuffer_.readableBytes() >= readAtLeast_;
+}
+
+void TcpConnection::setRecvLowat(size_t bytes)
+{
+    // 超过INT_MAX没有意义 内核本身也会限制在接收缓冲区的一半
+    int lowat = static_cast<int>(std::min<size_t>(bytes, 1 << 30));
+    if (lowat < 1)
+    {
+        lowat = 1;
+    }
+    if (lowat != rcvLowat_ && socket_->setRecvLowat(lowat))
+    {
+        rcvLowat_ = lowat;
+    }
+}
+
 void TcpConnection::handleWrite()
 {
     LOG_DEBUG << "TcpConnection::handleWrite [" << name_.c_str() << "]";
 
     if (channel_->isWriting())
     {
-        if (sendFileFd_ >= 0 && sendFileRemaining_ > 0)
+        // sendFile之前排队的数据要先发完
+        if (sendFileFd_ >= 0 && sendFileRemaining_ > 0 && pendingOutputBytes() == 0)
         {
-            ssize_t n = ::sendfile(socket_->fd(), sendFileFd_, &sendFileOffset_, sendFileRemaining_);
+            ssize_t n = sendFileChunk(sendFileFd_, &sendFileOffset_, sendFileRemaining_);
             if (n > 0)
             {
                 sendFileRemaining_ -= n;
@@ -489,7 +1420,7 @@ void TcpConnection::handleWrite()
                     shutdownInLoop();
                 }
             }
-            else if (n < 0 && errno != EWOULDBLOCK && errno != EAGAIN)
+            else if (n == 0 || (n < 0 && errno != EWOULDBLOCK && errno != EAGAIN))
             {
                 LOG_ERROR << "TcpConnection::handleWrite sendfile error";
                 channel_->disableWriting();
@@ -505,11 +1436,14 @@ void TcpConnection::handleWrite()
         }
 
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+        ssize_t n = writeOutput(&savedErrno);
+        if (n > 0 && sendFileFd_ >= 0)
+        {
+            return; // 挂起的是sendFile协程 发完排队数据后下一次可写事件开始sendfile
+        }
         if (n > 0)
         {
-            outputBuffer_.retrieve(n);
-            size_t remaining = outputBuffer_.readableBytes();
+            size_t remaining = pendingOutputBytes();
 
             bool shouldResume = false;
             if (writeResumeThreshold_ > 0)
@@ -558,10 +1492,26 @@ void TcpConnection::handleClose()
 
     TcpConnectionPtr guardThis(shared_from_this());
 
-    channel_->clearReadCoroutine();
-    channel_->clearReadResumeCallback();
+    readResume_ = nullptr;
 
     sendFileFd_ = -1;
+
+    // 还挂起在 read() 上的协程(例如被 forceClose 关闭)需要唤醒 否则协程帧和连接都会泄漏
+    if (auto readCo = channel_->readCoroutine())
+    {
+        channel_->clearReadCoroutine();
+        readCo.resume();
+    }
+    if (auto readCo = readAtLeastCoroutine_)
+    {
+        readAtLeastCoroutine_ = nullptr;
+        readCo.resume();
+    }
+    if (auto tlsCo = handshakeCoroutine_) // startTls返回false
+    {
+        handshakeCoroutine_ = nullptr;
+        tlsCo.resume();
+    }
     sendFileRemaining_ = 0;
 
     if (writeCoroutine_)
@@ -576,6 +1526,7 @@ void TcpConnection::handleClose()
     {
         connectionCallback_(guardThis);
     }
+    notifyCloseObservers();
     if (closeCallback_)
     {
         closeCallback_(guardThis);
@@ -604,6 +1555,10 @@ void TcpConnection::handleError()
 void TcpConnection::enableReading()
 {
     LOG_DEBUG << "TcpConnection::enableReading start";
+    if (budgetPaused_)
+    {
+        return; // 预算恢复后由checkBudgetResume重新开启
+    }
     if (!channel_->isReading())
         channel_->enableReading();
     LOG_DEBUG << "TcpConnection::enableReading end";
@@ -614,4 +1569,11 @@ void TcpConnection::enableWriting()
     if (!channel_->isWriting())
         channel_->enableWriting();
     LOG_DEBUG << "TcpConnection::enableWriting end";
+}
+void TcpConnection::disableReading()
+{
+    LOG_DEBUG << "TcpConnection::disableReading start";
+    if (channel_->isReading())
+        channel_->disableReading();
+    LOG_DEBUG << "TcpConnection::disableReading end";
 }
\ No newline at end of file
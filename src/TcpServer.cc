@@ -4,171 +4,196 @@
 #include <TcpServer.h>
 #include <Logger.h>
 #include <TcpConnection.h>
-
-static EventLoop *CheckLoopNotNull(EventLoop *loop)
-{
-    LOG_DEBUG << "CheckLoopNotNull start";
-    if (loop == nullptr)
-    {
-        LOG_FATAL << "main Loop is NULL!";
-    }
-    LOG_DEBUG << "CheckLoopNotNull end";
-    return loop;
-}
+#include <BufferBudget.h>
 
 TcpServer::TcpServer(EventLoop *loop,
                      const InetAddress &listenAddr,
                      const std::string &nameArg,
                      Option option)
-    : loop_(CheckLoopNotNull(loop)), ipPort_(listenAddr.toIpPort()), name_(nameArg), acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)), threadPool_(new EventLoopThreadPool(loop, name_)), connectionCallback_(), messageCallback_(), nextConnId_(1), started_(0)
+    : TcpServerBase(loop, listenAddr, nameArg, option == kReusePort), connectionCallback_(), messageCallback_(), imbalanceRatio_(2.0), rebalanceArmed_(false), sweepArmed_(false)
 {
-    LOG_DEBUG << "TcpServer::TcpServer start";
-    // // 当有新用户连接时，Acceptor类中绑定的acceptChannel_会有读事件发生，执行handleRead()调用TcpServer::newConnection回调
-    // acceptor_->setNewConnectionCallback(
-    //     std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
-    LOG_DEBUG << "TcpServer::TcpServer end";
 }
 
 TcpServer::~TcpServer()
 {
     LOG_DEBUG << "TcpServer::~TcpServer start";
-    for (auto &item : connections_)
+    if (rebalanceArmed_)
+    {
+        loop_->cancel(rebalanceTimer_);
+    }
+    if (sweepArmed_)
     {
-        TcpConnectionPtr conn(item.second);
-        item.second.reset(); // 把原始的智能指针复位 让栈空间的TcpConnectionPtr conn指向该对象 当conn出了其作用域 即可释放智能指针指向的对象
-        // 销毁连接
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestroyed, conn));
+        loop_->cancel(sweepTimer_);
     }
     LOG_DEBUG << "TcpServer::~TcpServer end";
 }
 
-// 设置底层subloop的个数
-void TcpServer::setThreadNum(int numThreads)
+bool TcpServer::setTuningProfile(const std::string &profile)
 {
-    LOG_DEBUG << "TcpServer::setThreadNum [" << name_.c_str() << "] threads " << numThreads;
-
-    int numThreads_ = numThreads;
-    threadPool_->setThreadNum(numThreads_);
-    LOG_DEBUG << "TcpServer::setThreadNum end";
+    SocketOptions options;
+    if (!SocketOptions::fromProfile(profile, &options))
+    {
+        LOG_ERROR << "TcpServer::setTuningProfile unknown profile " << profile;
+        return false;
+    }
+    setSocketOptions(options);
+    return true;
 }
 
 // 开启服务器监听
 void TcpServer::start()
 {
     LOG_DEBUG << "TcpServer::start [" << name_.c_str() << "] starting";
+    startServer(threadInitCallback_); // 启动底层的loop线程池 在baseLoop中开始accept
+}
 
-    if (started_.fetch_add(1) == 0) // 防止一个TcpServer对象被start多次
-    {
-        threadPool_->start(threadInitCallback_); // 启动底层的loop线程池
-        loop_->runInLoop([this]()
-                         {
-            acceptor_->listen();
-            // [新增] 启动 Accept 协程
-            acceptLoop(); });
-        LOG_DEBUG << "TcpServer::start end";
-    }
+void TcpServer::setupConnection(const TcpConnectionPtr &conn)
+{
+    // 连接建立/断开都通过connectionCallback_通知用户 关闭回调沿用TcpServerBase::removeConnection
+    conn->setConnectionCallback(connectionCallback_);
 }
 
-// [新增] Accept 协程：永不停止的循环
-Task TcpServer::acceptLoop()
+void TcpServer::connectionRemoved(const TcpConnectionPtr &conn)
 {
-    LOG_DEBUG << "TcpServer::acceptLoop start";
-    LOG_INFO << "AcceptLoop coroutine started";
+    lastBytes_.erase(conn->name());
+}
 
-    // 只要服务器在运行
-    while (true)
-    {
-        // 1. [挂起] 等待新连接
-        // 这一步会把协程句柄注册到 Acceptor 的 Channel 里
-        auto [connfd, peerAddr, err] = co_await acceptor_->accept();
+// ================= 连接迁移与负载均衡 =================
 
-        // 2. [恢复] 收到新连接
-        if (connfd >= 0)
-        {
-            if (started_ > 0) // 简单的运行状态检查
-            {
-                handleNewConnection(connfd, peerAddr);
-            }
-            else
-            {
-                ::close(connfd);
-            }
-        }
-        else
-        {
-            LOG_ERROR << "accept error: " << err;
-            // 可以在这里处理 EMFILE (文件描述符耗尽) 等情况
-            if (err == EMFILE)
-            {
-                ::sleep(1); // 简单的缓流策略
-            }
-        }
+// 计数已经由TcpServerBase更新 这里只通知用户
+void TcpServer::connectionMigrated(const TcpConnectionPtr &conn, EventLoop *from, EventLoop *to)
+{
+    if (migrateCallback_)
+    {
+        migrateCallback_(conn, from, to);
     }
+}
 
-    LOG_DEBUG << "AcceptLoop coroutine ended";
+void TcpServer::enableRebalancing(double intervalSecs, double imbalanceRatio)
+{
+    imbalanceRatio_ = imbalanceRatio;
+    if (rebalanceArmed_)
+    {
+        loop_->cancel(rebalanceTimer_);
+    }
+    rebalanceArmed_ = true;
+    rebalanceTimer_ = loop_->runEvery(intervalSecs, std::bind(&TcpServer::rebalance, this));
 }
 
-// 有一个新用户连接，acceptor会执行这个回调操作，负责将mainLoop接收到的请求连接(acceptChannel_会有读事件发生)通过回调轮询分发给subLoop去处理
-void TcpServer::handleNewConnection(int sockfd, const InetAddress &peerAddr)
+void TcpServer::rebalance()
 {
-    LOG_DEBUG << "TcpServer::handleNewConnection " << peerAddr.toIpPort().c_str();
-
-    // 轮询算法 选择一个subLoop 来管理connfd对应的channel
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_; // 这里没有设置为原子类是因为其只在mainloop中执行 不涉及线程安全问题
-    std::string connName = name_ + buf;
-
-    LOG_INFO << "TcpServer::newConnection [" << name_.c_str() << "]- new connection [" << connName.c_str() << "]from " << peerAddr.toIpPort().c_str();
-
-    // 通过sockfd获取其绑定的本机的ip地址和端口信息
-    sockaddr_in local;
-    ::memset(&local, 0, sizeof(local));
-    socklen_t addrlen = sizeof(local);
-    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    if (loops.size() < 2)
     {
-        LOG_ERROR << "sockets::getLocalAddr";
+        return;
     }
 
-    InetAddress localAddr(local);
-    TcpConnectionPtr conn(new TcpConnection(ioLoop,
-                                            connName,
-                                            sockfd,
-                                            localAddr,
-                                            peerAddr));
-    connections_[connName] = conn;
-    conn->setConnectionCallback(connectionCallback_);
+    struct LoopLoad
+    {
+        uint64_t bytes = 0;
+        size_t conns = 0;
+    };
+    std::unordered_map<EventLoop *, LoopLoad> loads;
+    for (EventLoop *loop : loops)
+    {
+        loads[loop];
+    }
 
-    // 设置了如何关闭连接的回调
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
+    // 每个连接这一轮的增量 同时记下所属loop 选迁移对象时再用
+    std::vector<std::pair<TcpConnectionPtr, uint64_t>> deltas;
+    deltas.reserve(connections_.size());
+    for (auto &item : connections_)
+    {
+        const TcpConnectionPtr &conn = item.second;
+        uint64_t total = conn->bytesTransferred();
+        uint64_t &last = lastBytes_[item.first];
+        uint64_t delta = total - last;
+        last = total;
+
+        auto it = loads.find(conn->getLoop());
+        if (it == loads.end())
+        {
+            continue; // 在retiring的loop上 不参与均衡
+        }
+        it->second.bytes += delta;
+        ++it->second.conns;
+        deltas.emplace_back(conn, delta);
+    }
 
-    ioLoop->runInLoop(
-        std::bind(&TcpConnection::connectEstablished, conn));
+    EventLoop *hot = loops[0];
+    EventLoop *cold = loops[0];
+    for (EventLoop *loop : loops)
+    {
+        if (loads[loop].bytes > loads[hot].bytes)
+        {
+            hot = loop;
+        }
+        if (loads[loop].bytes < loads[cold].bytes)
+        {
+            cold = loop;
+        }
+    }
+    uint64_t hotBytes = loads[hot].bytes;
+    uint64_t coldBytes = loads[cold].bytes;
+    // 只有一个连接的loop迁走它也只是把热点换个地方
+    if (hot == cold || loads[hot].conns < 2 || hotBytes == 0 ||
+        static_cast<double>(hotBytes) <= imbalanceRatio_ * static_cast<double>(coldBytes))
+    {
+        return;
+    }
 
-    LOG_DEBUG << "TcpServer::handleNewConnection done";
+    // 选择迁移后两边差距最小的连接: 增量不超过差值的前提下越大越好
+    uint64_t gap = hotBytes - coldBytes;
+    TcpConnectionPtr victim;
+    uint64_t victimBytes = 0;
+    for (auto &item : deltas)
+    {
+        if (item.first->getLoop() == hot && item.second < gap && item.second > victimBytes)
+        {
+            victim = item.first;
+            victimBytes = item.second;
+        }
+    }
+    if (victim)
+    {
+        LOG_INFO << "TcpServer [" << name_ << "] rebalance: move " << victim->name()
+                 << " (" << victimBytes << " bytes) hot=" << hotBytes << " cold=" << coldBytes;
+        victim->migrateTo(cold);
+    }
 }
 
-void TcpServer::removeConnection(const TcpConnectionPtr &conn)
-{
-    LOG_DEBUG << "TcpServer::removeConnection [" << name_.c_str() << "] - connection %s" << conn->name().c_str();
+// ================= 缓冲区内存预算 =================
 
-    loop_->runInLoop(
-        std::bind(&TcpServer::removeConnectionInLoop, this, conn));
-    LOG_DEBUG << "TcpServer::removeConnection end";
+void TcpServer::setBufferBudget(size_t bytes, double sweepIntervalSecs)
+{
+    BufferBudget::global().setLimit(bytes);
+    loop_->runInLoop([this, bytes, sweepIntervalSecs]() {
+        if (sweepArmed_)
+        {
+            sweepArmed_ = false;
+            loop_->cancel(sweepTimer_);
+        }
+        if (bytes > 0)
+        {
+            sweepArmed_ = true;
+            sweepTimer_ = loop_->runEvery(sweepIntervalSecs, std::bind(&TcpServer::sweepBuffers, this));
+        }
+    });
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+// 预算超限时 没有读写活动的连接不会走到chargeBuffers 由这里让它们收缩空闲缓冲区
+void TcpServer::sweepBuffers()
 {
-    LOG_DEBUG << "TcpServer::removeConnectionInLoop start";
-    LOG_INFO << "TcpServer::removeConnectionInLoop [" << name_.c_str() << "] - connection %s" << conn->name().c_str();
-
-    connections_.erase(conn->name());
-    EventLoop *ioLoop = conn->getLoop();
-    ioLoop->queueInLoop(
-        std::bind(&TcpConnection::connectDestroyed, conn));
-
-    LOG_DEBUG << "TcpServer::removeConnectionInLoop end";
-}
\ No newline at end of file
+    BufferBudget &budget = BufferBudget::global();
+    if (!budget.exceeded())
+    {
+        return;
+    }
+    LOG_WARN << "TcpServer [" << name_ << "] buffer budget exceeded: used " << budget.used()
+             << " limit " << budget.limit() << " paused " << budget.pausedConnections();
+    for (auto &item : connections_)
+    {
+        TcpConnectionPtr conn = item.second;
+        conn->getLoop()->runInLoop([conn]() { conn->shrinkBuffers(); });
+    }
+}
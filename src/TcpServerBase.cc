@@ -0,0 +1,223 @@
+#include <functional>
+#include <string.h>
+#include <unistd.h>
+
+#include <TcpServerBase.h>
+#include <Logger.h>
+#include <BufferBudget.h>
+
+static EventLoop *CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL << "main Loop is NULL!";
+    }
+    return loop;
+}
+
+TcpServerBase::TcpServerBase(EventLoop *loop,
+                             const InetAddress &listenAddr,
+                             const std::string &nameArg,
+                             bool reuseport)
+    : loop_(CheckLoopNotNull(loop))
+    , ipPort_(listenAddr.toIpPort())
+    , name_(nameArg)
+    , acceptor_(new Acceptor(loop, listenAddr, reuseport))
+    , threadPool_(new EventLoopThreadPool(loop, name_))
+    , started_(0)
+    , nextConnId_(1)
+    , maxConnections_(0)
+    , acceptRetryDelay_(0.1)
+    , retryTimerArmed_(false)
+{
+}
+
+TcpServerBase::~TcpServerBase()
+{
+    if (retryTimerArmed_)
+    {
+        loop_->cancel(retryTimer_);
+    }
+    for (auto &item : connections_)
+    {
+        TcpConnectionPtr conn(item.second);
+        item.second.reset(); // 把原始的智能指针复位 让栈空间的TcpConnectionPtr conn指向该对象 当conn出了其作用域 即可释放智能指针指向的对象
+        // 销毁连接
+        conn->getLoop()->runInLoop(
+            std::bind(&TcpConnection::connectDestroyed, conn));
+    }
+}
+
+void TcpServerBase::setThreadNum(int numThreads)
+{
+    LOG_DEBUG << "TcpServer::setThreadNum [" << name_.c_str() << "] threads " << numThreads;
+    threadPool_->setThreadNum(numThreads);
+}
+
+void TcpServerBase::resizeThreadPool(int numThreads)
+{
+    loop_->runInLoop([this, numThreads]() {
+        LOG_INFO << "TcpServer [" << name_ << "] resize thread pool to " << numThreads;
+        threadPool_->resize(numThreads);
+    });
+}
+
+void TcpServerBase::migrateConnection(const TcpConnectionPtr &conn, EventLoop *target)
+{
+    conn->migrateTo(target);
+}
+
+void TcpServerBase::startServer(const EventLoopThreadPool::ThreadInitCallback &cb)
+{
+    if (started_.fetch_add(1) == 0) // 防止一个TcpServer对象被start多次
+    {
+        threadPool_->start(cb); // 启动底层的loop线程池
+        loop_->runInLoop([this]() {
+            acceptor_->listen();
+            acceptLoop();
+        });
+    }
+}
+
+// Accept 协程：永不停止的循环
+Task TcpServerBase::acceptLoop()
+{
+    LOG_INFO << "AcceptLoop coroutine started";
+
+    while (true)
+    {
+        // 等待新连接 协程句柄注册到 Acceptor 的 Channel 里
+        auto [connfd, peerAddr, err] = co_await acceptor_->accept();
+
+        if (connfd >= 0)
+        {
+            if (BufferBudget::global().exceeded())
+            {
+                // 缓冲区预算已经用完 新连接只会让情况更糟 直接拒绝
+                LOG_WARN << "TcpServer [" << name_ << "] buffer budget exceeded, reject " << peerAddr.toIpPort();
+                ::close(connfd);
+            }
+            else if (started_ > 0) // 简单的运行状态检查
+            {
+                handleNewConnection(connfd, peerAddr);
+                if (maxConnections_ > 0 && connections_.size() >= maxConnections_)
+                {
+                    LOG_WARN << "TcpServer [" << name_ << "] reached max connections " << maxConnections_ << ", pause accepting";
+                    pauseAccepting(0.0); // 只在连接关闭时恢复
+                }
+            }
+            else
+            {
+                ::close(connfd);
+            }
+        }
+        else
+        {
+            LOG_ERROR << "accept error: " << err;
+            // fd耗尽: Acceptor已经用预留fd丢弃了一个连接 这里暂停accept一小段时间
+            // 不能阻塞mainloop 其他channel和定时器还要继续工作
+            if (err == EMFILE || err == ENFILE)
+            {
+                pauseAccepting(acceptRetryDelay_);
+            }
+        }
+    }
+}
+
+// 轮询选择一个subLoop 把新连接交给它
+void TcpServerBase::handleNewConnection(int sockfd, const InetAddress &peerAddr)
+{
+    EventLoop *ioLoop = threadPool_->getNextLoop();
+    char buf[64] = {0};
+    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
+    ++nextConnId_; // 这里没有设置为原子类是因为其只在mainloop中执行 不涉及线程安全问题
+    std::string connName = name_ + buf;
+
+    LOG_INFO << "TcpServer::newConnection [" << name_.c_str() << "]- new connection [" << connName.c_str() << "]from " << peerAddr.toIpPort().c_str();
+
+    // 通过sockfd获取其绑定的本机的ip地址和端口信息
+    sockaddr_storage local;
+    ::memset(&local, 0, sizeof(local));
+    socklen_t addrlen = sizeof(local);
+    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+    {
+        LOG_ERROR << "sockets::getLocalAddr";
+    }
+
+    TcpConnectionPtr conn(new TcpConnection(ioLoop,
+                                            connName,
+                                            sockfd,
+                                            InetAddress((sockaddr *)&local, addrlen),
+                                            peerAddr));
+    connections_[connName] = conn;
+    threadPool_->connectionAttached(ioLoop);
+    conn->applySocketOptions(socketOptions_);
+    // 在原loop线程调用 连接此时已经从原loop摘下 计数交给baseLoop更新
+    // 该连接之后的removeConnection一定排在这条记录后面 connectionDetached不会算错loop
+    conn->setMigrateCallback([this](const TcpConnectionPtr &c, EventLoop *from, EventLoop *to) {
+        loop_->runInLoop([this, from, to]() {
+            threadPool_->connectionAttached(to);
+            threadPool_->connectionDetached(from);
+        });
+        connectionMigrated(c, from, to);
+    });
+    conn->setCloseCallback(std::bind(&TcpServerBase::removeConnection, this, std::placeholders::_1));
+    setupConnection(conn);
+
+    ioLoop->runInLoop([this, conn]() {
+        conn->connectEstablished();
+        connectionReady(conn);
+    });
+}
+
+void TcpServerBase::removeConnection(const TcpConnectionPtr &conn)
+{
+    loop_->runInLoop(
+        std::bind(&TcpServerBase::removeConnectionInLoop, this, conn));
+}
+
+void TcpServerBase::removeConnectionInLoop(const TcpConnectionPtr &conn)
+{
+    LOG_INFO << "TcpServer::removeConnectionInLoop [" << name_.c_str() << "] - connection " << conn->name().c_str();
+
+    connections_.erase(conn->name());
+    connectionRemoved(conn);
+    maybeResumeAccepting();
+    EventLoop *ioLoop = conn->getLoop();
+    ioLoop->queueInLoop(
+        std::bind(&TcpConnection::connectDestroyed, conn));
+    // 必须在connectDestroyed投递之后 retiring的loop可能因此退出
+    threadPool_->connectionDetached(ioLoop);
+}
+
+void TcpServerBase::pauseAccepting(double retryDelay)
+{
+    acceptor_->pauseAccepting();
+    if (retryDelay > 0.0 && !retryTimerArmed_)
+    {
+        retryTimerArmed_ = true;
+        retryTimer_ = loop_->runAfter(retryDelay, [this]() {
+            retryTimerArmed_ = false;
+            maybeResumeAccepting();
+        });
+    }
+}
+
+void TcpServerBase::maybeResumeAccepting()
+{
+    if (!acceptor_->paused())
+    {
+        return;
+    }
+    if (maxConnections_ > 0 && connections_.size() >= maxConnections_)
+    {
+        return;
+    }
+    if (retryTimerArmed_)
+    {
+        retryTimerArmed_ = false;
+        loop_->cancel(retryTimer_);
+    }
+    LOG_INFO << "TcpServer [" << name_ << "] resume accepting";
+    acceptor_->resumeAccepting();
+}
@@ -62,8 +62,7 @@ TimerQueue::TimerQueue(EventLoop* loop)
       timerfdChannel_(loop_, timerfd_),
       timers_()
 {
-    timerfdChannel_.setReadCallback(
-        std::bind(&TimerQueue::handleRead, this));
+    timerfdChannel_.setHandler(this);
     timerfdChannel_.enableReading();
 }
 
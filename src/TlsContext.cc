@@ -0,0 +1,321 @@
+#include <errno.h>
+#include <limits.h>
+#include <algorithm>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include <TlsContext.h>
+#include <Buffer.h>
+#include <Logger.h>
+
+// 取出OpenSSL错误队列里最早的一条 同时清空队列 避免影响同一线程上其他连接的SSL_get_error
+static std::string takeSslError()
+{
+    unsigned long code = ERR_get_error();
+    ERR_clear_error();
+    if (code == 0)
+    {
+        return "no ssl error";
+    }
+    char buf[256];
+    ERR_error_string_n(code, buf, sizeof buf);
+    return buf;
+}
+
+// ================= TlsContext =================
+
+TlsContext::TlsContext(Mode mode)
+    : mode_(mode)
+    , ctx_(SSL_CTX_new(mode == kServer ? TLS_server_method() : TLS_client_method()))
+    , kernelTls_(false)
+{
+    if (ctx_ == nullptr)
+    {
+        LOG_ERROR << "TlsContext SSL_CTX_new failed: " << takeSslError();
+        return;
+    }
+    SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+    // 部分写 + 允许重试时缓冲区地址变化: 发送直接从outputBuffer_/共享消息上取数据 不需要额外拷贝
+    SSL_CTX_set_mode(ctx_, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    // 对端不发close_notify直接关连接时按普通EOF处理
+    SSL_CTX_set_options(ctx_, SSL_OP_IGNORE_UNEXPECTED_EOF);
+    setKernelTls(true);
+}
+
+TlsContext::~TlsContext()
+{
+    SSL_CTX_free(ctx_);
+}
+
+void TlsContext::setKernelTls(bool on)
+{
+    kernelTls_ = on;
+    if (ctx_ == nullptr)
+    {
+        return;
+    }
+    if (on)
+    {
+        SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+    }
+    else
+    {
+        SSL_CTX_clear_options(ctx_, SSL_OP_ENABLE_KTLS);
+    }
+}
+
+bool TlsContext::loadCertificate(const std::string &certFile, const std::string &keyFile)
+{
+    if (SSL_CTX_use_certificate_chain_file(ctx_, certFile.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx_, keyFile.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx_) != 1)
+    {
+        LOG_ERROR << "TlsContext::loadCertificate " << certFile << " failed: " << takeSslError();
+        return false;
+    }
+    return true;
+}
+
+bool TlsContext::useSelfSigned(const std::string &commonName)
+{
+    EVP_PKEY *pkey = EVP_EC_gen("P-256");
+    X509 *cert = X509_new();
+    bool ok = pkey != nullptr && cert != nullptr;
+    if (ok)
+    {
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 365L * 24 * 3600);
+        X509_set_pubkey(cert, pkey);
+
+        X509_NAME *name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                   reinterpret_cast<const unsigned char *>(commonName.c_str()), -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+
+        // 浏览器等客户端做主机名校验时只看subjectAltName 不再看CN
+        std::string san = "DNS:" + commonName;
+        X509_EXTENSION *ext = X509V3_EXT_conf_nid(nullptr, nullptr, NID_subject_alt_name, san.c_str());
+        ok = ext != nullptr && X509_add_ext(cert, ext, -1) == 1;
+        X509_EXTENSION_free(ext);
+
+        ok = ok && X509_sign(cert, pkey, EVP_sha256()) > 0 &&
+             SSL_CTX_use_certificate(ctx_, cert) == 1 &&
+             SSL_CTX_use_PrivateKey(ctx_, pkey) == 1;
+    }
+    if (!ok)
+    {
+        LOG_ERROR << "TlsContext::useSelfSigned failed: " << takeSslError();
+    }
+    X509_free(cert);
+    EVP_PKEY_free(pkey);
+    return ok;
+}
+
+std::string TlsContext::certificatePem() const
+{
+    X509 *cert = SSL_CTX_get0_certificate(ctx_);
+    if (cert == nullptr)
+    {
+        return std::string();
+    }
+    BIO *bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_X509(bio, cert);
+    char *data = nullptr;
+    long len = BIO_get_mem_data(bio, &data);
+    std::string pem(data, len);
+    BIO_free(bio);
+    return pem;
+}
+
+bool TlsContext::loadVerifyLocations(const std::string &caFile)
+{
+    if (SSL_CTX_load_verify_locations(ctx_, caFile.c_str(), nullptr) != 1)
+    {
+        LOG_ERROR << "TlsContext::loadVerifyLocations " << caFile << " failed: " << takeSslError();
+        return false;
+    }
+    enableVerify();
+    return true;
+}
+
+bool TlsContext::trustCertificatePem(const std::string &pem)
+{
+    BIO *bio = BIO_new_mem_buf(pem.data(), static_cast<int>(pem.size()));
+    X509 *cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+    BIO_free(bio);
+    bool ok = cert != nullptr && X509_STORE_add_cert(SSL_CTX_get_cert_store(ctx_), cert) == 1;
+    X509_free(cert);
+    if (!ok)
+    {
+        LOG_ERROR << "TlsContext::trustCertificatePem failed: " << takeSslError();
+        return false;
+    }
+    enableVerify();
+    return true;
+}
+
+void TlsContext::enableVerify()
+{
+    int mode = SSL_VERIFY_PEER;
+    if (mode_ == kServer)
+    {
+        mode |= SSL_VERIFY_FAIL_IF_NO_PEER_CERT; // 服务端设置了CA即要求客户端证书
+    }
+    SSL_CTX_set_verify(ctx_, mode, nullptr);
+}
+
+// ================= TlsSession =================
+
+TlsSession::TlsSession(TlsContext *ctx, int sockfd, const std::string &serverName)
+    : ssl_(SSL_new(ctx->native()))
+    , kernelSend_(false)
+    , kernelRecv_(false)
+{
+    if (ssl_ == nullptr || SSL_set_fd(ssl_, sockfd) != 1)
+    {
+        LOG_ERROR << "TlsSession create failed: " << takeSslError();
+        SSL_free(ssl_);
+        ssl_ = nullptr;
+        return;
+    }
+    if (ctx->mode() == TlsContext::kServer)
+    {
+        SSL_set_accept_state(ssl_);
+    }
+    else
+    {
+        SSL_set_connect_state(ssl_);
+        if (!serverName.empty())
+        {
+            SSL_set_tlsext_host_name(ssl_, serverName.c_str());
+            SSL_set1_host(ssl_, serverName.c_str());
+        }
+    }
+}
+
+TlsSession::~TlsSession()
+{
+    SSL_free(ssl_);
+}
+
+TlsSession::Status TlsSession::handshake()
+{
+    int ret = SSL_do_handshake(ssl_);
+    if (ret == 1)
+    {
+#ifndef OPENSSL_NO_KTLS
+        kernelSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+        kernelRecv_ = BIO_get_ktls_recv(SSL_get_rbio(ssl_));
+#endif
+        return kDone;
+    }
+    int err = SSL_get_error(ssl_, ret);
+    if (err == SSL_ERROR_WANT_READ)
+    {
+        return kWantRead;
+    }
+    if (err == SSL_ERROR_WANT_WRITE)
+    {
+        return kWantWrite;
+    }
+    LOG_ERROR << "TlsSession::handshake failed: " << takeSslError()
+              << " verify=" << X509_verify_cert_error_string(SSL_get_verify_result(ssl_));
+    return kFailed;
+}
+
+bool TlsSession::hasPending() const
+{
+    return SSL_has_pending(ssl_) == 1;
+}
+
+ssize_t TlsSession::read(Buffer *buf, int *savedErrno)
+{
+    // 一条TLS记录最多16KB明文 一直读到OpenSSL要求等待为止 保证没有数据留在OpenSSL内部而epoll不再通知
+    static const size_t kReadChunk = 16 * 1024;
+    ssize_t total = 0;
+    while (true)
+    {
+        buf->ensureWritableBytes(kReadChunk);
+        int want = static_cast<int>(std::min<size_t>(buf->writableBytes(), INT_MAX));
+        int n = SSL_read(ssl_, buf->beginWrite(), want);
+        if (n > 0)
+        {
+            buf->hasWritten(n);
+            total += n;
+            continue;
+        }
+        int err = translateError(n, savedErrno);
+        if (total > 0)
+        {
+            return total; // 错误或者EOF留给下一次read报告
+        }
+        return err == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+    }
+}
+
+ssize_t TlsSession::write(const void *data, size_t len, int *savedErrno)
+{
+    if (len == 0)
+    {
+        return 0;
+    }
+    int n = SSL_write(ssl_, data, static_cast<int>(std::min<size_t>(len, INT_MAX)));
+    if (n > 0)
+    {
+        return n;
+    }
+    translateError(n, savedErrno);
+    return -1;
+}
+
+void TlsSession::shutdown()
+{
+    if (SSL_is_init_finished(ssl_))
+    {
+        SSL_shutdown(ssl_); // 非阻塞socket上发不出去也不重试 随后的shutdownWrite同样表示结束
+        ERR_clear_error();
+    }
+}
+
+std::string TlsSession::version() const
+{
+    return SSL_get_version(ssl_);
+}
+
+std::string TlsSession::cipher() const
+{
+    return SSL_get_cipher_name(ssl_);
+}
+
+// 把SSL_get_error翻译成errno 返回SSL_get_error的结果
+int TlsSession::translateError(int ret, int *savedErrno)
+{
+    int sysErrno = errno;
+    int err = SSL_get_error(ssl_, ret);
+    switch (err)
+    {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        *savedErrno = EAGAIN;
+        break;
+    case SSL_ERROR_ZERO_RETURN:
+        *savedErrno = 0;
+        break;
+    case SSL_ERROR_SYSCALL:
+        *savedErrno = sysErrno != 0 ? sysErrno : ECONNRESET;
+        ERR_clear_error();
+        break;
+    default:
+        LOG_ERROR << "TlsSession error " << err << ": " << takeSslError();
+        *savedErrno = EPROTO;
+        break;
+    }
+    errno = *savedErrno;
+    return err;
+}
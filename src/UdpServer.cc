@@ -0,0 +1,65 @@
+#include <UdpServer.h>
+#include <EventLoop.h>
+#include <EventLoopThreadPool.h>
+#include <Logger.h>
+
+UdpServer::UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg)
+    : loop_(loop)
+    , listenAddr_(listenAddr)
+    , name_(nameArg)
+    , threadPool_(new EventLoopThreadPool(loop, nameArg))
+    , gro_(false)
+    , gso_(false)
+    , started_(0)
+{
+}
+
+UdpServer::~UdpServer()
+{
+}
+
+void UdpServer::setThreadNum(int numThreads)
+{
+    threadPool_->setThreadNum(numThreads);
+}
+
+void UdpServer::start()
+{
+    if (started_.fetch_add(1) == 0)
+    {
+        threadPool_->start(threadInitCallback_);
+        // socket在主线程里创建好 注册Channel和启动接收协程放到各自的loop线程里做
+        for (EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            sockets_.emplace_back(new UdpSocket(ioLoop, listenAddr_, true));
+            UdpSocket *sock = sockets_.back().get();
+            if (gro_)
+            {
+                sock->setGro(true);
+            }
+            if (gso_)
+            {
+                sock->enableGso();
+            }
+            ioLoop->runInLoop([this, sock]() { recvLoop(sock); });
+        }
+        LOG_INFO << "UdpServer [" << name_ << "] listening on " << listenAddr_.toIpPort()
+                 << " with " << sockets_.size() << " sockets";
+    }
+}
+
+Task UdpServer::recvLoop(UdpSocket *sock)
+{
+    while (true)
+    {
+        const auto &batch = co_await sock->recv();
+        if (!datagramCallback_)
+        {
+            continue;
+        }
+        for (const UdpSocket::Datagram &datagram : batch)
+        {
+            datagramCallback_(sock, datagram);
+        }
+    }
+}
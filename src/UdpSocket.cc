@@ -0,0 +1,342 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/udp.h>
+
+#include <UdpSocket.h>
+#include <Channel.h>
+#include <EventLoop.h>
+#include <Logger.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+// 内核一次GSO最多切分的段数(UDP_MAX_SEGMENTS)
+static const size_t kMaxGsoSegments = 64;
+// 单个UDP数据报最大负载
+static const size_t kMaxUdpPayload = 65507;
+
+static int createNonblockingUdp()
+{
+    int sockfd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (sockfd < 0)
+    {
+        LOG_FATAL << "udp socket create err " << errno;
+    }
+    return sockfd;
+}
+
+UdpSocket::UdpSocket(EventLoop *loop, const InetAddress &localAddr, bool reuseport)
+    : loop_(loop)
+    , socket_(createNonblockingUdp())
+    , localAddr_(localAddr)
+    , channel_(new Channel(loop, socket_.fd()))
+    , groEnabled_(false)
+    , gsoEnabled_(false)
+    , slotSize_(kSlotSize)
+    , pendingHead_(0)
+    , flushScheduled_(false)
+    , dropped_(0)
+{
+    socket_.setReuseAddr(true);
+    if (reuseport)
+    {
+        socket_.setReusePort(true); // 每个subloop一个socket 由内核按四元组哈希分流
+    }
+    socket_.bindAddress(localAddr);
+
+    // 绑定的是0端口时取回内核分配的实际端口
+    sockaddr_in local;
+    socklen_t addrlen = sizeof(local);
+    if (::getsockname(socket_.fd(), (sockaddr *)&local, &addrlen) == 0)
+    {
+        localAddr_.setSockAddr(local);
+    }
+
+    setupRecvRing();
+    channel_->setHandler(this);
+}
+
+UdpSocket::~UdpSocket()
+{
+    channel_->disableAll();
+    channel_->remove();
+}
+
+bool UdpSocket::setGro(bool on)
+{
+    int optval = on ? 1 : 0;
+    if (::setsockopt(socket_.fd(), SOL_UDP, UDP_GRO, &optval, sizeof(optval)) < 0)
+    {
+        LOG_WARN << "UdpSocket::setGro not supported, errno=" << errno;
+        return false;
+    }
+    groEnabled_ = on;
+    // GRO合并后的包最大64KB 接收槽位需要随之变大
+    slotSize_ = on ? kGroSlotSize : kSlotSize;
+    setupRecvRing();
+    return true;
+}
+
+bool UdpSocket::enableGso()
+{
+    // UDP_SEGMENT 设置为0表示不做默认切分 只用来探测内核是否支持
+    int optval = 0;
+    if (::setsockopt(socket_.fd(), SOL_UDP, UDP_SEGMENT, &optval, sizeof(optval)) < 0)
+    {
+        LOG_WARN << "UdpSocket::enableGso not supported, errno=" << errno;
+        gsoEnabled_ = false;
+        return false;
+    }
+    gsoEnabled_ = true;
+    return true;
+}
+
+// 预先分配接收槽位 之后每一批recvmmsg都复用这些内存 不再有任何分配
+void UdpSocket::setupRecvRing()
+{
+    const size_t controlSpace = CMSG_SPACE(sizeof(int));
+    recvSlots_.assign(kBatchSize * slotSize_, 0);
+    recvMsgs_.assign(kBatchSize, mmsghdr());
+    recvIovecs_.assign(kBatchSize, iovec());
+    recvAddrs_.assign(kBatchSize, sockaddr_in());
+    recvControl_.assign(kBatchSize * controlSpace, 0);
+    datagrams_.reserve(kBatchSize);
+
+    for (int i = 0; i < kBatchSize; ++i)
+    {
+        recvIovecs_[i].iov_base = &recvSlots_[i * slotSize_];
+        recvIovecs_[i].iov_len = slotSize_;
+        msghdr &hdr = recvMsgs_[i].msg_hdr;
+        hdr.msg_name = &recvAddrs_[i];
+        hdr.msg_iov = &recvIovecs_[i];
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = &recvControl_[i * controlSpace];
+    }
+}
+
+void UdpSocket::recvBatch()
+{
+    const size_t controlSpace = CMSG_SPACE(sizeof(int));
+    // msg_namelen/msg_controllen 是值-结果参数 每次调用前都要复位
+    for (int i = 0; i < kBatchSize; ++i)
+    {
+        msghdr &hdr = recvMsgs_[i].msg_hdr;
+        hdr.msg_namelen = sizeof(sockaddr_in);
+        hdr.msg_controllen = groEnabled_ ? controlSpace : 0;
+        hdr.msg_flags = 0;
+        recvMsgs_[i].msg_len = 0;
+    }
+
+    datagrams_.clear();
+    int n = ::recvmmsg(socket_.fd(), recvMsgs_.data(), kBatchSize, MSG_DONTWAIT, nullptr);
+    if (n < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            LOG_ERROR << "UdpSocket::recvBatch recvmmsg error " << errno;
+        }
+        return;
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        msghdr &hdr = recvMsgs_[i].msg_hdr;
+        const char *data = static_cast<const char *>(recvIovecs_[i].iov_base);
+        size_t len = recvMsgs_[i].msg_len;
+        InetAddress peer(recvAddrs_[i]);
+
+        if (hdr.msg_flags & MSG_TRUNC)
+        {
+            LOG_WARN << "UdpSocket::recvBatch datagram from " << peer.toIpPort() << " truncated";
+        }
+
+        size_t segmentSize = 0;
+        if (groEnabled_)
+        {
+            for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+                {
+                    int gsoSize = 0;
+                    ::memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+                    segmentSize = static_cast<size_t>(gsoSize);
+                }
+            }
+        }
+
+        if (segmentSize == 0 || len <= segmentSize)
+        {
+            datagrams_.push_back({data, len, peer});
+            continue;
+        }
+        // GRO合并包: 前面每段都是segmentSize 最后一段可能更短
+        for (size_t off = 0; off < len; off += segmentSize)
+        {
+            datagrams_.push_back({data + off, std::min(segmentSize, len - off), peer});
+        }
+    }
+}
+
+void UdpSocket::sendTo(const InetAddress &peer, const void *data, size_t len)
+{
+    if (!loop_->isInLoopThread())
+    {
+        std::string copy(static_cast<const char *>(data), len);
+        loop_->runInLoop([this, peer, copy]() { sendTo(peer, copy.data(), copy.size()); });
+        return;
+    }
+
+    if (sendBuffer_.size() + len > kMaxQueuedBytes)
+    {
+        ++dropped_;
+        return;
+    }
+    pending_.push_back({peer, sendBuffer_.size(), len, 0});
+    sendBuffer_.append(static_cast<const char *>(data), len);
+    scheduleFlush();
+}
+
+void UdpSocket::sendSegmented(const InetAddress &peer, const void *data, size_t len, size_t segmentSize)
+{
+    const char *p = static_cast<const char *>(data);
+    if (!gsoEnabled_ || segmentSize == 0 || segmentSize > UINT16_MAX || len <= segmentSize)
+    {
+        size_t step = segmentSize == 0 ? len : segmentSize;
+        for (size_t off = 0; off < len; off += step)
+        {
+            sendTo(peer, p + off, std::min(step, len - off));
+        }
+        return;
+    }
+    if (!loop_->isInLoopThread())
+    {
+        std::string copy(p, len);
+        loop_->runInLoop([this, peer, copy, segmentSize]() {
+            sendSegmented(peer, copy.data(), copy.size(), segmentSize);
+        });
+        return;
+    }
+
+    // 单次GSO发送受UDP最大负载和最大段数限制 超过时拆成多次
+    size_t maxChunk = std::min(kMaxUdpPayload / segmentSize, kMaxGsoSegments) * segmentSize;
+    for (size_t off = 0; off < len; off += maxChunk)
+    {
+        size_t chunk = std::min(maxChunk, len - off);
+        if (sendBuffer_.size() + chunk > kMaxQueuedBytes)
+        {
+            ++dropped_;
+            return;
+        }
+        pending_.push_back({peer, sendBuffer_.size(), chunk, static_cast<uint16_t>(segmentSize)});
+        sendBuffer_.append(p + off, chunk);
+    }
+    scheduleFlush();
+}
+
+// 同一轮事件循环里的sendTo只登记一次flush 在本轮事件循环末尾统一执行
+void UdpSocket::scheduleFlush()
+{
+    if (!flushScheduled_ && !channel_->isWriting())
+    {
+        flushScheduled_ = true;
+        loop_->queueAfterDispatch(std::bind(&UdpSocket::flush, this));
+    }
+}
+
+void UdpSocket::flush()
+{
+    flushScheduled_ = false;
+
+    mmsghdr msgs[kBatchSize];
+    iovec iovecs[kBatchSize];
+    char control[kBatchSize][CMSG_SPACE(sizeof(uint16_t))];
+
+    while (pendingHead_ < pending_.size())
+    {
+        int batch = static_cast<int>(std::min<size_t>(kBatchSize, pending_.size() - pendingHead_));
+        ::memset(msgs, 0, sizeof(mmsghdr) * batch);
+        for (int i = 0; i < batch; ++i)
+        {
+            PendingDatagram &d = pending_[pendingHead_ + i];
+            iovecs[i].iov_base = &sendBuffer_[d.offset];
+            iovecs[i].iov_len = d.len;
+            msghdr &hdr = msgs[i].msg_hdr;
+            hdr.msg_name = const_cast<sockaddr *>(d.peer.getSockAddr());
+            hdr.msg_namelen = d.peer.getSockLen();
+            hdr.msg_iov = &iovecs[i];
+            hdr.msg_iovlen = 1;
+            if (d.segmentSize > 0)
+            {
+                hdr.msg_control = control[i];
+                hdr.msg_controllen = sizeof(control[i]);
+                cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                ::memcpy(CMSG_DATA(cmsg), &d.segmentSize, sizeof(uint16_t));
+            }
+        }
+
+        int n = ::sendmmsg(socket_.fd(), msgs, batch, 0);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // 发送缓冲区满了 等可写事件再继续
+                if (!channel_->isWriting())
+                {
+                    channel_->enableWriting();
+                }
+                return;
+            }
+            // 队首数据报发送失败(如ICMP端口不可达、数据报过大) 丢弃它继续发后面的
+            LOG_ERROR << "UdpSocket::flush sendmmsg error " << errno << " to "
+                      << pending_[pendingHead_].peer.toIpPort();
+            ++dropped_;
+            n = 1;
+        }
+        pendingHead_ += n;
+    }
+
+    pending_.clear();
+    sendBuffer_.clear();
+    pendingHead_ = 0;
+    if (channel_->isWriting())
+    {
+        channel_->disableWriting();
+    }
+}
+
+void UdpSocket::handleRead()
+{
+    // 没有协程在 co_await recv()，停止监听 数据留在内核里等下一次recv
+    channel_->disableReading();
+}
+
+void UdpSocket::handleWrite()
+{
+    flush();
+}
+
+// ================= RecvAwaiter 实现 =================
+
+void UdpSocket::RecvAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    sock_->channel_->setReadCoroutine(h);
+    if (!sock_->channel_->isReading())
+    {
+        sock_->channel_->enableReading();
+    }
+}
+
+const std::vector<UdpSocket::Datagram> &UdpSocket::RecvAwaiter::await_resume()
+{
+    sock_->channel_->clearReadCoroutine();
+    sock_->recvBatch();
+    return sock_->datagrams_;
+}
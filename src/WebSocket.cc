@@ -0,0 +1,510 @@
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <openssl/evp.h>
+
+#include <WebSocket.h>
+#include <HttpRequest.h>
+#include <HttpResponse.h>
+#include <Logger.h>
+
+namespace
+{
+
+const char kWebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+std::string_view trim(std::string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+    {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+    {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+// 逗号分隔的列表里是否有token(不区分大小写) 例如 Connection: keep-alive, Upgrade
+bool hasToken(std::string_view list, std::string_view token)
+{
+    while (!list.empty())
+    {
+        size_t comma = list.find(',');
+        std::string_view item = trim(list.substr(0, comma));
+        if (item.size() == token.size() && ::strncasecmp(item.data(), token.data(), token.size()) == 0)
+        {
+            return true;
+        }
+        if (comma == std::string_view::npos)
+        {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+// 可以出现在close帧里的状态码(RFC 6455 7.4 以及IANA登记的1012~1014)
+bool validCloseCode(uint16_t code)
+{
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) || (code >= 3000 && code <= 4999);
+}
+
+// 多字节字符的总长度 由首字节决定 非法首字节也按4处理 交给校验函数拒绝
+size_t utf8SequenceLength(unsigned char lead)
+{
+    return lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+}
+
+// 末尾不完整的多字节字符的长度 只看最后3个字节
+size_t utf8IncompleteTail(const char *data, size_t len)
+{
+    for (size_t i = 1; i <= std::min<size_t>(3, len); ++i)
+    {
+        unsigned char c = static_cast<unsigned char>(data[len - i]);
+        if ((c & 0xC0) == 0x80)
+        {
+            continue;
+        }
+        return utf8SequenceLength(c) > i ? i : 0;
+    }
+    return 0;
+}
+
+} // namespace
+
+WebSocket::WebSocket(const TcpConnectionPtr &conn)
+    : conn_(conn)
+    , maxMessageSize_(kDefaultMaxMessageSize)
+    , lastPoll_(kNeedMore)
+    , pendingConsume_(0)
+    , frame_{kText, true, std::string_view(), 0}
+    , fragmented_(false)
+    , messageOpcode_(kText)
+    , messageBytes_(0)
+    , closeSent_(false)
+    , closeCode_(0)
+    , closeReasonLen_(0)
+{
+}
+
+// ================= 握手 =================
+
+bool WebSocket::isUpgradeRequest(const HttpRequest &req)
+{
+    return req.method() == HttpRequest::kGet && hasToken(req.header("Upgrade"), "websocket") &&
+           hasToken(req.header("Connection"), "upgrade");
+}
+
+bool WebSocket::acceptHandshake(const HttpRequest &req, HttpResponse *resp)
+{
+    // 16字节随机数的base64 固定24个字符
+    std::string_view key = trim(req.header("Sec-WebSocket-Key"));
+    if (!isUpgradeRequest(req) || req.version() != HttpRequest::kHttp11 || key.size() != 24)
+    {
+        resp->setStatusCode(HttpResponse::k400BadRequest);
+        resp->setCloseConnection(true);
+        return false;
+    }
+    if (trim(req.header("Sec-WebSocket-Version")) != "13")
+    {
+        resp->setStatusCode(HttpResponse::k426UpgradeRequired);
+        resp->addHeader("Sec-WebSocket-Version", "13");
+        resp->setCloseConnection(true);
+        return false;
+    }
+    resp->setStatusCode(HttpResponse::k101SwitchingProtocols);
+    resp->addHeader("Upgrade", "websocket");
+    resp->addHeader("Connection", "Upgrade");
+    resp->addHeader("Sec-WebSocket-Accept", acceptKey(key));
+    return true;
+}
+
+std::string WebSocket::acceptKey(std::string_view key)
+{
+    std::string input(key);
+    input.append(kWebSocketGuid, sizeof kWebSocketGuid - 1);
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int mdLen = 0;
+    EVP_Digest(input.data(), input.size(), md, &mdLen, EVP_sha1(), nullptr);
+    unsigned char out[64];
+    int n = EVP_EncodeBlock(out, md, static_cast<int>(mdLen));
+    return std::string(reinterpret_cast<const char *>(out), n);
+}
+
+// ================= 接收 =================
+
+WebSocket::FrameAwaiter::FrameAwaiter(WebSocket *ws)
+    : ws_(ws)
+    , read_(ws->conn_.get(), [ws](Buffer *in) {
+        ws->lastPoll_ = ws->poll(in, kPollFrame);
+        return ws->lastPoll_ != kNeedMore;
+    })
+{
+}
+
+WebSocket::Frame WebSocket::FrameAwaiter::await_resume()
+{
+    read_.await_resume();
+    if (ws_->lastPoll_ == kGotFrame)
+    {
+        return ws_->frame_;
+    }
+    if (ws_->closeCode_ == 0)
+    {
+        ws_->finishClose(kAbnormalClosure, nullptr, 0); // 帧没收全连接就断了
+    }
+    return Frame{kClose, true, std::string_view(ws_->closeReason_, ws_->closeReasonLen_), ws_->closeCode_};
+}
+
+WebSocket::MessageAwaiter::MessageAwaiter(WebSocket *ws)
+    : ws_(ws)
+    , read_(ws->conn_.get(), [ws](Buffer *in) {
+        ws->lastPoll_ = ws->poll(in, kPollMessage);
+        return ws->lastPoll_ != kNeedMore;
+    })
+{
+}
+
+WebSocket::Message WebSocket::MessageAwaiter::await_resume()
+{
+    read_.await_resume();
+    if (ws_->lastPoll_ == kGotMessage)
+    {
+        return Message{ws_->frame_.opcode, ws_->frame_.payload, 0};
+    }
+    if (ws_->closeCode_ == 0)
+    {
+        ws_->finishClose(kAbnormalClosure, nullptr, 0);
+    }
+    return Message{kClose, std::string_view(ws_->closeReason_, ws_->closeReasonLen_), ws_->closeCode_};
+}
+
+WebSocket::PollResult WebSocket::poll(Buffer *in, PollMode mode)
+{
+    if (pendingConsume_ > 0)
+    {
+        in->retrieve(pendingConsume_);
+        pendingConsume_ = 0;
+    }
+    if (!fragmented_)
+    {
+        message_.clear(); // 上一条拼接的消息已经交出去了
+    }
+
+    while (closeCode_ == 0)
+    {
+        size_t readable = in->readableBytes();
+        if (readable < 2)
+        {
+            return kNeedMore;
+        }
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(in->peek());
+        bool fin = p[0] & 0x80;
+        Opcode opcode = static_cast<Opcode>(p[0] & 0x0F);
+        bool masked = p[1] & 0x80;
+        uint64_t len = p[1] & 0x7F;
+        size_t headLen = 2;
+        if (len == 126)
+        {
+            if (readable < 4)
+            {
+                return kNeedMore;
+            }
+            len = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+            headLen = 4;
+        }
+        else if (len == 127)
+        {
+            if (readable < 10)
+            {
+                return kNeedMore;
+            }
+            len = 0;
+            for (int i = 2; i < 10; ++i)
+            {
+                len = (len << 8) | p[i];
+            }
+            headLen = 10;
+        }
+
+        // 没有协商扩展 保留位必须为0; 客户端发来的帧必须带掩码
+        bool control = opcode & 0x8;
+        if ((p[0] & 0x70) != 0 || !masked)
+        {
+            fail(kProtocolError);
+            break;
+        }
+        if (control)
+        {
+            if ((opcode != kClose && opcode != kPing && opcode != kPong) || !fin || len > kMaxControlPayload)
+            {
+                fail(kProtocolError);
+                break;
+            }
+        }
+        else
+        {
+            // 分片消息的后续帧必须是kContinuation 中间不能插入新的数据消息
+            if (opcode > kBinary || (opcode == kContinuation) != fragmented_)
+            {
+                fail(kProtocolError);
+                break;
+            }
+            uint64_t received = opcode == kContinuation ? messageBytes_ : 0;
+            if (len > maxMessageSize_ - received)
+            {
+                fail(kMessageTooBig);
+                break;
+            }
+        }
+
+        // 整帧到齐再处理 长度已经检查过 不会无限等待
+        const char *mask = in->peek() + headLen;
+        headLen += 4;
+        if (readable < headLen || readable - headLen < len)
+        {
+            return kNeedMore;
+        }
+        // 负载就在输入缓冲区里 原地去掩码
+        char *payload = const_cast<char *>(in->peek()) + headLen;
+        unmask(payload, len, mask);
+        size_t frameLen = headLen + len;
+
+        if (control)
+        {
+            handleControl(opcode, payload, len);
+            in->retrieve(frameLen);
+            continue;
+        }
+
+        if (opcode != kContinuation)
+        {
+            messageOpcode_ = opcode;
+            messageBytes_ = 0;
+            utf8_.reset();
+        }
+        messageBytes_ += len;
+        fragmented_ = !fin;
+        if (messageOpcode_ == kText && !utf8_.feed(payload, len, fin))
+        {
+            fail(kInvalidPayload);
+            break;
+        }
+
+        if (mode == kPollFrame)
+        {
+            frame_ = Frame{opcode, fin, std::string_view(payload, len), 0};
+            pendingConsume_ = frameLen;
+            return kGotFrame;
+        }
+        if (fin && opcode != kContinuation)
+        {
+            // 单帧消息 直接交出输入缓冲区里的负载
+            frame_ = Frame{opcode, true, std::string_view(payload, len), 0};
+            pendingConsume_ = frameLen;
+            return kGotMessage;
+        }
+        message_.append(payload, len);
+        in->retrieve(frameLen);
+        if (fin)
+        {
+            frame_ = Frame{messageOpcode_, true, message_, 0};
+            return kGotMessage;
+        }
+    }
+    return kClosed;
+}
+
+void WebSocket::handleControl(Opcode opcode, const char *payload, size_t len)
+{
+    if (opcode == kPing)
+    {
+        if (!closeSent_)
+        {
+            sendRaw(kPong, payload, len);
+        }
+        return;
+    }
+    if (opcode != kClose)
+    {
+        return; // 没有发过ping的pong 当作单向心跳忽略
+    }
+
+    uint16_t code = kNoStatus;
+    if (len == 1)
+    {
+        fail(kProtocolError);
+        return;
+    }
+    if (len >= 2)
+    {
+        code = static_cast<uint16_t>((static_cast<unsigned char>(payload[0]) << 8) | static_cast<unsigned char>(payload[1]));
+        if (!validCloseCode(code))
+        {
+            fail(kProtocolError);
+            return;
+        }
+        if (!validUtf8(payload + 2, len - 2))
+        {
+            fail(kInvalidPayload);
+            return;
+        }
+    }
+    // 回应close(带回对方的状态码) 服务端随后关闭TCP连接
+    if (!closeSent_)
+    {
+        closeSent_ = true;
+        sendRaw(kClose, payload, std::min<size_t>(len, 2));
+        conn_->shutdown();
+    }
+    finishClose(code, len > 2 ? payload + 2 : nullptr, len > 2 ? len - 2 : 0);
+}
+
+void WebSocket::fail(uint16_t code)
+{
+    LOG_DEBUG << "WebSocket " << conn_->name() << " fail code=" << code;
+    close(code);
+}
+
+void WebSocket::finishClose(uint16_t code, const char *reason, size_t len)
+{
+    if (closeCode_ != 0)
+    {
+        return;
+    }
+    closeCode_ = code;
+    closeReasonLen_ = std::min(len, sizeof closeReason_);
+    if (closeReasonLen_ > 0)
+    {
+        memcpy(closeReason_, reason, closeReasonLen_);
+    }
+}
+
+// ================= 发送 =================
+
+size_t WebSocket::encodeHeader(char *out, Opcode opcode, bool fin, size_t payloadLen)
+{
+    unsigned char *p = reinterpret_cast<unsigned char *>(out);
+    p[0] = static_cast<unsigned char>((fin ? 0x80 : 0) | opcode);
+    if (payloadLen < 126)
+    {
+        p[1] = static_cast<unsigned char>(payloadLen);
+        return 2;
+    }
+    if (payloadLen <= 0xFFFF)
+    {
+        p[1] = 126;
+        p[2] = static_cast<unsigned char>(payloadLen >> 8);
+        p[3] = static_cast<unsigned char>(payloadLen);
+        return 4;
+    }
+    p[1] = 127;
+    for (int i = 0; i < 8; ++i)
+    {
+        p[2 + i] = static_cast<unsigned char>(static_cast<uint64_t>(payloadLen) >> (56 - 8 * i));
+    }
+    return 10;
+}
+
+SharedMessage WebSocket::makeFrame(Opcode opcode, std::string_view payload)
+{
+    char head[10];
+    size_t headLen = encodeHeader(head, opcode, true, payload.size());
+    std::string frame;
+    frame.reserve(headLen + payload.size());
+    frame.append(head, headLen);
+    frame.append(payload);
+    return std::make_shared<const std::string>(std::move(frame));
+}
+
+void WebSocket::sendRaw(Opcode opcode, const char *payload, size_t len)
+{
+    char head[10];
+    size_t headLen = encodeHeader(head, opcode, true, len);
+    output_.append(head, headLen);
+    output_.append(payload, len);
+    conn_->send(&output_);
+}
+
+void WebSocket::send(Opcode opcode, std::string_view payload)
+{
+    if (closeSent_)
+    {
+        return;
+    }
+    sendRaw(opcode, payload.data(), payload.size());
+}
+
+void WebSocket::sendFrame(const SharedMessage &frame)
+{
+    if (!closeSent_)
+    {
+        conn_->sendShared(frame);
+    }
+}
+
+void WebSocket::ping(std::string_view payload)
+{
+    if (!closeSent_)
+    {
+        sendRaw(kPing, payload.data(), std::min(payload.size(), kMaxControlPayload));
+    }
+}
+
+void WebSocket::close(uint16_t code, std::string_view reason)
+{
+    if (!closeSent_)
+    {
+        closeSent_ = true;
+        char payload[kMaxControlPayload];
+        payload[0] = static_cast<char>(code >> 8);
+        payload[1] = static_cast<char>(code);
+        size_t reasonLen = std::min(reason.size(), kMaxControlPayload - 2);
+        memcpy(payload + 2, reason.data(), reasonLen);
+        sendRaw(kClose, payload, 2 + reasonLen);
+        conn_->shutdown();
+    }
+    finishClose(code, reason.data(), reason.size());
+}
+
+// ================= UTF-8 跨分片校验 =================
+
+bool WebSocket::Utf8Stream::feed(const char *data, size_t len, bool last)
+{
+    if (pendingLen > 0)
+    {
+        // 先用这一片开头的续字节把上一片留下的字符补完
+        size_t need = utf8SequenceLength(static_cast<unsigned char>(pending[0])) - pendingLen;
+        size_t take = std::min(need, len);
+        for (size_t i = 0; i < take; ++i)
+        {
+            if ((static_cast<unsigned char>(data[i]) & 0xC0) != 0x80)
+            {
+                return false;
+            }
+            pending[pendingLen++] = data[i];
+        }
+        data += take;
+        len -= take;
+        if (take < need)
+        {
+            return !last;
+        }
+        if (!validUtf8(pending, pendingLen))
+        {
+            return false;
+        }
+        pendingLen = 0;
+    }
+    size_t tail = last ? 0 : utf8IncompleteTail(data, len);
+    if (!validUtf8(data, len - tail))
+    {
+        return false;
+    }
+    memcpy(pending, data + len - tail, tail);
+    pendingLen = tail;
+    return true;
+}
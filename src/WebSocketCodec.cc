@@ -0,0 +1,365 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include <WebSocket.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define KAMA_CODEC_X86 1
+#endif
+
+/**
+ * WebSocket 的负载内核: 去掩码 和 UTF-8 校验
+ *
+ * 去掩码: 4字节掩码循环异或 从帧负载的第0个字节开始对齐
+ *   把掩码广播成8/16/32字节的块 每次异或一整块; 块长是4的倍数 所以掩码相位在块之间不变 尾部逐字节
+ *
+ * UTF-8校验:
+ *   scalar  逐字符检查 每次先按8字节判断是不是全ASCII 是就整块跳过
+ *   sse2    SSE2没有按字节查表(pshufb) 只把全ASCII的判断扩到16字节 遇到非ASCII块交给scalar
+ *   avx2    查表法(Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte"):
+ *           每个字节和它前面的字节组成一对 用(前一字节高4位, 前一字节低4位, 当前字节高4位)查三张表
+ *           三个结果按位与 非零就是非法组合(过短/过长/超长编码/代理区/超出U+10FFFF);
+ *           3、4字节字符的第3、4个字节是否是续字节 用前2、3个字节是否是3、4字节首字节来核对
+ *           整块是ASCII时只检查上一块是否以不完整的字符结尾
+ *
+ * 分派方式和 BufferScan.cc 相同 KAMA_SCAN_ISA=scalar|sse2 同样生效
+ */
+
+namespace
+{
+
+// ================= scalar =================
+
+void unmaskScalar(char *data, size_t len, uint32_t key)
+{
+    uint64_t key64 = (static_cast<uint64_t>(key) << 32) | key;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        word ^= key64;
+        memcpy(data + i, &word, 8);
+    }
+    const char *mask = reinterpret_cast<const char *>(&key);
+    for (; i < len; ++i)
+    {
+        data[i] ^= mask[i & 3];
+    }
+}
+
+// 校验p处的一个字符 返回下一个字符的位置 非法时返回nullptr
+inline const unsigned char *utf8Char(const unsigned char *p, const unsigned char *end)
+{
+    unsigned char c = *p;
+    if (c < 0x80)
+    {
+        return p + 1;
+    }
+    if (c < 0xC2)
+    {
+        return nullptr; // 续字节打头 或者 C0/C1 两字节超长编码
+    }
+    if (c < 0xE0)
+    {
+        return end - p >= 2 && (p[1] & 0xC0) == 0x80 ? p + 2 : nullptr;
+    }
+    if (c < 0xF0)
+    {
+        if (end - p < 3 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80)
+        {
+            return nullptr;
+        }
+        // E0 A0..BF: 排除超长编码; ED 80..9F: 排除代理区 D800~DFFF
+        if ((c == 0xE0 && p[1] < 0xA0) || (c == 0xED && p[1] > 0x9F))
+        {
+            return nullptr;
+        }
+        return p + 3;
+    }
+    if (c < 0xF5)
+    {
+        if (end - p < 4 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80 || (p[3] & 0xC0) != 0x80)
+        {
+            return nullptr;
+        }
+        // F0 90..BF: 排除超长编码; F4 80..8F: 不超过 U+10FFFF
+        if ((c == 0xF0 && p[1] < 0x90) || (c == 0xF4 && p[1] > 0x8F))
+        {
+            return nullptr;
+        }
+        return p + 4;
+    }
+    return nullptr;
+}
+
+bool utf8Scalar(const unsigned char *p, const unsigned char *end)
+{
+    while (p < end)
+    {
+        if (end - p >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            if ((word & 0x8080808080808080ULL) == 0)
+            {
+                p += 8;
+                continue;
+            }
+        }
+        p = utf8Char(p, end);
+        if (p == nullptr)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool validScalar(const char *data, size_t len)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    return utf8Scalar(p, p + len);
+}
+
+#ifdef KAMA_CODEC_X86
+
+// ================= SSE2 =================
+
+void unmaskSse2(char *data, size_t len, uint32_t key)
+{
+    const __m128i k = _mm_set1_epi32(static_cast<int>(key));
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), k));
+    }
+    unmaskScalar(data + i, len - i, key);
+}
+
+bool validSse2(const char *data, size_t len)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    const unsigned char *end = p + len;
+    while (end - p >= 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        if (mask == 0)
+        {
+            p += 16;
+            continue;
+        }
+        // 从第一个非ASCII字节开始逐字符校验 越过这一块之后回到按块跳过ASCII
+        p += __builtin_ctz(mask);
+        const unsigned char *stop = std::min(p + 16, end);
+        while (p < stop)
+        {
+            p = utf8Char(p, end);
+            if (p == nullptr)
+            {
+                return false;
+            }
+        }
+    }
+    return utf8Scalar(p, end);
+}
+
+// ================= AVX2 =================
+
+#define KAMA_AVX2 __attribute__((target("avx2")))
+
+// 查表法的错误位 一个字节对同时命中三张表的同一位才算错误
+const uint8_t kTooShort = 1 << 0;   // 11______ 0_______ / 11______ 11______  首字节后面缺续字节
+const uint8_t kTooLong = 1 << 1;    // 0_______ 10______                       多出来的续字节
+const uint8_t kOverlong3 = 1 << 2;  // 11100000 100_____
+const uint8_t kTooLarge = 1 << 3;   // 11110100 1001____ / 11110100 101_____ / 11110101+
+const uint8_t kSurrogate = 1 << 4;  // 11101101 101_____
+const uint8_t kOverlong2 = 1 << 5;  // 1100000_ 10______
+const uint8_t kTooLarge1000 = 1 << 6; // 11110101+ 1000____
+const uint8_t kOverlong4 = 1 << 6;  // 11110000 1000____
+const uint8_t kTwoConts = 1 << 7;   // 10______ 10______  合法性由3、4字节字符的位置核对
+const uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+KAMA_AVX2 inline __m256i table(uint8_t v0, uint8_t v1, uint8_t v2, uint8_t v3, uint8_t v4, uint8_t v5, uint8_t v6,
+                               uint8_t v7, uint8_t v8, uint8_t v9, uint8_t v10, uint8_t v11, uint8_t v12, uint8_t v13,
+                               uint8_t v14, uint8_t v15)
+{
+    // pshufb 在每个128位通道内独立查表 两个通道放同一张表
+    return _mm256_setr_epi8(v0, v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15, v0, v1, v2, v3, v4,
+                            v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15);
+}
+
+// input在前一块prev之后 取每个字节前面第N个字节(跨通道、跨块)
+template <int N>
+KAMA_AVX2 inline __m256i previous(__m256i input, __m256i prev)
+{
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+KAMA_AVX2 inline __m256i highNibble(__m256i v)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+struct Utf8CheckerAvx2
+{
+    __m256i error;
+    __m256i prev; // 上一块 第一块之前当作全0(ASCII)
+    __m256i prevIncomplete;
+
+    KAMA_AVX2 Utf8CheckerAvx2()
+        : error(_mm256_setzero_si256()), prev(_mm256_setzero_si256()), prevIncomplete(_mm256_setzero_si256())
+    {
+    }
+
+    KAMA_AVX2 void check(__m256i input)
+    {
+        if (_mm256_movemask_epi8(input) == 0)
+        {
+            // 全ASCII 只要上一块不是以不完整的字符结尾就合法
+            error = _mm256_or_si256(error, prevIncomplete);
+            prev = input;
+            return;
+        }
+
+        const __m256i byte1HighTable =
+            table(kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTwoConts, kTwoConts,
+                  kTwoConts, kTwoConts, kTooShort | kOverlong2, kTooShort, kTooShort | kOverlong3 | kSurrogate,
+                  kTooShort | kTooLarge | kTooLarge1000 | kOverlong4);
+        const __m256i byte1LowTable =
+            table(kCarry | kOverlong3 | kOverlong2 | kOverlong4, kCarry | kOverlong2, kCarry, kCarry, kCarry | kTooLarge,
+                  kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+                  kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+                  kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+                  kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+                  kCarry | kTooLarge | kTooLarge1000 | kSurrogate, kCarry | kTooLarge | kTooLarge1000,
+                  kCarry | kTooLarge | kTooLarge1000);
+        const __m256i byte2HighTable =
+            table(kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+                  kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge1000 | kOverlong4,
+                  kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,
+                  kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+                  kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge, kTooShort, kTooShort, kTooShort, kTooShort);
+
+        __m256i prev1 = previous<1>(input, prev);
+        __m256i special = _mm256_and_si256(
+            _mm256_and_si256(_mm256_shuffle_epi8(byte1HighTable, highNibble(prev1)),
+                             _mm256_shuffle_epi8(byte1LowTable, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+            _mm256_shuffle_epi8(byte2HighTable, highNibble(input)));
+
+        // 前2个字节是3/4字节首字节(>=E0) 或者前3个字节是4字节首字节(>=F0)时 当前字节必须是"第二个连续续字节"
+        __m256i third = _mm256_subs_epu8(previous<2>(input, prev), _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+        __m256i fourth = _mm256_subs_epu8(previous<3>(input, prev), _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+        __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+        error = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+
+        // 块尾的最后3个字节里有还没结束的多字节字符
+        const __m256i maxValue = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+        prevIncomplete = _mm256_subs_epu8(input, maxValue);
+        prev = input;
+    }
+};
+
+KAMA_AVX2 void unmaskAvx2(char *data, size_t len, uint32_t key)
+{
+    const __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        __m256i *p = reinterpret_cast<__m256i *>(data + i);
+        __m256i a = _mm256_xor_si256(_mm256_loadu_si256(p), k);
+        __m256i b = _mm256_xor_si256(_mm256_loadu_si256(p + 1), k);
+        _mm256_storeu_si256(p, a);
+        _mm256_storeu_si256(p + 1, b);
+    }
+    unmaskSse2(data + i, len - i, key);
+}
+
+KAMA_AVX2 bool validAvx2(const char *data, size_t len)
+{
+    Utf8CheckerAvx2 checker;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        checker.check(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)));
+    }
+    if (i < len)
+    {
+        // 尾部补0(ASCII)凑成一整块 不完整的字符会在补的0上报错
+        char tail[32] = {0};
+        memcpy(tail, data + i, len - i);
+        checker.check(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(tail)));
+    }
+    __m256i error = _mm256_or_si256(checker.error, checker.prevIncomplete);
+    return _mm256_testz_si256(error, error);
+}
+
+#undef KAMA_AVX2
+
+#endif // KAMA_CODEC_X86
+
+// ================= 运行时分派 =================
+
+struct CodecKernels
+{
+    const char *name;
+    void (*unmask)(char *, size_t, uint32_t);
+    bool (*validUtf8)(const char *, size_t);
+};
+
+const CodecKernels kScalarKernels = {"scalar", unmaskScalar, validScalar};
+#ifdef KAMA_CODEC_X86
+const CodecKernels kSse2Kernels = {"sse2", unmaskSse2, validSse2};
+const CodecKernels kAvx2Kernels = {"avx2", unmaskAvx2, validAvx2};
+#endif
+
+const CodecKernels &selectKernels()
+{
+    const char *forced = ::getenv("KAMA_SCAN_ISA");
+    if (forced != nullptr && ::strcmp(forced, "scalar") == 0)
+    {
+        return kScalarKernels;
+    }
+#ifdef KAMA_CODEC_X86
+    __builtin_cpu_init();
+    bool wantAvx2 = forced == nullptr || ::strcmp(forced, "sse2") != 0;
+    if (wantAvx2 && __builtin_cpu_supports("avx2"))
+    {
+        return kAvx2Kernels;
+    }
+    return kSse2Kernels;
+#else
+    return kScalarKernels;
+#endif
+}
+
+inline const CodecKernels &kernels()
+{
+    static const CodecKernels &k = selectKernels();
+    return k;
+}
+
+} // namespace
+
+void WebSocket::unmask(char *data, size_t len, const char mask[4])
+{
+    uint32_t key;
+    memcpy(&key, mask, 4);
+    kernels().unmask(data, len, key);
+}
+
+bool WebSocket::validUtf8(const char *data, size_t len)
+{
+    return kernels().validUtf8(data, len);
+}
+
+const char *WebSocket::codecIsa()
+{
+    return kernels().name;
+}
@@ -0,0 +1,149 @@
+#include <WorkerPool.h>
+#include <Logger.h>
+
+namespace
+{
+// 当前线程所属的WorkerPool和worker编号 用于判断submit是否来自worker自身
+thread_local WorkerPool *t_pool = nullptr;
+thread_local int t_workerIndex = -1;
+}
+
+WorkerPool::WorkerPool(int numThreads, const std::string &name)
+    : name_(name)
+    , numThreads_(numThreads > 0 ? numThreads : 1)
+    , running_(false)
+    , pending_(0)
+    , nextWorker_(0)
+    , stolen_(0)
+{
+    for (int i = 0; i < numThreads_; ++i)
+    {
+        workers_.emplace_back(new Worker);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::start()
+{
+    if (running_.exchange(true))
+    {
+        return;
+    }
+    for (int i = 0; i < numThreads_; ++i)
+    {
+        workers_[i]->thread.reset(new Thread(std::bind(&WorkerPool::workerFunc, this, i), name_ + std::to_string(i)));
+        workers_[i]->thread->start();
+    }
+    LOG_INFO << "WorkerPool [" << name_ << "] started with " << numThreads_ << " threads";
+}
+
+void WorkerPool::stop()
+{
+    if (!running_.exchange(false))
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    cond_.notify_all();
+    for (auto &worker : workers_)
+    {
+        worker->thread->join();
+    }
+}
+
+void WorkerPool::submit(Job job)
+{
+    if (!running_)
+    {
+        job();
+        return;
+    }
+
+    int index;
+    if (t_pool == this)
+    {
+        index = t_workerIndex; // worker派生的子任务留在本地队列
+    }
+    else
+    {
+        index = static_cast<int>(nextWorker_.fetch_add(1, std::memory_order_relaxed) % numThreads_);
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->jobs.push_back(std::move(job));
+    }
+    pending_.fetch_add(1);
+    {
+        // 与worker检查pending_和进入睡眠之间互斥 避免丢失唤醒
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    cond_.notify_one();
+}
+
+bool WorkerPool::popLocal(int index, Job *job)
+{
+    Worker &worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.jobs.empty())
+    {
+        return false;
+    }
+    *job = std::move(worker.jobs.back());
+    worker.jobs.pop_back();
+    return true;
+}
+
+bool WorkerPool::steal(int thief, Job *job)
+{
+    for (int i = 1; i < numThreads_; ++i)
+    {
+        Worker &victim = *workers_[(thief + i) % numThreads_];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.jobs.empty())
+        {
+            continue;
+        }
+        *job = std::move(victim.jobs.front());
+        victim.jobs.pop_front();
+        stolen_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void WorkerPool::workerFunc(int index)
+{
+    t_pool = this;
+    t_workerIndex = index;
+
+    while (true)
+    {
+        Job job;
+        if (popLocal(index, &job) || steal(index, &job))
+        {
+            pending_.fetch_sub(1);
+            job();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        if (pending_.load() > 0)
+        {
+            continue; // 任务在别人的队列里 但刚才try_lock没抢到 重新扫一遍
+        }
+        if (!running_)
+        {
+            break;
+        }
+        cond_.wait(lock, [this]() { return pending_.load() > 0 || !running_; });
+    }
+
+    t_pool = nullptr;
+    t_workerIndex = -1;
+}
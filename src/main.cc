@@ -1,4 +1,5 @@
 #include <string>
+#include <string_view>
 #include <coroutine>
 #include <fcntl.h>
 #include <unistd.h>
@@ -10,6 +11,44 @@
 #include "LFU.h"
 #include "memoryPool.h"
 #include "CoroutineSupport.h"
+#include "WorkerPool.h"
+#include "FileCache.h"
+
+// 计算线程池 耗CPU的请求交给它 不占用IO loop
+static WorkerPool *g_workerPool = nullptr;
+// file命令用的打开文件缓存
+static FileCache *g_fileCache = nullptr;
+
+// 统计[2, n]内的素数个数 用来模拟一段耗CPU的业务逻辑
+static size_t countPrimes(size_t n)
+{
+    size_t count = 0;
+    for (size_t i = 2; i <= n; ++i)
+    {
+        bool prime = true;
+        for (size_t j = 2; j * j <= i; ++j)
+        {
+            if (i % j == 0)
+            {
+                prime = false;
+                break;
+            }
+        }
+        count += prime;
+    }
+    return count;
+}
+
+// 去掉首尾空格
+static std::string_view trimSpaces(std::string_view s)
+{
+    size_t first = s.find_first_not_of(' ');
+    if (first == std::string_view::npos)
+    {
+        return std::string_view();
+    }
+    return s.substr(first, s.find_last_not_of(' ') - first + 1);
+}
 
 /**
  * [新增] 协程业务处理函数
@@ -37,16 +76,16 @@ Task sessionHandler(std::shared_ptr<TcpConnection> conn)
                 continue;
             }
 
-            std::string msg = buf->retrieveAllAsString();
-            LOG_INFO << "Received: " << msg; // [2] 唤醒后
-            
-            if (msg.empty())
-                continue;
+            // 命令只看第一行: 直接在输入缓冲区上找行尾 不拷贝 行尾的\r\n不算参数
+            const char *eol = buf->findAnyOf("\r\n");
+            std::string_view line(buf->peek(), (eol ? eol : buf->beginWrite()) - buf->peek());
+            LOG_INFO << "Received: " << GeneralTemplate(line.data(), static_cast<int>(line.size())); // [2] 唤醒后
 
             // 2. [业务逻辑] 判断是否请求大数据测试
             // 如果收到 "load"，则发送 100MB 数据进行压力测试
-            if (msg.size() >= 4 && msg.substr(0, 4) == "load")
+            if (line.starts_with("load"))
             {
+                buf->retrieveAll();
                 LOG_INFO << "Start sending 100MB big data...";
 
                 std::string chunk(1024 * 1024, 'X');
@@ -66,62 +105,47 @@ Task sessionHandler(std::shared_ptr<TcpConnection> conn)
                 }
                 LOG_INFO << "Finished sending big data.";
             }
-            else if (msg.size() >= 4 && msg.substr(0, 4) == "file")
+            else if (line.starts_with("file"))
             {
                 std::string filename = "testfile.bin";
-                if (msg.size() > 5)
+                std::string_view arg = trimSpaces(line.substr(4));
+                if (!arg.empty())
                 {
-                    filename = msg.substr(5);
-                    auto pos = filename.find_first_not_of(' ');
-                    if (pos != std::string::npos)
-                        filename = filename.substr(pos);
-                    auto endpos = filename.find_last_not_of(" \r\n");
-                    if (endpos != std::string::npos)
-                        filename = filename.substr(0, endpos + 1);
+                    filename.assign(arg);
                 }
+                buf->retrieveAll();
 
-                int fd = ::open(filename.c_str(), O_RDONLY);
-                if (fd < 0)
+                // 打开文件缓存: 命中时没有open/fstat/close 发送期间file持有fd
+                FileCache::FilePtr file = g_fileCache->open(filename);
+                if (!file)
                 {
                     LOG_ERROR << "Failed to open file: " << filename;
                     conn->send("Error: file not found\n");
                     continue;
                 }
 
-                struct stat st;
-                if (::fstat(fd, &st) < 0)
-                {
-                    LOG_ERROR << "Failed to stat file: " << filename;
-                    ::close(fd);
-                    conn->send("Error: cannot stat file\n");
-                    continue;
-                }
-
-                LOG_INFO << "Sending file: " << filename << " size: " << st.st_size;
-                ssize_t bytesSent = co_await conn->sendFile(fd, 0, st.st_size);
-                ::close(fd);
+                LOG_INFO << "Sending file: " << filename << " size: " << file->size();
+                ssize_t bytesSent = co_await conn->sendFile(file->fd, 0, file->size());
                 LOG_INFO << "File sent, bytes: " << bytesSent;
             }
             // 如果收到 "sleep X"，则在协程中基于定时器挂起 X 秒，再回一条消息
-            else if (msg.size() >= 6 && msg.substr(0, 5) == "sleep")
+            else if (line.size() >= 6 && line.starts_with("sleep"))
             {
                 double seconds = 0.0;
                 try
                 {
                     // 允许格式："sleep 1" / "sleep 1.5" 等
-                    std::string arg = msg.substr(5);
-                    // 去掉前导空格
-                    auto firstNotSpace = arg.find_first_not_of(' ');
-                    if (firstNotSpace != std::string::npos)
+                    std::string_view arg = trimSpaces(line.substr(5));
+                    if (!arg.empty())
                     {
-                        arg = arg.substr(firstNotSpace);
-                        seconds = std::stod(arg);
+                        seconds = std::stod(std::string(arg));
                     }
                 }
                 catch (...)
                 {
                     seconds = 0.0;
                 }
+                buf->retrieveAll();
 
                 if (seconds < 0.0)
                 {
@@ -132,8 +156,28 @@ Task sessionHandler(std::shared_ptr<TcpConnection> conn)
                 co_await asyncSleep(conn, seconds);
                 conn->send("wake up after sleep\n");
             }
-            else if (msg.size() >= 7 && msg.substr(0, 7) == "timeout")
+            // 如果收到 "primes N"，在计算线程池中统计N以内的素数 协程在worker执行期间挂起 loop继续服务其他连接
+            else if (line.size() >= 7 && line.starts_with("primes"))
+            {
+                size_t n = 0;
+                try
+                {
+                    n = std::stoul(std::string(line.substr(6)));
+                    buf->retrieveAll();
+                }
+                catch (...)
+                {
+                    buf->retrieveAll();
+                    conn->send("Usage: primes N\n");
+                    continue;
+                }
+
+                size_t count = co_await g_workerPool->run(conn, [n]() { return countPrimes(n); });
+                conn->send("primes below " + std::to_string(n) + ": " + std::to_string(count) + "\n");
+            }
+            else if (line.starts_with("timeout"))
             {
+                buf->retrieveAll();
                 conn->send("Waiting for your input (5 second timeout)...\n");
                 
                 auto [buf, timedOut] = co_await conn->readWithTimeout(5.0);
@@ -148,8 +192,9 @@ Task sessionHandler(std::shared_ptr<TcpConnection> conn)
                     conn->send("Received within timeout: " + data);
                 }
             }
-            else if (msg.size() >= 8 && msg.substr(0, 8) == "bigwrite")
+            else if (line.starts_with("bigwrite"))
             {
+                buf->retrieveAll();
                 LOG_INFO << "Testing WriteAwaiter with backpressure control...";
                 conn->send("Starting bigwrite test (10 chunks of 1MB with 2MB high water mark)...\n");
 
@@ -168,7 +213,7 @@ Task sessionHandler(std::shared_ptr<TcpConnection> conn)
             else
             {
                 // 3. [普通逻辑] 简单的 Echo 回显
-                conn->send(msg);
+                conn->send(buf);
             }
         }
     }
@@ -260,8 +305,14 @@ int main(int argc, char *argv[])
     // 初始化缓存
     const int CAPACITY = 5;
     KamaCache::KLfuCache<int, std::string> lfu(CAPACITY);
-    // 第三步启动底层网络模块
+    // 第三步启动底层网络模块和计算线程池
     EventLoop loop;
+    // 在loop之后构造 先于loop析构 worker里尚未完成的任务不会再投递到已经析构的loop
+    WorkerPool workerPool(4, "Worker");
+    workerPool.start();
+    g_workerPool = &workerPool;
+    FileCache fileCache(&loop);
+    g_fileCache = &fileCache;
     InetAddress addr(8080);
     EchoServer server(&loop, addr, "EchoServer");
     server.start();
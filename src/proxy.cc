@@ -0,0 +1,82 @@
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+#include <ProxyServer.h>
+#include <Logger.h>
+
+/**
+ * 四层反向代理
+ * 用法: ./proxy <listenPort> <rr|leastconn|hash> <ip:port> [ip:port ...] [-t threads]
+ * 例如: ./proxy 9000 leastconn 127.0.0.1:8080 127.0.0.1:8081 -t 4
+ */
+static bool parseIpPort(const std::string &s, InetAddress *addr)
+{
+    auto pos = s.rfind(':');
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    int port = atoi(s.c_str() + pos + 1);
+    if (port <= 0 || port > 65535)
+    {
+        return false;
+    }
+    *addr = InetAddress(static_cast<uint16_t>(port), s.substr(0, pos));
+    return true;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s <listenPort> <rr|leastconn|hash> <ip:port> [ip:port ...] [-t threads]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint16_t port = static_cast<uint16_t>(atoi(argv[1]));
+    LoadBalancer::Policy policy;
+    if (!LoadBalancer::parsePolicy(argv[2], &policy))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int numThreads = 4;
+    std::vector<InetAddress> backends;
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc)
+        {
+            numThreads = atoi(argv[++i]);
+            continue;
+        }
+        InetAddress addr;
+        if (!parseIpPort(arg, &addr))
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        backends.push_back(addr);
+    }
+    if (backends.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // 转发路径上每个事件都会打日志 代理只保留告警以上的日志
+    Logger::setLogLevel(Logger::WARN);
+
+    EventLoop loop;
+    ProxyServer proxy(&loop, InetAddress(port, "0.0.0.0"), "Proxy", policy, backends);
+    proxy.setThreadNum(numThreads);
+    proxy.start();
+    loop.loop();
+}